@@ -3,125 +3,561 @@
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace llvm;
 
+// Pick the one-shot block coverage probes instead of the branch counters
+// when the plugin is inserted automatically at pipeline start.
+static cl::opt<bool> CoverageMode(
+    "bc-coverage", cl::init(false),
+    cl::desc("Instrument basic blocks with one-shot coverage flags instead "
+             "of branch counters"));
+
+// Load/store access profiling, added on top of the counters or coverage
+static cl::opt<bool> MemProfMode(
+    "bc-memprof", cl::init(false),
+    cl::desc("Also instrument loads and stores with per-site access counts "
+             "and a sampled address trace"));
+
+static cl::list<std::string> MemProfFunctions(
+    "bc-memprof-func", cl::CommaSeparated,
+    cl::desc("Functions (glob patterns) whose loads and stores are profiled; "
+             "all functions when empty"));
+
+static cl::opt<bool> MemProfStack(
+    "bc-memprof-stack", cl::init(false),
+    cl::desc("Also profile accesses to the function's own stack slots"));
+
 namespace {
 
+// Site kinds, must match enum bc_site_kind in branch_runtime.h
+enum SiteKind : uint8_t {
+    SK_CondBranch = 0,
+    SK_UncondBranch,
+    SK_LoopHeader,
+    SK_DirectCall,
+    SK_Return,
+    SK_Block,
+    SK_Load,
+    SK_Store,
+};
+
+// Output sections. The linker concatenates the per-module tables and the
+// runtime walks them through the __start_/__stop_ symbols, so names must
+// stay valid C identifiers.
+constexpr const char *SitesSection = "__bc_sites";
+constexpr const char *CountersSection = "__bc_cnts";
+constexpr const char *CoverageSection = "__bc_cov";
+
+// Named metadata marking an already instrumented module. Keeps LTO link
+// steps that run the plugin again from instrumenting twice.
+constexpr const char *InstrumentedMD = "bc.instrumented";
+
+// Address trace hook of the memory profiling mode
+constexpr const char *MemAccessHook = "__bc_mem_access";
+
+// Runtime entry points and compiler intrinsics must never be instrumented.
+static bool isRuntimeFunction(StringRef Name) {
+    return Name.starts_with("increment_") ||
+           Name.starts_with("print_") ||
+           Name.starts_with("reset_") ||
+           Name.starts_with("init_") ||
+           Name.starts_with("get_") ||
+           Name.starts_with("__bc_") ||
+           Name.starts_with("llvm.");
+}
+
+// Each mode marks the module separately, so the memory profile can be
+// combined with the counters or the coverage probes
+static bool isInstrumented(Module &M, StringRef Mode) {
+    NamedMDNode *MD = M.getNamedMetadata(InstrumentedMD);
+    if (!MD)
+        return false;
+    for (MDNode *Op : MD->operands()) {
+        auto *Name = dyn_cast<MDString>(Op->getOperand(0));
+        if (Name && Name->getString() == Mode)
+            return true;
+    }
+    return false;
+}
+
+static void markInstrumented(Module &M, StringRef Mode) {
+    LLVMContext &Ctx = M.getContext();
+    M.getOrInsertNamedMetadata(InstrumentedMD)
+        ->addOperand(MDNode::get(Ctx, MDString::get(Ctx, Mode)));
+}
+
+// Collects the sites of one module and emits its site table. Site IDs are
+// the upper half of a hash of the module identity combined with a local
+// index, so separately instrumented modules never need to coordinate.
+// Modes that add a second table to a module pass a salt to keep their IDs
+// apart.
+class SiteTable {
+public:
+    explicit SiteTable(Module &M, StringRef Salt = "");
+
+    // Returns the index of the site's first counter
+    uint32_t addSite(Function &F, Instruction *At, SiteKind Kind,
+                     uint8_t NumCounters);
+    uint32_t numCounters() const { return CounterCount; }
+    uint64_t lastSiteId() const { return ModuleHash | (Sites.size() - 1); }
+    bool empty() const { return Sites.empty(); }
+
+    // Emits the site table, pointing each site at its slot in Counters
+    void emit(GlobalVariable *Counters);
+
+    // Module-unique name for a per-module global
+    std::string globalName(StringRef Base) const;
+
+private:
+    struct Site {
+        SiteKind Kind;
+        uint8_t NumCounters;
+        uint32_t FirstCounter;
+        Constant *FuncName;
+        Constant *FileName;
+        uint32_t Line;
+        uint16_t Column;
+    };
+
+    Constant *getString(StringRef Str);
+
+    Module &M;
+    uint64_t ModuleHash;
+    uint32_t CounterCount = 0;
+    std::vector<Site> Sites;
+    StringMap<Constant *> Strings;
+};
+
+SiteTable::SiteTable(Module &M, StringRef Salt) : M(M) {
+    std::string Identity = M.getModuleIdentifier();
+    Identity += '\0';
+    Identity += M.getSourceFileName();
+    if (!Salt.empty()) {
+        Identity += '\0';
+        Identity += Salt;
+    }
+    ModuleHash = MD5Hash(Identity) & ~0xffffffffULL;
+}
+
+std::string SiteTable::globalName(StringRef Base) const {
+    return (Base + "." + Twine::utohexstr(ModuleHash >> 32)).str();
+}
+
+Constant *SiteTable::getString(StringRef Str) {
+    Constant *&Cached = Strings[Str];
+    if (!Cached)
+        Cached = ConstantExpr::getPointerCast(
+            createPrivateGlobalForString(M, Str, true),
+            PointerType::getUnqual(M.getContext()));
+    return Cached;
+}
+
+uint32_t SiteTable::addSite(Function &F, Instruction *At, SiteKind Kind,
+                            uint8_t NumCounters) {
+    StringRef File = M.getSourceFileName();
+    if (DISubprogram *SP = F.getSubprogram())
+        File = SP->getFilename();
+
+    // Block sites may start with instructions without a location
+    uint32_t Line = 0;
+    uint16_t Column = 0;
+    for (Instruction *I = At; I; I = I->getNextNode()) {
+        if (const DebugLoc &DL = I->getDebugLoc()) {
+            Line = DL.getLine();
+            Column = DL.getCol();
+            break;
+        }
+        if (Kind != SK_Block && Kind != SK_LoopHeader)
+            break;
+    }
+
+    uint32_t First = CounterCount;
+    Sites.push_back({Kind, NumCounters, First, getString(F.getName()),
+                     getString(File), Line, Column});
+    CounterCount += NumCounters;
+    return First;
+}
+
+void SiteTable::emit(GlobalVariable *Counters) {
+    LLVMContext &Ctx = M.getContext();
+    Type *Int8Ty = Type::getInt8Ty(Ctx);
+    Type *Int16Ty = Type::getInt16Ty(Ctx);
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+
+    // Layout must match struct bc_site in branch_runtime.h
+    StructType *SiteTy = StructType::get(
+        Ctx, {Int64Ty, PtrTy, PtrTy, Int32Ty, Int16Ty, Int8Ty, Int8Ty, PtrTy});
+
+    std::vector<Constant *> Entries;
+    for (uint32_t I = 0; I < Sites.size(); ++I) {
+        const Site &S = Sites[I];
+        Constant *Slot = ConstantExpr::getInBoundsGetElementPtr(
+            Counters->getValueType(), Counters,
+            ArrayRef<Constant *>{ConstantInt::get(Int64Ty, 0),
+                                 ConstantInt::get(Int64Ty, S.FirstCounter)});
+        Entries.push_back(ConstantStruct::get(
+            SiteTy, {ConstantInt::get(Int64Ty, ModuleHash | I), S.FuncName,
+                     S.FileName, ConstantInt::get(Int32Ty, S.Line),
+                     ConstantInt::get(Int16Ty, S.Column),
+                     ConstantInt::get(Int8Ty, S.Kind),
+                     ConstantInt::get(Int8Ty, S.NumCounters), Slot}));
+    }
+
+    // Writable: the entries carry pointers that need dynamic relocations
+    ArrayType *TableTy = ArrayType::get(SiteTy, Entries.size());
+    auto *Table = new GlobalVariable(M, TableTy, false,
+                                     GlobalValue::InternalLinkage,
+                                     ConstantArray::get(TableTy, Entries),
+                                     globalName("__bc_sites"));
+    Table->setSection(SitesSection);
+    Table->setAlignment(Align(8));
+
+    // Nothing references the table itself, keep it through optimization
+    // and LTO internalization
+    appendToCompilerUsed(M, {Table, Counters});
+}
+
 class BranchCounterPass : public PassInfoMixin<BranchCounterPass> {
 public:
-    PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
-    
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+
 private:
-    void insertCounterCall(Instruction *InsertBefore, const char *funcName, Module *M);
+    void insertIncrement(Instruction *InsertBefore, GlobalVariable *Counters,
+                         uint32_t Index, Value *Offset = nullptr);
 };
 
-void BranchCounterPass::insertCounterCall(Instruction *InsertBefore, 
-                                          const char *funcName, Module *M) {
-    LLVMContext &Ctx = M->getContext();
+// Inline counter bump: Counters[Index + Offset]++
+void BranchCounterPass::insertIncrement(Instruction *InsertBefore,
+                                        GlobalVariable *Counters,
+                                        uint32_t Index, Value *Offset) {
     IRBuilder<> Builder(InsertBefore);
-    
-    FunctionType *FuncTy = FunctionType::get(Type::getVoidTy(Ctx), false);
-    FunctionCallee CounterFunc = M->getOrInsertFunction(funcName, FuncTy);
-    
-    Builder.CreateCall(CounterFunc);
-}
-
-PreservedAnalyses BranchCounterPass::run(Function &F, FunctionAnalysisManager &FAM) {
-    Module *M = F.getParent();
-    LLVMContext &Ctx = M->getContext();
-    
-    // Skip our instrumentation functions
-    StringRef FuncName = F.getName();
-    if (FuncName.starts_with("increment_") || 
-        FuncName.starts_with("print_") ||
-        FuncName.starts_with("reset_") ||
-        FuncName.starts_with("init_") ||
-        FuncName.starts_with("get_")) {
+    Value *Slot = Builder.getInt64(Index);
+    if (Offset)
+        Slot = Builder.CreateAdd(Slot, Builder.CreateZExt(Offset,
+                                                          Builder.getInt64Ty()));
+
+    Value *Ptr = Builder.CreateInBoundsGEP(Counters->getValueType(), Counters,
+                                           {Builder.getInt64(0), Slot});
+    Value *Count = Builder.CreateLoad(Builder.getInt64Ty(), Ptr);
+    Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)), Ptr);
+}
+
+PreservedAnalyses BranchCounterPass::run(Module &M, ModuleAnalysisManager &MAM) {
+    LLVMContext &Ctx = M.getContext();
+    FunctionAnalysisManager &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+    if (isInstrumented(M, "counters"))
         return PreservedAnalyses::all();
-    }
-    
-    // Get Loop Information
-    LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
-    
-    // Collect all loop headers
-    SmallPtrSet<BasicBlock*, 32> LoopHeaders;
-    for (Loop *L : LI) {
-        std::function<void(Loop*)> collectHeaders = [&](Loop *LP) {
-            LoopHeaders.insert(LP->getHeader());
-            for (Loop *SubL : LP->getSubLoops()) {
-                collectHeaders(SubL);
-            }
-        };
-        collectHeaders(L);
-    }
-    
-    bool Modified = false;
-    
-    // Iterate through all basic blocks
-    for (BasicBlock &BB : F) {
-        // Instrument loop headers at the beginning of the block
-        if (LoopHeaders.count(&BB)) {
-            Instruction *FirstInst = &BB.front();
-            // Skip PHI nodes
-            while (isa<PHINode>(FirstInst)) {
-                FirstInst = FirstInst->getNextNode();
-                if (!FirstInst) break;
-            }
-            if (FirstInst) {
-                insertCounterCall(FirstInst, "increment_loop_header", M);
-                Modified = true;
-            }
+
+    SiteTable Table(M);
+    struct Probe {
+        Instruction *At;
+        uint32_t Index;
+        Value *Offset;
+    };
+    std::vector<Probe> Probes;
+
+    for (Function &F : M) {
+        // Skip our instrumentation functions
+        if (F.isDeclaration() || isRuntimeFunction(F.getName()))
+            continue;
+
+        // Get Loop Information
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+
+        // Collect all loop headers
+        SmallPtrSet<BasicBlock*, 32> LoopHeaders;
+        for (Loop *L : LI) {
+            std::function<void(Loop*)> collectHeaders = [&](Loop *LP) {
+                LoopHeaders.insert(LP->getHeader());
+                for (Loop *SubL : LP->getSubLoops()) {
+                    collectHeaders(SubL);
+                }
+            };
+            collectHeaders(L);
         }
-        
-        // Iterate through instructions
-        std::vector<std::pair<Instruction*, const char*>> ToInstrument;
-        
-        for (Instruction &Inst : BB) {
-            // Count branches
-            if (BranchInst *BI = dyn_cast<BranchInst>(&Inst)) {
-                if (BI->isConditional()) {
-                    ToInstrument.push_back({BI, "increment_cond_branch"});
-                } else {
-                    ToInstrument.push_back({BI, "increment_uncond_branch"});
+
+        // Iterate through all basic blocks
+        for (BasicBlock &BB : F) {
+            // Instrument loop headers at the beginning of the block
+            if (LoopHeaders.count(&BB)) {
+                BasicBlock::iterator IP = BB.getFirstInsertionPt();
+                if (IP != BB.end()) {
+                    uint32_t Index = Table.addSite(F, &*IP, SK_LoopHeader, 1);
+                    Probes.push_back({&*IP, Index, nullptr});
                 }
             }
-            
-            // Count direct calls
-            else if (CallInst *CI = dyn_cast<CallInst>(&Inst)) {
-                Function *Callee = CI->getCalledFunction();
-                if (Callee && !Callee->isIntrinsic()) {
-                    StringRef CalleeName = Callee->getName();
+
+            // Iterate through instructions
+            for (Instruction &Inst : BB) {
+                // Count branches; conditional ones get a taken and a
+                // not-taken counter so the profile carries branch bias
+                if (BranchInst *BI = dyn_cast<BranchInst>(&Inst)) {
+                    if (BI->isConditional()) {
+                        uint32_t Index = Table.addSite(F, BI, SK_CondBranch, 2);
+                        IRBuilder<> Builder(BI);
+                        Value *NotTaken = Builder.CreateNot(BI->getCondition());
+                        Probes.push_back({BI, Index, NotTaken});
+                    } else {
+                        uint32_t Index = Table.addSite(F, BI, SK_UncondBranch, 1);
+                        Probes.push_back({BI, Index, nullptr});
+                    }
+                }
+
+                // Count direct calls
+                else if (CallInst *CI = dyn_cast<CallInst>(&Inst)) {
+                    Function *Callee = CI->getCalledFunction();
                     // Don't instrument our own functions
-                    if (!CalleeName.starts_with("increment_") &&
-                        !CalleeName.starts_with("print_") &&
-                        !CalleeName.starts_with("reset_") &&
-                        !CalleeName.starts_with("init_") &&
-                        !CalleeName.starts_with("get_") &&
-                        !CalleeName.starts_with("llvm.")) {
-                        ToInstrument.push_back({CI, "increment_direct_call"});
+                    if (Callee && !Callee->isIntrinsic() &&
+                        !isRuntimeFunction(Callee->getName())) {
+                        uint32_t Index = Table.addSite(F, CI, SK_DirectCall, 1);
+                        Probes.push_back({CI, Index, nullptr});
                     }
                 }
-            }
-            
-            // Count returns
-            else if (isa<ReturnInst>(&Inst)) {
-                ToInstrument.push_back({&Inst, "increment_return"});
+
+                // Count returns
+                else if (isa<ReturnInst>(&Inst)) {
+                    uint32_t Index = Table.addSite(F, &Inst, SK_Return, 1);
+                    Probes.push_back({&Inst, Index, nullptr});
+                }
             }
         }
-        
-        // Insert instrumentation calls
-        for (auto &Pair : ToInstrument) {
-            insertCounterCall(Pair.first, Pair.second, M);
-            Modified = true;
+    }
+
+    if (Table.empty())
+        return PreservedAnalyses::all();
+
+    ArrayType *CountersTy = ArrayType::get(Type::getInt64Ty(Ctx),
+                                           Table.numCounters());
+    auto *Counters = new GlobalVariable(M, CountersTy, false,
+                                        GlobalValue::InternalLinkage,
+                                        ConstantAggregateZero::get(CountersTy),
+                                        Table.globalName("__bc_cnts"));
+    Counters->setSection(CountersSection);
+    Counters->setAlignment(Align(8));
+
+    // Insert instrumentation
+    for (const Probe &P : Probes)
+        insertIncrement(P.At, Counters, P.Index, P.Offset);
+
+    Table.emit(Counters);
+    markInstrumented(M, "counters");
+    return PreservedAnalyses::none();
+}
+
+// Block coverage: every basic block gets a one-byte flag in a per-module
+// bitmap. The probe is a load/compare guarding the store, so after the first
+// hit a block pays one predictable, never-taken branch and never dirties the
+// bitmap cache line again. The bitmap and its site table land in their own
+// sections, where the runtime finds them.
+class BlockCoveragePass : public PassInfoMixin<BlockCoveragePass> {
+public:
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+
+private:
+    void insertProbe(BasicBlock *BB, GlobalVariable *Bitmap, uint32_t Index);
+};
+
+void BlockCoveragePass::insertProbe(BasicBlock *BB, GlobalVariable *Bitmap,
+                                    uint32_t Index) {
+    LLVMContext &Ctx = BB->getContext();
+    BasicBlock::iterator IP = BB->getFirstInsertionPt();
+    // Keep static allocas in the entry block
+    if (BB->isEntryBlock()) {
+        while (isa<AllocaInst>(&*IP))
+            ++IP;
+    }
+    Instruction *InsertBefore = &*IP;
+    IRBuilder<> Builder(InsertBefore);
+
+    Value *Flag = Builder.CreateConstInBoundsGEP2_64(
+        Bitmap->getValueType(), Bitmap, 0, Index);
+    Value *Seen = Builder.CreateLoad(Builder.getInt8Ty(), Flag);
+    Value *First = Builder.CreateICmpEQ(Seen, Builder.getInt8(0));
+
+    // The store is taken once per block for the whole run
+    MDNode *Weights = MDBuilder(Ctx).createBranchWeights(1, (1U << 20) - 1);
+    Instruction *Then = SplitBlockAndInsertIfThen(First, InsertBefore, false,
+                                                  Weights);
+    Builder.SetInsertPoint(Then);
+    Builder.CreateStore(Builder.getInt8(1), Flag);
+}
+
+PreservedAnalyses BlockCoveragePass::run(Module &M, ModuleAnalysisManager &MAM) {
+    LLVMContext &Ctx = M.getContext();
+
+    if (isInstrumented(M, "coverage"))
+        return PreservedAnalyses::all();
+
+    SiteTable Table(M);
+    std::vector<BasicBlock *> Blocks;
+
+    // Collect sites first: inserting probes splits blocks
+    for (Function &F : M) {
+        if (F.isDeclaration() || isRuntimeFunction(F.getName()))
+            continue;
+
+        for (BasicBlock &BB : F) {
+            if (BB.getFirstInsertionPt() == BB.end() || BB.isEHPad())
+                continue;
+            Table.addSite(F, &*BB.getFirstInsertionPt(), SK_Block, 1);
+            Blocks.push_back(&BB);
         }
     }
-    
-    return Modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+
+    if (Table.empty())
+        return PreservedAnalyses::all();
+
+    ArrayType *BitmapTy = ArrayType::get(Type::getInt8Ty(Ctx), Blocks.size());
+    auto *Bitmap = new GlobalVariable(M, BitmapTy, false,
+                                      GlobalValue::InternalLinkage,
+                                      ConstantAggregateZero::get(BitmapTy),
+                                      Table.globalName("__bc_cov"));
+    Bitmap->setSection(CoverageSection);
+
+    for (uint32_t I = 0; I < Blocks.size(); ++I)
+        insertProbe(Blocks[I], Bitmap, I);
+
+    Table.emit(Bitmap);
+    markInstrumented(M, "coverage");
+    return PreservedAnalyses::none();
+}
+
+// Memory access profiling: every load and store in the selected functions
+// bumps a per-site access counter and reports its address to the runtime,
+// which keeps a sampled per-thread trace for offline reuse distance and
+// stride analysis (mem_analyze). Accesses to the function's own stack slots
+// are skipped by default; they are plentiful and rarely cache-hostile.
+class MemoryProfilePass : public PassInfoMixin<MemoryProfilePass> {
+public:
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+
+private:
+    bool shouldProfile(const Function &F) const;
+    bool shouldProfile(Value *Ptr) const;
+
+    std::vector<GlobPattern> Filters;
+};
+
+bool MemoryProfilePass::shouldProfile(const Function &F) const {
+    if (Filters.empty())
+        return true;
+    for (const GlobPattern &P : Filters)
+        if (P.match(F.getName()))
+            return true;
+    return false;
+}
+
+bool MemoryProfilePass::shouldProfile(Value *Ptr) const {
+    // The runtime only sees flat addresses
+    if (Ptr->getType()->getPointerAddressSpace() != 0)
+        return false;
+    const Value *Obj = getUnderlyingObject(Ptr);
+    if (auto *GV = dyn_cast<GlobalVariable>(Obj))
+        return !GV->getSection().starts_with("__bc_");
+    if (isa<AllocaInst>(Obj))
+        return MemProfStack;
+    return true;
+}
+
+PreservedAnalyses MemoryProfilePass::run(Module &M, ModuleAnalysisManager &MAM) {
+    LLVMContext &Ctx = M.getContext();
+
+    if (isInstrumented(M, "memprof"))
+        return PreservedAnalyses::all();
+
+    for (const std::string &Pattern : MemProfFunctions) {
+        Expected<GlobPattern> P = GlobPattern::create(Pattern);
+        if (!P) {
+            errs() << "BranchCounter: bad -bc-memprof-func pattern '"
+                   << Pattern << "': " << toString(P.takeError()) << "\n";
+            return PreservedAnalyses::all();
+        }
+        Filters.push_back(std::move(*P));
+    }
+
+    SiteTable Table(M, "memprof");
+    struct Access {
+        Instruction *At;
+        Value *Ptr;
+        uint32_t Index;
+        uint64_t SiteId;
+    };
+    std::vector<Access> Accesses;
+
+    for (Function &F : M) {
+        if (F.isDeclaration() || isRuntimeFunction(F.getName()) ||
+            !shouldProfile(F))
+            continue;
+
+        for (Instruction &I : instructions(F)) {
+            Value *Ptr;
+            SiteKind Kind;
+            if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                Ptr = LI->getPointerOperand();
+                Kind = SK_Load;
+            } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                Ptr = SI->getPointerOperand();
+                Kind = SK_Store;
+            } else {
+                continue;
+            }
+            if (!shouldProfile(Ptr))
+                continue;
+
+            uint32_t Index = Table.addSite(F, &I, Kind, 1);
+            Accesses.push_back({&I, Ptr, Index, Table.lastSiteId()});
+        }
+    }
+
+    if (Table.empty())
+        return PreservedAnalyses::all();
+
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    ArrayType *CountersTy = ArrayType::get(Int64Ty, Table.numCounters());
+    auto *Counters = new GlobalVariable(M, CountersTy, false,
+                                        GlobalValue::InternalLinkage,
+                                        ConstantAggregateZero::get(CountersTy),
+                                        Table.globalName("__bc_mem_cnts"));
+    Counters->setSection(CountersSection);
+    Counters->setAlignment(Align(8));
+
+    FunctionCallee Hook = M.getOrInsertFunction(
+        MemAccessHook, Type::getVoidTy(Ctx), Int64Ty,
+        PointerType::getUnqual(Ctx));
+
+    for (const Access &A : Accesses) {
+        IRBuilder<> Builder(A.At);
+        Value *Slot = Builder.CreateConstInBoundsGEP2_64(
+            CountersTy, Counters, 0, A.Index);
+        Value *Count = Builder.CreateLoad(Int64Ty, Slot);
+        Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)),
+                            Slot);
+        Builder.CreateCall(Hook, {Builder.getInt64(A.SiteId),
+                                  Builder.CreatePointerCast(
+                                      A.Ptr, PointerType::getUnqual(Ctx))});
+    }
+
+    Table.emit(Counters);
+    markInstrumented(M, "memprof");
+    return PreservedAnalyses::none();
 }
 
 } // end anonymous namespace
@@ -132,26 +568,42 @@ llvmGetPassPluginInfo() {
     return {
         .APIVersion = LLVM_PLUGIN_API_VERSION,
         .PluginName = "BranchCounter",
-        .PluginVersion = "v0.1",
+        .PluginVersion = "v0.3",
         .RegisterPassBuilderCallbacks = [](PassBuilder &PB) {
             // Register for optimization pipeline
             PB.registerPipelineParsingCallback(
-                [](StringRef Name, FunctionPassManager &FPM,
+                [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
                     if (Name == "branch-counter") {
-                        FPM.addPass(BranchCounterPass());
+                        MPM.addPass(BranchCounterPass());
+                        return true;
+                    }
+                    if (Name == "block-coverage") {
+                        MPM.addPass(BlockCoveragePass());
+                        return true;
+                    }
+                    if (Name == "memory-profile") {
+                        MPM.addPass(MemoryProfilePass());
                         return true;
                     }
                     return false;
                 });
-            
-            // Also register at pipeline start for automatic instrumentation
+
+            // Also register at pipeline start for automatic instrumentation.
+            // With -flto / -flto=thin this runs in each TU's pre-link
+            // compile; the bc.instrumented marker makes any later run over
+            // the merged module a no-op.
             PB.registerPipelineStartEPCallback(
                 [](ModulePassManager &MPM, OptimizationLevel Level) {
-                    FunctionPassManager FPM;
-                    FPM.addPass(BranchCounterPass());
-                    MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+                    // Before the counters, which add loads and stores of
+                    // their own
+                    if (MemProfMode)
+                        MPM.addPass(MemoryProfilePass());
+                    if (CoverageMode)
+                        MPM.addPass(BlockCoveragePass());
+                    else
+                        MPM.addPass(BranchCounterPass());
                 });
         }
     };
-}
\ No newline at end of file
+}
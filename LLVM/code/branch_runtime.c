@@ -1,15 +1,63 @@
 #include "branch_runtime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
 
-// Global counters
+// Global counters, bumped by the legacy increment_* entry points
 static volatile uint64_t cond_branch_count = 0;
 static volatile uint64_t uncond_branch_count = 0;
 static volatile uint64_t loop_header_count = 0;
 static volatile uint64_t direct_call_count = 0;
 static volatile uint64_t return_count = 0;
 
+// Per-module site tables, counters and coverage bitmaps, concatenated by the
+// linker. Weak so the runtime still links into programs with no instrumented
+// module. The runtime must be linked statically into the executable (or the
+// same DSO) for these to cover the instrumented code.
+extern struct bc_site __start___bc_sites[] __attribute__((weak));
+extern struct bc_site __stop___bc_sites[] __attribute__((weak));
+extern uint64_t __start___bc_cnts[] __attribute__((weak));
+extern uint64_t __stop___bc_cnts[] __attribute__((weak));
+extern uint8_t __start___bc_cov[] __attribute__((weak));
+extern uint8_t __stop___bc_cov[] __attribute__((weak));
+
+static const char *const site_kind_names[] = {
+    [BC_SITE_COND_BRANCH] = "cond",
+    [BC_SITE_UNCOND_BRANCH] = "uncond",
+    [BC_SITE_LOOP_HEADER] = "loop",
+    [BC_SITE_DIRECT_CALL] = "call",
+    [BC_SITE_RETURN] = "ret",
+    [BC_SITE_BLOCK] = "block",
+    [BC_SITE_LOAD] = "load",
+    [BC_SITE_STORE] = "store",
+};
+
+const struct bc_site *get_branch_sites(uint64_t *count) {
+    *count = __start___bc_sites ? __stop___bc_sites - __start___bc_sites : 0;
+    return __start___bc_sites;
+}
+
+// Sum of all counters of the given site kind
+static uint64_t sum_site_counts(enum bc_site_kind kind) {
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t total = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (sites[i].kind != kind)
+            continue;
+        for (unsigned c = 0; c < sites[i].num_counters; c++)
+            total += ((uint64_t *)sites[i].counters)[c];
+    }
+    return total;
+}
+
 // Thread-safe increment (for single-threaded we can keep it simple)
 void increment_cond_branch(void) {
     cond_branch_count++;
@@ -41,6 +89,10 @@ void reset_branch_stats(void) {
     loop_header_count = 0;
     direct_call_count = 0;
     return_count = 0;
+
+    if (__start___bc_cnts)
+        memset(__start___bc_cnts, 0,
+               (char *)__stop___bc_cnts - (char *)__start___bc_cnts);
 }
 
 void print_branch_stats(void) {
@@ -48,32 +100,673 @@ void print_branch_stats(void) {
     printf("================================\n");
     printf("   Branch Statistics Report     \n");
     printf("================================\n");
-    printf("# Conditional Branches:   %llu\n", (unsigned long long)cond_branch_count);
-    printf("# Unconditional Branches: %llu\n", (unsigned long long)uncond_branch_count);
-    printf("# Loop Headers:           %llu\n", (unsigned long long)loop_header_count);
-    printf("# Direct Calls:           %llu\n", (unsigned long long)direct_call_count);
-    printf("# Returns/Exits:          %llu\n", (unsigned long long)return_count);
+    printf("# Conditional Branches:   %llu\n", (unsigned long long)get_cond_branch_count());
+    printf("# Unconditional Branches: %llu\n", (unsigned long long)get_uncond_branch_count());
+    printf("# Loop Headers:           %llu\n", (unsigned long long)get_loop_header_count());
+    printf("# Direct Calls:           %llu\n", (unsigned long long)get_direct_call_count());
+    printf("# Returns/Exits:          %llu\n", (unsigned long long)get_return_count());
     printf("================================\n");
     printf("\n");
     fflush(stdout);
 }
 
+// Counts are passed separately so merged totals can be printed
+static void print_site_line(FILE *out, const struct bc_site *site,
+                            uint64_t count, uint64_t not_taken) {
+    fprintf(out, "%016llx %s %s %s:%u:%u %llu",
+            (unsigned long long)site->id, site_kind_names[site->kind],
+            site->function, site->file, site->line, site->column,
+            (unsigned long long)count);
+    if (site->num_counters > 1)
+        fprintf(out, " %llu", (unsigned long long)not_taken);
+    fputc('\n', out);
+}
+
+// Site counts read back from an existing profile when merging
+struct merged_site {
+    uint64_t id;
+    uint64_t counts[2];
+    const char *line;           // original text, kept if no live site matches
+    int matched;
+};
+
+static int compare_merged_site(const void *a, const void *b) {
+    const struct merged_site *x = a, *y = b;
+
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static struct merged_site *find_merged_site(struct merged_site *merged,
+                                            size_t num_merged, uint64_t id) {
+    struct merged_site key = { .id = id };
+
+    if (!num_merged)
+        return NULL;
+    return bsearch(&key, merged, num_merged, sizeof(*merged),
+                   compare_merged_site);
+}
+
+// Format: a header, then one line per counter site
+//   <site id> <kind> <function> <file>:<line>:<col> <count> [<not taken>]
+// Conditional branches carry taken and not-taken counts. The counts of
+// merged (sorted by id) are added to the live counters; its sites that this
+// binary does not have are copied through.
+static void write_branch_profile(FILE *out, struct merged_site *merged,
+                                 size_t num_merged, uint64_t runs) {
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t events = 0;
+    uint64_t counter_sites = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        struct merged_site *old;
+
+        // Coverage flags and -bc-memprof access counts are not branches
+        if (sites[i].kind >= BC_SITE_BLOCK)
+            continue;
+        counter_sites++;
+        for (unsigned c = 0; c < sites[i].num_counters; c++)
+            events += ((uint64_t *)sites[i].counters)[c];
+        old = find_merged_site(merged, num_merged, sites[i].id);
+        if (old)
+            old->matched = 1;
+    }
+    for (size_t i = 0; i < num_merged; i++) {
+        events += merged[i].counts[0] + merged[i].counts[1];
+        counter_sites += !merged[i].matched;
+    }
+
+    fprintf(out, "# branch profile v1\n");
+    fprintf(out, "# sites %llu events %llu\n",
+            (unsigned long long)counter_sites, (unsigned long long)events);
+    fprintf(out, "# runs %llu\n", (unsigned long long)runs);
+
+    for (uint64_t i = 0; i < count; i++) {
+        const struct bc_site *site = &sites[i];
+        const uint64_t *counters = site->counters;
+        struct merged_site *old;
+        uint64_t count = counters[0];
+        uint64_t not_taken = site->num_counters > 1 ? counters[1] : 0;
+
+        if (site->kind >= BC_SITE_BLOCK)
+            continue;
+        old = find_merged_site(merged, num_merged, site->id);
+        if (old) {
+            count += old->counts[0];
+            not_taken += old->counts[1];
+        }
+        print_site_line(out, site, count, not_taken);
+    }
+
+    for (size_t i = 0; i < num_merged; i++) {
+        if (!merged[i].matched)
+            fprintf(out, "%s\n", merged[i].line);
+    }
+}
+
+int print_branch_profile(const char *path) {
+    FILE *out = stdout;
+
+    if (path) {
+        out = fopen(path, "w");
+        if (!out) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    write_branch_profile(out, NULL, 0, 1);
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    return 0;
+}
+
+// Reads the whole of fd into a NUL terminated buffer
+static char *read_all(int fd) {
+    size_t size = 0, cap = 4096;
+    char *buf = malloc(cap);
+
+    while (buf) {
+        ssize_t n = read(fd, buf + size, cap - size - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n < 0) {
+                free(buf);
+                return NULL;
+            }
+            buf[size] = '\0';
+            return buf;
+        }
+        size += n;
+        if (cap - size < 2) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown)
+                free(buf);
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    return NULL;
+}
+
+static int is_branch_kind(const char *name) {
+    for (int k = 0; k < BC_SITE_BLOCK; k++)
+        if (!strcmp(name, site_kind_names[k]))
+            return 1;
+    return 0;
+}
+
+// Splits text into site entries (in place) and picks up the run count.
+// Function and file names may hold spaces, so the counts are read after
+// the last ':', the one before the column. Fails on a line it cannot
+// read, or out of memory, so the caller never rewrites a profile it has
+// not fully taken in.
+static int parse_merged_profile(char *text, struct merged_site **merged,
+                                size_t *count, uint64_t *runs) {
+    size_t n = 0, cap = 0;
+    struct merged_site *sites = NULL;
+    char *line, *save;
+
+    *runs = 0;
+    for (line = strtok_r(text, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        struct merged_site site = { .line = line };
+        const char *column = strrchr(line, ':');
+        char kind[16];
+
+        if (line[0] == '#') {
+            sscanf(line, "# runs %" SCNu64, runs);
+            continue;
+        }
+        if (sscanf(line, "%" SCNx64 " %15s", &site.id, kind) != 2 ||
+            !column ||
+            sscanf(column + 1, "%*u %" SCNu64 " %" SCNu64,
+                   &site.counts[0], &site.counts[1]) < 1) {
+            fprintf(stderr, "malformed profile line: %s\n", line);
+            free(sites);
+            errno = EINVAL;
+            return -1;
+        }
+        // Profiles written before memprof sites were left out had them
+        if (!is_branch_kind(kind))
+            continue;
+
+        if (n == cap) {
+            struct merged_site *grown;
+            cap = cap ? cap * 2 : 256;
+            grown = realloc(sites, cap * sizeof(*sites));
+            if (!grown) {
+                free(sites);
+                return -1;
+            }
+            sites = grown;
+        }
+        sites[n++] = site;
+    }
+
+    if (n)
+        qsort(sites, n, sizeof(*sites), compare_merged_site);
+    *merged = sites;
+    *count = n;
+    return 0;
+}
+
+// Adds this process's counts to the profile at path under an exclusive
+// flock, so concurrent processes can all merge into one file
+int print_merged_branch_profile(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct merged_site *merged = NULL;
+    size_t num_merged = 0;
+    uint64_t runs = 0;
+    char *text;
+    FILE *out;
+    int ret = -1;
+
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) < 0) {
+        if (errno != EINTR) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    text = read_all(fd);
+    if (!text)
+        goto out;
+    // The file is left as it was if it cannot be merged
+    if (text[0] && parse_merged_profile(text, &merged, &num_merged, &runs))
+        goto out;
+
+    if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+        goto out;
+    out = fdopen(dup(fd), "w");
+    if (!out)
+        goto out;
+    write_branch_profile(out, merged, num_merged, runs + 1);
+    ret = fclose(out) ? -1 : 0;
+
+out:
+    if (ret)
+        perror(path);
+    free(merged);
+    free(text);
+    flock(fd, LOCK_UN);
+    close(fd);
+    return ret;
+}
+
+// Profile file pattern, BRANCH_PROFILE_FILE or set by init_branch_profile()
+static char profile_pattern[4096];
+
+// Hash of the site IDs, the same for every process of one binary
+static uint64_t profile_signature(void) {
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (uint64_t i = 0; i < count; i++) {
+        hash ^= sites[i].id;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Expands %p (pid), %h (host name), %m (binary signature) and %%; returns
+// whether the pattern asks for merging (%m)
+static int expand_profile_pattern(const char *pattern, char *path,
+                                  size_t size) {
+    size_t len = 0;
+    int merge = 0;
+
+    for (const char *p = pattern; *p && len + 1 < size; p++) {
+        char host[256];
+
+        if (*p != '%' || !p[1]) {
+            path[len++] = *p;
+            continue;
+        }
+        switch (*++p) {
+        case 'p':
+            len += snprintf(path + len, size - len, "%ld", (long)getpid());
+            break;
+        case 'h':
+            if (gethostname(host, sizeof(host)) < 0)
+                strcpy(host, "unknown");
+            host[sizeof(host) - 1] = '\0';
+            len += snprintf(path + len, size - len, "%s", host);
+            break;
+        case 'm':
+            len += snprintf(path + len, size - len, "%016llx",
+                            (unsigned long long)profile_signature());
+            merge = 1;
+            break;
+        case '%':
+            path[len++] = '%';
+            break;
+        default:
+            path[len++] = '%';
+            path[len++] = *p;
+            break;
+        }
+        if (len >= size)
+            len = size - 1;
+    }
+    path[len] = '\0';
+    return merge;
+}
+
+static void dump_branch_profile(void) {
+    char path[4096];
+
+    if (!profile_pattern[0])
+        return;
+    if (expand_profile_pattern(profile_pattern, path, sizeof(path)))
+        print_merged_branch_profile(path);
+    else
+        print_branch_profile(path);
+}
+
+int init_branch_profile(const char *pattern) {
+    static int registered;
+
+    if (!pattern)
+        pattern = getenv("BRANCH_PROFILE_FILE");
+    if (!pattern || !pattern[0] || strlen(pattern) >= sizeof(profile_pattern))
+        return -1;
+
+    strcpy(profile_pattern, pattern);
+    if (!registered && atexit(dump_branch_profile))
+        return -1;
+    registered = 1;
+    return 0;
+}
+
 uint64_t get_cond_branch_count(void) {
-    return cond_branch_count;
+    return cond_branch_count + sum_site_counts(BC_SITE_COND_BRANCH);
 }
 
 uint64_t get_uncond_branch_count(void) {
-    return uncond_branch_count;
+    return uncond_branch_count + sum_site_counts(BC_SITE_UNCOND_BRANCH);
 }
 
 uint64_t get_loop_header_count(void) {
-    return loop_header_count;
+    return loop_header_count + sum_site_counts(BC_SITE_LOOP_HEADER);
 }
 
 uint64_t get_direct_call_count(void) {
-    return direct_call_count;
+    return direct_call_count + sum_site_counts(BC_SITE_DIRECT_CALL);
 }
 
 uint64_t get_return_count(void) {
-    return return_count;
-}
\ No newline at end of file
+    return return_count + sum_site_counts(BC_SITE_RETURN);
+}
+
+void reset_coverage(void) {
+    if (__start___bc_cov)
+        memset(__start___bc_cov, 0, __stop___bc_cov - __start___bc_cov);
+}
+
+uint64_t get_coverage_site_count(void) {
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t total = 0;
+
+    for (uint64_t i = 0; i < count; i++)
+        total += sites[i].kind == BC_SITE_BLOCK;
+    return total;
+}
+
+uint64_t get_covered_site_count(void) {
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t covered = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (sites[i].kind == BC_SITE_BLOCK)
+            covered += *(uint8_t *)sites[i].counters != 0;
+    }
+    return covered;
+}
+
+// Format: a "bitmap" line (one hex digit per 4 blocks, first block in the
+// low bit of the first digit, in site table order) followed by the site
+// table, one "<hit> <site id> <function> <file>:<line>:<col>" line per block.
+int print_coverage_report(const char *path) {
+    FILE *out = stdout;
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+    uint64_t total = get_coverage_site_count();
+    uint64_t covered = get_covered_site_count();
+    unsigned nibble = 0;
+    uint64_t bit = 0;
+
+    if (path) {
+        out = fopen(path, "w");
+        if (!out) {
+            perror(path);
+            return -1;
+        }
+    }
+
+    fprintf(out, "# block coverage v1\n");
+    fprintf(out, "# covered %llu/%llu blocks (%.1f%%)\n",
+            (unsigned long long)covered, (unsigned long long)total,
+            total ? covered * 100.0 / total : 0.0);
+
+    fprintf(out, "bitmap %llu ", (unsigned long long)total);
+    for (uint64_t i = 0; i < count; i++) {
+        if (sites[i].kind != BC_SITE_BLOCK)
+            continue;
+        nibble |= (*(uint8_t *)sites[i].counters != 0) << (bit % 4);
+        if (++bit % 4 == 0) {
+            fputc("0123456789abcdef"[nibble], out);
+            nibble = 0;
+        }
+    }
+    if (bit % 4)
+        fputc("0123456789abcdef"[nibble], out);
+    fputc('\n', out);
+
+    for (uint64_t i = 0; i < count; i++) {
+        const struct bc_site *site = &sites[i];
+
+        if (site->kind != BC_SITE_BLOCK)
+            continue;
+        fprintf(out, "%d %016llx %s %s:%u:%u\n",
+                *(uint8_t *)site->counters != 0,
+                (unsigned long long)site->id, site->function, site->file,
+                site->line, site->column);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    return 0;
+}
+
+// Memory access trace file layout (little endian, host word order):
+//   "BCMEMTR1" <u32 period> <u32 burst>
+//   blocks of <u32 thread> <u32 count> followed by count records
+//   {<u64 site id> <u64 address>}; a site id of all ones ends a burst
+//   a block with thread 0xffffffff and count 0, then the load/store sites
+//   as text in the print_branch_profile() line format
+#define MEM_TRACE_RECORDS 8192
+#define MEM_TRACE_BREAK UINT64_MAX
+#define MEM_TRACE_TRAILER UINT32_MAX
+
+struct mem_trace_record {
+    uint64_t site;
+    uint64_t addr;
+};
+
+struct mem_trace_buffer {
+    struct mem_trace_buffer *next;
+    uint32_t thread;
+    uint32_t used;
+    uint32_t skip;              // accesses left until the next burst
+    uint32_t burst_left;
+    struct mem_trace_record records[MEM_TRACE_RECORDS];
+};
+
+static FILE *mem_trace_file;
+static uint32_t mem_trace_period = 131072;
+static uint32_t mem_trace_burst = 16384;
+static uint64_t mem_trace_records;
+static uint32_t mem_trace_threads;
+static struct mem_trace_buffer *mem_trace_buffers;
+static pthread_mutex_t mem_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t mem_trace_key;
+static __thread struct mem_trace_buffer *mem_trace_thread;
+
+// Caller holds mem_trace_lock
+static void mem_trace_flush_locked(struct mem_trace_buffer *buf) {
+    uint32_t header[2] = { buf->thread, buf->used };
+
+    if (!buf->used || !mem_trace_file)
+        return;
+    fwrite(header, sizeof(header), 1, mem_trace_file);
+    fwrite(buf->records, sizeof(buf->records[0]), buf->used, mem_trace_file);
+    mem_trace_records += buf->used;
+    buf->used = 0;
+}
+
+// Thread exit: write out what is left and drop the buffer
+static void mem_trace_thread_exit(void *arg) {
+    struct mem_trace_buffer *buf = arg;
+    struct mem_trace_buffer **link;
+
+    pthread_mutex_lock(&mem_trace_lock);
+    mem_trace_flush_locked(buf);
+    for (link = &mem_trace_buffers; *link; link = &(*link)->next) {
+        if (*link == buf) {
+            *link = buf->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mem_trace_lock);
+    free(buf);
+}
+
+static struct mem_trace_buffer *mem_trace_thread_buffer(void) {
+    struct mem_trace_buffer *buf = calloc(1, sizeof(*buf));
+
+    if (!buf)
+        return NULL;
+    buf->burst_left = mem_trace_burst;
+
+    pthread_mutex_lock(&mem_trace_lock);
+    buf->thread = mem_trace_threads++;
+    buf->next = mem_trace_buffers;
+    mem_trace_buffers = buf;
+    pthread_mutex_unlock(&mem_trace_lock);
+
+    pthread_setspecific(mem_trace_key, buf);
+    mem_trace_thread = buf;
+    return buf;
+}
+
+void __bc_mem_access(uint64_t site, const void *addr) {
+    struct mem_trace_buffer *buf = mem_trace_thread;
+
+    if (!mem_trace_file)
+        return;
+    if (!buf && !(buf = mem_trace_thread_buffer()))
+        return;
+    if (buf->skip) {
+        buf->skip--;
+        return;
+    }
+
+    buf->records[buf->used].site = site;
+    buf->records[buf->used].addr = (uint64_t)(uintptr_t)addr;
+    buf->used++;
+
+    // Keep room for the burst marker
+    if (--buf->burst_left == 0) {
+        buf->records[buf->used].site = MEM_TRACE_BREAK;
+        buf->records[buf->used].addr = 0;
+        buf->used++;
+        buf->skip = mem_trace_period - mem_trace_burst;
+        buf->burst_left = mem_trace_burst;
+    }
+    if (buf->used >= MEM_TRACE_RECORDS - 1) {
+        pthread_mutex_lock(&mem_trace_lock);
+        mem_trace_flush_locked(buf);
+        pthread_mutex_unlock(&mem_trace_lock);
+    }
+}
+
+// Program exit: flush every live buffer (threads still running may lose the
+// accesses they record meanwhile) and append the site table
+static void mem_trace_finish(void) {
+    uint32_t trailer[2] = { MEM_TRACE_TRAILER, 0 };
+    uint64_t count;
+    const struct bc_site *sites = get_branch_sites(&count);
+
+    pthread_mutex_lock(&mem_trace_lock);
+    if (!mem_trace_file) {
+        pthread_mutex_unlock(&mem_trace_lock);
+        return;
+    }
+    for (struct mem_trace_buffer *buf = mem_trace_buffers; buf; buf = buf->next)
+        mem_trace_flush_locked(buf);
+
+    fwrite(trailer, sizeof(trailer), 1, mem_trace_file);
+    for (uint64_t i = 0; i < count; i++) {
+        if (sites[i].kind == BC_SITE_LOAD || sites[i].kind == BC_SITE_STORE)
+            print_site_line(mem_trace_file, &sites[i],
+                            *(uint64_t *)sites[i].counters, 0);
+    }
+    fclose(mem_trace_file);
+    mem_trace_file = NULL;
+    pthread_mutex_unlock(&mem_trace_lock);
+}
+
+static uint32_t mem_trace_env(const char *name, uint32_t def) {
+    const char *value = getenv(name);
+    unsigned long v;
+
+    if (!value)
+        return def;
+    v = strtoul(value, NULL, 0);
+    return v && v <= UINT32_MAX ? (uint32_t)v : def;
+}
+
+int init_memory_trace(const char *path) {
+    static const char magic[8] = "BCMEMTR1";
+    static int initialized;
+    uint32_t header[2];
+
+    if (mem_trace_file)
+        return 0;
+
+    mem_trace_period = mem_trace_env("BC_MEMPROF_PERIOD", mem_trace_period);
+    mem_trace_burst = mem_trace_env("BC_MEMPROF_BURST", mem_trace_burst);
+    if (mem_trace_burst > mem_trace_period)
+        mem_trace_burst = mem_trace_period;
+
+    if (!initialized) {
+        if (pthread_key_create(&mem_trace_key, mem_trace_thread_exit) ||
+            atexit(mem_trace_finish))
+            return -1;
+        initialized = 1;
+    }
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    header[0] = mem_trace_period;
+    header[1] = mem_trace_burst;
+    fwrite(magic, sizeof(magic), 1, out);
+    fwrite(header, sizeof(header), 1, out);
+
+    mem_trace_file = out;
+    return 0;
+}
+
+uint64_t get_memory_trace_records(void) {
+    return mem_trace_records;
+}
+
+// fork(): the child starts with empty counters, so every event is counted by
+// exactly one process and per-process or merged dumps add up. The memory
+// trace belongs to the parent; the child stops tracing until it calls
+// init_memory_trace() with a path of its own.
+static void fork_prepare(void) {
+    pthread_mutex_lock(&mem_trace_lock);
+    if (mem_trace_file)
+        fflush(mem_trace_file);
+}
+
+static void fork_parent(void) {
+    pthread_mutex_unlock(&mem_trace_lock);
+}
+
+static void fork_child(void) {
+    reset_branch_stats();
+
+    // Nothing is buffered after fork_prepare, closing writes nothing
+    if (mem_trace_file)
+        fclose(mem_trace_file);
+    mem_trace_file = NULL;
+    for (struct mem_trace_buffer *buf = mem_trace_buffers; buf; buf = buf->next)
+        buf->used = 0;
+    pthread_mutex_init(&mem_trace_lock, NULL);
+}
+
+__attribute__((constructor)) static void branch_runtime_init(void) {
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+    if (getenv("BRANCH_PROFILE_FILE"))
+        init_branch_profile(NULL);
+}
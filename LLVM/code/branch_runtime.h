@@ -7,7 +7,34 @@
 extern "C" {
 #endif
 
-// Counter increment functions (called by instrumented code)
+// Site kinds recorded in the site table
+enum bc_site_kind {
+    BC_SITE_COND_BRANCH = 0,    // counters[0] taken, counters[1] not taken
+    BC_SITE_UNCOND_BRANCH,
+    BC_SITE_LOOP_HEADER,
+    BC_SITE_DIRECT_CALL,
+    BC_SITE_RETURN,
+    BC_SITE_BLOCK,              // one-byte coverage flag
+    BC_SITE_LOAD,               // access count (-bc-memprof)
+    BC_SITE_STORE,
+};
+
+// One instrumented site. Every instrumented module emits an array of these
+// into the __bc_sites section; the linker concatenates them and the runtime
+// walks the result. Layout must match SiteTable::emit in BranchCounter.cpp.
+struct bc_site {
+    uint64_t id;                // module hash (high 32 bits) | local index
+    const char *function;
+    const char *file;
+    uint32_t line;
+    uint16_t column;
+    uint8_t kind;               // enum bc_site_kind
+    uint8_t num_counters;
+    void *counters;             // uint64_t[num_counters], uint8_t for blocks
+};
+
+// Counter increment functions (per-event calls; the plugin now bumps
+// per-site counters inline, these remain for code instrumented earlier)
 void increment_cond_branch(void);
 void increment_uncond_branch(void);
 void increment_loop_header(void);
@@ -19,6 +46,21 @@ void print_branch_stats(void);
 void reset_branch_stats(void);
 void init_branch_stats(void);
 
+// Writes the per-site profile to path, or to stdout when path is NULL
+int print_branch_profile(const char *path);
+
+// Adds this process's counts to the profile at path, holding an exclusive
+// flock on it, so any number of processes can merge into one file
+int print_merged_branch_profile(const char *path);
+
+// Dumps the profile at exit to a file named by pattern, or by the
+// BRANCH_PROFILE_FILE environment variable when pattern is NULL (read
+// automatically at startup). Like LLVM_PROFILE_FILE: %p expands to the
+// process ID, %h to the host name, %% to a percent sign, and %m to a
+// signature of the binary's site table and selects the merging dump.
+// After fork() the child starts with zeroed counters.
+int init_branch_profile(const char *pattern);
+
 // Get individual counts
 uint64_t get_cond_branch_count(void);
 uint64_t get_uncond_branch_count(void);
@@ -26,8 +68,30 @@ uint64_t get_loop_header_count(void);
 uint64_t get_direct_call_count(void);
 uint64_t get_return_count(void);
 
+// Site table access
+const struct bc_site *get_branch_sites(uint64_t *count);
+
+// Block coverage (modules built with -mllvm -bc-coverage)
+// Writes the bitmap and site table to path, or to stdout when path is NULL.
+int print_coverage_report(const char *path);
+void reset_coverage(void);
+uint64_t get_coverage_site_count(void);
+uint64_t get_covered_site_count(void);
+
+// Memory access trace (modules built with -mllvm -bc-memprof)
+// Each thread records bursts of consecutive accesses into its own buffer,
+// by default 16384 accesses out of every 131072 (BC_MEMPROF_BURST and
+// BC_MEMPROF_PERIOD override). Buffers are appended to path as they fill,
+// when their thread exits and at program exit, followed by the load/store
+// site table. Nothing is recorded until this is called.
+int init_memory_trace(const char *path);
+uint64_t get_memory_trace_records(void);
+
+// Called by instrumented code for every load and store
+void __bc_mem_access(uint64_t site, const void *addr);
+
 #ifdef __cplusplus
 }
 #endif
 
-#endif // BRANCH_RUNTIME_H
\ No newline at end of file
+#endif // BRANCH_RUNTIME_H
@@ -0,0 +1,334 @@
+// mem_analyze: per-site cache behaviour from a trace written by
+// init_memory_trace() in modules built with -mllvm -bc-memprof
+//
+//   mem_analyze [--top N] [--line B] [--l1 KB] [--l2 KB] trace.bin
+//
+// Reuse distance is the number of distinct cache lines touched by the same
+// thread since the last access to a line. Against a fully associative LRU
+// cache of C lines an access misses when its distance is C or more, which
+// gives a per-site miss ratio estimate for each cache level. Distances only
+// span one sampling burst; the first touch of a line in a burst is counted
+// as cold. Strides are taken between consecutive accesses of the same site
+// and thread.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t BurstBreak = ~0ULL;
+constexpr uint32_t TrailerThread = ~0U;
+
+struct Record {
+    uint64_t Site;
+    uint64_t Addr;
+};
+
+struct SiteInfo {
+    std::string Kind = "?";
+    std::string Function = "?";
+    std::string Location = "?";
+    uint64_t Count = 0;             // all executions, from the site table
+};
+
+struct SiteStats {
+    uint64_t Samples = 0;
+    uint64_t Cold = 0;
+    uint64_t MissL1 = 0;            // distance >= L1 lines, cold included
+    uint64_t MissL2 = 0;
+    std::vector<uint64_t> Distances;
+    std::map<int64_t, uint64_t> Strides;
+    uint64_t StrideSamples = 0;
+};
+
+// Reuse distance of one access stream. Each line is marked at the time of
+// its latest access; the distance is the number of marks after the
+// previous access to the same line.
+class ReuseTracker {
+public:
+    static constexpr uint64_t Cold = ~0ULL;
+
+    uint64_t access(uint64_t Line) {
+        uint64_t Now = ++Time;
+        grow(Now);
+        uint64_t Distance = Cold;
+        auto It = Last.find(Line);
+        if (It != Last.end()) {
+            Distance = prefix(Now - 1) - prefix(It->second);
+            add(It->second, -1);
+            It->second = Now;
+        } else {
+            Last.emplace(Line, Now);
+        }
+        add(Now, 1);
+        return Distance;
+    }
+
+    void reset() {
+        Time = 0;
+        Last.clear();
+        Tree.assign(Tree.size(), 0);
+    }
+
+private:
+    void grow(uint64_t N) {
+        if (N < Tree.size())
+            return;
+        // Rebuild from the live marks, a Fenwick tree cannot be resized
+        std::vector<int64_t> Fresh(std::max<size_t>(N + 1, Tree.size() * 2));
+        Tree.swap(Fresh);
+        for (const auto &L : Last)
+            add(L.second, 1);
+    }
+
+    void add(uint64_t I, int64_t V) {
+        for (; I < Tree.size(); I += I & -I)
+            Tree[I] += V;
+    }
+
+    int64_t prefix(uint64_t I) const {
+        int64_t Sum = 0;
+        for (; I; I -= I & -I)
+            Sum += Tree[I];
+        return Sum;
+    }
+
+    uint64_t Time = 0;
+    std::unordered_map<uint64_t, uint64_t> Last;
+    std::vector<int64_t> Tree = std::vector<int64_t>(1024);
+};
+
+struct ThreadState {
+    ReuseTracker Reuse;
+    std::unordered_map<uint64_t, uint64_t> LastAddr;    // per site
+};
+
+struct Options {
+    size_t Top = 20;
+    uint64_t LineSize = 64;
+    uint64_t L1Lines = 32 * 1024 / 64;
+    uint64_t L2Lines = 1024 * 1024 / 64;
+};
+
+struct Trace {
+    uint32_t Period = 0;
+    uint32_t Burst = 0;
+    uint64_t Records = 0;
+    std::map<uint64_t, SiteInfo> Sites;
+    std::map<uint64_t, SiteStats> Stats;
+};
+
+void parseSiteTable(std::FILE *In, Trace &T) {
+    char Buf[4096];
+    while (std::fgets(Buf, sizeof(Buf), In)) {
+        std::istringstream Fields(Buf);
+        std::string Id;
+        SiteInfo S;
+        if (Fields >> Id >> S.Kind >> S.Function >> S.Location >> S.Count)
+            T.Sites[std::strtoull(Id.c_str(), nullptr, 16)] = S;
+    }
+}
+
+bool loadTrace(const char *Path, const Options &Opt, Trace &T) {
+    std::FILE *In = std::fopen(Path, "rb");
+    if (!In) {
+        std::fprintf(stderr, "mem_analyze: cannot open %s\n", Path);
+        return false;
+    }
+
+    char Magic[8];
+    uint32_t Header[2];
+    if (std::fread(Magic, sizeof(Magic), 1, In) != 1 ||
+        std::memcmp(Magic, "BCMEMTR1", sizeof(Magic)) != 0 ||
+        std::fread(Header, sizeof(Header), 1, In) != 1) {
+        std::fprintf(stderr, "mem_analyze: %s is not a memory trace\n", Path);
+        std::fclose(In);
+        return false;
+    }
+    T.Period = Header[0];
+    T.Burst = Header[1];
+
+    std::map<uint32_t, ThreadState> Threads;
+    std::vector<Record> Block;
+    uint32_t BlockHeader[2];
+    bool Trailer = false;
+    while (std::fread(BlockHeader, sizeof(BlockHeader), 1, In) == 1) {
+        if (BlockHeader[0] == TrailerThread) {
+            Trailer = true;
+            break;
+        }
+
+        Block.resize(BlockHeader[1]);
+        if (std::fread(Block.data(), sizeof(Record), Block.size(), In) !=
+            Block.size()) {
+            std::fprintf(stderr, "mem_analyze: %s: truncated block\n", Path);
+            break;
+        }
+
+        ThreadState &TS = Threads[BlockHeader[0]];
+        for (const Record &R : Block) {
+            if (R.Site == BurstBreak) {
+                TS.Reuse.reset();
+                TS.LastAddr.clear();
+                continue;
+            }
+            ++T.Records;
+
+            SiteStats &S = T.Stats[R.Site];
+            ++S.Samples;
+            uint64_t Distance = TS.Reuse.access(R.Addr / Opt.LineSize);
+            if (Distance == ReuseTracker::Cold) {
+                ++S.Cold;
+                ++S.MissL1;
+                ++S.MissL2;
+            } else {
+                S.MissL1 += Distance >= Opt.L1Lines;
+                S.MissL2 += Distance >= Opt.L2Lines;
+                S.Distances.push_back(Distance);
+            }
+
+            auto Prev = TS.LastAddr.find(R.Site);
+            if (Prev != TS.LastAddr.end()) {
+                ++S.Strides[int64_t(R.Addr - Prev->second)];
+                ++S.StrideSamples;
+                Prev->second = R.Addr;
+            } else {
+                TS.LastAddr.emplace(R.Site, R.Addr);
+            }
+        }
+    }
+
+    if (Trailer)
+        parseSiteTable(In, T);
+    else
+        std::fprintf(stderr, "mem_analyze: %s has no site table (program "
+                     "did not exit normally?)\n", Path);
+    std::fclose(In);
+    return true;
+}
+
+// Dominant stride and the share of accesses that follow it
+std::string describeStride(const SiteStats &S, uint64_t LineSize) {
+    if (!S.StrideSamples)
+        return "-";
+    auto Top = std::max_element(
+        S.Strides.begin(), S.Strides.end(),
+        [](const auto &A, const auto &B) { return A.second < B.second; });
+    double Share = double(Top->second) / S.StrideSamples;
+
+    char Buf[64];
+    if (Share < 0.5)
+        std::snprintf(Buf, sizeof(Buf), "irregular (%zu strides)",
+                      S.Strides.size());
+    else if (Top->first == 0)
+        std::snprintf(Buf, sizeof(Buf), "same address %.0f%%", Share * 100);
+    else if (uint64_t(std::llabs(Top->first)) < LineSize)
+        std::snprintf(Buf, sizeof(Buf), "sequential %+" PRId64 " %.0f%%",
+                      Top->first, Share * 100);
+    else
+        std::snprintf(Buf, sizeof(Buf), "strided %+" PRId64 " %.0f%%",
+                      Top->first, Share * 100);
+    return Buf;
+}
+
+uint64_t medianDistance(std::vector<uint64_t> &D) {
+    if (D.empty())
+        return 0;
+    std::nth_element(D.begin(), D.begin() + D.size() / 2, D.end());
+    return D[D.size() / 2];
+}
+
+void printReport(Trace &T, const Options &Opt) {
+    std::printf("Trace: %" PRIu64 " sampled accesses, %zu sites, bursts of "
+                "%u every %u accesses per thread\n", T.Records,
+                T.Stats.size(), T.Burst, T.Period);
+    std::printf("Cache model: %" PRIu64 " B lines, L1 %" PRIu64 " lines, "
+                "L2 %" PRIu64 " lines, fully associative LRU\n\n",
+                Opt.LineSize, Opt.L1Lines, Opt.L2Lines);
+
+    // Rank by estimated L1 misses over the whole run: the sampled miss
+    // ratio scaled by the site's full access count
+    struct Row {
+        uint64_t Id;
+        SiteStats *S;
+        double EstMisses;
+    };
+    std::vector<Row> Rows;
+    for (auto &Entry : T.Stats) {
+        auto Info = T.Sites.find(Entry.first);
+        uint64_t Count = Info != T.Sites.end() ? Info->second.Count
+                                               : Entry.second.Samples;
+        double Ratio = double(Entry.second.MissL1) / Entry.second.Samples;
+        Rows.push_back({Entry.first, &Entry.second, Ratio * Count});
+    }
+    std::sort(Rows.begin(), Rows.end(), [](const Row &A, const Row &B) {
+        return A.EstMisses > B.EstMisses;
+    });
+
+    std::printf("  %-5s %-24s %-28s %12s %9s %6s %6s %6s %9s  %s\n", "kind",
+                "function", "location", "accesses", "sampled", "cold%",
+                "L1mr%", "L2mr%", "med.dist", "stride");
+    SiteInfo Unknown;
+    for (size_t I = 0; I < Rows.size() && I < Opt.Top; ++I) {
+        const Row &R = Rows[I];
+        SiteStats &S = *R.S;
+        auto Info = T.Sites.find(R.Id);
+        const SiteInfo &SI = Info != T.Sites.end() ? Info->second : Unknown;
+        std::printf("  %-5s %-24s %-28s %12" PRIu64 " %9" PRIu64
+                    " %6.1f %6.1f %6.1f %9" PRIu64 "  %s\n",
+                    SI.Kind.c_str(), SI.Function.c_str(), SI.Location.c_str(),
+                    SI.Count, S.Samples, 100.0 * S.Cold / S.Samples,
+                    100.0 * S.MissL1 / S.Samples,
+                    100.0 * S.MissL2 / S.Samples, medianDistance(S.Distances),
+                    describeStride(S, Opt.LineSize).c_str());
+    }
+}
+
+void usage(const char *Prog) {
+    std::fprintf(stderr, "usage: %s [--top N] [--line BYTES] [--l1 KB] "
+                 "[--l2 KB] trace.bin\n", Prog);
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+    Options Opt;
+    uint64_t L1KB = 32, L2KB = 1024;
+    std::vector<const char *> Inputs;
+
+    for (int I = 1; I < argc; ++I) {
+        if (!std::strcmp(argv[I], "--top") && I + 1 < argc)
+            Opt.Top = std::strtoul(argv[++I], nullptr, 10);
+        else if (!std::strcmp(argv[I], "--line") && I + 1 < argc)
+            Opt.LineSize = std::strtoull(argv[++I], nullptr, 10);
+        else if (!std::strcmp(argv[I], "--l1") && I + 1 < argc)
+            L1KB = std::strtoull(argv[++I], nullptr, 10);
+        else if (!std::strcmp(argv[I], "--l2") && I + 1 < argc)
+            L2KB = std::strtoull(argv[++I], nullptr, 10);
+        else if (argv[I][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else
+            Inputs.push_back(argv[I]);
+    }
+    if (Inputs.size() != 1 || !Opt.LineSize) {
+        usage(argv[0]);
+        return 2;
+    }
+    Opt.L1Lines = L1KB * 1024 / Opt.LineSize;
+    Opt.L2Lines = L2KB * 1024 / Opt.LineSize;
+
+    Trace T;
+    if (!loadTrace(Inputs[0], Opt, T))
+        return 1;
+    printReport(T, Opt);
+    return 0;
+}
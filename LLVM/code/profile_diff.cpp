@@ -0,0 +1,341 @@
+// profile_diff: compare two branch profiles written by print_branch_profile()
+//
+//   profile_diff [--top N] [--min-count N] [--json out.json] base.prof new.prof
+//
+// Sites are aligned by site ID, falling back to (kind, function, location)
+// when a module hash changed between builds. Counts are normalized by the
+// total events of their profile, so runs of different length compare, and
+// sites are ranked by the largest relative change in execution count and by
+// the largest shift in branch bias.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct SiteRecord {
+    uint64_t Id = 0;
+    std::string Kind;
+    std::string Function;
+    std::string Location;       // file:line:col
+    uint64_t Count = 0;         // total executions (taken + not taken)
+    uint64_t Taken = 0;         // conditional branches only
+    bool IsCond = false;
+};
+
+struct Profile {
+    std::vector<SiteRecord> Sites;
+    uint64_t Events = 0;
+};
+
+struct SiteDiff {
+    const SiteRecord *Base = nullptr;
+    const SiteRecord *New = nullptr;
+    double BaseFreq = 0;
+    double NewFreq = 0;
+    double CountScore = 0;      // |log2(new/base)| of normalized counts
+    double BaseBias = -1;       // taken ratio, -1 when not a cond branch
+    double NewBias = -1;
+    double BiasShift = 0;
+    bool Flipped = false;
+};
+
+bool loadProfile(const char *Path, Profile &P) {
+    std::ifstream In(Path);
+    if (!In) {
+        std::fprintf(stderr, "profile_diff: cannot open %s\n", Path);
+        return false;
+    }
+
+    std::string Line;
+    unsigned LineNo = 0;
+    while (std::getline(In, Line)) {
+        ++LineNo;
+        if (Line.empty() || Line[0] == '#')
+            continue;
+
+        std::istringstream Fields(Line);
+        std::string Id;
+        SiteRecord S;
+        uint64_t Second = 0;
+        if (!(Fields >> Id >> S.Kind >> S.Function >> S.Location >> S.Count)) {
+            std::fprintf(stderr, "profile_diff: %s:%u: malformed line\n",
+                         Path, LineNo);
+            return false;
+        }
+        S.Id = std::strtoull(Id.c_str(), nullptr, 16);
+        S.IsCond = S.Kind == "cond";
+        if (S.IsCond && (Fields >> Second)) {
+            S.Taken = S.Count;
+            S.Count += Second;
+        }
+        P.Events += S.Count;
+        P.Sites.push_back(std::move(S));
+    }
+    return true;
+}
+
+std::string locationKey(const SiteRecord &S) {
+    return S.Kind + '\0' + S.Function + '\0' + S.Location;
+}
+
+// Matching a site by ID first, then by location. Several sites can share a
+// location (no debug info, or the same inline function in several TUs),
+// those are paired in order of appearance. All ID matches are made before
+// any location fallback, so a fallback cannot take a site that an exact
+// match needs, and no new site is paired twice.
+std::vector<SiteDiff> alignProfiles(const Profile &Base, const Profile &New) {
+    std::map<uint64_t, const SiteRecord *> NewById;
+    std::map<std::string, std::vector<const SiteRecord *>> NewByLoc;
+    std::map<const SiteRecord *, bool> Used;
+
+    for (const SiteRecord &S : New.Sites) {
+        NewById[S.Id] = &S;
+        NewByLoc[locationKey(S)].push_back(&S);
+    }
+
+    std::vector<SiteDiff> Diffs;
+    for (const SiteRecord &S : Base.Sites) {
+        SiteDiff D;
+        D.Base = &S;
+
+        auto ById = NewById.find(S.Id);
+        if (ById != NewById.end() && !Used[ById->second] &&
+            locationKey(*ById->second) == locationKey(S)) {
+            D.New = ById->second;
+            Used[D.New] = true;
+        }
+        Diffs.push_back(D);
+    }
+
+    std::map<std::string, size_t> LocCursor;
+    for (SiteDiff &D : Diffs) {
+        if (D.New)
+            continue;
+        auto &Candidates = NewByLoc[locationKey(*D.Base)];
+        size_t &Cursor = LocCursor[locationKey(*D.Base)];
+        while (Cursor < Candidates.size() && Used[Candidates[Cursor]])
+            ++Cursor;
+        if (Cursor < Candidates.size()) {
+            D.New = Candidates[Cursor++];
+            Used[D.New] = true;
+        }
+    }
+
+    for (const SiteRecord &S : New.Sites) {
+        if (!Used[&S]) {
+            SiteDiff D;
+            D.New = &S;
+            Diffs.push_back(D);
+        }
+    }
+    return Diffs;
+}
+
+void scoreDiffs(std::vector<SiteDiff> &Diffs, const Profile &Base,
+                const Profile &New) {
+    // Half an event of smoothing keeps sites that are new or gone finite
+    double BaseEps = Base.Events ? 0.5 / Base.Events : 0.5;
+    double NewEps = New.Events ? 0.5 / New.Events : 0.5;
+
+    for (SiteDiff &D : Diffs) {
+        if (D.Base && Base.Events)
+            D.BaseFreq = double(D.Base->Count) / Base.Events;
+        if (D.New && New.Events)
+            D.NewFreq = double(D.New->Count) / New.Events;
+        D.CountScore = std::fabs(std::log2((D.NewFreq + NewEps) /
+                                           (D.BaseFreq + BaseEps)));
+
+        if (D.Base && D.Base->IsCond && D.Base->Count)
+            D.BaseBias = double(D.Base->Taken) / D.Base->Count;
+        if (D.New && D.New->IsCond && D.New->Count)
+            D.NewBias = double(D.New->Taken) / D.New->Count;
+        if (D.BaseBias >= 0 && D.NewBias >= 0) {
+            D.BiasShift = std::fabs(D.NewBias - D.BaseBias);
+            D.Flipped = (D.BaseBias > 0.5) != (D.NewBias > 0.5) &&
+                        D.BaseBias != 0.5 && D.NewBias != 0.5;
+        }
+    }
+}
+
+const SiteRecord &anySite(const SiteDiff &D) {
+    return D.Base ? *D.Base : *D.New;
+}
+
+uint64_t countOf(const SiteRecord *S) {
+    return S ? S->Count : 0;
+}
+
+void printReport(const std::vector<SiteDiff> &Diffs, const Profile &Base,
+                 const Profile &New, size_t Top, uint64_t MinCount) {
+    std::printf("Base: %zu sites, %" PRIu64 " events\n", Base.Sites.size(),
+                Base.Events);
+    std::printf("New:  %zu sites, %" PRIu64 " events (%.3fx)\n",
+                New.Sites.size(), New.Events,
+                Base.Events ? double(New.Events) / Base.Events : 0.0);
+
+    std::vector<const SiteDiff *> ByCount, ByBias;
+    size_t OnlyBase = 0, OnlyNew = 0;
+    for (const SiteDiff &D : Diffs) {
+        OnlyBase += !D.New;
+        OnlyNew += !D.Base;
+        if (std::max(countOf(D.Base), countOf(D.New)) < MinCount)
+            continue;
+        if (D.CountScore > 0)
+            ByCount.push_back(&D);
+        if (D.BiasShift > 0)
+            ByBias.push_back(&D);
+    }
+    std::printf("Unmatched: %zu only in base, %zu only in new\n\n",
+                OnlyBase, OnlyNew);
+
+    std::sort(ByCount.begin(), ByCount.end(),
+              [](const SiteDiff *A, const SiteDiff *B) {
+                  return A->CountScore > B->CountScore;
+              });
+    std::sort(ByBias.begin(), ByBias.end(),
+              [](const SiteDiff *A, const SiteDiff *B) {
+                  if (A->Flipped != B->Flipped)
+                      return A->Flipped;
+                  return A->BiasShift > B->BiasShift;
+              });
+
+    std::printf("Largest relative changes in execution count "
+                "(per event, normalized)\n");
+    std::printf("  %-8s %-6s %-24s %-28s %12s %12s %9s\n", "ratio", "kind",
+                "function", "location", "base", "new", "log2");
+    for (size_t I = 0; I < ByCount.size() && I < Top; ++I) {
+        const SiteDiff &D = *ByCount[I];
+        const SiteRecord &S = anySite(D);
+        double Ratio = D.BaseFreq > 0 ? D.NewFreq / D.BaseFreq : INFINITY;
+        std::printf("  %-8.3g %-6s %-24s %-28s %12" PRIu64 " %12" PRIu64
+                    " %9.2f\n", Ratio, S.Kind.c_str(), S.Function.c_str(),
+                    S.Location.c_str(), countOf(D.Base), countOf(D.New),
+                    D.CountScore);
+    }
+
+    std::printf("\nLargest branch bias shifts (taken ratio)\n");
+    std::printf("  %-8s %-24s %-28s %8s %8s %s\n", "shift", "function",
+                "location", "base", "new", "");
+    for (size_t I = 0; I < ByBias.size() && I < Top; ++I) {
+        const SiteDiff &D = *ByBias[I];
+        const SiteRecord &S = anySite(D);
+        std::printf("  %-8.3f %-24s %-28s %8.3f %8.3f %s\n", D.BiasShift,
+                    S.Function.c_str(), S.Location.c_str(), D.BaseBias,
+                    D.NewBias, D.Flipped ? "FLIPPED" : "");
+    }
+}
+
+void writeJsonString(std::FILE *Out, const std::string &Str) {
+    std::fputc('"', Out);
+    for (char C : Str) {
+        if (C == '"' || C == '\\')
+            std::fprintf(Out, "\\%c", C);
+        else if (static_cast<unsigned char>(C) < 0x20)
+            std::fprintf(Out, "\\u%04x", C);
+        else
+            std::fputc(C, Out);
+    }
+    std::fputc('"', Out);
+}
+
+// Bias of a site missing from one profile (or never executed) is null
+void writeJsonBias(std::FILE *Out, const char *Key, double Bias) {
+    if (Bias < 0)
+        std::fprintf(Out, ", \"%s\": null", Key);
+    else
+        std::fprintf(Out, ", \"%s\": %.6g", Key, Bias);
+}
+
+bool writeJson(const char *Path, const std::vector<SiteDiff> &Diffs,
+               const Profile &Base, const Profile &New) {
+    std::FILE *Out = std::fopen(Path, "w");
+    if (!Out) {
+        std::perror(Path);
+        return false;
+    }
+
+    std::fprintf(Out, "{\n  \"base_events\": %" PRIu64 ",\n"
+                 "  \"new_events\": %" PRIu64 ",\n  \"sites\": [",
+                 Base.Events, New.Events);
+    for (size_t I = 0; I < Diffs.size(); ++I) {
+        const SiteDiff &D = Diffs[I];
+        const SiteRecord &S = anySite(D);
+        std::fprintf(Out, "%s\n    {\"id\": \"%016" PRIx64 "\", \"kind\": ",
+                     I ? "," : "", S.Id);
+        writeJsonString(Out, S.Kind);
+        std::fprintf(Out, ", \"function\": ");
+        writeJsonString(Out, S.Function);
+        std::fprintf(Out, ", \"location\": ");
+        writeJsonString(Out, S.Location);
+        std::fprintf(Out, ", \"base_count\": %" PRIu64 ", \"new_count\": %"
+                     PRIu64 ", \"base_freq\": %.9g, \"new_freq\": %.9g"
+                     ", \"count_score\": %.6g",
+                     countOf(D.Base), countOf(D.New), D.BaseFreq, D.NewFreq,
+                     D.CountScore);
+        if (S.IsCond) {
+            writeJsonBias(Out, "base_bias", D.BaseBias);
+            writeJsonBias(Out, "new_bias", D.NewBias);
+            std::fprintf(Out, ", \"bias_shift\": %.6g, \"flipped\": %s",
+                         D.BiasShift, D.Flipped ? "true" : "false");
+        }
+        std::fprintf(Out, ", \"status\": \"%s\"}",
+                     !D.New ? "removed" : !D.Base ? "added" : "matched");
+    }
+    std::fprintf(Out, "\n  ]\n}\n");
+    std::fclose(Out);
+    return true;
+}
+
+void usage(const char *Prog) {
+    std::fprintf(stderr, "usage: %s [--top N] [--min-count N] "
+                 "[--json out.json] base.prof new.prof\n", Prog);
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+    size_t Top = 20;
+    uint64_t MinCount = 1;
+    const char *JsonPath = nullptr;
+    std::vector<const char *> Inputs;
+
+    for (int I = 1; I < argc; ++I) {
+        if (!std::strcmp(argv[I], "--top") && I + 1 < argc)
+            Top = std::strtoul(argv[++I], nullptr, 10);
+        else if (!std::strcmp(argv[I], "--min-count") && I + 1 < argc)
+            MinCount = std::strtoull(argv[++I], nullptr, 10);
+        else if (!std::strcmp(argv[I], "--json") && I + 1 < argc)
+            JsonPath = argv[++I];
+        else if (argv[I][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else
+            Inputs.push_back(argv[I]);
+    }
+    if (Inputs.size() != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Profile Base, New;
+    if (!loadProfile(Inputs[0], Base) || !loadProfile(Inputs[1], New))
+        return 1;
+
+    std::vector<SiteDiff> Diffs = alignProfiles(Base, New);
+    scoreDiffs(Diffs, Base, New);
+    printReport(Diffs, Base, New, Top, MinCount);
+
+    if (JsonPath && !writeJson(JsonPath, Diffs, Base, New))
+        return 1;
+    return 0;
+}
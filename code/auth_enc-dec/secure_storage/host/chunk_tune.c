@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_tune.h"
+
+/* A larger chunk must beat a smaller one by this much to be chosen */
+#define CHUNK_TUNE_MARGIN 1.02
+
+static const char *profile_path(void)
+{
+	const char *path = getenv("HOST_CHUNK_PROFILE");
+
+	return path && *path ? path : CHUNK_TUNE_PROFILE;
+}
+
+static int key_matches(const char *line, const char *key)
+{
+	size_t len = strlen(key);
+
+	return !strncmp(line, key, len) && line[len] == ' ';
+}
+
+/* Profile lines are "<op> <io> <chunk bytes>", '#' starts a comment */
+static size_t profile_lookup(const char *key)
+{
+	FILE *f = fopen(profile_path(), "r");
+	char line[256];
+	unsigned long chunk = 0;
+
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (key_matches(line, key))
+			chunk = strtoul(line + strlen(key), NULL, 10);
+	fclose(f);
+	return chunk;
+}
+
+/* Rewrites the profile with key's line replaced, then renames it over */
+static int profile_save(const char *key, size_t chunk, double mb_s)
+{
+	const char *path = profile_path();
+	char tmp[512], line[256];
+	FILE *in, *out;
+	int ret;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	out = fopen(tmp, "w");
+	if (!out)
+		return -1;
+	in = fopen(path, "r");
+	if (!in)
+		fprintf(out, "# <op> <io> <chunk bytes>, from the chunk size tuner\n");
+	while (in && fgets(line, sizeof(line), in))
+		if (!key_matches(line, key))
+			fputs(line, out);
+	if (in)
+		fclose(in);
+	fprintf(out, "%s %zu # %.1f MB/s\n", key, chunk, mb_s);
+	ret = fclose(out);
+	if (ret || rename(tmp, path)) {
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static unsigned int probe_segments(const struct chunk_tune *t)
+{
+	return t->ncand * CHUNK_TUNE_ROUNDS;
+}
+
+uint64_t chunk_tune_min_size(size_t max_chunk)
+{
+	unsigned int n = 0;
+	size_t c;
+
+	for (c = CHUNK_TUNE_MIN; c <= max_chunk &&
+	     n < CHUNK_TUNE_MAX_CANDIDATES; c *= 2)
+		n++;
+	/* Every probe, plus as much again for the chosen size */
+	return (uint64_t)(n * CHUNK_TUNE_ROUNDS + 1) * CHUNK_TUNE_PROBE;
+}
+
+void chunk_tune_begin(struct chunk_tune *t, const char *op, const char *io,
+		      uint64_t size, size_t max_chunk, size_t def_chunk)
+{
+	const char *mode = getenv("HOST_CHUNK");
+	unsigned long fixed;
+	size_t saved, c;
+	char *end;
+	int calibrate = mode && !strcmp(mode, "calibrate");
+
+	memset(t, 0, sizeof(*t));
+	snprintf(t->key, sizeof(t->key), "%s %s", op, io);
+	t->size = size;
+	t->chunk = def_chunk;
+	for (c = CHUNK_TUNE_MIN; c <= max_chunk &&
+	     t->ncand < CHUNK_TUNE_MAX_CANDIDATES; c *= 2)
+		t->cand[t->ncand++] = c;
+
+	if (mode && *mode && strcmp(mode, "auto") && !calibrate) {
+		fixed = strtoul(mode, &end, 0);
+		if (*end || !fixed || fixed % 16 || fixed > max_chunk)
+			printf("Warning: HOST_CHUNK must be a multiple of 16 up to %zu, using %zu\n",
+			       max_chunk, def_chunk);
+		else
+			t->chunk = fixed;
+		printf("Chunk size: %zu bytes\n", t->chunk);
+		return;
+	}
+
+	if (!calibrate) {
+		saved = profile_lookup(t->key);
+		if (saved && saved <= max_chunk && !(saved % 16)) {
+			t->chunk = saved;
+			printf("Chunk size: %zu bytes (%s profile)\n", t->chunk,
+			       t->key);
+			return;
+		}
+	}
+
+	if (size >= chunk_tune_min_size(max_chunk)) {
+		t->probing = 1;
+		printf("Tuning the %s chunk size over the first %u MB\n",
+		       t->key, probe_segments(t) * CHUNK_TUNE_PROBE /
+		       (1024 * 1024));
+	} else if (calibrate) {
+		printf("Warning: calibrating needs %llu MB of data, using %zu-byte chunks\n",
+		       (unsigned long long)chunk_tune_min_size(max_chunk) /
+		       (1024 * 1024), def_chunk);
+	} else {
+		printf("Chunk size: %zu bytes\n", t->chunk);
+	}
+}
+
+/* Ends probing with the fastest candidate, preferring smaller ones */
+static void pick_best(struct chunk_tune *t)
+{
+	double best = 0;
+	unsigned int i;
+
+	printf("  Chunk size probe, %s:\n", t->key);
+	for (i = 0; i < t->ncand; i++) {
+		if (t->mb_s[i] < 0) {
+			printf("    %6zuK  unsupported\n", t->cand[i] / 1024);
+			continue;
+		}
+		printf("    %6zuK  %8.1f MB/s\n", t->cand[i] / 1024,
+		       t->mb_s[i]);
+		if (t->mb_s[i] > best * CHUNK_TUNE_MARGIN) {
+			best = t->mb_s[i];
+			t->chunk = t->cand[i];
+			t->cur = i;
+		}
+	}
+	t->probing = 0;
+	t->tuned = best > 0;
+	printf("  Using %zu-byte chunks\n", t->chunk);
+}
+
+int chunk_tune_next(struct chunk_tune *t, uint64_t *start, size_t *len,
+		    size_t *chunk)
+{
+	unsigned int i;
+
+	if (t->done >= t->size)
+		return 0;
+
+	while (t->probing && t->step < probe_segments(t)) {
+		i = t->step % t->ncand;
+		/* Odd rounds run from the largest candidate down */
+		if ((t->step / t->ncand) % 2)
+			i = t->ncand - 1 - i;
+		if (t->mb_s[i] < 0) {
+			t->step++;
+			continue;
+		}
+		t->cur = i;
+		t->cur_len = CHUNK_TUNE_PROBE;
+		*start = t->done;
+		*len = t->cur_len;
+		*chunk = t->cand[i];
+		clock_gettime(CLOCK_MONOTONIC, &t->start);
+		return 1;
+	}
+	if (t->probing)
+		pick_best(t);
+
+	t->cur_len = t->size - t->done;
+	*start = t->done;
+	*len = t->cur_len;
+	*chunk = t->chunk;
+	return 1;
+}
+
+void chunk_tune_done(struct chunk_tune *t)
+{
+	struct timespec now;
+	double sec, mb_s;
+
+	if (t->probing) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		sec = (now.tv_sec - t->start.tv_sec) +
+		      (now.tv_nsec - t->start.tv_nsec) / 1e9;
+		mb_s = t->cur_len / (1024.0 * 1024.0) / sec;
+		if (sec > 0 && mb_s > t->mb_s[t->cur])
+			t->mb_s[t->cur] = mb_s;
+		t->step++;
+	}
+	t->done += t->cur_len;
+}
+
+int chunk_tune_reject(struct chunk_tune *t)
+{
+	if (!t->probing)
+		return -1;
+	t->mb_s[t->cur] = -1;
+	t->step++;
+	return 0;
+}
+
+void chunk_tune_end(struct chunk_tune *t)
+{
+	/* Only a completed probe is worth keeping */
+	if (!t->tuned)
+		return;
+	if (profile_save(t->key, t->chunk, t->mb_s[t->cur]))
+		printf("Warning: cannot save the chunk size profile %s\n",
+		       profile_path());
+	else
+		printf("Saved %s chunk size %zu to %s\n", t->key, t->chunk,
+		       profile_path());
+}
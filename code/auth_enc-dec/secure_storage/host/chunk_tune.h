@@ -0,0 +1,77 @@
+/*
+ * Chunk size per TA call, chosen per operation and I/O path.
+ *
+ * A transfer is cut into segments, each run with one chunk size. While
+ * probing, the first segments try every candidate for CHUNK_TUNE_PROBE
+ * bytes, in CHUNK_TUNE_ROUNDS alternating passes so drift in the file
+ * cache or clock does not favour one end; the rest of the transfer then
+ * uses the fastest and the choice is saved to the profile.
+ *
+ * HOST_CHUNK picks the mode:
+ *   unset, auto  the profile's size; without one, probe during the first
+ *                transfer of at least chunk_tune_min_size() bytes
+ *   calibrate    always probe, and update the profile
+ *   <bytes>      that size, no profile
+ * HOST_CHUNK_PROFILE names the profile (default CHUNK_TUNE_PROFILE).
+ */
+#ifndef CHUNK_TUNE_H
+#define CHUNK_TUNE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CHUNK_TUNE_PROFILE "/data/optee_chunk_profile"
+#define CHUNK_TUNE_MIN (4 * 1024)
+#define CHUNK_TUNE_PROBE (1024 * 1024)
+#define CHUNK_TUNE_ROUNDS 2
+#define CHUNK_TUNE_MAX_CANDIDATES 16
+
+struct chunk_tune {
+	char key[64];			/* "<op> <io>" in the profile */
+	uint64_t size;
+	uint64_t done;			/* start of the next segment */
+	size_t chunk;			/* size once probing is over */
+	int probing;
+	int tuned;			/* chunk came from a full probe */
+	size_t cand[CHUNK_TUNE_MAX_CANDIDATES];
+	double mb_s[CHUNK_TUNE_MAX_CANDIDATES];	/* best; <0 unusable */
+	unsigned int ncand;
+	unsigned int step;		/* probe segments handed out */
+	unsigned int cur;		/* candidate of the current segment */
+	size_t cur_len;
+	struct timespec start;
+};
+
+/* Smallest transfer that auto mode probes during */
+uint64_t chunk_tune_min_size(size_t max_chunk);
+
+/*
+ * Sets up a transfer of size bytes. Candidates are the powers of two
+ * from CHUNK_TUNE_MIN to max_chunk; def_chunk is used when there is
+ * neither a profile entry nor enough data to probe.
+ */
+void chunk_tune_begin(struct chunk_tune *t, const char *op, const char *io,
+		      uint64_t size, size_t max_chunk, size_t def_chunk);
+
+/*
+ * Next segment: its offset, length and chunk size. Returns 0 once the
+ * transfer is complete.
+ */
+int chunk_tune_next(struct chunk_tune *t, uint64_t *start, size_t *len,
+		    size_t *chunk);
+
+/* The segment was processed; accounts its throughput while probing */
+void chunk_tune_done(struct chunk_tune *t);
+
+/*
+ * The I/O path cannot use this chunk size and did nothing. While
+ * probing the candidate is dropped and 0 returned, so the segment is
+ * retried with the next one; otherwise -1.
+ */
+int chunk_tune_reject(struct chunk_tune *t);
+
+/* Reports the choice and saves it to the profile if it was probed */
+void chunk_tune_end(struct chunk_tune *t);
+
+#endif /* CHUNK_TUNE_H */
@@ -1,13 +1,17 @@
+#define _GNU_SOURCE
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 
 /* OP-TEE TEE client API */
 #include <tee_client_api.h>
@@ -15,13 +19,44 @@
 /* TA API */
 #include <secure_storage_ta.h>
 
-#define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
+/* Synthetic test data */
+#include <testgen.h>
+
+/* Results store, when BENCHDB is set */
+#include <benchdb.h>
+
+/* Shared memory for the chunk buffers */
+#include <shm_pool.h>
+
+#include "chunk_tune.h"
+#include "uring_io.h"
+
+/* Chunk size without a tuned one, see chunk_tune.h */
+#define CHUNK_SIZE (16 * 1024)
+/*
+ * Host buffers hold the largest chunk the TA takes, plus padding. They
+ * are pool blocks, passed as partial memrefs, so no chunk is copied
+ * through temporary shared memory.
+ */
+#define BUF_SIZE (TA_MAX_CHUNK_SIZE + AES_BLOCK_SIZE)
 #define AES_BLOCK_SIZE 16
+/* Encrypted file: plaintext size, the stream's IV, then the ciphertext */
+#define FILE_HEADER_SIZE (sizeof(uint64_t) + TA_IV_SIZE)
+/* mmap input: each window is registered as shared memory once */
+#define MMAP_WINDOW_SIZE (1024 * 1024)
+/* io_uring pipeline: chunks in flight, and writes queued per submission */
+#define URING_DEPTH 8
+#define URING_WRITE_BATCH 4
+#define URING_SLOT_ALIGN 4096	/* slots hold chunk + padding */
+/* O_DIRECT output: staging buffer and the alignment writes must keep */
+#define DIRECT_STAGE_SIZE (1024 * 1024)
+#define DIRECT_ALIGN 4096
 
 /* TEE resources */
 struct test_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
+	struct shm_pool *pool;	/* plaintext and ciphertext buffers */
 };
 
 /* Timing and CPU utilization info */
@@ -154,6 +189,44 @@ static TEEC_Result verify_pin_tee(struct test_ctx *ctx, const char *pin,
 	return res;
 }
 
+/*
+ * Selects the TA key named by HOST_KEY, creating its slot on first use,
+ * so files outlive the session that encrypted them. The slot answers
+ * only to the PIN it was created under. Without HOST_KEY the TA's
+ * unnamed key is used.
+ */
+static TEEC_Result load_host_key(struct test_ctx *ctx)
+{
+	const char *name = getenv("HOST_KEY");
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	if (!name || !*name)
+		return TEEC_SUCCESS;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_INPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)name;
+	op.params[0].tmpref.size = strlen(name);
+	op.params[1].value.a = TA_KEY_CREATE;
+
+	res = TEEC_InvokeCommand(&ctx->sess, TA_SECURE_STORAGE_CMD_KEY_LOAD,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: Cannot load key %s: 0x%x / %u\n", name, res,
+		       origin);
+		return res;
+	}
+	printf("✓ Using key %s (%s)\n", name,
+	       op.params[2].value.a ? "created" :
+	       op.params[2].value.b ? "cached in TA" : "loaded from storage");
+	return TEEC_SUCCESS;
+}
+
 /* Prompt user to set up PIN */
 static int setup_pin(struct test_ctx *ctx)
 {
@@ -288,10 +361,15 @@ void prepare_tee_session(struct test_ctx *ctx)
 	if (res != TEEC_SUCCESS)
 		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
 			res, origin);
+
+	ctx->pool = shm_pool_create(&ctx->ctx, BUF_SIZE);
+	if (!ctx->pool)
+		errx(1, "Cannot create the shared memory pool");
 }
 
 void terminate_tee_session(struct test_ctx *ctx)
 {
+	shm_pool_destroy(ctx->pool);
 	TEEC_CloseSession(&ctx->sess);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
@@ -330,22 +408,937 @@ size_t unpad_data(uint8_t *data, size_t data_len)
 	return data_len - padding_len;
 }
 
+/*
+ * File I/O path, from HOST_IO. By default encryption tries the io_uring
+ * pipeline, then the mmap input path, then plain read()/write();
+ * decryption has no mmap path. Naming a path skips the ones before it.
+ * The path a transfer settles on is printed. The mmap path only works
+ * with the emulator: the Linux TEE driver pins registered pages for
+ * write, which a read-only file mapping refuses, so on real OP-TEE it
+ * falls back to read().
+ */
+enum host_io {
+	HOST_IO_URING,
+	HOST_IO_MMAP,
+	HOST_IO_READ,
+};
+
+static enum host_io host_io_mode(void)
+{
+	const char *io = getenv("HOST_IO");
+
+	if (io && !strcmp(io, "read"))
+		return HOST_IO_READ;
+	if (io && !strcmp(io, "mmap"))
+		return HOST_IO_MMAP;
+	return HOST_IO_URING;
+}
+
+/*
+ * Encrypted output file. With HOST_OUT=direct the final size is reserved
+ * with fallocate() and the ciphertext bypasses the page cache: it is
+ * staged in an aligned buffer and written with O_DIRECT in
+ * DIRECT_ALIGN multiples, so encrypting a large archive does not evict
+ * the rest of the cache. The unaligned tail is written after O_DIRECT is
+ * cleared. Otherwise writes go straight to the file as before.
+ */
+struct out_file {
+	int fd;
+	int direct;
+	uint8_t *stage;
+	size_t staged;
+	uint64_t offset;	/* file offset of stage[0] */
+};
+
+static int use_direct_output(void)
+{
+	const char *out = getenv("HOST_OUT");
+
+	return out && !strcmp(out, "direct");
+}
+
+static int out_open(struct out_file *out, const char *path,
+		    uint64_t final_size)
+{
+	memset(out, 0, sizeof(*out));
+	out->fd = -1;
+
+	if (use_direct_output()) {
+		out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,
+			       0644);
+		if (out->fd >= 0 &&
+		    posix_memalign((void **)&out->stage, DIRECT_ALIGN,
+				   DIRECT_STAGE_SIZE)) {
+			close(out->fd);
+			out->fd = -1;
+			out->stage = NULL;
+		}
+		/* Filesystems such as tmpfs reject O_DIRECT */
+		if (out->fd >= 0)
+			out->direct = 1;
+		else
+			printf("Warning: O_DIRECT output unavailable, using buffered writes\n");
+	}
+
+	if (out->fd < 0)
+		out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out->fd < 0)
+		return -1;
+
+	/* Allocate the whole file up front; only a hint if unsupported */
+	if (out->direct && final_size)
+		fallocate(out->fd, 0, 0, final_size);
+	return 0;
+}
+
+static int out_flush(struct out_file *out, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t n = pwrite(out->fd, out->stage + done, len - done,
+				   out->offset + done);
+
+		if (n <= 0)
+			return -1;
+		done += n;
+	}
+	memmove(out->stage, out->stage + len, out->staged - len);
+	out->staged -= len;
+	out->offset += len;
+	return 0;
+}
+
+static int out_write(struct out_file *out, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	if (!out->direct)
+		return write(out->fd, buf, len) == (ssize_t)len ? 0 : -1;
+
+	while (len) {
+		size_t n = DIRECT_STAGE_SIZE - out->staged;
+
+		if (n > len)
+			n = len;
+		memcpy(out->stage + out->staged, p, n);
+		out->staged += n;
+		p += n;
+		len -= n;
+		if (out->staged == DIRECT_STAGE_SIZE &&
+		    out_flush(out, DIRECT_STAGE_SIZE))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Overwrites len bytes written earlier at offset at. A direct file only
+ * takes this while they are still staged, as the header is until the
+ * first chunk has been written behind it.
+ */
+static int out_patch(struct out_file *out, uint64_t at, const void *buf,
+		     size_t len)
+{
+	if (!out->direct)
+		return pwrite(out->fd, buf, len, at) == (ssize_t)len ? 0 : -1;
+	if (at < out->offset || at + len > out->offset + out->staged)
+		return -1;
+	memcpy(out->stage + (at - out->offset), buf, len);
+	return 0;
+}
+
+/*
+ * Writes the staged tail and closes the file. Returns -1 if any of the
+ * data could not be written.
+ */
+static int out_close(struct out_file *out)
+{
+	int ret = 0;
+	int flags;
+
+	if (out->direct && out->staged) {
+		/* Aligned part still goes direct, the rest through the cache */
+		if (out_flush(out, out->staged & ~(size_t)(DIRECT_ALIGN - 1)))
+			ret = -1;
+		flags = fcntl(out->fd, F_GETFL);
+		if (!ret && (flags < 0 ||
+			     fcntl(out->fd, F_SETFL, flags & ~O_DIRECT) ||
+			     out_flush(out, out->staged)))
+			ret = -1;
+	}
+	/* Drop any preallocation beyond what was actually written */
+	if (out->direct && !ret && ftruncate(out->fd, out->offset))
+		ret = -1;
+
+	if (close(out->fd))
+		ret = -1;
+	free(out->stage);
+	out->fd = -1;
+	out->stage = NULL;
+	return ret;
+}
+
+/*
+ * Encrypts one chunk, whose plaintext the caller has put in op->params[0]
+ * as a partial memref, and appends the ciphertext to out. The first chunk
+ * of a stream also puts the IV the TA drew for it into the file header;
+ * those 16 bytes, once a stream, go as a temporary memref.
+ */
+static TEEC_Result encrypt_chunk(struct test_ctx *ctx, TEEC_Operation *op,
+				 const struct shm_buf *cipher,
+				 struct out_file *out, int is_first, size_t offset)
+{
+	uint8_t iv[TA_IV_SIZE];
+	uint32_t origin;
+	TEEC_Result res;
+	size_t encrypted_size;
+
+	op->paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					  TEEC_MEMREF_PARTIAL_OUTPUT,
+					  TEEC_MEMREF_TEMP_OUTPUT,
+					  TEEC_VALUE_OUTPUT);
+	shm_pool_param(&op->params[1], cipher, 0, BUF_SIZE);
+	op->params[2].tmpref.buffer = is_first ? iv : NULL;
+	op->params[2].tmpref.size = is_first ? sizeof(iv) : 0;
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK,
+				 op, &origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: Encryption failed at offset %zu: 0x%x / %u\n",
+		       offset, res, origin);
+		return res;
+	}
+
+	if (is_first && out_patch(out, sizeof(uint64_t), iv, sizeof(iv))) {
+		printf("Error: Cannot write header\n");
+		return TEEC_ERROR_GENERIC;
+	}
+
+	/* Write encrypted data */
+	encrypted_size = op->params[1].memref.size;
+	if (out_write(out, cipher->buffer, encrypted_size)) {
+		printf("Error: Write failed\n");
+		return TEEC_ERROR_GENERIC;
+	}
+	return TEEC_SUCCESS;
+}
+
+static void print_encrypt_progress(size_t total_encrypted, size_t file_size,
+				   size_t last_chunk, size_t chunk)
+{
+	if (total_encrypted % (256 * 1024) == 0 || last_chunk < chunk) {
+		printf("  Progress: %zu/%zu bytes (%.1f%%)\n",
+		       total_encrypted, file_size,
+		       (total_encrypted * 100.0) / file_size);
+	}
+}
+
+/*
+ * Encrypts from a read-only mapping of the input. Each window of about
+ * MMAP_WINDOW_SIZE is registered as shared memory once and its chunks are
+ * passed as partial memrefs, skipping the read() copy into plain.
+ * Only a final chunk that needs padding is copied, since padding cannot
+ * be added in place. Encrypts len bytes from start.
+ *
+ * Windows hold whole chunks, rounded up to whole pages, so any chunk size
+ * and page size work; a window then ends with a shorter chunk, which the
+ * stream does not mind. Returns TEEC_ERROR_NOT_SUPPORTED, before anything
+ * was encrypted and saying why, if the range cannot be mapped or
+ * registered. The latter is what the Linux TEE driver does, see
+ * host_io_mode, so this path is emulator only.
+ */
+static TEEC_Result encrypt_mmap(struct test_ctx *ctx, int in_fd,
+				size_t file_size, uint64_t start, size_t len,
+				size_t chunk, const struct shm_buf *plain,
+				const struct shm_buf *cipher,
+				struct out_file *out, size_t *total_encrypted)
+{
+	TEEC_Operation op;
+	TEEC_SharedMemory shm;
+	TEEC_Result res = TEEC_SUCCESS;
+	long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t *map, *data;
+	size_t offset, pos, lead, window_size;
+
+	if (!len)
+		return TEEC_ERROR_NOT_SUPPORTED;
+	if (page_size <= 0) {
+		printf("  mmap input: page size unknown\n");
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+
+	window_size = MMAP_WINDOW_SIZE / chunk * chunk;
+	if (!window_size)
+		window_size = chunk;
+	window_size = (window_size + page_size - 1) / page_size * page_size;
+
+	/* The mapping starts on a page; the segment may start inside one */
+	lead = start % page_size;
+	map = mmap(NULL, lead + len, PROT_READ, MAP_SHARED, in_fd,
+		   start - lead);
+	if (map == MAP_FAILED) {
+		printf("  mmap input: cannot map input: %s\n", strerror(errno));
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+	madvise(map, lead + len, MADV_SEQUENTIAL);
+	data = map + lead;
+
+	for (offset = 0; offset < len; offset += window_size) {
+		size_t window = len - offset;
+
+		if (window > window_size)
+			window = window_size;
+
+		memset(&shm, 0, sizeof(shm));
+		shm.buffer = data + offset;
+		shm.size = window;
+		shm.flags = TEEC_MEM_INPUT;
+		res = TEEC_RegisterSharedMemory(&ctx->ctx, &shm);
+		if (res != TEEC_SUCCESS) {
+			if (!offset) {
+				printf("  mmap input: cannot register mapping: 0x%x\n",
+				       res);
+				res = TEEC_ERROR_NOT_SUPPORTED;
+			} else
+				printf("Error: Cannot register input window: 0x%x\n",
+				       res);
+			break;
+		}
+
+		for (pos = 0; pos < window; pos += chunk) {
+			size_t len = window - pos;
+
+			if (len > chunk)
+				len = chunk;
+
+			memset(&op, 0, sizeof(op));
+			if (len % AES_BLOCK_SIZE) {
+				memcpy(plain->buffer, data + offset + pos, len);
+				shm_pool_param(&op.params[0], plain, 0,
+					       pad_data(plain->buffer, len,
+							BUF_SIZE));
+			} else {
+				op.params[0].memref.parent = &shm;
+				op.params[0].memref.offset = pos;
+				op.params[0].memref.size = len;
+			}
+			res = encrypt_chunk(ctx, &op, cipher, out,
+					    *total_encrypted == 0,
+					    *total_encrypted);
+			if (res != TEEC_SUCCESS)
+				break;
+
+			*total_encrypted += len;
+			print_encrypt_progress(*total_encrypted, file_size,
+					       len, chunk);
+		}
+
+		TEEC_ReleaseSharedMemory(&shm);
+		/*
+		 * Drop encrypted pages so the mapping never pins the file.
+		 * From the page start, so the window's last lead bytes go
+		 * with the next one.
+		 */
+		madvise(map + offset, window, MADV_DONTNEED);
+		if (res != TEEC_SUCCESS)
+			break;
+	}
+
+	munmap(map, lead + len);
+	return res;
+}
+
+/* Encrypts the next len bytes of in_fd */
+static TEEC_Result encrypt_read(struct test_ctx *ctx, int in_fd,
+				size_t file_size, size_t len, size_t chunk,
+				const struct shm_buf *plain,
+				const struct shm_buf *cipher,
+				struct out_file *out, size_t *total_encrypted)
+{
+	TEEC_Operation op;
+	TEEC_Result res;
+	ssize_t bytes_read = 0;
+	size_t done = 0;
+
+	/* Process file in chunks */
+	while (done < len &&
+	       (bytes_read = read(in_fd, plain->buffer, len - done < chunk ?
+				  len - done : chunk)) > 0) {
+		size_t padded_size = bytes_read;
+		
+		/* Pad last chunk if NOT multiple of AES block size */
+		if (bytes_read % AES_BLOCK_SIZE != 0) {
+			padded_size = pad_data(plain->buffer, bytes_read,
+					       BUF_SIZE);
+			if (padded_size == 0) {
+				printf("Error: Padding failed\n");
+				return TEEC_ERROR_GENERIC;
+			}
+		}
+		
+		/* Encrypt chunk via TEE */
+		memset(&op, 0, sizeof(op));
+		shm_pool_param(&op.params[0], plain, 0, padded_size);
+		
+		res = encrypt_chunk(ctx, &op, cipher, out,
+				    *total_encrypted == 0, *total_encrypted);
+		if (res != TEEC_SUCCESS)
+			return res;
+		
+		*total_encrypted += bytes_read;
+		done += bytes_read;
+		print_encrypt_progress(*total_encrypted, file_size,
+				       bytes_read, chunk);
+	}
+
+	if (bytes_read < 0) {
+		printf("Error: Read failed from file\n");
+		return TEEC_ERROR_GENERIC;
+	}
+	return TEEC_SUCCESS;
+}
+
+/*
+ * io_uring pipeline shared by encryption and decryption. Up to URING_DEPTH
+ * input chunks are read ahead into slots of one TEEC shared memory block,
+ * which is also registered with the ring as fixed buffers, so the kernel
+ * reads straight into memory the TEE sees and results are written from
+ * it. Chunks go to the TA strictly in order; completed outputs are
+ * written behind in batches of URING_WRITE_BATCH, so disk latency
+ * overlaps with TEE time instead of adding to it.
+ */
+struct uring_job {
+	uint32_t cmd;			/* ENCRYPT_CHUNK or DECRYPT_CHUNK */
+	size_t chunk;			/* bytes per TA call */
+	int resume;			/* continues the TA's stream, no IV */
+	int in_fd;
+	uint64_t in_offset;
+	size_t in_size;
+	int out_fd;
+	uint64_t out_offset;
+	size_t out_limit;		/* output bytes to keep */
+	int pad_last;			/* PKCS#7 pad a partial final block */
+	uint8_t *iv;			/* stream IV, from or to the first chunk */
+	size_t total_in;
+	size_t total_out;
+};
+
+struct uring_pipeline {
+	struct uring_io ring;
+	TEEC_SharedMemory shm;
+	size_t slot_size;
+	size_t in_len[URING_DEPTH];	/* bytes read, once complete */
+	int in_ready[URING_DEPTH];
+	enum { OUT_FREE, OUT_WAITING, OUT_WRITING } out_state[URING_DEPTH];
+	size_t out_len[URING_DEPTH];
+	uint64_t out_at[URING_DEPTH];
+	unsigned int writes_waiting;	/* outputs held back for a batch */
+	unsigned int inflight;
+	int error;
+};
+
+#define URING_WRITE_TAG 0x100
+
+static uint8_t *in_slot(struct uring_pipeline *pl, unsigned int slot)
+{
+	return (uint8_t *)pl->shm.buffer + slot * pl->slot_size;
+}
+
+static int uring_queue(struct uring_pipeline *pl, uint8_t opcode, int fd,
+		       unsigned int buf, size_t len, uint64_t offset,
+		       uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = uring_io_get_sqe(&pl->ring);
+
+	if (!sqe)
+		return -1;
+	uring_io_prep_rw(sqe, opcode, fd, in_slot(pl, buf), len, offset, buf,
+			 user_data);
+	pl->inflight++;
+	return 0;
+}
+
+static void uring_queue_read(struct uring_pipeline *pl, struct uring_job *job,
+			     size_t chunk)
+{
+	unsigned int slot = chunk % URING_DEPTH;
+	size_t len = job->in_size - chunk * job->chunk;
+
+	if (len > job->chunk)
+		len = job->chunk;
+	pl->in_ready[slot] = 0;
+	if (uring_queue(pl, IORING_OP_READ_FIXED, job->in_fd, slot, len,
+			job->in_offset + chunk * job->chunk, slot))
+		pl->error = 1;
+}
+
+/* Queues the waiting outputs as one batch of writes */
+static void uring_flush_writes(struct uring_pipeline *pl, int out_fd)
+{
+	for (unsigned int slot = 0; slot < URING_DEPTH; slot++) {
+		if (pl->out_state[slot] != OUT_WAITING)
+			continue;
+		if (uring_queue(pl, IORING_OP_WRITE_FIXED, out_fd,
+				URING_DEPTH + slot, pl->out_len[slot],
+				pl->out_at[slot], URING_WRITE_TAG | slot))
+			pl->error = 1;
+		pl->out_state[slot] = OUT_WRITING;
+	}
+	pl->writes_waiting = 0;
+}
+
+/* Waits for one completion and updates the slot it belongs to */
+static void uring_reap(struct uring_pipeline *pl)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int slot;
+
+	if (uring_io_wait_cqe(&pl->ring, &cqe) < 0) {
+		printf("Error: io_uring wait failed\n");
+		pl->error = 1;
+		pl->inflight = 0;
+		return;
+	}
+	slot = cqe->user_data & (URING_WRITE_TAG - 1);
+	pl->inflight--;
+
+	if (cqe->user_data & URING_WRITE_TAG) {
+		if (cqe->res != (int)pl->out_len[slot]) {
+			printf("Error: Write failed\n");
+			pl->error = 1;
+		}
+		pl->out_state[slot] = OUT_FREE;
+	} else if (cqe->res < 0) {
+		printf("Error: Read failed from file\n");
+		pl->error = 1;
+	} else {
+		pl->in_len[slot] = cqe->res;
+		pl->in_ready[slot] = 1;
+	}
+	uring_io_cqe_seen(&pl->ring);
+}
+
+static TEEC_Result uring_process_chunk(struct test_ctx *ctx,
+				       struct uring_pipeline *pl,
+				       struct uring_job *job, size_t chunk,
+				       size_t len)
+{
+	unsigned int slot = chunk % URING_DEPTH;
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	size_t in_len = len, out_len;
+
+	if (job->pad_last && len % AES_BLOCK_SIZE) {
+		in_len = pad_data(in_slot(pl, slot), len, pl->slot_size);
+		if (!in_len) {
+			printf("Error: Padding failed\n");
+			return TEEC_ERROR_GENERIC;
+		}
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 job->cmd == TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK ?
+					 TEEC_MEMREF_TEMP_OUTPUT :
+					 TEEC_MEMREF_TEMP_INPUT,
+					 TEEC_VALUE_OUTPUT);
+	op.params[0].memref.parent = &pl->shm;
+	op.params[0].memref.offset = slot * pl->slot_size;
+	op.params[0].memref.size = in_len;
+	op.params[1].memref.parent = &pl->shm;
+	op.params[1].memref.offset = (URING_DEPTH + slot) * pl->slot_size;
+	op.params[1].memref.size = pl->slot_size;
+	if (chunk == 0 && !job->resume) {
+		op.params[2].tmpref.buffer = job->iv;
+		op.params[2].tmpref.size = TA_IV_SIZE;
+	}
+
+	res = TEEC_InvokeCommand(&ctx->sess, job->cmd, &op, &origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: %s failed at offset %zu: 0x%x / %u\n",
+		       job->cmd == TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK ?
+		       "Encryption" : "Decryption", job->total_in, res, origin);
+		return res;
+	}
+
+	out_len = op.params[1].memref.size;
+	if (out_len > job->out_limit - job->total_out)
+		out_len = job->out_limit - job->total_out;
+	if (out_len) {
+		pl->out_len[slot] = out_len;
+		pl->out_at[slot] = job->out_offset;
+		pl->out_state[slot] = OUT_WAITING;
+		pl->writes_waiting++;
+	}
+	job->out_offset += out_len;
+	job->total_out += out_len;
+	job->total_in += len;
+	return TEEC_SUCCESS;
+}
+
+/*
+ * Runs a job through the pipeline. Returns TEEC_ERROR_NOT_SUPPORTED,
+ * before touching either file, when io_uring or the shared memory is
+ * unavailable, so the caller can fall back to blocking I/O.
+ */
+static TEEC_Result uring_run_job(struct test_ctx *ctx, struct uring_job *job)
+{
+	struct uring_pipeline pl;
+	struct iovec iov[2 * URING_DEPTH];
+	size_t nchunks = (job->in_size + job->chunk - 1) / job->chunk;
+	size_t next_read, chunk;
+	TEEC_Result res = TEEC_SUCCESS;
+
+	memset(&pl, 0, sizeof(pl));
+	if (!nchunks || uring_io_init(&pl.ring, 2 * URING_DEPTH) < 0)
+		return TEEC_ERROR_NOT_SUPPORTED;
+
+	pl.slot_size = (job->chunk + AES_BLOCK_SIZE + URING_SLOT_ALIGN - 1) &
+		       ~(size_t)(URING_SLOT_ALIGN - 1);
+	pl.shm.size = 2 * URING_DEPTH * pl.slot_size;
+	pl.shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	if (TEEC_AllocateSharedMemory(&ctx->ctx, &pl.shm) != TEEC_SUCCESS) {
+		uring_io_exit(&pl.ring);
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+	for (unsigned int i = 0; i < 2 * URING_DEPTH; i++) {
+		iov[i].iov_base = in_slot(&pl, i);
+		iov[i].iov_len = pl.slot_size;
+	}
+	if (uring_io_register_buffers(&pl.ring, iov, 2 * URING_DEPTH) < 0) {
+		TEEC_ReleaseSharedMemory(&pl.shm);
+		uring_io_exit(&pl.ring);
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+
+	for (next_read = 0; next_read < nchunks && next_read < URING_DEPTH;
+	     next_read++)
+		uring_queue_read(&pl, job, next_read);
+	uring_io_submit(&pl.ring, 0);
+
+	for (chunk = 0; chunk < nchunks && !pl.error; chunk++) {
+		unsigned int slot = chunk % URING_DEPTH;
+		size_t want = job->in_size - chunk * job->chunk;
+
+		if (want > job->chunk)
+			want = job->chunk;
+
+		/* The output slot may still be waiting for its batch */
+		if (pl.out_state[slot] == OUT_WAITING)
+			uring_flush_writes(&pl, job->out_fd);
+		while (!pl.error &&
+		       (!pl.in_ready[slot] || pl.out_state[slot] != OUT_FREE))
+			uring_reap(&pl);
+		if (pl.error)
+			break;
+
+		/* Regular files read short only at EOF; finish with pread */
+		while (pl.in_len[slot] < want) {
+			ssize_t n = pread(job->in_fd,
+					  in_slot(&pl, slot) + pl.in_len[slot],
+					  want - pl.in_len[slot],
+					  job->in_offset + chunk * job->chunk +
+					  pl.in_len[slot]);
+
+			if (n <= 0)
+				break;
+			pl.in_len[slot] += n;
+		}
+
+		res = uring_process_chunk(ctx, &pl, job, chunk,
+					  pl.in_len[slot]);
+		if (res != TEEC_SUCCESS)
+			break;
+
+		if (job->total_in % (256 * 1024) == 0 || chunk + 1 == nchunks)
+			printf("  Progress: %zu/%zu bytes (%.1f%%)\n",
+			       job->total_in, job->in_size,
+			       (job->total_in * 100.0) / job->in_size);
+
+		if (job->total_out >= job->out_limit)
+			break;
+
+		/* The input slot is free again: read ahead into it */
+		if (next_read < nchunks)
+			uring_queue_read(&pl, job, next_read++);
+		if (pl.writes_waiting >= URING_WRITE_BATCH)
+			uring_flush_writes(&pl, job->out_fd);
+		uring_io_submit(&pl.ring, 0);
+	}
+
+	/* Write what is left and wait for everything the kernel still owns */
+	uring_flush_writes(&pl, job->out_fd);
+	uring_io_submit(&pl.ring, 0);
+	while (pl.inflight)
+		uring_reap(&pl);
+
+	TEEC_ReleaseSharedMemory(&pl.shm);
+	uring_io_exit(&pl.ring);
+	if (res == TEEC_SUCCESS && pl.error)
+		res = TEEC_ERROR_GENERIC;
+	return res;
+}
+
+/*
+ * Decrypts the next len bytes of in_fd. The IV goes to the first chunk
+ * only, as a temporary memref.
+ */
+static TEEC_Result decrypt_read(struct test_ctx *ctx, int in_fd,
+				size_t original_size, size_t len, size_t chunk,
+				uint8_t *iv, const struct shm_buf *cipher,
+				const struct shm_buf *plain, int out_fd,
+				size_t *total_written)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	ssize_t bytes_read = 0;
+	size_t total_decrypted = 0;
+	int is_first = *total_written == 0;
+
+	/* Process file in chunks */
+	while (total_decrypted < len &&
+	       (bytes_read = read(in_fd, cipher->buffer,
+				  len - total_decrypted < chunk ?
+				  len - total_decrypted : chunk)) > 0) {
+		/* Decrypt chunk via TEE */
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+						 TEEC_MEMREF_PARTIAL_OUTPUT,
+						 TEEC_MEMREF_TEMP_INPUT,
+						 TEEC_VALUE_OUTPUT);
+		
+		shm_pool_param(&op.params[0], cipher, 0, bytes_read);
+		shm_pool_param(&op.params[1], plain, 0, BUF_SIZE);
+		if (is_first) {
+			op.params[2].tmpref.buffer = iv;
+			op.params[2].tmpref.size = TA_IV_SIZE;
+		}
+		
+		res = TEEC_InvokeCommand(&ctx->sess,
+					 TA_SECURE_STORAGE_CMD_DECRYPT_CHUNK,
+					 &op, &origin);
+		if (res != TEEC_SUCCESS) {
+			printf("Error: Decryption failed at offset %zu: 0x%x / %u\n",
+			       total_decrypted, res, origin);
+			return res;
+		}
+		
+		size_t decrypted_size = op.params[1].memref.size;
+		
+		/* Write only up to original file size */
+		size_t to_write = decrypted_size;
+		if (*total_written + to_write > original_size) {
+			to_write = original_size - *total_written;
+		}
+		
+		if (write(out_fd, plain->buffer, to_write) != to_write) {
+			printf("Error: Write failed\n");
+			return TEEC_ERROR_GENERIC;
+		}
+		
+		total_decrypted += decrypted_size;
+		*total_written += to_write;
+		is_first = 0;
+		
+		/* Stop if we've written all original data */
+		if (*total_written >= original_size) {
+			break;
+		}
+		
+		/* Progress indicator */
+		if (*total_written % (256 * 1024) < to_write || *total_written >= original_size) {
+			printf("  Progress: %zu/%zu bytes (%.1f%%)\n", 
+			       *total_written, original_size,
+			       (*total_written * 100.0) / original_size);
+		}
+	}
+
+	if (bytes_read < 0) {
+		printf("Error: Read failed from file\n");
+		return TEEC_ERROR_GENERIC;
+	}
+	return TEEC_SUCCESS;
+}
+
+/*
+ * A transfer runs as segments of one chunk size each, see chunk_tune.h.
+ * The first segment falls back from io_uring to mmap to read() as
+ * before; later ones stay on the path it took, so file offsets carry on.
+ */
+struct transfer {
+	struct test_ctx *ctx;
+	int in_fd;
+	int out_fd;
+	size_t size;			/* plaintext bytes */
+	struct shm_buf plain;		/* pool blocks of BUF_SIZE */
+	struct shm_buf cipher;
+	struct out_file *out;		/* encryption output */
+	size_t total;			/* bytes encrypted or written */
+	uint8_t *iv;			/* decryption: the stream's IV */
+	int pinned;
+	enum host_io io;		/* path asked for, then the one taken */
+	const char *skipped;		/* why it was passed over, if known */
+};
+
+static const char *host_io_name(enum host_io io)
+{
+	switch (io) {
+	case HOST_IO_URING:
+		return "uring";
+	case HOST_IO_MMAP:
+		return "mmap";
+	default:
+		return "read";
+	}
+}
+
+/* Keeps to the path that first handled a segment, and reports it */
+static TEEC_Result transfer_pin(struct transfer *x, enum host_io io,
+				TEEC_Result res)
+{
+	if (!x->pinned && res != TEEC_ERROR_NOT_SUPPORTED) {
+		if (io != x->io)
+			printf("  I/O path: %s (%s %s)\n", host_io_name(io),
+			       host_io_name(x->io),
+			       x->skipped ? x->skipped : "unavailable");
+		else
+			printf("  I/O path: %s\n", host_io_name(io));
+		x->pinned = 1;
+		x->io = io;
+	}
+	return res;
+}
+
+static TEEC_Result encrypt_segment(struct transfer *x, uint64_t start,
+				   size_t len, size_t chunk)
+{
+	enum host_io io = x->io;
+	uint8_t iv[TA_IV_SIZE];
+	TEEC_Result res;
+
+	/* The uring write-behind cannot stage through an O_DIRECT file */
+	if (io == HOST_IO_URING && x->out->direct) {
+		x->skipped = "skipped: O_DIRECT output is not supported "
+			     "on the uring path";
+	} else if (io == HOST_IO_URING) {
+		struct uring_job job = {
+			.cmd = TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK,
+			.chunk = chunk,
+			.resume = start != 0,
+			.in_fd = x->in_fd,
+			.in_offset = start,
+			.in_size = len,
+			.out_fd = x->out->fd,
+			.out_offset = FILE_HEADER_SIZE + start,
+			.out_limit = SIZE_MAX,
+			.pad_last = start + len == x->size,
+			.iv = iv,
+		};
+
+		res = uring_run_job(x->ctx, &job);
+		x->total += job.total_in;
+		/* Never direct here, so the header can be patched any time */
+		if (!job.resume && job.total_in &&
+		    out_patch(x->out, sizeof(uint64_t), iv, sizeof(iv))) {
+			printf("Error: Cannot write header\n");
+			res = TEEC_ERROR_GENERIC;
+		}
+		if (res != TEEC_ERROR_NOT_SUPPORTED || x->pinned)
+			return transfer_pin(x, HOST_IO_URING, res);
+	}
+	if (io != HOST_IO_READ) {
+		res = encrypt_mmap(x->ctx, x->in_fd, x->size, start, len, chunk,
+				   &x->plain, &x->cipher, x->out, &x->total);
+		if (res != TEEC_ERROR_NOT_SUPPORTED || x->pinned)
+			return transfer_pin(x, HOST_IO_MMAP, res);
+	}
+	res = encrypt_read(x->ctx, x->in_fd, x->size, len, chunk,
+			   &x->plain, &x->cipher, x->out, &x->total);
+	return transfer_pin(x, HOST_IO_READ, res);
+}
+
+/* start and len are in ciphertext, after the header */
+static TEEC_Result decrypt_segment(struct transfer *x, uint64_t start,
+				   size_t len, size_t chunk)
+{
+	enum host_io io = x->io;
+	TEEC_Result res;
+
+	if (io == HOST_IO_URING) {
+		struct uring_job job = {
+			.cmd = TA_SECURE_STORAGE_CMD_DECRYPT_CHUNK,
+			.chunk = chunk,
+			.resume = start != 0,
+			.in_fd = x->in_fd,
+			.in_offset = FILE_HEADER_SIZE + start,
+			.in_size = len,
+			.out_fd = x->out_fd,
+			.out_offset = start,
+			.out_limit = start < x->size ? x->size - start : 0,
+			.iv = x->iv,
+		};
+
+		res = uring_run_job(x->ctx, &job);
+		x->total += job.total_out;
+		if (res != TEEC_ERROR_NOT_SUPPORTED || x->pinned)
+			return transfer_pin(x, HOST_IO_URING, res);
+	}
+	res = decrypt_read(x->ctx, x->in_fd, x->size, len, chunk, x->iv,
+			   &x->cipher, &x->plain, x->out_fd, &x->total);
+	return transfer_pin(x, HOST_IO_READ, res);
+}
+
+/*
+ * Runs a whole transfer, letting the tuner choose the chunk size of
+ * each segment. A probe size the pinned path cannot take is retried
+ * with the next candidate.
+ */
+static TEEC_Result run_transfer(struct transfer *x, const char *op,
+				const char *io, uint64_t size,
+				TEEC_Result (*segment)(struct transfer *,
+						       uint64_t, size_t,
+						       size_t))
+{
+	struct chunk_tune tune;
+	TEEC_Result res = TEEC_SUCCESS;
+	uint64_t start;
+	size_t len, chunk;
+
+	chunk_tune_begin(&tune, op, io, size, TA_MAX_CHUNK_SIZE, CHUNK_SIZE);
+	while (chunk_tune_next(&tune, &start, &len, &chunk)) {
+		res = segment(x, start, len, chunk);
+		if (res == TEEC_ERROR_NOT_SUPPORTED &&
+		    !chunk_tune_reject(&tune))
+			continue;
+		if (res != TEEC_SUCCESS)
+			return res;
+		chunk_tune_done(&tune);
+	}
+	chunk_tune_end(&tune);
+	return TEEC_SUCCESS;
+}
+
 /* Encrypt file in normal world */
 TEEC_Result encrypt_file(struct test_ctx *ctx, const char *input_file,
                          const char *output_file, struct perf_info *perf)
 {
-	TEEC_Operation op;
-	uint32_t origin;
 	TEEC_Result res;
-	int in_fd, out_fd;
-	uint8_t *plain_buf, *cipher_buf;
-	ssize_t bytes_read;
+	int in_fd;
+	struct out_file out;
+	struct shm_buf plain, cipher;
 	size_t total_encrypted = 0;
-	int is_first = 1;
 	struct stat st;
 	struct cpu_snapshot cpu_start, cpu_end;
 	struct timeval wall_start, wall_end;
 	uint64_t original_size;
+	uint8_t iv[TA_IV_SIZE];
+	struct transfer xfer;
+	char io[16];
 	
 	if (stat(input_file, &st) != 0) {
 		printf("Error: Cannot stat file %s\n", input_file);
@@ -360,40 +1353,50 @@ TEEC_Result encrypt_file(struct test_ctx *ctx, const char *input_file,
 	       input_file, st.st_size, st.st_size / (1024.0 * 1024.0));
 	
 	/* Allocate buffers */
-	plain_buf = malloc(CHUNK_SIZE + AES_BLOCK_SIZE);
-	cipher_buf = malloc(CHUNK_SIZE + AES_BLOCK_SIZE);
-	if (!plain_buf || !cipher_buf) {
+	res = shm_pool_get(ctx->pool, BUF_SIZE, &plain);
+	if (res != TEEC_SUCCESS) {
 		printf("Error: Cannot allocate buffers\n");
-		free(plain_buf);
-		free(cipher_buf);
-		return TEEC_ERROR_OUT_OF_MEMORY;
+		return res;
+	}
+	res = shm_pool_get(ctx->pool, BUF_SIZE, &cipher);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: Cannot allocate buffers\n");
+		shm_pool_put(ctx->pool, &plain);
+		return res;
 	}
 	
 	/* Open files */
 	in_fd = open(input_file, O_RDONLY);
 	if (in_fd < 0) {
 		printf("Error: Cannot open input file\n");
-		free(plain_buf);
-		free(cipher_buf);
+		shm_pool_put(ctx->pool, &plain);
+		shm_pool_put(ctx->pool, &cipher);
 		return TEEC_ERROR_ITEM_NOT_FOUND;
 	}
 	
-	out_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (out_fd < 0) {
+	/* Header plus payload padded to whole AES blocks */
+	if (out_open(&out, output_file, FILE_HEADER_SIZE +
+		     ((original_size + AES_BLOCK_SIZE - 1) &
+		      ~(uint64_t)(AES_BLOCK_SIZE - 1)))) {
 		printf("Error: Cannot create output file\n");
 		close(in_fd);
-		free(plain_buf);
-		free(cipher_buf);
+		shm_pool_put(ctx->pool, &plain);
+		shm_pool_put(ctx->pool, &cipher);
 		return TEEC_ERROR_GENERIC;
 	}
 	
-	/* Write original file size as header (8 bytes) */
-	if (write(out_fd, &original_size, sizeof(original_size)) != sizeof(original_size)) {
+	/*
+	 * Header: original file size (8 bytes), then the IV, which the
+	 * first chunk fills in once the TA has drawn it
+	 */
+	memset(iv, 0, sizeof(iv));
+	if (out_write(&out, &original_size, sizeof(original_size)) ||
+	    out_write(&out, iv, sizeof(iv))) {
 		printf("Error: Cannot write header\n");
 		close(in_fd);
-		close(out_fd);
-		free(plain_buf);
-		free(cipher_buf);
+		out_close(&out);
+		shm_pool_put(ctx->pool, &plain);
+		shm_pool_put(ctx->pool, &cipher);
 		return TEEC_ERROR_GENERIC;
 	}
 	
@@ -401,60 +1404,28 @@ TEEC_Result encrypt_file(struct test_ctx *ctx, const char *input_file,
 	gettimeofday(&wall_start, NULL);
 	take_cpu_snapshot(&cpu_start);
 	
-	/* Process file in chunks */
-	while ((bytes_read = read(in_fd, plain_buf, CHUNK_SIZE)) > 0) {
-		size_t padded_size = bytes_read;
-		
-		/* Pad last chunk if NOT multiple of AES block size */
-		if (bytes_read % AES_BLOCK_SIZE != 0) {
-			padded_size = pad_data(plain_buf, bytes_read, 
-			                       CHUNK_SIZE + AES_BLOCK_SIZE);
-			if (padded_size == 0) {
-				printf("Error: Padding failed\n");
-				res = TEEC_ERROR_GENERIC;
-				goto cleanup_enc;
-			}
-		}
-		
-		/* Encrypt chunk via TEE */
-		memset(&op, 0, sizeof(op));
-		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-						 TEEC_MEMREF_TEMP_OUTPUT,
-						 TEEC_VALUE_INPUT,
-						 TEEC_VALUE_OUTPUT);
-		
-		op.params[0].tmpref.buffer = plain_buf;
-		op.params[0].tmpref.size = padded_size;
-		op.params[1].tmpref.buffer = cipher_buf;
-		op.params[1].tmpref.size = CHUNK_SIZE + AES_BLOCK_SIZE;
-		op.params[2].value.a = is_first;
-		
-		res = TEEC_InvokeCommand(&ctx->sess,
-					 TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK,
-					 &op, &origin);
-		if (res != TEEC_SUCCESS) {
-			printf("Error: Encryption failed at offset %zu: 0x%x / %u\n",
-			       total_encrypted, res, origin);
-			goto cleanup_enc;
-		}
-		
-		/* Write encrypted data */
-		size_t encrypted_size = op.params[1].tmpref.size;
-		if (write(out_fd, cipher_buf, encrypted_size) != encrypted_size) {
-			printf("Error: Write failed\n");
-			res = TEEC_ERROR_GENERIC;
-			goto cleanup_enc;
-		}
-		
-		total_encrypted += bytes_read;
-		is_first = 0;
-		
-		/* Progress indicator */
-		if (total_encrypted % (256 * 1024) == 0 || bytes_read < CHUNK_SIZE) {
-			printf("  Progress: %zu/%zu bytes (%.1f%%)\n",
-			       total_encrypted, st.st_size,
-			       (total_encrypted * 100.0) / st.st_size);
-		}
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.ctx = ctx;
+	xfer.in_fd = in_fd;
+	xfer.size = st.st_size;
+	xfer.plain = plain;
+	xfer.cipher = cipher;
+	xfer.out = &out;
+	xfer.io = host_io_mode();
+
+	/* Direct output is tuned apart: it never takes the uring path */
+	snprintf(io, sizeof(io), "%s%s", host_io_name(host_io_mode()),
+		 out.direct ? "+direct" : "");
+	res = run_transfer(&xfer, "encrypt", io, st.st_size,
+			   encrypt_segment);
+	total_encrypted = xfer.total;
+	if (res != TEEC_SUCCESS)
+		goto cleanup_enc;
+
+	if (out_close(&out)) {
+		printf("Error: Write failed\n");
+		res = TEEC_ERROR_GENERIC;
+		goto cleanup_enc;
 	}
 	
 	/* End timing */
@@ -471,9 +1442,10 @@ TEEC_Result encrypt_file(struct test_ctx *ctx, const char *input_file,
 
 cleanup_enc:
 	close(in_fd);
-	close(out_fd);
-	free(plain_buf);
-	free(cipher_buf);
+	if (out.fd >= 0)
+		out_close(&out);
+	shm_pool_put(ctx->pool, &plain);
+	shm_pool_put(ctx->pool, &cipher);
 	return res;
 }
 
@@ -481,19 +1453,16 @@ cleanup_enc:
 TEEC_Result decrypt_file(struct test_ctx *ctx, const char *input_file,
                          const char *output_file, struct perf_info *perf)
 {
-	TEEC_Operation op;
-	uint32_t origin;
 	TEEC_Result res;
 	int in_fd, out_fd;
-	uint8_t *cipher_buf, *plain_buf;
-	ssize_t bytes_read;
-	size_t total_decrypted = 0;
+	struct shm_buf cipher, plain;
 	size_t total_written = 0;
-	int is_first = 1;
 	struct stat st;
 	struct cpu_snapshot cpu_start, cpu_end;
 	struct timeval wall_start, wall_end;
 	uint64_t original_size;
+	uint8_t iv[TA_IV_SIZE];
+	struct transfer xfer;
 	
 	if (stat(input_file, &st) != 0) {
 		printf("Error: Cannot stat file %s\n", input_file);
@@ -504,21 +1473,24 @@ TEEC_Result decrypt_file(struct test_ctx *ctx, const char *input_file,
 	printf("Input file: %s (%zu bytes)\n", input_file, st.st_size);
 	
 	/* Allocate buffers */
-	cipher_buf = malloc(CHUNK_SIZE + AES_BLOCK_SIZE);
-	plain_buf = malloc(CHUNK_SIZE + AES_BLOCK_SIZE);
-	if (!cipher_buf || !plain_buf) {
+	res = shm_pool_get(ctx->pool, BUF_SIZE, &cipher);
+	if (res != TEEC_SUCCESS) {
 		printf("Error: Cannot allocate buffers\n");
-		free(cipher_buf);
-		free(plain_buf);
-		return TEEC_ERROR_OUT_OF_MEMORY;
+		return res;
+	}
+	res = shm_pool_get(ctx->pool, BUF_SIZE, &plain);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: Cannot allocate buffers\n");
+		shm_pool_put(ctx->pool, &cipher);
+		return res;
 	}
 	
 	/* Open files */
 	in_fd = open(input_file, O_RDONLY);
 	if (in_fd < 0) {
 		printf("Error: Cannot open input file\n");
-		free(cipher_buf);
-		free(plain_buf);
+		shm_pool_put(ctx->pool, &cipher);
+		shm_pool_put(ctx->pool, &plain);
 		return TEEC_ERROR_ITEM_NOT_FOUND;
 	}
 	
@@ -526,18 +1498,19 @@ TEEC_Result decrypt_file(struct test_ctx *ctx, const char *input_file,
 	if (out_fd < 0) {
 		printf("Error: Cannot create output file\n");
 		close(in_fd);
-		free(cipher_buf);
-		free(plain_buf);
+		shm_pool_put(ctx->pool, &cipher);
+		shm_pool_put(ctx->pool, &plain);
 		return TEEC_ERROR_GENERIC;
 	}
 	
-	/* Read original file size from header */
-	if (read(in_fd, &original_size, sizeof(original_size)) != sizeof(original_size)) {
+	/* Read original file size and the stream's IV from header */
+	if (read(in_fd, &original_size, sizeof(original_size)) != sizeof(original_size) ||
+	    read(in_fd, iv, sizeof(iv)) != sizeof(iv)) {
 		printf("Error: Cannot read header\n");
 		close(in_fd);
 		close(out_fd);
-		free(cipher_buf);
-		free(plain_buf);
+		shm_pool_put(ctx->pool, &cipher);
+		shm_pool_put(ctx->pool, &plain);
 		return TEEC_ERROR_GENERIC;
 	}
 	
@@ -547,60 +1520,23 @@ TEEC_Result decrypt_file(struct test_ctx *ctx, const char *input_file,
 	gettimeofday(&wall_start, NULL);
 	take_cpu_snapshot(&cpu_start);
 	
-	/* Process file in chunks */
-	while ((bytes_read = read(in_fd, cipher_buf, CHUNK_SIZE)) > 0) {
-		/* Decrypt chunk via TEE */
-		memset(&op, 0, sizeof(op));
-		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-						 TEEC_MEMREF_TEMP_OUTPUT,
-						 TEEC_VALUE_INPUT,
-						 TEEC_VALUE_OUTPUT);
-		
-		op.params[0].tmpref.buffer = cipher_buf;
-		op.params[0].tmpref.size = bytes_read;
-		op.params[1].tmpref.buffer = plain_buf;
-		op.params[1].tmpref.size = CHUNK_SIZE + AES_BLOCK_SIZE;
-		op.params[2].value.a = is_first;
-		
-		res = TEEC_InvokeCommand(&ctx->sess,
-					 TA_SECURE_STORAGE_CMD_DECRYPT_CHUNK,
-					 &op, &origin);
-		if (res != TEEC_SUCCESS) {
-			printf("Error: Decryption failed at offset %zu: 0x%x / %u\n",
-			       total_decrypted, res, origin);
-			goto cleanup_dec;
-		}
-		
-		size_t decrypted_size = op.params[1].tmpref.size;
-		
-		/* Write only up to original file size */
-		size_t to_write = decrypted_size;
-		if (total_written + to_write > original_size) {
-			to_write = original_size - total_written;
-		}
-		
-		if (write(out_fd, plain_buf, to_write) != to_write) {
-			printf("Error: Write failed\n");
-			res = TEEC_ERROR_GENERIC;
-			goto cleanup_dec;
-		}
-		
-		total_decrypted += decrypted_size;
-		total_written += to_write;
-		is_first = 0;
-		
-		/* Stop if we've written all original data */
-		if (total_written >= original_size) {
-			break;
-		}
-		
-		/* Progress indicator */
-		if (total_written % (256 * 1024) < to_write || total_written >= original_size) {
-			printf("  Progress: %zu/%zu bytes (%.1f%%)\n", 
-			       total_written, (size_t)original_size,
-			       (total_written * 100.0) / original_size);
-		}
-	}
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.ctx = ctx;
+	xfer.in_fd = in_fd;
+	xfer.out_fd = out_fd;
+	xfer.size = original_size;
+	xfer.plain = plain;
+	xfer.cipher = cipher;
+	xfer.iv = iv;
+	/* Decryption has no mmap path, so mmap mode shares read's profile */
+	xfer.io = host_io_mode() == HOST_IO_URING ? HOST_IO_URING :
+						    HOST_IO_READ;
+	res = run_transfer(&xfer, "decrypt", host_io_name(xfer.io),
+			   st.st_size - FILE_HEADER_SIZE,
+			   decrypt_segment);
+	total_written = xfer.total;
+	if (res != TEEC_SUCCESS)
+		goto cleanup_dec;
 	
 	/* End timing */
 	gettimeofday(&wall_end, NULL);
@@ -617,8 +1553,8 @@ TEEC_Result decrypt_file(struct test_ctx *ctx, const char *input_file,
 cleanup_dec:
 	close(in_fd);
 	close(out_fd);
-	free(cipher_buf);
-	free(plain_buf);
+	shm_pool_put(ctx->pool, &cipher);
+	shm_pool_put(ctx->pool, &plain);
 	return res;
 }
 
@@ -652,48 +1588,19 @@ TEEC_Result get_timing_info(struct test_ctx *ctx, struct perf_info *perf)
 /* Generate test file */
 int generate_test_file(const char *filename, size_t size_mb)
 {
-	int fd;
-	size_t total_written = 0;
-	size_t chunk_size = 256 * 1024; // 256KB chunks
-	uint8_t *buffer;
-	size_t target_size = size_mb * 1024 * 1024;
-	
-	printf("Generating test file: %s (%zu MB)...\n", 
-	       filename, size_mb);
-	
-	buffer = malloc(chunk_size);
-	if (!buffer) {
-		printf("Error: Cannot allocate buffer\n");
-		return -1;
-	}
-	
-	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd < 0) {
-		printf("Error: Cannot create file\n");
-		free(buffer);
+	struct testgen_params params;
+
+	printf("Generating test file: %s (%zu MB)...\n", filename, size_mb);
+
+	/* TESTGEN_PROFILE / TESTGEN_SEED select the data, see testgen.h */
+	testgen_params_from_env(&params);
+	params.size = (uint64_t)size_mb * 1024 * 1024;
+	if (testgen_write_file(filename, &params) != 0) {
+		printf("Error: Cannot create test file %s\n", filename);
 		return -1;
 	}
-	
-	/* Fill with pseudo-random pattern */
-	for (size_t i = 0; i < chunk_size; i++)
-		buffer[i] = (uint8_t)(i ^ (i >> 8));
-	
-	while (total_written < target_size) {
-		size_t to_write = (target_size - total_written > chunk_size) ?
-				   chunk_size : (target_size - total_written);
-		
-		if (write(fd, buffer, to_write) != to_write) {
-			printf("Error: Write failed\n");
-			close(fd);
-			free(buffer);
-			return -1;
-		}
-		total_written += to_write;
-	}
-	
-	close(fd);
-	free(buffer);
-	printf("✓ Test file created: %zu bytes\n", total_written);
+
+	printf("✓ Test file created: %zu bytes\n", (size_t)params.size);
 	return 0;
 }
 
@@ -732,6 +1639,36 @@ void print_performance_summary(struct perf_info *perf)
 	printf("=======================================================\n");
 }
 
+/* Appends this run to the BENCHDB results file, if there is one */
+static void record_run(struct perf_info *perf, int use_generated)
+{
+	struct benchdb_run *run = benchdb_begin("auth_enc-dec");
+	const char *io = getenv("HOST_IO");
+	const char *out = getenv("HOST_OUT");
+	const char *profile = getenv("TESTGEN_PROFILE");
+	double mb = perf->file_size / (1024.0 * 1024.0);
+
+	benchdb_config(run, "file_size", "%zu", perf->file_size);
+	benchdb_config(run, "data", "%s", !use_generated ? "file" :
+			profile ? profile : "random");
+	benchdb_config(run, "io", "%s", io ? io : "uring");
+	benchdb_config(run, "out", "%s", out ? out : "buffered");
+
+	benchdb_sample(run, "enc_mb_s", "MB/s", BENCHDB_HIGHER,
+		       mb / perf->host_enc_time_sec);
+	benchdb_sample(run, "dec_mb_s", "MB/s", BENCHDB_HIGHER,
+		       mb / perf->host_dec_time_sec);
+	benchdb_sample(run, "enc_tee_ms", "ms", BENCHDB_LOWER,
+		       perf->encryption_time_ms);
+	benchdb_sample(run, "dec_tee_ms", "ms", BENCHDB_LOWER,
+		       perf->decryption_time_ms);
+	benchdb_sample(run, "enc_cpu_pct", "%", BENCHDB_LOWER,
+		       perf->cpu_usage_enc);
+	benchdb_sample(run, "dec_cpu_pct", "%", BENCHDB_LOWER,
+		       perf->cpu_usage_dec);
+	benchdb_commit(run);
+}
+
 int main(int argc, char *argv[])
 {
 	struct test_ctx ctx;
@@ -739,13 +1676,14 @@ int main(int argc, char *argv[])
 	const char *encrypted_file = "/tmp/encrypted.bin";
 	const char *decrypted_file = "/tmp/decrypted.bin";
 	struct perf_info perf = {0};
+	struct timeval session_start, session_end;
 	TEEC_Result res;
 	int use_generated = 0;
 	
 	printf("=======================================================\n");
 	printf("  OP-TEE File Encryption/Decryption with PIN Auth\n");
 	printf("  Keys stored in Secure World\n");
-	printf("  Files processed in Normal World (16KB chunks)\n");
+	printf("  Files processed in Normal World (tuned chunks, see HOST_CHUNK)\n");
 	printf("=======================================================\n\n");
 	
 	/* Check for input file */
@@ -753,18 +1691,30 @@ int main(int argc, char *argv[])
 		input_file = argv[1];
 		printf("Using provided file: %s\n", input_file);
 	} else {
+		const char *mode = getenv("HOST_CHUNK");
+		size_t size_mb = 1;
+
+		/* A calibration run needs enough data to probe every size */
+		if (mode && !strcmp(mode, "calibrate"))
+			size_mb = (chunk_tune_min_size(TA_MAX_CHUNK_SIZE) +
+				   1024 * 1024 - 1) / (1024 * 1024);
 		input_file = "/tmp/test_input.bin";
 		use_generated = 1;
-		printf("Generating 1MB test file...\n");
-		if (generate_test_file(input_file, 1) != 0) {
+		printf("Generating %zuMB test file...\n", size_mb);
+		if (generate_test_file(input_file, size_mb) != 0) {
 			printf("Failed to generate test file\n");
 			return 1;
 		}
 	}
 	
 	printf("\nPreparing TEE session...\n");
+	gettimeofday(&session_start, NULL);
 	prepare_tee_session(&ctx);
-	printf("✓ Session established\n");
+	gettimeofday(&session_end, NULL);
+	/* Includes loading and preparing the TA unless an instance is alive */
+	printf("✓ Session established in %.2f ms\n",
+	       (session_end.tv_sec - session_start.tv_sec) * 1000.0 +
+	       (session_end.tv_usec - session_start.tv_usec) / 1000.0);
 	
 	/* Setup PIN */
 	if (setup_pin(&ctx) != 0) {
@@ -780,6 +1730,11 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 	
+	if (load_host_key(&ctx) != TEEC_SUCCESS) {
+		terminate_tee_session(&ctx);
+		return 1;
+	}
+	
 	/* Test 1: Encrypt file */
 	printf("\n=== TEST 1: Encrypt file ===\n");
 	res = encrypt_file(&ctx, input_file, encrypted_file, &perf);
@@ -821,6 +1776,7 @@ int main(int argc, char *argv[])
 	
 	/* Print performance summary */
 	print_performance_summary(&perf);
+	record_run(&perf, use_generated);
 	
 	printf("\n✓ ALL TESTS PASSED\n");
 
@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring_io.h"
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, NULL, 0);
+}
+
+static void *map_ring(int fd, size_t size, off_t offset)
+{
+	return mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, offset);
+}
+
+int uring_io_init(struct uring_io *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	int err;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -errno;
+
+	ring->entries = p.sq_entries;
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = p.cq_off.cqes +
+			     p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = map_ring(ring->fd, ring->sq_ring_size,
+				 IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		err = -errno;
+		goto err_close;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = map_ring(ring->fd, ring->cq_ring_size,
+					 IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			err = -errno;
+			goto err_unmap_sq;
+		}
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = map_ring(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		err = -errno;
+		goto err_unmap_cq;
+	}
+
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_ring +
+					 p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_ring +
+					  p.sq_off.array);
+	ring->cq_head = (unsigned int *)((char *)ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_ring +
+					 p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring +
+					     p.cq_off.cqes);
+	ring->sqe_tail = *ring->sq_tail;
+	ring->sqe_submitted = ring->sqe_tail;
+	return 0;
+
+err_unmap_cq:
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+err_unmap_sq:
+	munmap(ring->sq_ring, ring->sq_ring_size);
+err_close:
+	close(ring->fd);
+	ring->fd = -1;
+	return err;
+}
+
+void uring_io_exit(struct uring_io *ring)
+{
+	if (ring->fd < 0)
+		return;
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+	ring->fd = -1;
+}
+
+int uring_io_register_buffers(struct uring_io *ring, const struct iovec *iov,
+			      unsigned int count)
+{
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+		    iov, count) < 0)
+		return -errno;
+	return 0;
+}
+
+struct io_uring_sqe *uring_io_get_sqe(struct uring_io *ring)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned int index;
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head >= ring->entries)
+		return NULL;
+
+	index = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	ring->sq_array[index] = index;
+	ring->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void uring_io_prep_rw(struct io_uring_sqe *sqe, uint8_t opcode, int fd,
+		      void *buf, unsigned int len, uint64_t offset,
+		      int buf_index, uint64_t user_data)
+{
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->buf_index = (uint16_t)buf_index;
+	sqe->user_data = user_data;
+}
+
+int uring_io_submit(struct uring_io *ring, unsigned int wait_nr)
+{
+	unsigned int to_submit = ring->sqe_tail - ring->sqe_submitted;
+	int ret;
+
+	/* Publish the new tail after the SQE contents */
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+	ring->sqe_submitted = ring->sqe_tail;
+	if (!to_submit && !wait_nr)
+		return 0;
+
+	do {
+		ret = sys_io_uring_enter(ring->fd, to_submit, wait_nr,
+					 wait_nr ? IORING_ENTER_GETEVENTS : 0);
+	} while (ret < 0 && errno == EINTR);
+	return ret < 0 ? -errno : ret;
+}
+
+static struct io_uring_cqe *peek_cqe(struct uring_io *ring)
+{
+	unsigned int head = *ring->cq_head;
+	unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+int uring_io_wait_cqe(struct uring_io *ring, struct io_uring_cqe **cqe)
+{
+	int ret;
+
+	while (!(*cqe = peek_cqe(ring))) {
+		ret = uring_io_submit(ring, 1);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+void uring_io_cqe_seen(struct uring_io *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
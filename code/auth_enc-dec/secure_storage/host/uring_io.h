@@ -0,0 +1,61 @@
+/*
+ * Minimal io_uring wrapper on the raw system calls, for systems without
+ * liburing. Single-threaded use only.
+ */
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct uring_io {
+	int fd;
+	unsigned int entries;
+
+	/* Submission queue */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int sqe_tail;		/* next SQE to hand out */
+	unsigned int sqe_submitted;	/* published to the kernel */
+
+	/* Completion queue */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+/* Returns 0 or a negative errno, e.g. -ENOSYS on kernels without io_uring */
+int uring_io_init(struct uring_io *ring, unsigned int entries);
+void uring_io_exit(struct uring_io *ring);
+int uring_io_register_buffers(struct uring_io *ring, const struct iovec *iov,
+			      unsigned int count);
+
+/* Next free SQE, zeroed; NULL when the submission queue is full */
+struct io_uring_sqe *uring_io_get_sqe(struct uring_io *ring);
+void uring_io_prep_rw(struct io_uring_sqe *sqe, uint8_t opcode, int fd,
+		      void *buf, unsigned int len, uint64_t offset,
+		      int buf_index, uint64_t user_data);
+
+/*
+ * Submits queued SQEs and waits for at least wait_nr completions. Returns
+ * the number submitted or a negative errno.
+ */
+int uring_io_submit(struct uring_io *ring, unsigned int wait_nr);
+
+/* Oldest unseen completion, waiting for one if none is ready */
+int uring_io_wait_cqe(struct uring_io *ring, struct io_uring_cqe **cqe);
+void uring_io_cqe_seen(struct uring_io *ring);
+
+#endif /* URING_IO_H */
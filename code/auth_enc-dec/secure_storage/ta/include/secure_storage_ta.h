@@ -48,11 +48,26 @@
  */
 #define TA_SECURE_STORAGE_CMD_VERIFY_PIN       1
 
+/*
+ * Largest chunk ENCRYPT_CHUNK and DECRYPT_CHUNK accept. The TA works on
+ * the shared buffers in place, so this costs no TA heap; the host picks
+ * its chunk size at or below it.
+ */
+#define TA_MAX_CHUNK_SIZE (256 * 1024)
+
+/*
+ * Every encrypted stream runs under a fresh random IV, which the TA
+ * returns from the stream's first chunk. The host stores it with the
+ * ciphertext and passes it back on the first chunk to decrypt.
+ */
+#define TA_IV_SIZE 16
+
 /*
  * TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK - Encrypt a chunk of data
  * param[0] (memref input) Plaintext chunk data
  * param[1] (memref output) Encrypted chunk data (same size as input)
- * param[2] (value input) is_first flag (1 for first chunk, 0 for subsequent)
+ * param[2] (memref output) TA_IV_SIZE bytes for the stream's IV on its
+ *          first chunk; empty (size 0) on subsequent chunks
  * param[3] (value output) Encryption time for this chunk in microseconds
  */
 #define TA_SECURE_STORAGE_CMD_ENCRYPT_CHUNK    2
@@ -61,7 +76,8 @@
  * TA_SECURE_STORAGE_CMD_DECRYPT_CHUNK - Decrypt a chunk of data
  * param[0] (memref input) Encrypted chunk data
  * param[1] (memref output) Decrypted chunk data (same size as input)
- * param[2] (value input) is_first flag (1 for first chunk, 0 for subsequent)
+ * param[2] (memref input) The stream's IV, as ENCRYPT_CHUNK returned it,
+ *          on its first chunk; empty (size 0) on subsequent chunks
  * param[3] (value output) Decryption time for this chunk in microseconds
  */
 #define TA_SECURE_STORAGE_CMD_DECRYPT_CHUNK    3
@@ -81,6 +97,45 @@
  */
 #define TA_SECURE_STORAGE_CMD_RESET            5
 
+/*
+ * Named keys. A key slot is a TEE_TYPE_AES persistent object holding a
+ * 256-bit key, with a SHA-256 of the PIN it was created under as its
+ * data, so a file encrypted under a name can be decrypted by a later
+ * client that verifies the same PIN, and by no other. The TA instance keeps the
+ * recently used slots open, with their operations keyed, in a small LRU
+ * cache; a stream's first chunk finds its key there by name. Sessions
+ * that load no key use the instance's unnamed key, which lives as long
+ * as the instance.
+ */
+#define TA_KEY_NAME_MAX 32
+
+/*
+ * TA_SECURE_STORAGE_CMD_KEY_LOAD - Select a named key for the session's
+ * later streams, opening its slot into the cache if needed. Needs a
+ * verified PIN; a slot created under another PIN is refused with
+ * TEE_ERROR_ACCESS_DENIED.
+ * param[0] (memref input) Key name, 1 to TA_KEY_NAME_MAX bytes
+ * param[1] (value input) TA_KEY_CREATE to create a missing slot (a)
+ * param[2] (value output) Slot created (a), slot was cached (b)
+ * param[3] unused
+ */
+#define TA_SECURE_STORAGE_CMD_KEY_LOAD         6
+
+#define TA_KEY_CREATE  (1 << 0)
+
+/*
+ * TA_SECURE_STORAGE_CMD_KEY_EVICT - Drop a named key from the cache; a
+ * stream still running on it fails with TEE_ERROR_BAD_STATE. Needs a
+ * verified PIN, the one the slot was created under, else
+ * TEE_ERROR_ACCESS_DENIED.
+ * param[0] (memref input) Key name
+ * param[1] (value input) TA_KEY_DESTROY to delete the slot too (a)
+ * param[2-3] unused
+ */
+#define TA_SECURE_STORAGE_CMD_KEY_EVICT        7
+
+#define TA_KEY_DESTROY (1 << 0)
+
 /* PIN configuration */
 #define PIN_MIN_LENGTH 4
 #define PIN_MAX_LENGTH 8
@@ -4,21 +4,78 @@
 #include <tee_internal_api_extensions.h>
 #include <string.h>
 
-#define CHUNK_SIZE (16 * 1024)  // 16KB chunks
 #define AES_KEY_SIZE 32         // 256-bit key
-#define AES_IV_SIZE 16          // 128-bit IV
+#define AES_IV_SIZE TA_IV_SIZE  // 128-bit IV
 
-/* Session context to maintain encryption state and PIN authentication */
-struct crypto_session {
+#define KEY_CACHE_SIZE 4
+#define KEY_BUCKETS 8           /* power of two */
+#define KEY_ID_PREFIX "key:"
+#define KEY_ID_PREFIX_LEN (sizeof(KEY_ID_PREFIX) - 1)
+#define KEY_OWNER_SIZE 32       /* SHA-256 of the creator's PIN */
+
+/* An open key slot, keyed and ready for a TEE_CipherInit */
+struct key_entry {
+	char name[TA_KEY_NAME_MAX];
+	uint32_t name_len;
+	uint32_t hash;
+	uint8_t owner[KEY_OWNER_SIZE];
+	TEE_ObjectHandle key;
 	TEE_OperationHandle enc_op;
 	TEE_OperationHandle dec_op;
+	uint32_t gen;           /* 0 while the entry is free */
+	uint32_t last_used;
+	int next;               /* in the bucket's chain, -1 ends it */
+};
+
+/*
+ * Opened key slots, found by name hash. A miss opens the slot from
+ * storage into a free entry or the least recently used one.
+ */
+struct key_cache {
+	struct key_entry entries[KEY_CACHE_SIZE];
+	int buckets[KEY_BUCKETS];
+	uint32_t tick;
+	uint32_t next_gen;
+};
+
+/* The key a cipher stream runs on, fixed by its first chunk */
+struct key_stream {
+	int slot;               /* cache entry, or one of the below */
+	uint32_t gen;           /* the entry's gen when bound */
+};
+
+#define STREAM_UNBOUND -2
+#define STREAM_UNNAMED -1
+
+/*
+ * Instance state. The TA is kept alive between sessions
+ * (TA_FLAG_INSTANCE_KEEP_ALIVE), so the key object and the keyed cipher
+ * operations are built once, when the instance is created, and a later
+ * session, also one of a later client process, starts its stream with
+ * a TEE_CipherInit. Named keys are cached here the same way. The
+ * instance takes one session at a time (no TA_FLAG_MULTI_SESSION), so
+ * that session has the operations to itself.
+ */
+struct crypto_instance {
 	TEE_ObjectHandle key_handle;
-	uint8_t iv[AES_IV_SIZE];
-	bool initialized;
+	TEE_OperationHandle enc_op;
+	TEE_OperationHandle dec_op;
+	struct key_cache keys;
+};
+
+/* Session context to maintain encryption state and PIN authentication */
+struct crypto_session {
 	uint32_t total_enc_time_us;
 	uint32_t total_dec_time_us;
 	size_t total_bytes;
 	
+	/* Named key from KEY_LOAD; none selects the unnamed key */
+	char key_name[TA_KEY_NAME_MAX];
+	uint32_t key_name_len;
+	uint8_t key_owner[KEY_OWNER_SIZE];
+	struct key_stream enc;
+	struct key_stream dec;
+	
 	/* PIN authentication state */
 	char pin[PIN_MAX_LENGTH + 1];
 	bool pin_set;
@@ -28,6 +85,8 @@ struct crypto_session {
 	bool locked_out;
 };
 
+static struct crypto_instance g_inst;
+
 /* Hash PIN using SHA-256 for secure storage */
 static TEE_Result hash_pin(const char *pin, uint8_t *hash, uint32_t hash_len)
 {
@@ -196,7 +255,7 @@ static TEE_Result check_authentication(struct crypto_session *sess)
 }
 
 /* Generate or retrieve the encryption key (stored securely in TA) */
-static TEE_Result init_crypto_key(struct crypto_session *sess)
+static TEE_Result init_crypto_key(struct crypto_instance *inst)
 {
 	TEE_Result res;
 	TEE_Attribute attr;
@@ -211,7 +270,7 @@ static TEE_Result init_crypto_key(struct crypto_session *sess)
 	
 	/* Allocate transient object for AES key */
 	res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_KEY_SIZE * 8, 
-	                                   &sess->key_handle);
+	                                   &inst->key_handle);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_AllocateTransientObject failed: 0x%x", res);
 		return res;
@@ -219,70 +278,326 @@ static TEE_Result init_crypto_key(struct crypto_session *sess)
 	
 	/* Populate key */
 	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key_data, AES_KEY_SIZE);
-	res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
+	res = TEE_PopulateTransientObject(inst->key_handle, &attr, 1);
+	TEE_MemFill(key_data, 0, sizeof(key_data));
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_PopulateTransientObject failed: 0x%x", res);
-		TEE_FreeTransientObject(sess->key_handle);
+		TEE_FreeTransientObject(inst->key_handle);
+		inst->key_handle = TEE_HANDLE_NULL;
 		return res;
 	}
 	
-	/* Generate IV (in production, this should be unique per file) */
-	TEE_GenerateRandom(sess->iv, AES_IV_SIZE);
-	
 	return TEE_SUCCESS;
 }
 
-/* Initialize encryption operation */
-static TEE_Result init_encryption(struct crypto_session *sess)
+/* Allocates a cipher operation of the mode and keys it */
+static TEE_Result prepare_operation(TEE_OperationHandle *op, uint32_t mode,
+				    TEE_ObjectHandle key)
 {
 	TEE_Result res;
 	
-	/* Allocate encryption operation */
-	res = TEE_AllocateOperation(&sess->enc_op, TEE_ALG_AES_CBC_NOPAD,
-	                             TEE_MODE_ENCRYPT, AES_KEY_SIZE * 8);
+	res = TEE_AllocateOperation(op, TEE_ALG_AES_CBC_NOPAD, mode,
+	                            AES_KEY_SIZE * 8);
 	if (res != TEE_SUCCESS) {
-		EMSG("TEE_AllocateOperation (encrypt) failed: 0x%x", res);
+		EMSG("TEE_AllocateOperation (mode %u) failed: 0x%x", mode, res);
 		return res;
 	}
 	
-	/* Set encryption key */
-	res = TEE_SetOperationKey(sess->enc_op, sess->key_handle);
+	res = TEE_SetOperationKey(*op, key);
 	if (res != TEE_SUCCESS) {
-		EMSG("TEE_SetOperationKey (encrypt) failed: 0x%x", res);
-		TEE_FreeOperation(sess->enc_op);
+		EMSG("TEE_SetOperationKey (mode %u) failed: 0x%x", mode, res);
+		TEE_FreeOperation(*op);
+		*op = TEE_HANDLE_NULL;
 		return res;
 	}
 	
-	/* Initialize cipher with IV */
-	TEE_CipherInit(sess->enc_op, sess->iv, AES_IV_SIZE);
-	
 	return TEE_SUCCESS;
 }
 
-/* Initialize decryption operation */
-static TEE_Result init_decryption(struct crypto_session *sess)
+/* FNV-1a */
+static uint32_t key_hash(const char *name, uint32_t len)
+{
+	uint32_t h = 2166136261u;
+	
+	while (len--)
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	return h;
+}
+
+static void key_cache_init(struct key_cache *c)
+{
+	int i;
+	
+	TEE_MemFill(c, 0, sizeof(*c));
+	for (i = 0; i < KEY_BUCKETS; i++)
+		c->buckets[i] = -1;
+}
+
+static int key_cache_find(struct key_cache *c, const char *name,
+                          uint32_t len, uint32_t hash)
+{
+	struct key_entry *e;
+	int i;
+	
+	for (i = c->buckets[hash & (KEY_BUCKETS - 1)]; i >= 0; i = e->next) {
+		e = &c->entries[i];
+		if (e->hash == hash && e->name_len == len &&
+		    !TEE_MemCompare(e->name, name, len)) {
+			e->last_used = ++c->tick;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Unhashes an entry and closes its slot */
+static void key_cache_drop(struct key_cache *c, int slot)
+{
+	struct key_entry *e = &c->entries[slot];
+	int *link = &c->buckets[e->hash & (KEY_BUCKETS - 1)];
+	
+	while (*link != slot)
+		link = &c->entries[*link].next;
+	*link = e->next;
+	
+	if (e->enc_op)
+		TEE_FreeOperation(e->enc_op);
+	if (e->dec_op)
+		TEE_FreeOperation(e->dec_op);
+	if (e->key)
+		TEE_CloseObject(e->key);
+	TEE_MemFill(e, 0, sizeof(*e));
+}
+
+static void key_cache_release(struct key_cache *c)
+{
+	int i;
+	
+	for (i = 0; i < KEY_CACHE_SIZE; i++)
+		if (c->entries[i].gen)
+			key_cache_drop(c, i);
+}
+
+static void release_instance(struct crypto_instance *inst)
+{
+	key_cache_release(&inst->keys);
+	if (inst->enc_op)
+		TEE_FreeOperation(inst->enc_op);
+	if (inst->dec_op)
+		TEE_FreeOperation(inst->dec_op);
+	if (inst->key_handle)
+		TEE_FreeTransientObject(inst->key_handle);
+	inst->enc_op = TEE_HANDLE_NULL;
+	inst->dec_op = TEE_HANDLE_NULL;
+	inst->key_handle = TEE_HANDLE_NULL;
+}
+
+/* Builds the key and both keyed operations, once per instance */
+static TEE_Result prepare_instance(struct crypto_instance *inst)
 {
 	TEE_Result res;
 	
-	/* Allocate decryption operation */
-	res = TEE_AllocateOperation(&sess->dec_op, TEE_ALG_AES_CBC_NOPAD,
-	                             TEE_MODE_DECRYPT, AES_KEY_SIZE * 8);
-	if (res != TEE_SUCCESS) {
-		EMSG("TEE_AllocateOperation (decrypt) failed: 0x%x", res);
+	key_cache_init(&inst->keys);
+	res = init_crypto_key(inst);
+	if (res == TEE_SUCCESS)
+		res = prepare_operation(&inst->enc_op, TEE_MODE_ENCRYPT,
+		                        inst->key_handle);
+	if (res == TEE_SUCCESS)
+		res = prepare_operation(&inst->dec_op, TEE_MODE_DECRYPT,
+		                        inst->key_handle);
+	if (res != TEE_SUCCESS)
+		release_instance(inst);
+	return res;
+}
+
+static void key_object_id(char *id, const char *name, uint32_t len)
+{
+	TEE_MemMove(id, KEY_ID_PREFIX, KEY_ID_PREFIX_LEN);
+	TEE_MemMove(id + KEY_ID_PREFIX_LEN, name, len);
+}
+
+/*
+ * Creates a slot holding a fresh key, with the owner as its data; IVs
+ * are drawn per stream.
+ */
+static TEE_Result create_key_slot(const char *id, uint32_t id_len,
+                                  const uint8_t *owner,
+                                  TEE_ObjectHandle *key)
+{
+	TEE_ObjectHandle tmp;
+	TEE_Result res;
+	
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_KEY_SIZE * 8,
+	                                  &tmp);
+	if (res != TEE_SUCCESS)
 		return res;
+	res = TEE_GenerateKey(tmp, AES_KEY_SIZE * 8, NULL, 0);
+	if (res == TEE_SUCCESS)
+		res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id,
+		                                 id_len,
+		                                 TEE_DATA_FLAG_ACCESS_READ,
+		                                 tmp, owner, KEY_OWNER_SIZE,
+		                                 key);
+	TEE_FreeTransientObject(tmp);
+	return res;
+}
+
+/* Whether the slot was created under the owner's PIN */
+static TEE_Result check_key_owner(TEE_ObjectHandle key, const uint8_t *owner)
+{
+	uint8_t stored[KEY_OWNER_SIZE];
+	uint32_t n = 0;
+	TEE_Result res;
+	
+	res = TEE_SeekObjectData(key, 0, TEE_DATA_SEEK_SET);
+	if (res == TEE_SUCCESS)
+		res = TEE_ReadObjectData(key, stored, sizeof(stored), &n);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (n != sizeof(stored) ||
+	    TEE_MemCompare(stored, owner, sizeof(stored))) {
+		EMSG("Key slot belongs to another PIN");
+		return TEE_ERROR_ACCESS_DENIED;
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * Finds the named key in the cache or opens its slot into it, creating
+ * the slot if asked to; either way the slot must be the owner's. *slot
+ * is the entry. A slot that cannot be opened and keyed leaves the cache
+ * as it was.
+ */
+static TEE_Result key_cache_load(struct key_cache *c, const char *name,
+                                 uint32_t len, const uint8_t *owner,
+                                 bool create, bool *created, bool *hit,
+                                 int *slot)
+{
+	char id[KEY_ID_PREFIX_LEN + TA_KEY_NAME_MAX];
+	uint32_t hash = key_hash(name, len);
+	TEE_OperationHandle enc_op, dec_op;
+	TEE_ObjectHandle key;
+	struct key_entry *e;
+	TEE_Result res;
+	int i, victim = 0;
+	
+	*created = false;
+	*slot = key_cache_find(c, name, len, hash);
+	*hit = *slot >= 0;
+	if (*hit) {
+		if (TEE_MemCompare(c->entries[*slot].owner, owner,
+		                   KEY_OWNER_SIZE)) {
+			EMSG("Key slot belongs to another PIN");
+			return TEE_ERROR_ACCESS_DENIED;
+		}
+		return TEE_SUCCESS;
 	}
 	
-	/* Set decryption key */
-	res = TEE_SetOperationKey(sess->dec_op, sess->key_handle);
+	key_object_id(id, name, len);
+	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, id,
+	                               KEY_ID_PREFIX_LEN + len,
+	                               TEE_DATA_FLAG_ACCESS_READ, &key);
+	if (res == TEE_SUCCESS) {
+		res = check_key_owner(key, owner);
+		if (res != TEE_SUCCESS)
+			TEE_CloseObject(key);
+	} else if (res == TEE_ERROR_ITEM_NOT_FOUND && create) {
+		res = create_key_slot(id, KEY_ID_PREFIX_LEN + len, owner, &key);
+		*created = res == TEE_SUCCESS;
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+	
+	res = prepare_operation(&enc_op, TEE_MODE_ENCRYPT, key);
+	if (res == TEE_SUCCESS) {
+		res = prepare_operation(&dec_op, TEE_MODE_DECRYPT, key);
+		if (res != TEE_SUCCESS)
+			TEE_FreeOperation(enc_op);
+	}
 	if (res != TEE_SUCCESS) {
-		EMSG("TEE_SetOperationKey (decrypt) failed: 0x%x", res);
-		TEE_FreeOperation(sess->dec_op);
+		TEE_CloseObject(key);
 		return res;
 	}
 	
-	/* Initialize cipher with same IV */
-	TEE_CipherInit(sess->dec_op, sess->iv, AES_IV_SIZE);
+	/* Only now that it has a replacement: a free entry, else the LRU */
+	for (i = 0; i < KEY_CACHE_SIZE; i++) {
+		if (!c->entries[i].gen) {
+			victim = i;
+			break;
+		}
+		if (c->entries[i].last_used < c->entries[victim].last_used)
+			victim = i;
+	}
+	if (c->entries[victim].gen)
+		key_cache_drop(c, victim);
+	e = &c->entries[victim];
+	
+	TEE_MemMove(e->name, name, len);
+	e->name_len = len;
+	e->hash = hash;
+	TEE_MemMove(e->owner, owner, KEY_OWNER_SIZE);
+	e->key = key;
+	e->enc_op = enc_op;
+	e->dec_op = dec_op;
+	e->gen = ++c->next_gen;
+	e->last_used = ++c->tick;
+	e->next = c->buckets[hash & (KEY_BUCKETS - 1)];
+	c->buckets[hash & (KEY_BUCKETS - 1)] = victim;
+	
+	*slot = victim;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Binds a stream to the session's key on its first chunk: the named
+ * key's cache entry, loaded again if it was evicted, or the unnamed key.
+ */
+static TEE_Result bind_stream(struct crypto_session *sess,
+                              struct key_stream *st)
+{
+	struct key_cache *c = &g_inst.keys;
+	TEE_Result res;
+	bool created, hit;
+	int slot;
 	
+	if (!sess->key_name_len) {
+		st->slot = STREAM_UNNAMED;
+		return TEE_SUCCESS;
+	}
+	res = key_cache_load(c, sess->key_name, sess->key_name_len,
+	                     sess->key_owner, false, &created, &hit, &slot);
+	if (res != TEE_SUCCESS) {
+		st->slot = STREAM_UNBOUND;
+		return res;
+	}
+	st->slot = slot;
+	st->gen = c->entries[slot].gen;
+	return TEE_SUCCESS;
+}
+
+/* The stream's cache entry; NULL if it runs on the unnamed key */
+static TEE_Result stream_entry(struct key_stream *st, struct key_entry **e)
+{
+	*e = NULL;
+	if (st->slot == STREAM_UNNAMED)
+		return TEE_SUCCESS;
+	if (st->slot == STREAM_UNBOUND ||
+	    g_inst.keys.entries[st->slot].gen != st->gen) {
+		EMSG("No stream, or its key was evicted");
+		return TEE_ERROR_BAD_STATE;
+	}
+	*e = &g_inst.keys.entries[st->slot];
+	return TEE_SUCCESS;
+}
+
+/* A stream's first chunk carries its IV in param[2], later ones none */
+static TEE_Result chunk_iv(const TEE_Param *param, bool *is_first)
+{
+	*is_first = param->memref.size != 0;
+	if (*is_first && param->memref.size != AES_IV_SIZE) {
+		EMSG("IV must be %d bytes", AES_IV_SIZE);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
 	return TEE_SUCCESS;
 }
 
@@ -293,13 +608,16 @@ static TEE_Result encrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
 				TEE_PARAM_TYPE_MEMREF_OUTPUT,
-				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
 				TEE_PARAM_TYPE_VALUE_OUTPUT);
 	TEE_Result res;
+	struct key_entry *key;
+	TEE_OperationHandle op;
+	uint8_t iv[AES_IV_SIZE];
 	void *plaintext;
 	void *ciphertext;
 	size_t data_sz;
-	uint32_t is_first;
+	bool is_first;
 	TEE_Time start_time, end_time;
 	uint32_t elapsed_us;
 	uint32_t out_len;
@@ -315,25 +633,33 @@ static TEE_Result encrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	plaintext = params[0].memref.buffer;
 	data_sz = params[0].memref.size;
 	ciphertext = params[1].memref.buffer;
-	is_first = params[2].value.a;
+	res = chunk_iv(&params[2], &is_first);
+	if (res != TEE_SUCCESS)
+		return res;
 	
-	if (data_sz > CHUNK_SIZE) {
-		EMSG("Chunk size %zu exceeds maximum %d", data_sz, CHUNK_SIZE);
+	if (data_sz > TA_MAX_CHUNK_SIZE) {
+		EMSG("Chunk size %zu exceeds maximum %d", data_sz,
+		     TA_MAX_CHUNK_SIZE);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	/* Initialize on first chunk */
+	/* Restart the prepared operation on first chunk */
 	if (is_first) {
-		if (!sess->initialized) {
-			res = init_crypto_key(sess);
-			if (res != TEE_SUCCESS)
-				return res;
-			sess->initialized = true;
-		}
-		
-		res = init_encryption(sess);
+		res = bind_stream(sess, &sess->enc);
 		if (res != TEE_SUCCESS)
 			return res;
+	}
+	
+	res = stream_entry(&sess->enc, &key);
+	if (res != TEE_SUCCESS)
+		return res;
+	op = key ? key->enc_op : g_inst.enc_op;
+	
+	if (is_first) {
+		/* A fresh IV per stream, whichever key it runs on */
+		TEE_GenerateRandom(iv, sizeof(iv));
+		TEE_CipherInit(op, iv, sizeof(iv));
+		TEE_MemMove(params[2].memref.buffer, iv, sizeof(iv));
 		
 		sess->total_enc_time_us = 0;
 		sess->total_bytes = 0;
@@ -349,7 +675,7 @@ static TEE_Result encrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	TEE_GetSystemTime(&start_time);
 	
 	out_len = params[1].memref.size;
-	res = TEE_CipherUpdate(sess->enc_op, plaintext, data_sz,
+	res = TEE_CipherUpdate(op, plaintext, data_sz,
 	                       ciphertext, &out_len);
 	
 	TEE_GetSystemTime(&end_time);
@@ -379,13 +705,16 @@ static TEE_Result decrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	const uint32_t exp_param_types =
 		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
 				TEE_PARAM_TYPE_MEMREF_OUTPUT,
-				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_INPUT,
 				TEE_PARAM_TYPE_VALUE_OUTPUT);
 	TEE_Result res;
+	struct key_entry *key;
+	TEE_OperationHandle op;
+	uint8_t iv[AES_IV_SIZE];
 	void *ciphertext;
 	void *plaintext;
 	size_t data_sz;
-	uint32_t is_first;
+	bool is_first;
 	TEE_Time start_time, end_time;
 	uint32_t elapsed_us;
 	uint32_t out_len;
@@ -401,23 +730,32 @@ static TEE_Result decrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	ciphertext = params[0].memref.buffer;
 	data_sz = params[0].memref.size;
 	plaintext = params[1].memref.buffer;
-	is_first = params[2].value.a;
+	res = chunk_iv(&params[2], &is_first);
+	if (res != TEE_SUCCESS)
+		return res;
 	
-	if (data_sz > CHUNK_SIZE) {
-		EMSG("Chunk size %zu exceeds maximum %d", data_sz, CHUNK_SIZE);
+	if (data_sz > TA_MAX_CHUNK_SIZE) {
+		EMSG("Chunk size %zu exceeds maximum %d", data_sz,
+		     TA_MAX_CHUNK_SIZE);
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	/* Initialize on first chunk */
+	/* Restart the prepared operation, with the stream's IV, on first chunk */
 	if (is_first) {
-		if (!sess->initialized) {
-			EMSG("Crypto not initialized");
-			return TEE_ERROR_BAD_STATE;
-		}
-		
-		res = init_decryption(sess);
+		res = bind_stream(sess, &sess->dec);
 		if (res != TEE_SUCCESS)
 			return res;
+	}
+	
+	res = stream_entry(&sess->dec, &key);
+	if (res != TEE_SUCCESS)
+		return res;
+	op = key ? key->dec_op : g_inst.dec_op;
+	
+	if (is_first) {
+		/* Copied first: the client can change shared memory under us */
+		TEE_MemMove(iv, params[2].memref.buffer, sizeof(iv));
+		TEE_CipherInit(op, iv, sizeof(iv));
 		
 		sess->total_dec_time_us = 0;
 	}
@@ -426,7 +764,7 @@ static TEE_Result decrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	TEE_GetSystemTime(&start_time);
 	
 	out_len = params[1].memref.size;
-	res = TEE_CipherUpdate(sess->dec_op, ciphertext, data_sz,
+	res = TEE_CipherUpdate(op, ciphertext, data_sz,
 	                       plaintext, &out_len);
 	
 	TEE_GetSystemTime(&end_time);
@@ -448,6 +786,131 @@ static TEE_Result decrypt_chunk(uint32_t param_types, TEE_Param params[4],
 	return TEE_SUCCESS;
 }
 
+static TEE_Result check_key_name(const TEE_Param *param)
+{
+	if (!param->memref.size || param->memref.size > TA_KEY_NAME_MAX) {
+		EMSG("Key name must be 1-%d bytes", TA_KEY_NAME_MAX);
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * Select a named key, opening or creating its slot. The slot is bound to
+ * the session's PIN: one created under another PIN is refused.
+ */
+static TEE_Result key_load(uint32_t param_types, TEE_Param params[4],
+                           struct crypto_session *sess)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	uint8_t owner[KEY_OWNER_SIZE];
+	TEE_Result res;
+	bool created, hit;
+	int slot;
+	
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	res = check_authentication(sess);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = check_key_name(&params[0]);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = hash_pin(sess->pin, owner, sizeof(owner));
+	if (res != TEE_SUCCESS)
+		return res;
+	
+	res = key_cache_load(&g_inst.keys, params[0].memref.buffer,
+	                     params[0].memref.size, owner,
+	                     params[1].value.a & TA_KEY_CREATE,
+	                     &created, &hit, &slot);
+	if (res != TEE_SUCCESS) {
+		EMSG("Cannot load key: 0x%x", res);
+		return res;
+	}
+	
+	TEE_MemMove(sess->key_name, params[0].memref.buffer,
+	            params[0].memref.size);
+	sess->key_name_len = params[0].memref.size;
+	TEE_MemMove(sess->key_owner, owner, sizeof(owner));
+	params[2].value.a = created;
+	params[2].value.b = hit;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Drop a named key from the cache, and destroy its slot if asked; either
+ * only for the PIN the slot was created under.
+ */
+static TEE_Result key_evict(uint32_t param_types, TEE_Param params[4],
+                            struct crypto_session *sess)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	char id[KEY_ID_PREFIX_LEN + TA_KEY_NAME_MAX];
+	uint8_t owner[KEY_OWNER_SIZE];
+	TEE_ObjectHandle object;
+	const char *name;
+	uint32_t len;
+	TEE_Result res;
+	int slot;
+	
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	res = check_authentication(sess);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = check_key_name(&params[0]);
+	if (res != TEE_SUCCESS)
+		return res;
+	
+	res = hash_pin(sess->pin, owner, sizeof(owner));
+	if (res != TEE_SUCCESS)
+		return res;
+	
+	name = params[0].memref.buffer;
+	len = params[0].memref.size;
+	slot = key_cache_find(&g_inst.keys, name, len, key_hash(name, len));
+	if (slot >= 0) {
+		if (TEE_MemCompare(g_inst.keys.entries[slot].owner, owner,
+		                   sizeof(owner))) {
+			EMSG("Key slot belongs to another PIN");
+			return TEE_ERROR_ACCESS_DENIED;
+		}
+		key_cache_drop(&g_inst.keys, slot);
+	}
+	if (!(params[1].value.a & TA_KEY_DESTROY))
+		return TEE_SUCCESS;
+	
+	key_object_id(id, name, len);
+	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, id,
+	                               KEY_ID_PREFIX_LEN + len,
+	                               TEE_DATA_FLAG_ACCESS_READ |
+	                               TEE_DATA_FLAG_ACCESS_WRITE_META,
+	                               &object);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = check_key_owner(object, owner);
+	if (res != TEE_SUCCESS) {
+		TEE_CloseObject(object);
+		return res;
+	}
+	TEE_CloseAndDeletePersistentObject1(object);
+	
+	/* A session whose key is gone falls back to the unnamed one */
+	if (sess->key_name_len == len &&
+	    !TEE_MemCompare(sess->key_name, name, len))
+		sess->key_name_len = 0;
+	return TEE_SUCCESS;
+}
+
 /* Get final timing statistics */
 static TEE_Result finalize_operation(uint32_t param_types, TEE_Param params[4],
                                      struct crypto_session *sess)
@@ -472,16 +935,12 @@ static TEE_Result finalize_operation(uint32_t param_types, TEE_Param params[4],
 	return TEE_SUCCESS;
 }
 
-/* Reset session state */
+/*
+ * Reset session state. The operations stay prepared; the next first
+ * chunk restarts them.
+ */
 static TEE_Result reset_session(struct crypto_session *sess)
 {
-	if (sess->enc_op)
-		TEE_FreeOperation(sess->enc_op);
-	if (sess->dec_op)
-		TEE_FreeOperation(sess->dec_op);
-	
-	sess->enc_op = TEE_HANDLE_NULL;
-	sess->dec_op = TEE_HANDLE_NULL;
 	sess->total_enc_time_us = 0;
 	sess->total_dec_time_us = 0;
 	sess->total_bytes = 0;
@@ -491,11 +950,13 @@ static TEE_Result reset_session(struct crypto_session *sess)
 
 TEE_Result TA_CreateEntryPoint(void)
 {
-	return TEE_SUCCESS;
+	/* Paid once per instance, which outlives its sessions */
+	return prepare_instance(&g_inst);
 }
 
 void TA_DestroyEntryPoint(void)
 {
+	release_instance(&g_inst);
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
@@ -509,9 +970,8 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	
 	TEE_MemFill(sess, 0, sizeof(*sess));
-	sess->initialized = false;
-	sess->enc_op = TEE_HANDLE_NULL;
-	sess->dec_op = TEE_HANDLE_NULL;
+	sess->enc.slot = STREAM_UNBOUND;
+	sess->dec.slot = STREAM_UNBOUND;
 	
 	/* Initialize PIN authentication state */
 	sess->pin_set = false;
@@ -531,13 +991,6 @@ void TA_CloseSessionEntryPoint(void *session)
 	struct crypto_session *sess = session;
 	
 	if (sess) {
-		if (sess->enc_op)
-			TEE_FreeOperation(sess->enc_op);
-		if (sess->dec_op)
-			TEE_FreeOperation(sess->dec_op);
-		if (sess->initialized && sess->key_handle)
-			TEE_FreeTransientObject(sess->key_handle);
-		
 		/* Clear PIN from memory */
 		TEE_MemFill(sess->pin, 0, sizeof(sess->pin));
 		
@@ -567,6 +1020,10 @@ TEE_Result TA_InvokeCommandEntryPoint(void *session,
 		return finalize_operation(param_types, params, sess);
 	case TA_SECURE_STORAGE_CMD_RESET:
 		return reset_session(sess);
+	case TA_SECURE_STORAGE_CMD_KEY_LOAD:
+		return key_load(param_types, params, sess);
+	case TA_SECURE_STORAGE_CMD_KEY_EVICT:
+		return key_evict(param_types, params, sess);
 	default:
 		EMSG("Command ID 0x%x is not supported", command);
 		return TEE_ERROR_NOT_SUPPORTED;
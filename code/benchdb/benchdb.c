@@ -0,0 +1,235 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/utsname.h>
+
+#include <benchdb.h>
+
+/* Set by the host Makefiles from `git describe` */
+#ifndef BENCHDB_GIT_REV
+#define BENCHDB_GIT_REV "unknown"
+#endif
+
+#define BENCHDB_MAX_CONFIG 16
+#define BENCHDB_MAX_METRICS 64
+#define BENCHDB_NAME_LEN 64
+#define BENCHDB_VALUE_LEN 128
+
+struct benchdb_metric {
+	char name[BENCHDB_NAME_LEN];
+	char unit[16];
+	enum benchdb_better better;
+	double *samples;
+	size_t count;
+	size_t alloc;
+};
+
+struct benchdb_run {
+	char path[256];
+	char bench[BENCHDB_NAME_LEN];
+	time_t time;
+	struct {
+		char key[BENCHDB_NAME_LEN];
+		char value[BENCHDB_VALUE_LEN];
+	} config[BENCHDB_MAX_CONFIG];
+	size_t nconfig;
+	struct benchdb_metric metrics[BENCHDB_MAX_METRICS];
+	size_t nmetrics;
+};
+
+struct benchdb_run *benchdb_begin(const char *bench)
+{
+	const char *path = getenv("BENCHDB");
+	struct benchdb_run *run;
+
+	if (!path || !*path)
+		return NULL;
+	run = calloc(1, sizeof(*run));
+	if (!run)
+		return NULL;
+	snprintf(run->path, sizeof(run->path), "%s", path);
+	snprintf(run->bench, sizeof(run->bench), "%s", bench);
+	run->time = time(NULL);
+	return run;
+}
+
+void benchdb_config(struct benchdb_run *run, const char *key,
+		    const char *fmt, ...)
+{
+	va_list ap;
+	size_t i;
+
+	if (!run)
+		return;
+	for (i = 0; i < run->nconfig; i++)
+		if (!strcmp(run->config[i].key, key))
+			break;
+	if (i == BENCHDB_MAX_CONFIG)
+		return;
+	if (i == run->nconfig) {
+		snprintf(run->config[i].key, sizeof(run->config[i].key), "%s",
+			 key);
+		run->nconfig++;
+	}
+	va_start(ap, fmt);
+	vsnprintf(run->config[i].value, sizeof(run->config[i].value), fmt, ap);
+	va_end(ap);
+}
+
+void benchdb_sample(struct benchdb_run *run, const char *metric,
+		    const char *unit, enum benchdb_better better,
+		    double value)
+{
+	struct benchdb_metric *m = NULL;
+	double *samples;
+	size_t i;
+
+	if (!run)
+		return;
+	for (i = 0; i < run->nmetrics; i++)
+		if (!strcmp(run->metrics[i].name, metric))
+			m = &run->metrics[i];
+	if (!m) {
+		if (run->nmetrics == BENCHDB_MAX_METRICS)
+			return;
+		m = &run->metrics[run->nmetrics++];
+		snprintf(m->name, sizeof(m->name), "%s", metric);
+		snprintf(m->unit, sizeof(m->unit), "%s", unit);
+		m->better = better;
+	}
+	if (m->count == m->alloc) {
+		samples = realloc(m->samples,
+				  (m->alloc ? 2 * m->alloc : 8) * sizeof(double));
+		if (!samples)
+			return;
+		m->samples = samples;
+		m->alloc = m->alloc ? 2 * m->alloc : 8;
+	}
+	m->samples[m->count++] = value;
+}
+
+static void put_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+/* Board description: BENCHDB_BOARD, else host name and machine */
+static void put_board(FILE *f)
+{
+	const char *board = getenv("BENCHDB_BOARD");
+	struct utsname u;
+	char buf[2 * sizeof(u.nodename) + 2];
+
+	if (!board || !*board) {
+		if (uname(&u))
+			board = "unknown";
+		else {
+			snprintf(buf, sizeof(buf), "%s-%s", u.nodename,
+				 u.machine);
+			board = buf;
+		}
+	}
+	put_string(f, board);
+}
+
+static void put_record(FILE *f, const struct benchdb_run *run)
+{
+	const char *rev = getenv("BENCHDB_REV");
+	const struct benchdb_metric *m;
+	size_t i, j;
+
+	fprintf(f, "{\"time\":%lld,\"rev\":", (long long)run->time);
+	put_string(f, rev && *rev ? rev : BENCHDB_GIT_REV);
+	fputs(",\"board\":", f);
+	put_board(f);
+	fputs(",\"bench\":", f);
+	put_string(f, run->bench);
+
+	fputs(",\"config\":{", f);
+	for (i = 0; i < run->nconfig; i++) {
+		if (i)
+			fputc(',', f);
+		put_string(f, run->config[i].key);
+		fputc(':', f);
+		put_string(f, run->config[i].value);
+	}
+
+	fputs("},\"metrics\":{", f);
+	for (i = 0; i < run->nmetrics; i++) {
+		m = &run->metrics[i];
+		if (i)
+			fputc(',', f);
+		put_string(f, m->name);
+		fputs(":{\"unit\":", f);
+		put_string(f, m->unit);
+		fprintf(f, ",\"better\":\"%s\",\"samples\":[",
+			m->better == BENCHDB_HIGHER ? "higher" : "lower");
+		for (j = 0; j < m->count; j++)
+			/* JSON has no inf/nan; a broken sample reads as 0 */
+			fprintf(f, "%s%.9g", j ? "," : "",
+				isfinite(m->samples[j]) ? m->samples[j] : 0.0);
+		fputs("]}", f);
+	}
+	fputs("}}\n", f);
+}
+
+int benchdb_commit(struct benchdb_run *run)
+{
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t n = -1;
+	FILE *f;
+	int fd;
+
+	if (!run)
+		return 0;
+
+	/*
+	 * The whole line goes out in one O_APPEND write under an exclusive
+	 * lock, so concurrent hosts never interleave records.
+	 */
+	f = open_memstream(&line, &len);
+	if (f) {
+		put_record(f, run);
+		fclose(f);
+	}
+	fd = line ? open(run->path, O_WRONLY | O_CREAT | O_APPEND, 0644) : -1;
+	if (fd >= 0) {
+		flock(fd, LOCK_EX);
+		n = write(fd, line, len);
+		flock(fd, LOCK_UN);
+		close(fd);
+	}
+	if (n != (ssize_t)len)
+		fprintf(stderr, "benchdb: cannot append to %s\n", run->path);
+
+	free(line);
+	benchdb_discard(run);
+	return n == (ssize_t)len ? 0 : -1;
+}
+
+void benchdb_discard(struct benchdb_run *run)
+{
+	size_t i;
+
+	if (!run)
+		return;
+	for (i = 0; i < run->nmetrics; i++)
+		free(run->metrics[i].samples);
+	free(run);
+}
@@ -0,0 +1,687 @@
+/*
+ * benchdb: reads the runs the hosts appended to a BENCHDB file (see
+ * benchdb.h) and checks a run against a baseline.
+ *
+ *   benchdb [-f file] list [bench]
+ *   benchdb [-f file] compare [-t pct] [-a alpha] baseline [candidate]
+ *
+ * A run is selected by its number in list, "last", "prev" (the latest
+ * run before the candidate) or "rev:<prefix>", which pools every run of
+ * that revision. The candidate defaults to the last run; the baseline
+ * only takes runs of the candidate's bench, board and config.
+ *
+ * compare exits 1 when a metric got worse by more than pct percent
+ * (default 5) and Welch's t-test gives p below alpha (default 0.05).
+ * With fewer than two samples on a side there is no test and the
+ * threshold alone decides.
+ */
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_THRESHOLD 5.0
+#define DEFAULT_ALPHA 0.05
+
+enum json_type { J_NULL, J_BOOL, J_NUM, J_STR, J_ARR, J_OBJ };
+
+struct json {
+	enum json_type type;
+	double num;
+	char *str;
+	struct json *items;	/* array elements or object values */
+	char **keys;		/* object keys */
+	size_t n;
+};
+
+struct record {
+	struct json root;
+	int line;
+	long long time;
+	const char *rev;
+	const char *board;
+	const char *bench;
+	const struct json *config;
+	const struct json *metrics;
+};
+
+struct db {
+	struct record *runs;
+	size_t n;
+};
+
+/* Pooled samples of one metric over a set of runs */
+struct pool {
+	double *v;
+	size_t n;
+	size_t alloc;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: benchdb [-f file] list [bench]\n"
+		"       benchdb [-f file] compare [-t pct] [-a alpha] baseline [candidate]\n"
+		"  -f file    results file (default: $BENCHDB)\n"
+		"  -t pct     regression threshold in percent (default %g)\n"
+		"  -a alpha   significance level (default %g)\n"
+		"  runs: N (from list), last, prev, rev:<prefix>\n",
+		DEFAULT_THRESHOLD, DEFAULT_ALPHA);
+	exit(2);
+}
+
+/* A minimal JSON reader, enough for the records benchdb.c writes */
+
+static void json_free(struct json *v)
+{
+	size_t i;
+
+	for (i = 0; i < v->n; i++) {
+		json_free(&v->items[i]);
+		if (v->keys)
+			free(v->keys[i]);
+	}
+	free(v->items);
+	free(v->keys);
+	free(v->str);
+	memset(v, 0, sizeof(*v));
+}
+
+static void skip_ws(const char **p)
+{
+	while (isspace((unsigned char)**p))
+		(*p)++;
+}
+
+static char *parse_string(const char **p)
+{
+	const char *s = *p + 1;
+	char *out, *o;
+	unsigned int cp;
+
+	out = malloc(strlen(s) + 1);
+	if (!out)
+		return NULL;
+	for (o = out; *s && *s != '"'; s++) {
+		if (*s != '\\') {
+			*o++ = *s;
+			continue;
+		}
+		switch (*++s) {
+		case 'b': *o++ = '\b'; break;
+		case 'f': *o++ = '\f'; break;
+		case 'n': *o++ = '\n'; break;
+		case 'r': *o++ = '\r'; break;
+		case 't': *o++ = '\t'; break;
+		case 'u':
+			if (sscanf(s + 1, "%4x", &cp) != 1)
+				goto bad;
+			s += 4;
+			/* Only control characters are escaped this way */
+			*o++ = cp < 0x80 ? (char)cp : '?';
+			break;
+		case '\0':
+			goto bad;
+		default:
+			*o++ = *s;
+		}
+	}
+	if (*s != '"')
+		goto bad;
+	*o = '\0';
+	*p = s + 1;
+	return out;
+bad:
+	free(out);
+	return NULL;
+}
+
+static int parse_value(const char **p, struct json *v);
+
+static int parse_container(const char **p, struct json *v, char close)
+{
+	struct json *items;
+	char **keys;
+	char *key = NULL;
+
+	(*p)++;
+	skip_ws(p);
+	if (**p == close) {
+		(*p)++;
+		return 0;
+	}
+	for (;;) {
+		skip_ws(p);
+		if (v->type == J_OBJ) {
+			if (**p != '"' || !(key = parse_string(p)))
+				return -1;
+			skip_ws(p);
+			if (*(*p)++ != ':') {
+				free(key);
+				return -1;
+			}
+		}
+		items = realloc(v->items, (v->n + 1) * sizeof(*items));
+		keys = v->type == J_OBJ ?
+		       realloc(v->keys, (v->n + 1) * sizeof(*keys)) : NULL;
+		if (items)
+			v->items = items;
+		if (keys)
+			v->keys = keys;
+		if (!items || (v->type == J_OBJ && !keys)) {
+			free(key);
+			return -1;
+		}
+		if (v->type == J_OBJ)
+			v->keys[v->n] = key;
+		key = NULL;
+		memset(&v->items[v->n], 0, sizeof(*items));
+		v->n++;
+		if (parse_value(p, &v->items[v->n - 1]))
+			return -1;
+		skip_ws(p);
+		if (**p == ',') {
+			(*p)++;
+			continue;
+		}
+		if (**p != close)
+			return -1;
+		(*p)++;
+		return 0;
+	}
+}
+
+static int parse_value(const char **p, struct json *v)
+{
+	char *end;
+
+	skip_ws(p);
+	switch (**p) {
+	case '{':
+		v->type = J_OBJ;
+		return parse_container(p, v, '}');
+	case '[':
+		v->type = J_ARR;
+		return parse_container(p, v, ']');
+	case '"':
+		v->type = J_STR;
+		v->str = parse_string(p);
+		return v->str ? 0 : -1;
+	case 't':
+	case 'f':
+	case 'n':
+		v->type = **p == 'n' ? J_NULL : J_BOOL;
+		v->num = **p == 't';
+		if (strncmp(*p, "true", 4) && strncmp(*p, "false", 5) &&
+		    strncmp(*p, "null", 4))
+			return -1;
+		*p += **p == 'f' ? 5 : 4;
+		return 0;
+	default:
+		v->type = J_NUM;
+		v->num = strtod(*p, &end);
+		if (end == *p)
+			return -1;
+		*p = end;
+		return 0;
+	}
+}
+
+static const struct json *json_get(const struct json *obj, const char *key,
+				   enum json_type type)
+{
+	size_t i;
+
+	if (!obj || obj->type != J_OBJ)
+		return NULL;
+	for (i = 0; i < obj->n; i++)
+		if (!strcmp(obj->keys[i], key))
+			return obj->items[i].type == type ? &obj->items[i] :
+							    NULL;
+	return NULL;
+}
+
+static const char *json_str(const struct json *obj, const char *key)
+{
+	const struct json *v = json_get(obj, key, J_STR);
+
+	return v ? v->str : NULL;
+}
+
+/* The results file */
+
+static int parse_record(const char *line, struct record *r)
+{
+	const struct json *t;
+
+	if (parse_value(&line, &r->root))
+		return -1;
+	skip_ws(&line);
+	if (*line)
+		return -1;
+	t = json_get(&r->root, "time", J_NUM);
+	r->time = t ? (long long)t->num : 0;
+	r->rev = json_str(&r->root, "rev");
+	r->board = json_str(&r->root, "board");
+	r->bench = json_str(&r->root, "bench");
+	r->config = json_get(&r->root, "config", J_OBJ);
+	r->metrics = json_get(&r->root, "metrics", J_OBJ);
+	return r->rev && r->board && r->bench && r->config && r->metrics ?
+	       0 : -1;
+}
+
+static void load(const char *path, struct db *db)
+{
+	struct record *runs;
+	char *line = NULL;
+	size_t cap = 0;
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(2);
+	}
+	while (getline(&line, &cap, f) > 0) {
+		lineno++;
+		if (line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		runs = realloc(db->runs, (db->n + 1) * sizeof(*runs));
+		if (!runs) {
+			fprintf(stderr, "benchdb: out of memory\n");
+			exit(2);
+		}
+		db->runs = runs;
+		memset(&runs[db->n], 0, sizeof(*runs));
+		runs[db->n].line = lineno;
+		if (parse_record(line, &runs[db->n])) {
+			/* A torn or foreign line does not hide the rest */
+			fprintf(stderr, "benchdb: %s:%d: not a run record, skipped\n",
+				path, lineno);
+			json_free(&runs[db->n].root);
+			continue;
+		}
+		db->n++;
+	}
+	free(line);
+	fclose(f);
+}
+
+static int same_config(const struct record *a, const struct record *b)
+{
+	const char *v;
+	size_t i;
+
+	if (strcmp(a->bench, b->bench) || strcmp(a->board, b->board) ||
+	    a->config->n != b->config->n)
+		return 0;
+	for (i = 0; i < a->config->n; i++) {
+		v = json_str(b->config, a->config->keys[i]);
+		if (a->config->items[i].type != J_STR || !v ||
+		    strcmp(a->config->items[i].str, v))
+			return 0;
+	}
+	return 1;
+}
+
+static void print_config(const struct record *r)
+{
+	size_t i;
+
+	for (i = 0; i < r->config->n; i++)
+		if (r->config->items[i].type == J_STR)
+			printf(" %s=%s", r->config->keys[i],
+			       r->config->items[i].str);
+}
+
+static void cmd_list(const struct db *db, const char *bench)
+{
+	const struct record *r;
+	char date[32];
+	time_t t;
+	size_t i;
+
+	printf("%5s %-16s %-14s %-20s %-14s %s\n", "run", "date", "rev",
+	       "board", "bench", "config");
+	for (i = 0; i < db->n; i++) {
+		r = &db->runs[i];
+		if (bench && strcmp(r->bench, bench))
+			continue;
+		t = r->time;
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&t));
+		printf("%5zu %-16s %-14s %-20s %-14s", i + 1, date, r->rev,
+		       r->board, r->bench);
+		print_config(r);
+		printf("\n");
+	}
+}
+
+/*
+ * Marks the runs sel picks in set[]. ref, when set, limits the choice to
+ * runs comparable with it and excludes ref itself; the candidate is
+ * resolved without one. Returns the latest run picked, or -1.
+ */
+static long select_runs(const struct db *db, const char *sel, long ref,
+			char *set)
+{
+	const struct record *r = ref >= 0 ? &db->runs[ref] : NULL;
+	long last = -1, i;
+	char *end;
+
+	memset(set, 0, db->n);
+	if (!strncmp(sel, "rev:", 4)) {
+		/* The candidate's revision is pooled over its latest config */
+		for (i = db->n - 1; !r && i >= 0; i--)
+			if (!strncmp(db->runs[i].rev, sel + 4, strlen(sel + 4)))
+				r = &db->runs[i];
+		for (i = 0; r && i < (long)db->n; i++) {
+			if (i == ref || !same_config(r, &db->runs[i]) ||
+			    strncmp(db->runs[i].rev, sel + 4, strlen(sel + 4)))
+				continue;
+			set[i] = 1;
+			last = i;
+		}
+		return last;
+	}
+	if (!strcmp(sel, "last") || !strcmp(sel, "prev")) {
+		i = !strcmp(sel, "prev") && ref >= 0 ? ref - 1 : (long)db->n - 1;
+		for (; i >= 0; i--) {
+			if (i != ref && (!r || same_config(r, &db->runs[i])))
+				break;
+		}
+	} else {
+		i = strtol(sel, &end, 10) - 1;
+		if (*end || end == sel || i < 0 || i >= (long)db->n)
+			return -1;
+		if (r && (i == ref || !same_config(r, &db->runs[i]))) {
+			fprintf(stderr, "benchdb: run %s is not comparable with run %ld\n",
+				sel, ref + 1);
+			return -1;
+		}
+	}
+	if (i >= 0)
+		set[i] = 1;
+	return i;
+}
+
+static int pool_add(struct pool *p, double v)
+{
+	double *n;
+
+	if (p->n == p->alloc) {
+		n = realloc(p->v, (p->alloc ? 2 * p->alloc : 16) * sizeof(*n));
+		if (!n)
+			return -1;
+		p->v = n;
+		p->alloc = p->alloc ? 2 * p->alloc : 16;
+	}
+	p->v[p->n++] = v;
+	return 0;
+}
+
+static void pool_metric(const struct db *db, const char *set,
+			const char *name, struct pool *p)
+{
+	const struct json *m, *s;
+	size_t i, j;
+
+	p->n = 0;
+	for (i = 0; i < db->n; i++) {
+		if (!set[i])
+			continue;
+		m = json_get(db->runs[i].metrics, name, J_OBJ);
+		s = json_get(m, "samples", J_ARR);
+		for (j = 0; s && j < s->n; j++)
+			if (s->items[j].type == J_NUM &&
+			    pool_add(p, s->items[j].num))
+				return;
+	}
+}
+
+static void stats(const struct pool *p, double *mean, double *var)
+{
+	double sum = 0, sq = 0;
+	size_t i;
+
+	for (i = 0; i < p->n; i++)
+		sum += p->v[i];
+	*mean = p->n ? sum / p->n : 0;
+	for (i = 0; i < p->n; i++)
+		sq += (p->v[i] - *mean) * (p->v[i] - *mean);
+	*var = p->n > 1 ? sq / (p->n - 1) : 0;
+}
+
+/* Continued fraction of the incomplete beta function (Lentz) */
+static double beta_cf(double a, double b, double x)
+{
+	const double tiny = 1e-300;
+	double c = 1, d, h, aa, del;
+	int m;
+
+	d = 1 - (a + b) * x / (a + 1);
+	d = 1 / (fabs(d) < tiny ? tiny : d);
+	h = d;
+	for (m = 1; m <= 300; m++) {
+		aa = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+		d = 1 + aa * d;
+		d = 1 / (fabs(d) < tiny ? tiny : d);
+		c = 1 + aa / c;
+		c = fabs(c) < tiny ? tiny : c;
+		h *= d * c;
+		aa = -(a + m) * (a + b + m) * x /
+		     ((a + 2 * m) * (a + 2 * m + 1));
+		d = 1 + aa * d;
+		d = 1 / (fabs(d) < tiny ? tiny : d);
+		c = 1 + aa / c;
+		c = fabs(c) < tiny ? tiny : c;
+		del = d * c;
+		h *= del;
+		if (fabs(del - 1) < 1e-12)
+			break;
+	}
+	return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double ibeta(double a, double b, double x)
+{
+	double bt;
+
+	if (x <= 0)
+		return 0;
+	if (x >= 1)
+		return 1;
+	bt = exp(lgamma(a + b) - lgamma(a) - lgamma(b) +
+		 a * log(x) + b * log(1 - x));
+	if (x < (a + 1) / (a + b + 2))
+		return bt * beta_cf(a, b, x) / a;
+	return 1 - bt * beta_cf(b, a, 1 - x) / b;
+}
+
+/* Two-sided p-value of Welch's t-test; -1 when it cannot be computed */
+static double welch_p(const struct pool *a, const struct pool *b)
+{
+	double ma, va, mb, vb, sa, sb, t, df;
+
+	if (a->n < 2 || b->n < 2)
+		return -1;
+	stats(a, &ma, &va);
+	stats(b, &mb, &vb);
+	sa = va / a->n;
+	sb = vb / b->n;
+	if (sa + sb == 0)
+		return ma == mb ? 1 : 0;
+	t = (ma - mb) / sqrt(sa + sb);
+	df = (sa + sb) * (sa + sb) /
+	     (sa * sa / (a->n - 1) + sb * sb / (b->n - 1));
+	return ibeta(df / 2, 0.5, df / (df + t * t));
+}
+
+static void print_runs(const char *what, const struct db *db,
+		       const char *set)
+{
+	size_t i;
+
+	printf("%s:", what);
+	for (i = 0; i < db->n; i++)
+		if (set[i])
+			printf(" %zu", i + 1);
+	printf("\n");
+}
+
+static int cmd_compare(const struct db *db, const char *base_sel,
+		       const char *cand_sel, double threshold, double alpha)
+{
+	char *base_set, *cand_set;
+	const struct record *cand;
+	const struct json *m;
+	const char *unit, *better, *verdict;
+	struct pool bp = { 0 }, cp = { 0 };
+	double bm, bv, cm, cv, change, p;
+	int higher, regressions = 0, untested = 0;
+	long c;
+	size_t i;
+
+	base_set = calloc(db->n + 1, 1);
+	cand_set = calloc(db->n + 1, 1);
+	if (!base_set || !cand_set) {
+		fprintf(stderr, "benchdb: out of memory\n");
+		exit(2);
+	}
+	c = select_runs(db, cand_sel, -1, cand_set);
+	if (c < 0) {
+		fprintf(stderr, "benchdb: no run matches %s\n", cand_sel);
+		exit(2);
+	}
+	if (select_runs(db, base_sel, c, base_set) < 0) {
+		fprintf(stderr, "benchdb: no baseline run matches %s\n",
+			base_sel);
+		exit(2);
+	}
+	/* A pooled revision is never its own baseline */
+	for (i = 0; i < db->n; i++)
+		if (cand_set[i])
+			base_set[i] = 0;
+
+	cand = &db->runs[c];
+	printf("%s on %s,", cand->bench, cand->board);
+	print_config(cand);
+	printf("\n");
+	print_runs("baseline runs", db, base_set);
+	print_runs("candidate runs", db, cand_set);
+	printf("\n%-24s %-6s %20s %20s %8s %7s  %s\n", "metric", "unit",
+	       "baseline", "candidate", "change", "p", "");
+
+	for (i = 0; i < cand->metrics->n; i++) {
+		m = &cand->metrics->items[i];
+		unit = json_str(m, "unit");
+		better = json_str(m, "better");
+		higher = !better || strcmp(better, "lower");
+		pool_metric(db, cand_set, cand->metrics->keys[i], &cp);
+		pool_metric(db, base_set, cand->metrics->keys[i], &bp);
+		if (!cp.n || !bp.n) {
+			printf("%-24s %-6s %20s\n", cand->metrics->keys[i],
+			       unit ? unit : "", "no baseline");
+			continue;
+		}
+		stats(&bp, &bm, &bv);
+		stats(&cp, &cm, &cv);
+		change = bm ? (cm - bm) / fabs(bm) * 100 : 0;
+		p = welch_p(&bp, &cp);
+
+		verdict = "";
+		if (higher ? change < -threshold : change > threshold) {
+			if (p < 0) {
+				verdict = "REGRESSION (untested)";
+				untested = 1;
+				regressions++;
+			} else if (p < alpha) {
+				verdict = "REGRESSION";
+				regressions++;
+			} else {
+				verdict = "noise";
+			}
+		} else if (higher ? change > threshold : change < -threshold) {
+			verdict = p < 0 || p < alpha ? "improved" : "noise";
+		}
+		printf("%-24s %-6s %11.4g ±%-6.2g%2zu %11.4g ±%-6.2g%2zu %+7.1f%% ",
+		       cand->metrics->keys[i], unit ? unit : "", bm, sqrt(bv),
+		       bp.n, cm, sqrt(cv), cp.n, change);
+		if (p < 0)
+			printf("%7s  %s\n", "-", verdict);
+		else
+			printf("%7.3f  %s\n", p, verdict);
+	}
+
+	printf("\n%d regression%s beyond %g%% at alpha %g\n", regressions,
+	       regressions == 1 ? "" : "s", threshold, alpha);
+	if (untested)
+		printf("(untested: under two samples on a side, threshold only)\n");
+
+	free(bp.v);
+	free(cp.v);
+	free(base_set);
+	free(cand_set);
+	return regressions ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = getenv("BENCHDB");
+	double threshold = DEFAULT_THRESHOLD, alpha = DEFAULT_ALPHA;
+	struct db db = { 0 };
+	const char *cmd;
+	int opt, ret = 0;
+	size_t i;
+
+	/* Options may come before or after the command */
+	while ((opt = getopt(argc, argv, "+f:")) != -1) {
+		if (opt != 'f')
+			usage();
+		path = optarg;
+	}
+	if (optind >= argc || !path)
+		usage();
+	cmd = argv[optind];
+	argc -= optind;
+	argv += optind;
+	/* Restarts the scan with the command as argv[0] */
+	optind = 0;
+	while ((opt = getopt(argc, argv, "f:t:a:")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 't':
+			threshold = atof(optarg);
+			break;
+		case 'a':
+			alpha = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (threshold < 0 || alpha <= 0 || alpha >= 1)
+		usage();
+
+	load(path, &db);
+	if (!strcmp(cmd, "list") && argc - optind <= 1)
+		cmd_list(&db, optind < argc ? argv[optind] : NULL);
+	else if (!strcmp(cmd, "compare") && argc - optind >= 1 &&
+		 argc - optind <= 2)
+		ret = cmd_compare(&db, argv[optind],
+				  optind + 1 < argc ? argv[optind + 1] : "last",
+				  threshold, alpha);
+	else
+		usage();
+
+	for (i = 0; i < db.n; i++)
+		json_free(&db.runs[i].root);
+	free(db.runs);
+	return ret;
+}
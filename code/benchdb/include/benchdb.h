@@ -0,0 +1,51 @@
+/*
+ * Benchmark results store shared by the host programs and the benchdb
+ * tool. Every run is appended as one JSON object per line:
+ *
+ *   {"time":1760771234,"rev":"114c48a","board":"rpi3-aarch64",
+ *    "bench":"auth_enc-dec","config":{"file_size":"1048576",...},
+ *    "metrics":{"enc_mb_s":{"unit":"MB/s","better":"higher",
+ *                           "samples":[41.2,40.9]},...}}
+ *
+ * Recording is off unless BENCHDB names the file, so the hosts call the
+ * functions below unconditionally. BENCHDB_REV and BENCHDB_BOARD
+ * override the git revision the host was built from and the uname()
+ * machine description.
+ */
+#ifndef BENCHDB_H
+#define BENCHDB_H
+
+enum benchdb_better {
+	BENCHDB_HIGHER,		/* throughput */
+	BENCHDB_LOWER,		/* latency, time */
+};
+
+struct benchdb_run;
+
+/* Starts a record for bench; NULL when BENCHDB is unset */
+struct benchdb_run *benchdb_begin(const char *bench);
+
+/*
+ * Runs are only compared with runs of the same bench, board and config,
+ * so config holds whatever changes the numbers: sizes, I/O paths, data
+ * profile. A NULL run is ignored here and below.
+ */
+void benchdb_config(struct benchdb_run *run, const char *key,
+		    const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/* Adds one raw sample; the first sample of a metric fixes unit and better */
+void benchdb_sample(struct benchdb_run *run, const char *metric,
+		    const char *unit, enum benchdb_better better,
+		    double value);
+
+/*
+ * Appends the record with a single locked write and frees the run.
+ * Returns -1 if it could not be written.
+ */
+int benchdb_commit(struct benchdb_run *run);
+
+/* Frees the run without recording it, e.g. after a failed benchmark */
+void benchdb_discard(struct benchdb_run *run);
+
+#endif /* BENCHDB_H */
@@ -0,0 +1,330 @@
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* TA API: UUID, command IDs and the shared counter */
+#include <crypto_bench_ta.h>
+
+/* Results store, when BENCHDB is set */
+#include <benchdb.h>
+
+#define MIN_CHUNK 16
+#define DEFAULT_TOTAL (4 * 1024 * 1024)
+#define DEFAULT_REPEATS 3
+#define MAX_SIZES 32
+/* GP overhead counts as amortized once it is this share of a call */
+#define OVERHEAD_PCT 10
+
+/* TEE resources */
+struct test_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+};
+
+static const struct {
+	uint32_t alg;
+	const char *name;
+	const char *opt;
+} algs[] = {
+	{ CB_ALG_AES_CBC, "AES-256-CBC encrypt", "aes" },
+	{ CB_ALG_SHA256, "SHA-256", "sha" },
+};
+
+void prepare_tee_session(struct test_ctx *ctx)
+{
+	TEEC_UUID uuid = TA_CRYPTO_BENCH_UUID;
+	uint32_t origin;
+	TEEC_Result res;
+
+	/* Initialize a context connecting us to the TEE */
+	res = TEEC_InitializeContext(NULL, &ctx->ctx);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	/* Open a session with the TA */
+	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
+			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+			res, origin);
+}
+
+void terminate_tee_session(struct test_ctx *ctx)
+{
+	TEEC_CloseSession(&ctx->sess);
+	TEEC_FinalizeContext(&ctx->ctx);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: optee_example_crypto_bench [options]\n"
+		"  -a aes|sha   one algorithm only (default: both)\n"
+		"  -m bytes     largest chunk, a power of two (default %d)\n"
+		"  -t bytes     data per measurement (default %d)\n"
+		"  -r repeats   best of this many runs (default %d)\n",
+		CB_MAX_CHUNK, DEFAULT_TOTAL, DEFAULT_REPEATS);
+	exit(1);
+}
+
+static void get_info(struct test_ctx *ctx, uint32_t *features,
+		     uint32_t *freq)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	res = TEEC_InvokeCommand(&ctx->sess, TA_CRYPTO_BENCH_CMD_GET_INFO,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InvokeCommand(GET_INFO) failed 0x%x origin 0x%x",
+			res, origin);
+	*features = op.params[0].value.a;
+	*freq = op.params[0].value.b;
+}
+
+static void selftest(struct test_ctx *ctx)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	res = TEEC_InvokeCommand(&ctx->sess, TA_CRYPTO_BENCH_CMD_SELFTEST,
+				 &op, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "In-TA crypto does not match the GP API (0x%x origin 0x%x), not benchmarking it",
+			res, origin);
+}
+
+/*
+ * The counter's rate when the TA cannot report it (the emulator's TSC):
+ * both worlds read the same counter, so the host can time it.
+ */
+static double calibrate_freq(void)
+{
+	struct timespec start, end, pause = { 0, 200 * 1000 * 1000 };
+	uint64_t t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	t0 = cb_counter();
+	nanosleep(&pause, NULL);
+	t1 = cb_counter();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (t1 - t0) / ((end.tv_sec - start.tv_sec) +
+			    (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+/* Best ticks per call over the repeats; each repeat in samples[] */
+static double run(struct test_ctx *ctx, uint32_t alg, uint32_t impl,
+		  uint32_t size, uint32_t iterations, int repeats,
+		  double *samples)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+	uint64_t ticks, best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < repeats; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].value.a = alg;
+		op.params[0].value.b = impl;
+		op.params[1].value.a = size;
+		op.params[1].value.b = iterations;
+		res = TEEC_InvokeCommand(&ctx->sess, TA_CRYPTO_BENCH_CMD_RUN,
+					 &op, &origin);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_InvokeCommand(RUN) failed 0x%x origin 0x%x",
+				res, origin);
+		ticks = ((uint64_t)op.params[2].value.b << 32) |
+			op.params[2].value.a;
+		samples[i] = (double)ticks / iterations;
+		if (ticks < best)
+			best = ticks;
+	}
+	return (double)best / iterations;
+}
+
+static const char *fmt_size(char *buf, size_t len, uint32_t size)
+{
+	if (size >= 1024 * 1024 && !(size % (1024 * 1024)))
+		snprintf(buf, len, "%uM", size / (1024 * 1024));
+	else if (size >= 1024 && !(size % 1024))
+		snprintf(buf, len, "%uK", size / 1024);
+	else
+		snprintf(buf, len, "%u", size);
+	return buf;
+}
+
+static double mb_per_s(uint32_t size, double ticks, double freq)
+{
+	return size / (ticks / freq) / (1024.0 * 1024.0);
+}
+
+/* Every repeat is a sample, e.g. aes_gp_4K and aes_ta_4K in MB/s */
+static void record(struct benchdb_run *db, int a, const char *impl,
+		   uint32_t size, const double *samples, int repeats,
+		   double freq)
+{
+	char name[64], buf[16];
+	int i;
+
+	snprintf(name, sizeof(name), "%s_%s_%s", algs[a].opt, impl,
+		 fmt_size(buf, sizeof(buf), size));
+	for (i = 0; i < repeats; i++)
+		benchdb_sample(db, name, "MB/s", BENCHDB_HIGHER,
+			       mb_per_s(size, samples[i], freq));
+}
+
+static void bench_alg(struct test_ctx *ctx, int a, uint32_t max_chunk,
+		      uint32_t total, int repeats, double freq,
+		      struct benchdb_run *db)
+{
+	uint32_t sizes[MAX_SIZES] = { 0 };
+	double gp[MAX_SIZES] = { 0 }, sw[MAX_SIZES] = { 0 };
+	double per_byte, overhead;
+	uint32_t size, iterations;
+	int n = 0, i, amortized = -1, sw_wins = -1;
+	char buf[16];
+	double *samples;
+
+	samples = calloc(repeats, sizeof(*samples));
+	if (!samples)
+		errx(1, "Out of memory");
+
+	printf("\n%s, one update call per chunk\n", algs[a].name);
+	printf("%8s %12s %12s %9s %12s\n", "chunk", "GP MB/s", "in-TA MB/s",
+	       "GP/in-TA", "GP us/call");
+
+	for (size = MIN_CHUNK; size <= max_chunk && n < MAX_SIZES; size *= 2) {
+		iterations = total / size ? total / size : 1;
+		sizes[n] = size;
+		gp[n] = run(ctx, algs[a].alg, CB_IMPL_GP, size, iterations,
+			    repeats, samples);
+		record(db, a, "gp", size, samples, repeats, freq);
+		sw[n] = run(ctx, algs[a].alg, CB_IMPL_SW, size, iterations,
+			    repeats, samples);
+		record(db, a, "ta", size, samples, repeats, freq);
+		printf("%8s %12.1f %12.1f %9.2f %12.2f\n",
+		       fmt_size(buf, sizeof(buf), size),
+		       mb_per_s(size, gp[n], freq), mb_per_s(size, sw[n], freq),
+		       sw[n] / gp[n], gp[n] / freq * 1e6);
+		n++;
+	}
+	free(samples);
+
+	/*
+	 * A GP call costs a fixed overhead plus a per-byte rate; the largest
+	 * chunk gives the rate, the smallest the overhead.
+	 */
+	per_byte = gp[n - 1] / sizes[n - 1];
+	overhead = gp[0] - sizes[0] * per_byte;
+	if (overhead < 0)
+		overhead = 0;
+	for (i = 0; i < n; i++) {
+		if (amortized < 0 && overhead <= gp[i] * OVERHEAD_PCT / 100)
+			amortized = i;
+		if (sw[i] < gp[i])
+			sw_wins = i;
+	}
+
+	printf("GP per-call overhead about %.2f us", overhead / freq * 1e6);
+	if (amortized >= 0)
+		printf(", under %d%% of the call from %s chunks\n",
+		       OVERHEAD_PCT, fmt_size(buf, sizeof(buf),
+					      sizes[amortized]));
+	else
+		printf(", still over %d%% of the call at %s chunks\n",
+		       OVERHEAD_PCT, fmt_size(buf, sizeof(buf),
+					      sizes[n - 1]));
+	if (sw_wins < 0)
+		printf("GP API faster at every chunk size\n");
+	else if (sw_wins == n - 1)
+		printf("In-TA code faster at every chunk size, %.2fx at %s\n",
+		       gp[n - 1] / sw[n - 1],
+		       fmt_size(buf, sizeof(buf), sizes[n - 1]));
+	else
+		printf("In-TA code faster up to %s chunks\n",
+		       fmt_size(buf, sizeof(buf), sizes[sw_wins]));
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_ctx ctx;
+	struct benchdb_run *db;
+	uint32_t features, ta_freq;
+	uint32_t max_chunk = CB_MAX_CHUNK, total = DEFAULT_TOTAL;
+	int repeats = DEFAULT_REPEATS, only = -1;
+	double freq;
+	size_t a;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:m:t:r:")) != -1) {
+		switch (opt) {
+		case 'a':
+			for (a = 0; a < sizeof(algs) / sizeof(algs[0]); a++)
+				if (!strcmp(optarg, algs[a].opt))
+					only = a;
+			if (only < 0)
+				usage();
+			break;
+		case 'm':
+			max_chunk = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			total = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (max_chunk < MIN_CHUNK || max_chunk > CB_MAX_CHUNK ||
+	    (max_chunk & (max_chunk - 1)) || !total || repeats < 1)
+		usage();
+
+	prepare_tee_session(&ctx);
+
+	get_info(&ctx, &features, &ta_freq);
+	selftest(&ctx);
+	freq = ta_freq ? ta_freq : calibrate_freq();
+
+	printf("In-TA AES: %s, SHA-256: %s; counter %.1f MHz%s\n",
+	       features & CB_SW_AES_CE ? "ARMv8 CE" : "C",
+	       features & CB_SW_SHA256_CE ? "ARMv8 CE" : "C", freq / 1e6,
+	       ta_freq ? "" : " (calibrated)");
+	printf("%u bytes per measurement, best of %d\n", total, repeats);
+
+	db = benchdb_begin("crypto_bench");
+	benchdb_config(db, "total", "%u", total);
+	benchdb_config(db, "max_chunk", "%u", max_chunk);
+	benchdb_config(db, "algs", "%s", only < 0 ? "all" : algs[only].opt);
+	benchdb_config(db, "features", "0x%x", features);
+
+	for (a = 0; a < sizeof(algs) / sizeof(algs[0]); a++)
+		if (only < 0 || (size_t)only == a)
+			bench_alg(&ctx, a, max_chunk, total, repeats, freq,
+				  db);
+	benchdb_commit(db);
+
+	terminate_tee_session(&ctx);
+	return 0;
+}
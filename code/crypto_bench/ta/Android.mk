@@ -0,0 +1,4 @@
+LOCAL_PATH := $(call my-dir)
+
+local_module := d2d0867e-dcdd-4a3f-8114-a7ad0c9b147b.ta
+include $(BUILD_OPTEE_MK)
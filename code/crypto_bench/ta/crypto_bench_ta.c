@@ -0,0 +1,289 @@
+#include <inttypes.h>
+#include <string.h>
+#include <crypto_bench_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "sw_crypto.h"
+
+#define AES_KEY_SIZE 32
+#define AES_IV_SIZE 16
+#define SHA256_SIZE 32
+#define SELFTEST_SIZE 4096
+
+/* One key per session, shared by both implementations */
+struct bench_session {
+	uint8_t key[AES_KEY_SIZE];
+	TEE_ObjectHandle key_handle;
+	struct sw_aes sw_key;
+};
+
+static TEE_Result gp_cipher_start(struct bench_session *sess,
+				  TEE_OperationHandle *op, const uint8_t *iv)
+{
+	TEE_Result res;
+
+	res = TEE_AllocateOperation(op, TEE_ALG_AES_CBC_NOPAD,
+				    TEE_MODE_ENCRYPT, AES_KEY_SIZE * 8);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_AllocateOperation (cipher) failed: 0x%x", res);
+		return res;
+	}
+	res = TEE_SetOperationKey(*op, sess->key_handle);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_SetOperationKey failed: 0x%x", res);
+		TEE_FreeOperation(*op);
+		return res;
+	}
+	TEE_CipherInit(*op, iv, AES_IV_SIZE);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result gp_digest_start(TEE_OperationHandle *op)
+{
+	TEE_Result res;
+
+	res = TEE_AllocateOperation(op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+	if (res != TEE_SUCCESS)
+		EMSG("TEE_AllocateOperation (digest) failed: 0x%x", res);
+	return res;
+}
+
+static TEE_Result get_info(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	params[0].value.a = sw_crypto_features();
+	params[0].value.b = cb_counter_freq();
+	return TEE_SUCCESS;
+}
+
+/*
+ * Both implementations on the same random data, fed in uneven pieces so
+ * the in-TA code's buffering and IV chaining are exercised too.
+ */
+static TEE_Result selftest(struct bench_session *sess, uint32_t param_types)
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	TEE_OperationHandle op = TEE_HANDLE_NULL;
+	struct sw_sha256 sha;
+	uint8_t iv[AES_IV_SIZE];
+	uint8_t gp_digest[SHA256_SIZE], sw_digest[SHA256_SIZE];
+	uint8_t *in, *gp_out, *sw_out;
+	uint32_t out_len = SELFTEST_SIZE;
+	uint32_t digest_len = sizeof(gp_digest);
+	TEE_Result res;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	in = TEE_Malloc(3 * SELFTEST_SIZE, TEE_MALLOC_FILL_ZERO);
+	if (!in)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	gp_out = in + SELFTEST_SIZE;
+	sw_out = gp_out + SELFTEST_SIZE;
+	TEE_GenerateRandom(in, SELFTEST_SIZE);
+	TEE_GenerateRandom(iv, sizeof(iv));
+
+	res = gp_cipher_start(sess, &op, iv);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TEE_CipherUpdate(op, in, SELFTEST_SIZE, gp_out, &out_len);
+	TEE_FreeOperation(op);
+	if (res != TEE_SUCCESS)
+		goto out;
+	sw_aes_cbc_encrypt(&sess->sw_key, iv, in, sw_out, 1008);
+	sw_aes_cbc_encrypt(&sess->sw_key, iv, in + 1008, sw_out + 1008,
+			   SELFTEST_SIZE - 1008);
+	if (out_len != SELFTEST_SIZE ||
+	    TEE_MemCompare(gp_out, sw_out, SELFTEST_SIZE)) {
+		EMSG("In-TA AES-CBC differs from TEE_CipherUpdate");
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = gp_digest_start(&op);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = TEE_DigestDoFinal(op, in, SELFTEST_SIZE - 1, gp_digest,
+				&digest_len);
+	TEE_FreeOperation(op);
+	if (res != TEE_SUCCESS)
+		goto out;
+	sw_sha256_init(&sha);
+	sw_sha256_update(&sha, in, 37);
+	sw_sha256_update(&sha, in + 37, SELFTEST_SIZE - 1 - 37);
+	sw_sha256_final(&sha, sw_digest);
+	if (TEE_MemCompare(gp_digest, sw_digest, SHA256_SIZE)) {
+		EMSG("In-TA SHA-256 differs from TEE_DigestDoFinal");
+		res = TEE_ERROR_GENERIC;
+	}
+out:
+	TEE_Free(in);
+	return res;
+}
+
+static TEE_Result run(struct bench_session *sess, uint32_t param_types,
+		      TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	uint32_t alg = params[0].value.a;
+	uint32_t impl = params[0].value.b;
+	uint32_t size = params[1].value.a;
+	uint32_t iterations = params[1].value.b;
+	TEE_OperationHandle op = TEE_HANDLE_NULL;
+	struct sw_sha256 sha;
+	uint8_t iv[AES_IV_SIZE] = { 0 };
+	uint8_t digest[SHA256_SIZE];
+	uint32_t digest_len = sizeof(digest);
+	uint8_t *in, *out;
+	uint32_t out_len, i;
+	uint64_t start, ticks;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (alg > CB_ALG_SHA256 || impl > CB_IMPL_SW || !iterations ||
+	    !size || size > CB_MAX_CHUNK || size % AES_IV_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* TA-private buffers, so shared memory plays no part */
+	in = TEE_Malloc(2 * size, 0);
+	if (!in)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	out = in + size;
+	TEE_GenerateRandom(in, size);
+
+	if (impl == CB_IMPL_GP) {
+		res = alg == CB_ALG_AES_CBC ? gp_cipher_start(sess, &op, iv) :
+					      gp_digest_start(&op);
+		if (res != TEE_SUCCESS)
+			goto out;
+	} else if (alg == CB_ALG_SHA256) {
+		sw_sha256_init(&sha);
+	}
+
+	/* One update per iteration, as the crypto TAs make one per chunk */
+	start = cb_counter();
+	for (i = 0; i < iterations && res == TEE_SUCCESS; i++) {
+		if (impl == CB_IMPL_SW && alg == CB_ALG_AES_CBC) {
+			sw_aes_cbc_encrypt(&sess->sw_key, iv, in, out, size);
+		} else if (impl == CB_IMPL_SW) {
+			sw_sha256_update(&sha, in, size);
+		} else if (alg == CB_ALG_AES_CBC) {
+			out_len = size;
+			res = TEE_CipherUpdate(op, in, size, out, &out_len);
+		} else {
+			TEE_DigestUpdate(op, in, size);
+		}
+	}
+	ticks = cb_counter() - start;
+
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_CipherUpdate failed: 0x%x", res);
+		goto out;
+	}
+	/* Finish the hash so none of the work can be skipped */
+	if (alg == CB_ALG_SHA256 && impl == CB_IMPL_GP)
+		res = TEE_DigestDoFinal(op, NULL, 0, digest, &digest_len);
+	else if (alg == CB_ALG_SHA256)
+		sw_sha256_final(&sha, digest);
+
+	DMSG("%s %s: %u x %u bytes, %" PRIu64 " ticks",
+	     alg == CB_ALG_AES_CBC ? "aes-cbc" : "sha256",
+	     impl == CB_IMPL_GP ? "gp" : "sw", iterations, size, ticks);
+
+	params[2].value.a = (uint32_t)ticks;
+	params[2].value.b = (uint32_t)(ticks >> 32);
+out:
+	if (op != TEE_HANDLE_NULL)
+		TEE_FreeOperation(op);
+	TEE_Free(in);
+	return res;
+}
+
+TEE_Result TA_CreateEntryPoint(void)
+{
+	return TEE_SUCCESS;
+}
+
+void TA_DestroyEntryPoint(void)
+{
+}
+
+TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
+				    TEE_Param __unused params[4],
+				    void **session)
+{
+	struct bench_session *sess;
+	TEE_Attribute attr;
+	TEE_Result res;
+
+	sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+	if (!sess)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	TEE_GenerateRandom(sess->key, sizeof(sess->key));
+	sw_aes_setkey(&sess->sw_key, sess->key, sizeof(sess->key));
+
+	res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_KEY_SIZE * 8,
+					  &sess->key_handle);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_AllocateTransientObject failed: 0x%x", res);
+		TEE_Free(sess);
+		return res;
+	}
+	TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, sess->key,
+			     sizeof(sess->key));
+	res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
+	if (res != TEE_SUCCESS) {
+		EMSG("TEE_PopulateTransientObject failed: 0x%x", res);
+		TEE_FreeTransientObject(sess->key_handle);
+		TEE_Free(sess);
+		return res;
+	}
+
+	*session = sess;
+	return TEE_SUCCESS;
+}
+
+void TA_CloseSessionEntryPoint(void *session)
+{
+	struct bench_session *sess = session;
+
+	TEE_FreeTransientObject(sess->key_handle);
+	TEE_Free(sess);
+}
+
+TEE_Result TA_InvokeCommandEntryPoint(void *session,
+				      uint32_t command,
+				      uint32_t param_types,
+				      TEE_Param params[4])
+{
+	switch (command) {
+	case TA_CRYPTO_BENCH_CMD_GET_INFO:
+		return get_info(param_types, params);
+	case TA_CRYPTO_BENCH_CMD_SELFTEST:
+		return selftest(session, param_types);
+	case TA_CRYPTO_BENCH_CMD_RUN:
+		return run(session, param_types, params);
+	default:
+		EMSG("Command ID 0x%x is not supported", command);
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+}
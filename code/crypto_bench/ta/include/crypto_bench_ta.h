@@ -0,0 +1,104 @@
+/*
+ * AES and SHA-256 inside the TA, through the GP Internal API and through
+ * the TA's own software (or ARMv8 Crypto Extensions) implementation, to
+ * see what the per-call cost of the GP path is worth across chunk sizes.
+ */
+#ifndef __CRYPTO_BENCH_TA_H__
+#define __CRYPTO_BENCH_TA_H__
+
+#include <stdint.h>
+
+/* UUID of the trusted application */
+#define TA_CRYPTO_BENCH_UUID \
+		{ 0xd2d0867e, 0xdcdd, 0x4a3f, \
+			{ 0x81, 0x14, 0xa7, 0xad, 0x0c, 0x9b, 0x14, 0x7b } }
+
+/* Algorithms, the ones the crypto TAs use */
+#define CB_ALG_AES_CBC		0	/* AES-256-CBC-NOPAD encrypt */
+#define CB_ALG_SHA256		1
+
+/* Implementations */
+#define CB_IMPL_GP		0	/* TEE_CipherUpdate / TEE_DigestUpdate */
+#define CB_IMPL_SW		1	/* in-TA code */
+
+/* Flags in TA_CRYPTO_BENCH_CMD_GET_INFO param[0].value.a */
+#define CB_SW_AES_CE		(1 << 0)
+#define CB_SW_SHA256_CE		(1 << 1)
+
+/* Largest chunk TA_CRYPTO_BENCH_CMD_RUN accepts */
+#define CB_MAX_CHUNK		(256 * 1024)
+
+/*
+ * TA_CRYPTO_BENCH_CMD_GET_INFO - How the in-TA code was built
+ * param[0] (value output) a: CB_SW_* flags,
+ *          b: counter frequency in Hz, 0 if unknown
+ * param[1] unused
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_CRYPTO_BENCH_CMD_GET_INFO	0
+
+/*
+ * TA_CRYPTO_BENCH_CMD_SELFTEST - Check the in-TA code against the GP API
+ * on random data. Returns TEE_ERROR_GENERIC on a mismatch.
+ * param[0..3] unused
+ */
+#define TA_CRYPTO_BENCH_CMD_SELFTEST	1
+
+/*
+ * TA_CRYPTO_BENCH_CMD_RUN - Process one TA-private chunk repeatedly, one
+ * update call per iteration
+ * param[0] (value input) a: CB_ALG_*, b: CB_IMPL_*
+ * param[1] (value input) a: chunk size, a multiple of 16 up to
+ *          CB_MAX_CHUNK, b: iterations
+ * param[2] (value output) a/b: counter ticks for all iterations, low/high
+ * param[3] unused
+ */
+#define TA_CRYPTO_BENCH_CMD_RUN		2
+
+/*
+ * The timer both worlds read. Only the update loop is timed; operation
+ * setup and the invoke itself are not.
+ */
+static inline uint64_t cb_counter(void)
+{
+#if defined(__aarch64__)
+	uint64_t v;
+
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+	return v;
+#elif defined(__arm__)
+	uint32_t lo, hi;
+
+	__asm__ volatile("isb; mrrc p15, 1, %0, %1, c14"
+			 : "=r"(lo), "=r"(hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+
+	/* Emulator builds: the TSC */
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+#error "No cycle counter for this architecture"
+#endif
+}
+
+static inline uint32_t cb_counter_freq(void)
+{
+#if defined(__aarch64__)
+	uint64_t v;
+
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r"(v));
+	return (uint32_t)v;
+#elif defined(__arm__)
+	uint32_t v;
+
+	__asm__ volatile("mrc p15, 0, %0, c14, c0, 0" : "=r"(v));
+	return v;
+#else
+	return 0;
+#endif
+}
+
+#endif /* __CRYPTO_BENCH_TA_H__ */
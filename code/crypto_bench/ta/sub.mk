@@ -0,0 +1,6 @@
+global-incdirs-y += include
+srcs-y += crypto_bench_ta.c
+srcs-y += sw_crypto.c
+ifeq ($(CFG_CRYPTO_BENCH_CE),y)
+cflags-sw_crypto.c-y += -march=armv8-a+crypto
+endif
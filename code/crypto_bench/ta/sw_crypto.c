@@ -0,0 +1,355 @@
+#include <string.h>
+
+#include <crypto_bench_ta.h>
+
+#include "sw_crypto.h"
+
+#if defined(__aarch64__) && \
+	(defined(__ARM_FEATURE_CRYPTO) || \
+	 (defined(__ARM_FEATURE_AES) && defined(__ARM_FEATURE_SHA2)))
+#define SW_CRYPTO_CE 1
+#include <arm_neon.h>
+#else
+#define SW_CRYPTO_CE 0
+#endif
+
+static uint8_t aes_sbox[256];
+/* Combined SubBytes/ShiftRows/MixColumns, one table per byte position */
+static uint32_t aes_te[4][256];
+static int aes_tables_ready;
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror32(uint32_t x, unsigned int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline uint8_t rol8(uint8_t x, unsigned int n)
+{
+	return (uint8_t)((x << n) | (x >> (8 - n)));
+}
+
+static inline uint8_t xtime(uint8_t x)
+{
+	return (uint8_t)((x << 1) ^ (x & 0x80 ? 0x1b : 0));
+}
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/*
+ * The S-box from its definition rather than a 256-byte literal: p walks
+ * the multiplicative group by powers of 3 while q walks it by powers of
+ * 1/3, so q is always the inverse of p.
+ */
+static void aes_init_tables(void)
+{
+	uint8_t p = 1, q = 1, s;
+	int i;
+
+	do {
+		p = p ^ xtime(p);
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if (q & 0x80)
+			q ^= 0x09;
+		aes_sbox[p] = q ^ rol8(q, 1) ^ rol8(q, 2) ^ rol8(q, 3) ^
+			      rol8(q, 4) ^ 0x63;
+	} while (p != 1);
+	aes_sbox[0] = 0x63;
+
+	for (i = 0; i < 256; i++) {
+		s = aes_sbox[i];
+		aes_te[0][i] = ((uint32_t)xtime(s) << 24) | ((uint32_t)s << 16) |
+			       ((uint32_t)s << 8) | (uint8_t)(xtime(s) ^ s);
+		aes_te[1][i] = ror32(aes_te[0][i], 8);
+		aes_te[2][i] = ror32(aes_te[0][i], 16);
+		aes_te[3][i] = ror32(aes_te[0][i], 24);
+	}
+	aes_tables_ready = 1;
+}
+
+static uint32_t aes_sub_word(uint32_t w)
+{
+	return ((uint32_t)aes_sbox[w >> 24] << 24) |
+	       ((uint32_t)aes_sbox[(w >> 16) & 0xff] << 16) |
+	       ((uint32_t)aes_sbox[(w >> 8) & 0xff] << 8) |
+	       aes_sbox[w & 0xff];
+}
+
+uint32_t sw_crypto_features(void)
+{
+	return SW_CRYPTO_CE ? CB_SW_AES_CE | CB_SW_SHA256_CE : 0;
+}
+
+int sw_aes_setkey(struct sw_aes *ctx, const uint8_t *key, size_t key_len)
+{
+	unsigned int nk = key_len / 4;
+	unsigned int i, total;
+	uint8_t rcon = 1;
+	uint32_t t;
+
+	if (key_len != 16 && key_len != 24 && key_len != 32)
+		return -1;
+	if (!aes_tables_ready)
+		aes_init_tables();
+
+	ctx->rounds = nk + 6;
+	total = 4 * (ctx->rounds + 1);
+	for (i = 0; i < nk; i++)
+		ctx->rk[i] = load_be32(key + 4 * i);
+	for (i = nk; i < total; i++) {
+		t = ctx->rk[i - 1];
+		if (i % nk == 0) {
+			t = aes_sub_word((t << 8) | (t >> 24)) ^
+			    ((uint32_t)rcon << 24);
+			rcon = xtime(rcon);
+		} else if (nk > 6 && i % nk == 4) {
+			t = aes_sub_word(t);
+		}
+		ctx->rk[i] = ctx->rk[i - nk] ^ t;
+	}
+	return 0;
+}
+
+#if SW_CRYPTO_CE
+
+void sw_aes_cbc_encrypt(const struct sw_aes *ctx, uint8_t iv[16],
+			const uint8_t *in, uint8_t *out, size_t len)
+{
+	uint8x16_t rk[15], state = vld1q_u8(iv);
+	uint8_t bytes[16];
+	unsigned int i, r;
+
+	/* The Crypto Extensions take round keys as bytes in key order */
+	for (r = 0; r <= ctx->rounds; r++) {
+		for (i = 0; i < 4; i++)
+			store_be32(bytes + 4 * i, ctx->rk[4 * r + i]);
+		rk[r] = vld1q_u8(bytes);
+	}
+
+	for (; len >= 16; len -= 16, in += 16, out += 16) {
+		state = veorq_u8(state, vld1q_u8(in));
+		for (r = 0; r < ctx->rounds - 1; r++)
+			state = vaesmcq_u8(vaeseq_u8(state, rk[r]));
+		state = vaeseq_u8(state, rk[r]);
+		state = veorq_u8(state, rk[r + 1]);
+		vst1q_u8(out, state);
+	}
+	vst1q_u8(iv, state);
+}
+
+static void sha256_blocks(uint32_t h[8], const uint8_t *p, size_t blocks)
+{
+	uint32x4_t abcd = vld1q_u32(h), efgh = vld1q_u32(h + 4);
+	uint32x4_t abcd_save, efgh_save, wk, t, m[4];
+	int i;
+
+	while (blocks--) {
+		abcd_save = abcd;
+		efgh_save = efgh;
+		for (i = 0; i < 4; i++)
+			m[i] = vreinterpretq_u32_u8(vrev32q_u8(
+					vld1q_u8(p + 16 * i)));
+
+		/* 16 groups of 4 rounds; groups 0-11 extend the schedule */
+		for (i = 0; i < 16; i++) {
+			wk = vaddq_u32(m[i & 3], vld1q_u32(sha256_k + 4 * i));
+			if (i < 12)
+				m[i & 3] = vsha256su1q_u32(
+					vsha256su0q_u32(m[i & 3],
+							m[(i + 1) & 3]),
+					m[(i + 2) & 3], m[(i + 3) & 3]);
+			t = abcd;
+			abcd = vsha256hq_u32(abcd, efgh, wk);
+			efgh = vsha256h2q_u32(efgh, t, wk);
+		}
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		efgh = vaddq_u32(efgh, efgh_save);
+		p += 64;
+	}
+	vst1q_u32(h, abcd);
+	vst1q_u32(h + 4, efgh);
+}
+
+#else
+
+#define AES_ROUND(d, s, rk) \
+	((d)[0] = aes_te[0][(s)[0] >> 24] ^ aes_te[1][((s)[1] >> 16) & 0xff] ^ \
+		  aes_te[2][((s)[2] >> 8) & 0xff] ^ aes_te[3][(s)[3] & 0xff] ^ \
+		  (rk)[0], \
+	 (d)[1] = aes_te[0][(s)[1] >> 24] ^ aes_te[1][((s)[2] >> 16) & 0xff] ^ \
+		  aes_te[2][((s)[3] >> 8) & 0xff] ^ aes_te[3][(s)[0] & 0xff] ^ \
+		  (rk)[1], \
+	 (d)[2] = aes_te[0][(s)[2] >> 24] ^ aes_te[1][((s)[3] >> 16) & 0xff] ^ \
+		  aes_te[2][((s)[0] >> 8) & 0xff] ^ aes_te[3][(s)[1] & 0xff] ^ \
+		  (rk)[2], \
+	 (d)[3] = aes_te[0][(s)[3] >> 24] ^ aes_te[1][((s)[0] >> 16) & 0xff] ^ \
+		  aes_te[2][((s)[1] >> 8) & 0xff] ^ aes_te[3][(s)[2] & 0xff] ^ \
+		  (rk)[3])
+
+static uint32_t aes_last_word(const uint32_t s[4], int i, uint32_t rk)
+{
+	return (((uint32_t)aes_sbox[s[i] >> 24] << 24) |
+		((uint32_t)aes_sbox[(s[(i + 1) & 3] >> 16) & 0xff] << 16) |
+		((uint32_t)aes_sbox[(s[(i + 2) & 3] >> 8) & 0xff] << 8) |
+		aes_sbox[s[(i + 3) & 3] & 0xff]) ^ rk;
+}
+
+void sw_aes_cbc_encrypt(const struct sw_aes *ctx, uint8_t iv[16],
+			const uint8_t *in, uint8_t *out, size_t len)
+{
+	const uint32_t *rk = ctx->rk;
+	uint32_t s[4], t[4], c[4];
+	unsigned int r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		c[i] = load_be32(iv + 4 * i);
+
+	for (; len >= 16; len -= 16, in += 16, out += 16) {
+		for (i = 0; i < 4; i++)
+			s[i] = load_be32(in + 4 * i) ^ c[i] ^ rk[i];
+		for (r = 1; r < ctx->rounds; r++) {
+			AES_ROUND(t, s, rk + 4 * r);
+			memcpy(s, t, sizeof(s));
+		}
+		for (i = 0; i < 4; i++) {
+			c[i] = aes_last_word(s, i, rk[4 * r + i]);
+			store_be32(out + 4 * i, c[i]);
+		}
+	}
+	for (i = 0; i < 4; i++)
+		store_be32(iv + 4 * i, c[i]);
+}
+
+#define SHA_CH(x, y, z)		(((x) & (y)) ^ (~(x) & (z)))
+#define SHA_MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA_S0(x)		(ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22))
+#define SHA_S1(x)		(ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25))
+#define SHA_G0(x)		(ror32(x, 7) ^ ror32(x, 18) ^ ((x) >> 3))
+#define SHA_G1(x)		(ror32(x, 17) ^ ror32(x, 19) ^ ((x) >> 10))
+
+static void sha256_blocks(uint32_t h[8], const uint8_t *p, size_t blocks)
+{
+	uint32_t w[64], a, b, c, d, e, f, g, hh, t1, t2;
+	int i;
+
+	while (blocks--) {
+		for (i = 0; i < 16; i++)
+			w[i] = load_be32(p + 4 * i);
+		for (; i < 64; i++)
+			w[i] = SHA_G1(w[i - 2]) + w[i - 7] +
+			       SHA_G0(w[i - 15]) + w[i - 16];
+
+		a = h[0]; b = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+		for (i = 0; i < 64; i++) {
+			t1 = hh + SHA_S1(e) + SHA_CH(e, f, g) + sha256_k[i] +
+			     w[i];
+			t2 = SHA_S0(a) + SHA_MAJ(a, b, c);
+			hh = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+		p += 64;
+	}
+}
+
+#endif /* SW_CRYPTO_CE */
+
+void sw_sha256_init(struct sw_sha256 *ctx)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(ctx->h, iv, sizeof(iv));
+	ctx->len = 0;
+	ctx->used = 0;
+}
+
+void sw_sha256_update(struct sw_sha256 *ctx, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t n;
+
+	ctx->len += len;
+	if (ctx->used) {
+		n = sizeof(ctx->buf) - ctx->used;
+		if (n > len)
+			n = len;
+		memcpy(ctx->buf + ctx->used, p, n);
+		ctx->used += n;
+		p += n;
+		len -= n;
+		if (ctx->used < sizeof(ctx->buf))
+			return;
+		sha256_blocks(ctx->h, ctx->buf, 1);
+		ctx->used = 0;
+	}
+	/* Whole blocks straight from the caller's buffer */
+	sha256_blocks(ctx->h, p, len / 64);
+	p += len & ~(size_t)63;
+	len &= 63;
+	memcpy(ctx->buf, p, len);
+	ctx->used = len;
+}
+
+void sw_sha256_final(struct sw_sha256 *ctx, uint8_t digest[32])
+{
+	uint64_t bits = ctx->len * 8;
+	int i;
+
+	ctx->buf[ctx->used++] = 0x80;
+	if (ctx->used > 56) {
+		memset(ctx->buf + ctx->used, 0, 64 - ctx->used);
+		sha256_blocks(ctx->h, ctx->buf, 1);
+		ctx->used = 0;
+	}
+	memset(ctx->buf + ctx->used, 0, 56 - ctx->used);
+	store_be32(ctx->buf + 56, bits >> 32);
+	store_be32(ctx->buf + 60, bits);
+	sha256_blocks(ctx->h, ctx->buf, 1);
+	for (i = 0; i < 8; i++)
+		store_be32(digest + 4 * i, ctx->h[i]);
+}
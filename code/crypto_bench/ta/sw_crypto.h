@@ -0,0 +1,38 @@
+/*
+ * AES encryption and SHA-256 without the GP API. Built with
+ * -march=armv8-a+crypto on AArch64 (CFG_CRYPTO_BENCH_CE=y) they use the
+ * Crypto Extensions, otherwise plain C.
+ */
+#ifndef SW_CRYPTO_H
+#define SW_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct sw_aes {
+	uint32_t rk[60];		/* round keys, big-endian words */
+	unsigned int rounds;
+};
+
+struct sw_sha256 {
+	uint32_t h[8];
+	uint64_t len;
+	uint8_t buf[64];
+	size_t used;
+};
+
+/* CB_SW_* flags of what this build accelerates */
+uint32_t sw_crypto_features(void);
+
+/* key_len is 16, 24 or 32; returns -1 otherwise */
+int sw_aes_setkey(struct sw_aes *ctx, const uint8_t *key, size_t key_len);
+
+/* len is a multiple of 16; iv is updated to chain the next call */
+void sw_aes_cbc_encrypt(const struct sw_aes *ctx, uint8_t iv[16],
+			const uint8_t *in, uint8_t *out, size_t len);
+
+void sw_sha256_init(struct sw_sha256 *ctx);
+void sw_sha256_update(struct sw_sha256 *ctx, const void *data, size_t len);
+void sw_sha256_final(struct sw_sha256 *ctx, uint8_t digest[32]);
+
+#endif /* SW_CRYPTO_H */
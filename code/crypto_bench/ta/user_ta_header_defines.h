@@ -0,0 +1,22 @@
+/*
+ * The name of this file must not be modified
+ */
+
+#ifndef USER_TA_HEADER_DEFINES_H
+#define USER_TA_HEADER_DEFINES_H
+
+#include <crypto_bench_ta.h>
+
+#define TA_UUID				TA_CRYPTO_BENCH_UUID
+
+#define TA_FLAGS			(TA_FLAG_EXEC_DDR | TA_FLAG_SINGLE_INSTANCE)
+#define TA_STACK_SIZE			(4 * 1024)
+/* Input and output copies of the largest chunk, plus the selftest */
+#define TA_DATA_SIZE			(2 * CB_MAX_CHUNK + 32 * 1024)
+
+#define TA_CURRENT_TA_EXT_PROPERTIES \
+    { "gp.ta.description", USER_TA_PROP_TYPE_STRING, \
+        "GP crypto API vs in-TA AES and SHA-256 across chunk sizes" }, \
+    { "gp.ta.version", USER_TA_PROP_TYPE_U32, &(const uint32_t){ 0x0010 } }
+
+#endif /*USER_TA_HEADER_DEFINES_H*/
@@ -0,0 +1,77 @@
+# Builds libembench.a from an embench-iot checkout, for either side:
+# the host Makefile includes this with its native compiler, the TA
+# Makefile with the TA toolchain and dev kit headers. Both use the same
+# kernel list, defines and optimisation level, so the two builds differ
+# only in the world they run in.
+#
+# Include it after the makefile's default goal.
+#
+# In:  EMBENCH_DIR, EMBENCH_TA_DIR (for embench_run.h), EB_OUT, EB_CC,
+#      EB_LD, EB_OBJCOPY, EB_AR, EB_CFLAGS
+# Out: EB_LIB, i.e. $(EB_OUT)/libembench.a
+
+# Integer kernels only: TAs have no libm, which cubic, minver, nbody, st
+# and wikisort need.
+EMBENCH_KERNELS ?= aha-mont64 crc32 edn huffbench matmult-int md5sum \
+		   nettle-aes nettle-sha256 nsichneu picojpeg primecount \
+		   qrduino sglib-combined slre statemate tarfind ud
+
+# CPU_MHZ scales each kernel's inner repeat count; 1 keeps a run short
+EMBENCH_CPU_MHZ ?= 1
+
+EB_DEFS = -DCPU_MHZ=$(EMBENCH_CPU_MHZ) -DWARMUP_HEAT=1 \
+	  -I$(EMBENCH_DIR)/support
+EB_SYMS = initialise_benchmark warm_caches benchmark verify_benchmark
+
+eb_sym = $(subst -,_,$(1))
+
+EB_LIB = $(EB_OUT)/libembench.a
+
+ifeq ($(EMBENCH_DIR),)
+$(EB_LIB):
+	@echo 'Set EMBENCH_DIR to the absolute path of an embench-iot checkout'
+	@false
+else
+
+# Each kernel is compiled and prelinked on its own, its entry points get
+# the kernel's name as prefix and every other symbol is made local, so
+# helpers with the same name in two kernels cannot collide.
+$(EB_OUT)/kernel-%.o: $(EMBENCH_DIR)/src/%
+	@mkdir -p $(EB_OUT)/$*
+	set -e; for f in $(EMBENCH_DIR)/src/$*/*.c; do \
+		$(EB_CC) $(EB_CFLAGS) $(EB_DEFS) -c $$f \
+			-o $(EB_OUT)/$*/$$(basename $$f .c).o; \
+	done
+	$(EB_LD) -r -o $@.tmp $(EB_OUT)/$*/*.o
+	$(EB_OBJCOPY) $(foreach s,$(EB_SYMS),\
+		--redefine-sym $(s)=$(call eb_sym,$*)_$(s) \
+		-G $(call eb_sym,$*)_$(s)) $@.tmp $@
+	rm -f $@.tmp
+
+$(EB_OUT)/beebsc.o: $(EMBENCH_DIR)/support/beebsc.c
+	@mkdir -p $(EB_OUT)
+	$(EB_CC) $(EB_CFLAGS) $(EB_DEFS) -c $< -o $@
+
+# Kernel table for embench_run.h, regenerated when the list changes
+$(EB_OUT)/embench_table.c: FORCE
+	@mkdir -p $(EB_OUT)
+	@{ echo '#include "embench_run.h"'; \
+	  $(foreach k,$(EMBENCH_KERNELS),echo 'EMBENCH_DECLARE($(call eb_sym,$(k)))';) \
+	  echo 'const struct embench_kernel embench_kernels[] = {'; \
+	  $(foreach k,$(EMBENCH_KERNELS),echo '	EMBENCH_KERNEL($(call eb_sym,$(k)), "$(k)"),';) \
+	  echo '};'; \
+	  echo 'const unsigned int embench_kernel_count = $(words $(EMBENCH_KERNELS));'; \
+	} > $@.new
+	@cmp -s $@.new $@ && rm -f $@.new || mv $@.new $@
+
+$(EB_OUT)/embench_table.o: $(EB_OUT)/embench_table.c
+	$(EB_CC) $(EB_CFLAGS) -I$(EMBENCH_TA_DIR) -c $< -o $@
+
+$(EB_LIB): $(patsubst %,$(EB_OUT)/kernel-%.o,$(EMBENCH_KERNELS)) \
+	   $(EB_OUT)/beebsc.o $(EB_OUT)/embench_table.o
+	rm -f $@
+	$(EB_AR) rcs $@ $^
+
+.PHONY: FORCE
+FORCE:
+endif
@@ -0,0 +1,247 @@
+#include <err.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* TA API: UUID, command IDs and the shared counter */
+#include <embench_ta.h>
+
+#include "embench_run.h"
+
+#define DEFAULT_ITERATIONS 10
+#define DEFAULT_REPEATS 3
+
+/* TEE resources */
+struct test_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+};
+
+struct result {
+	const char *name;
+	double native;		/* ticks per iteration */
+	double secure;
+	int ok;
+};
+
+void prepare_tee_session(struct test_ctx *ctx)
+{
+	TEEC_UUID uuid = TA_EMBENCH_UUID;
+	uint32_t origin;
+	TEEC_Result res;
+
+	/* Initialize a context connecting us to the TEE */
+	res = TEEC_InitializeContext(NULL, &ctx->ctx);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	/* Open a session with the TA */
+	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
+			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+			res, origin);
+}
+
+void terminate_tee_session(struct test_ctx *ctx)
+{
+	TEEC_CloseSession(&ctx->sess);
+	TEEC_FinalizeContext(&ctx->ctx);
+}
+
+/* Index of the named kernel in the TA's table, or -1 */
+static int find_ta_kernel(struct test_ctx *ctx, const char *name)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	char ta_name[64];
+	uint32_t i;
+
+	for (i = 0;; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+						 TEEC_MEMREF_TEMP_OUTPUT,
+						 TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = i;
+		op.params[1].tmpref.buffer = ta_name;
+		op.params[1].tmpref.size = sizeof(ta_name);
+		if (TEEC_InvokeCommand(&ctx->sess, TA_EMBENCH_CMD_GET_KERNEL,
+				       &op, &origin) != TEEC_SUCCESS)
+			return -1;
+		if (!strcmp(ta_name, name))
+			return i;
+	}
+}
+
+static uint64_t run_secure(struct test_ctx *ctx, uint32_t index,
+			   uint32_t iterations, int *correct,
+			   uint32_t *freq)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_VALUE_OUTPUT,
+					 TEEC_NONE);
+	op.params[0].value.a = index;
+	op.params[0].value.b = iterations;
+	res = TEEC_InvokeCommand(&ctx->sess, TA_EMBENCH_CMD_RUN, &op,
+				 &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TA_EMBENCH_CMD_RUN failed with code 0x%x origin 0x%x",
+		     res, origin);
+
+	*correct = op.params[2].value.a;
+	*freq = op.params[2].value.b;
+	return ((uint64_t)op.params[1].value.b << 32) | op.params[1].value.a;
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"Usage: optee_example_embench [-n iterations] [-r repeats] [kernel...]\n"
+		"  -n  benchmark() calls per timed run (default %d)\n"
+		"  -r  timed runs per kernel and world, fastest kept (default %d)\n"
+		"Kernels:",
+		DEFAULT_ITERATIONS, DEFAULT_REPEATS);
+	for (i = 0; i < embench_kernel_count; i++)
+		fprintf(stderr, " %s", embench_kernels[i].name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static int selected(const char *name, int argc, char *argv[])
+{
+	int i;
+
+	if (!argc)
+		return 1;
+	for (i = 0; i < argc; i++)
+		if (!strcmp(argv[i], name))
+			return 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_ctx ctx;
+	struct result *results;
+	uint32_t iterations = DEFAULT_ITERATIONS;
+	unsigned int repeats = DEFAULT_REPEATS;
+	unsigned int i, r, n = 0, failed = 0;
+	uint32_t freq = 0;
+	double log_sum = 0, log_sq = 0, lo = 0, hi = 0, mean, sd;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			repeats = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!iterations || !repeats)
+		usage();
+	argc -= optind;
+	argv += optind;
+
+	results = calloc(embench_kernel_count, sizeof(*results));
+	if (!results)
+		err(1, "calloc");
+
+	prepare_tee_session(&ctx);
+
+	printf("=======================================================\n");
+	printf("  Embench: secure world vs normal world\n");
+	printf("=======================================================\n");
+	printf("%u iterations per run, best of %u runs\n\n", iterations,
+	       repeats);
+
+	for (i = 0; i < embench_kernel_count; i++) {
+		const struct embench_kernel *k = &embench_kernels[i];
+		struct result *res = &results[n];
+		int index, ok_native, ok_secure;
+		uint64_t best_native = UINT64_MAX, best_secure = UINT64_MAX;
+		uint64_t t;
+
+		if (!selected(k->name, argc, argv))
+			continue;
+		index = find_ta_kernel(&ctx, k->name);
+		if (index < 0) {
+			printf("%-16s not in the TA, skipped\n", k->name);
+			continue;
+		}
+
+		/* Alternate the worlds so drift affects both alike */
+		for (r = 0; r < repeats; r++) {
+			t = embench_run(k, iterations, &ok_native);
+			if (t < best_native)
+				best_native = t;
+			t = run_secure(&ctx, index, iterations, &ok_secure,
+				       &freq);
+			if (t < best_secure)
+				best_secure = t;
+		}
+
+		res->name = k->name;
+		res->native = (double)best_native / iterations;
+		res->secure = (double)best_secure / iterations;
+		res->ok = ok_native && ok_secure;
+		if (!res->ok)
+			failed++;
+		n++;
+	}
+
+	if (!n)
+		errx(1, "No kernels to run");
+
+	/*
+	 * Embench scores a platform as baseline time over measured time. The
+	 * baseline here is the same kernel in the normal world, so a score of
+	 * 1.0 means no secure-world penalty and 0.8 means 25% slower.
+	 */
+	printf("%-16s %16s %16s %9s %s\n", "Benchmark", "Native ticks/it",
+	       "Secure ticks/it", "Relative", "");
+	for (i = 0; i < n; i++) {
+		double rel = results[i].native / results[i].secure;
+
+		printf("%-16s %16.0f %16.0f %9.3f %s\n", results[i].name,
+		       results[i].native, results[i].secure, rel,
+		       results[i].ok ? "" : "VERIFY FAILED");
+		log_sum += log(rel);
+		log_sq += log(rel) * log(rel);
+		if (!i || rel < lo)
+			lo = rel;
+		if (!i || rel > hi)
+			hi = rel;
+	}
+
+	mean = log_sum / n;
+	sd = sqrt(log_sq / n - mean * mean > 0 ? log_sq / n - mean * mean : 0);
+	printf("%-16s %16s %16s %9.3f\n", "Geometric mean", "", "", exp(mean));
+	printf("%-16s %16s %16s %9.3f\n", "Geometric SD", "", "", exp(sd));
+	printf("%-16s %16s %16s %5.3f - %.3f\n", "Range", "", "", lo, hi);
+	if (freq)
+		printf("\nCounter: %.2f MHz\n", freq / 1e6);
+	printf("Secure-world compute penalty: %.1f%%\n",
+	       (1.0 / exp(mean) - 1.0) * 100.0);
+
+	terminate_tee_session(&ctx);
+	free(results);
+	return failed ? 1 : 0;
+}
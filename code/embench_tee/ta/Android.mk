@@ -0,0 +1,4 @@
+LOCAL_PATH := $(call my-dir)
+
+local_module := f50ffed8-ada1-400d-a96f-78e1159cb872.ta
+include $(BUILD_OPTEE_MK)
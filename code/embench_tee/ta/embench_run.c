@@ -0,0 +1,22 @@
+#include <embench_ta.h>
+
+#include "embench_run.h"
+
+uint64_t embench_run(const struct embench_kernel *k, uint32_t iterations,
+		     int *correct)
+{
+	uint64_t start, end;
+	int result = 0;
+	uint32_t i;
+
+	k->initialise();
+	k->warm_caches(WARMUP_HEAT);
+
+	start = embench_counter();
+	for (i = 0; i < iterations; i++)
+		result = k->benchmark();
+	end = embench_counter();
+
+	*correct = k->verify(result);
+	return end - start;
+}
@@ -0,0 +1,48 @@
+/*
+ * Harness shared by the TA and the host: the sequence of Embench's
+ * support/main.c, run against kernels linked from libembench.a.
+ */
+#ifndef EMBENCH_RUN_H
+#define EMBENCH_RUN_H
+
+#include <stdint.h>
+
+/* Embench's default for all kernels */
+#define WARMUP_HEAT 1
+
+/*
+ * Every kernel defines the same four entry points. embench.mk prefixes
+ * them with the kernel name, e.g. crc32_benchmark, and hides all other
+ * symbols so the kernels can be linked side by side.
+ */
+struct embench_kernel {
+	const char *name;
+	void (*initialise)(void);
+	void (*warm_caches)(int heat);
+	int (*benchmark)(void);
+	int (*verify)(int result);
+};
+
+#define EMBENCH_DECLARE(sym) \
+	void sym##_initialise_benchmark(void); \
+	void sym##_warm_caches(int heat); \
+	int sym##_benchmark(void); \
+	int sym##_verify_benchmark(int result);
+
+#define EMBENCH_KERNEL(sym, name) \
+	{ name, sym##_initialise_benchmark, sym##_warm_caches, \
+	  sym##_benchmark, sym##_verify_benchmark }
+
+/* Generated by embench.mk from EMBENCH_KERNELS */
+extern const struct embench_kernel embench_kernels[];
+extern const unsigned int embench_kernel_count;
+
+/*
+ * Initialises the kernel, warms its caches, then times iterations calls
+ * of benchmark(). Returns the counter ticks; *correct is the verdict of
+ * verify_benchmark() on the last result.
+ */
+uint64_t embench_run(const struct embench_kernel *k, uint32_t iterations,
+		     int *correct);
+
+#endif /* EMBENCH_RUN_H */
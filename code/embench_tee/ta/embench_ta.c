@@ -0,0 +1,98 @@
+#include <inttypes.h>
+#include <string.h>
+#include <embench_ta.h>
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "embench_run.h"
+
+static TEE_Result get_kernel(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	const char *name;
+	size_t len;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (params[0].value.a >= embench_kernel_count)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	name = embench_kernels[params[0].value.a].name;
+	len = strlen(name) + 1;
+	if (params[1].memref.size < len) {
+		params[1].memref.size = len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+	TEE_MemMove(params[1].memref.buffer, name, len);
+	params[1].memref.size = len;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result run_kernel(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
+	const struct embench_kernel *k;
+	uint64_t ticks;
+	int correct;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (params[0].value.a >= embench_kernel_count || !params[0].value.b)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	k = &embench_kernels[params[0].value.a];
+	ticks = embench_run(k, params[0].value.b, &correct);
+
+	DMSG("%s: %u iterations, %" PRIu64 " ticks, %s", k->name,
+	     params[0].value.b, ticks, correct ? "verified" : "WRONG RESULT");
+
+	params[1].value.a = (uint32_t)ticks;
+	params[1].value.b = (uint32_t)(ticks >> 32);
+	params[2].value.a = correct ? 1 : 0;
+	params[2].value.b = embench_counter_freq();
+	return TEE_SUCCESS;
+}
+
+TEE_Result TA_CreateEntryPoint(void)
+{
+	return TEE_SUCCESS;
+}
+
+void TA_DestroyEntryPoint(void)
+{
+}
+
+TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
+				    TEE_Param __unused params[4],
+				    void __unused **session)
+{
+	return TEE_SUCCESS;
+}
+
+void TA_CloseSessionEntryPoint(void __unused *session)
+{
+}
+
+TEE_Result TA_InvokeCommandEntryPoint(void __unused *session,
+				      uint32_t command,
+				      uint32_t param_types,
+				      TEE_Param params[4])
+{
+	switch (command) {
+	case TA_EMBENCH_CMD_GET_KERNEL:
+		return get_kernel(param_types, params);
+	case TA_EMBENCH_CMD_RUN:
+		return run_kernel(param_types, params);
+	default:
+		EMSG("Command ID 0x%x is not supported", command);
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * Embench kernels run inside the secure world, to compare against the
+ * same kernels built natively into the host.
+ */
+#ifndef __EMBENCH_TA_H__
+#define __EMBENCH_TA_H__
+
+#include <stdint.h>
+
+/* UUID of the trusted application */
+#define TA_EMBENCH_UUID \
+		{ 0xf50ffed8, 0xada1, 0x400d, \
+			{ 0xa9, 0x6f, 0x78, 0xe1, 0x15, 0x9c, 0xb8, 0x72 } }
+
+/*
+ * TA_EMBENCH_CMD_GET_KERNEL - Name of a linked kernel
+ * param[0] (value input) a: kernel index
+ * param[1] (memref output) NUL-terminated kernel name
+ * param[2] unused
+ * param[3] unused
+ * Returns TEE_ERROR_ITEM_NOT_FOUND past the last kernel.
+ */
+#define TA_EMBENCH_CMD_GET_KERNEL	0
+
+/*
+ * TA_EMBENCH_CMD_RUN - Run a kernel through the beebs harness
+ * param[0] (value input) a: kernel index, b: iterations
+ * param[1] (value output) a/b: counter ticks for all iterations, low/high
+ * param[2] (value output) a: 1 if verify_benchmark() passed,
+ *          b: counter frequency in Hz, 0 if unknown
+ * param[3] unused
+ */
+#define TA_EMBENCH_CMD_RUN		1
+
+/*
+ * The timer both worlds read, so native and secure ticks compare
+ * directly. Only the kernel loop is timed: invoke and world-switch cost
+ * is excluded, leaving the compute penalty of the secure world.
+ */
+static inline uint64_t embench_counter(void)
+{
+#if defined(__aarch64__)
+	uint64_t v;
+
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+	return v;
+#elif defined(__arm__)
+	uint32_t lo, hi;
+
+	__asm__ volatile("isb; mrrc p15, 1, %0, %1, c14"
+			 : "=r"(lo), "=r"(hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+
+	/* Emulator builds: the TSC */
+	__asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+#error "No cycle counter for this architecture"
+#endif
+}
+
+static inline uint32_t embench_counter_freq(void)
+{
+#if defined(__aarch64__)
+	uint64_t v;
+
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r"(v));
+	return (uint32_t)v;
+#elif defined(__arm__)
+	uint32_t v;
+
+	__asm__ volatile("mrc p15, 0, %0, c14, c0, 0" : "=r"(v));
+	return v;
+#else
+	return 0;
+#endif
+}
+
+#endif /* __EMBENCH_TA_H__ */
@@ -0,0 +1,3 @@
+global-incdirs-y += include
+srcs-y += embench_ta.c
+srcs-y += embench_run.c
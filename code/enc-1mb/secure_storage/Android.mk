@@ -4,9 +4,11 @@ include $(CLEAR_VARS)
 LOCAL_CFLAGS += -DANDROID_BUILD
 LOCAL_CFLAGS += -Wall
 
-LOCAL_SRC_FILES += host/main.c
+LOCAL_SRC_FILES += host/main.c \
+		   ../../testgen/testgen.c
 
-LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/ta/include \
+		    $(LOCAL_PATH)/../../testgen/include
 
 LOCAL_SHARED_LIBRARIES := libteec
 LOCAL_MODULE := optee_example_secure_storage
@@ -14,6 +14,9 @@
 /* TA API */
 #include <secure_storage_ta.h>
 
+/* Synthetic test data */
+#include <testgen.h>
+
 #define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
 #define AES_BLOCK_SIZE 16
 
@@ -440,48 +443,19 @@ TEEC_Result get_timing_info(struct test_ctx *ctx, struct perf_info *perf)
 /* Generate test file */
 int generate_test_file(const char *filename, size_t size_mb)
 {
-	int fd;
-	size_t total_written = 0;
-	size_t chunk_size = 256 * 1024; // 256KB chunks
-	uint8_t *buffer;
-	size_t target_size = size_mb * 1024 * 1024;
-	
-	printf("Generating test file: %s (%.2f MB)...\n", 
-	       filename, size_mb);
-	
-	buffer = malloc(chunk_size);
-	if (!buffer) {
-		printf("Error: Cannot allocate buffer\n");
-		return -1;
-	}
-	
-	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd < 0) {
-		printf("Error: Cannot create file\n");
-		free(buffer);
+	struct testgen_params params;
+
+	printf("Generating test file: %s (%zu MB)...\n", filename, size_mb);
+
+	/* TESTGEN_PROFILE / TESTGEN_SEED select the data, see testgen.h */
+	testgen_params_from_env(&params);
+	params.size = (uint64_t)size_mb * 1024 * 1024;
+	if (testgen_write_file(filename, &params) != 0) {
+		printf("Error: Cannot create test file %s\n", filename);
 		return -1;
 	}
-	
-	/* Fill with pseudo-random pattern */
-	for (size_t i = 0; i < chunk_size; i++)
-		buffer[i] = (uint8_t)(i ^ (i >> 8));
-	
-	while (total_written < target_size) {
-		size_t to_write = (target_size - total_written > chunk_size) ?
-				   chunk_size : (target_size - total_written);
-		
-		if (write(fd, buffer, to_write) != to_write) {
-			printf("Error: Write failed\n");
-			close(fd);
-			free(buffer);
-			return -1;
-		}
-		total_written += to_write;
-	}
-	
-	close(fd);
-	free(buffer);
-	printf("✓ Test file created: %zu bytes\n", total_written);
+
+	printf("✓ Test file created: %zu bytes\n", (size_t)params.size);
 	return 0;
 }
 
@@ -13,6 +13,9 @@
 /* TA API: UUID and command IDs */
 #include <secure_storage_ta.h>
 
+/* Synthetic test data */
+#include <testgen.h>
+
 #define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
 
 /* TEE resources */
@@ -317,46 +320,19 @@ TEEC_Result read_entire_file_from_secure_storage(struct test_ctx *ctx,
  */
 int generate_test_file(const char *filename, size_t size_mb)
 {
-	int fd;
-	size_t total_written = 0;
-	size_t chunk_size = 1024 * 1024; // 1MB chunks
-	char *buffer;
-	size_t target_size = size_mb * 1024 * 1024;
+	struct testgen_params params;
 
 	printf("Generating test file: %s (%zu MB)...\n", filename, size_mb);
 
-	buffer = malloc(chunk_size);
-	if (!buffer) {
-		printf("Error: Cannot allocate buffer for test file\n");
-		return -1;
-	}
-
-	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd < 0) {
+	/* TESTGEN_PROFILE / TESTGEN_SEED select the data, see testgen.h */
+	testgen_params_from_env(&params);
+	params.size = (uint64_t)size_mb * 1024 * 1024;
+	if (testgen_write_file(filename, &params) != 0) {
 		printf("Error: Cannot create test file %s\n", filename);
-		free(buffer);
 		return -1;
 	}
 
-	/* Fill with pattern */
-	memset(buffer, 0xAB, chunk_size);
-
-	while (total_written < target_size) {
-		size_t to_write = (target_size - total_written > chunk_size) ?
-				   chunk_size : (target_size - total_written);
-		
-		if (write(fd, buffer, to_write) != to_write) {
-			printf("Error: Write failed\n");
-			close(fd);
-			free(buffer);
-			return -1;
-		}
-		total_written += to_write;
-	}
-
-	close(fd);
-	free(buffer);
-	printf("✓ Test file created: %zu bytes\n", total_written);
+	printf("✓ Test file created: %zu bytes\n", (size_t)params.size);
 	return 0;
 }
 
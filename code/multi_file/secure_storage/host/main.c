@@ -1,9 +1,12 @@
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 /* OP-TEE TEE client API (built by optee_client) */
@@ -12,14 +15,26 @@
 /* TA API: UUID and command IDs */
 #include <secure_storage_ta.h>
 
+/* Synthetic test data */
+#include <testgen.h>
+
+/* Results store, when BENCHDB is set */
+#include <benchdb.h>
+
+/* Shared memory for the chunk path */
+#include <shm_pool.h>
+
 #define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
 // *** CHANGE 1: Add default iterations (no upper limit) ***
 #define DEFAULT_ITERATIONS 100
+/* mmap input: each window is registered as shared memory once */
+#define MMAP_WINDOW_SIZE (1024 * 1024)
 
 /* TEE resources */
 struct test_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
+	struct shm_pool *pool;	/* object IDs and chunks on the write path */
 };
 
 void prepare_tee_session(struct test_ctx *ctx)
@@ -39,10 +54,15 @@ void prepare_tee_session(struct test_ctx *ctx)
 	if (res != TEEC_SUCCESS)
 		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
 			res, origin);
+
+	ctx->pool = shm_pool_create(&ctx->ctx, CHUNK_SIZE);
+	if (!ctx->pool)
+		errx(1, "Cannot create the shared memory pool");
 }
 
 void terminate_tee_session(struct test_ctx *ctx)
 {
+	shm_pool_destroy(ctx->pool);
 	TEEC_CloseSession(&ctx->sess);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
@@ -76,6 +96,238 @@ TEEC_Result delete_secure_object(struct test_ctx *ctx, char *id)
 	return res;
 }
 
+/*
+ * Input path: HOST_IO=read reads into a shared memory pool block,
+ * anything else (the default) tries the mmap path first. The mmap path
+ * only works with the emulator: the Linux TEE driver pins registered
+ * pages for write, which a read-only file mapping refuses, so on real
+ * OP-TEE it falls back to read(). The path taken is printed.
+ */
+static int use_mmap_input(void)
+{
+	const char *io = getenv("HOST_IO");
+
+	return !io || strcmp(io, "read") != 0;
+}
+
+/*
+ * The TA's heap snapshot from the last heap failure, where the TA keeps
+ * memory statistics; the TA in this tree does not.
+ */
+static void print_heap_stats(struct test_ctx *ctx)
+{
+#ifdef TA_SECURE_STORAGE_CMD_GET_MEM_STATS
+	TEEC_Operation op;
+	uint32_t origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT,
+					 TEEC_VALUE_OUTPUT, TEEC_NONE);
+	if (TEEC_InvokeCommand(&ctx->sess, TA_SECURE_STORAGE_CMD_GET_MEM_STATS,
+			       &op, &origin) != TEEC_SUCCESS)
+		return;
+	printf("TA heap: %u bytes in use, peak %u, %u heap failures\n",
+	       op.params[0].value.a, op.params[0].value.b,
+	       op.params[1].value.b);
+	printf("Last failure: %u bytes wanted with %u in use\n",
+	       op.params[2].value.b, op.params[2].value.a);
+#else
+	(void)ctx;
+#endif
+}
+
+/*
+ * Sends one chunk; the caller has filled op->params[1] with the data.
+ * The object ID is a pool block, like the data unless that comes from a
+ * registered mapping: no chunk sets up shared memory of its own.
+ */
+static TEEC_Result send_chunk(struct test_ctx *ctx, const struct shm_buf *id,
+			      size_t id_len, TEEC_Operation *op,
+			      int is_first, size_t total_written)
+{
+	uint32_t origin;
+	TEEC_Result res;
+
+	op->paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					  TEEC_MEMREF_PARTIAL_INPUT,
+					  TEEC_VALUE_INPUT,
+					  TEEC_NONE);
+
+	shm_pool_param(&op->params[0], id, 0, id_len);
+
+	op->params[2].value.a = is_first;
+
+	res = TEEC_InvokeCommand(&ctx->sess,
+				 TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK,
+				 op, &origin);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: Write failed at offset %zu: 0x%x / %u\n",
+		       total_written, res, origin);
+		if (res == TEEC_ERROR_STORAGE_NO_SPACE) {
+			printf("\n*** STORAGE FULL ***\n");
+			printf("Your /data/tee/ partition is too small.\n");
+			printf("Current written: %zu bytes (%.2f MB)\n", 
+			       total_written, total_written / (1024.0 * 1024.0));
+			printf("Check: df -h /data/tee/\n\n");
+		} else if (res == TA_SECURE_STORAGE_ERROR_HEAP) {
+			/* Storage has room; the TA had no heap left */
+			printf("\n*** TA HEAP EXHAUSTED ***\n");
+			printf("The TA could not get even its smallest buffer.\n");
+			print_heap_stats(ctx);
+			printf("Raise TA_DATA_SIZE or run fewer sessions.\n\n");
+		} else if (res == TEEC_ERROR_OUT_OF_MEMORY) {
+			printf("\n*** TEE OUT OF MEMORY ***\n");
+			printf("The TEE core or driver ran out of memory.\n\n");
+		}
+	}
+	return res;
+}
+
+static void print_write_progress(size_t total_written, size_t file_size)
+{
+	/* Progress indicator every 1MB */
+	if (total_written % (1024 * 1024) == 0) {
+		printf("  Progress: %zu/%zu bytes (%.1f%%) - %.2f MB\n",
+		       total_written, file_size,
+		       (total_written * 100.0) / file_size,
+		       total_written / (1024.0 * 1024.0));
+	}
+}
+
+/*
+ * Streams the file from a read-only mapping. Each MMAP_WINDOW_SIZE window
+ * is registered as shared memory once and its chunks are passed as partial
+ * memrefs, so data goes from the page cache to the TEE without the read()
+ * copy into a user buffer. Returns TEEC_ERROR_NOT_SUPPORTED, before
+ * anything was sent, if the file cannot be mapped or registered; the
+ * latter is what the Linux TEE driver does, see use_mmap_input.
+ */
+static TEEC_Result stream_file_mmap(struct test_ctx *ctx,
+				    const struct shm_buf *id, size_t id_len,
+				    int fd, size_t file_size,
+				    size_t *total_written)
+{
+	TEEC_Operation op;
+	TEEC_SharedMemory shm;
+	TEEC_Result res = TEEC_SUCCESS;
+	long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t *map;
+	size_t offset, pos;
+
+	/*
+	 * Each window starts on a page, whatever CHUNK_SIZE is: 64K-page
+	 * kernels need only MMAP_WINDOW_SIZE to be whole pages
+	 */
+	if (!file_size)
+		return TEEC_ERROR_NOT_SUPPORTED;
+	if (page_size <= 0 || MMAP_WINDOW_SIZE % page_size) {
+		printf("  mmap input: page size %ld does not divide the window\n",
+		       page_size);
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+
+	map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("  mmap input: cannot map file: %s\n", strerror(errno));
+		return TEEC_ERROR_NOT_SUPPORTED;
+	}
+	madvise(map, file_size, MADV_SEQUENTIAL);
+
+	for (offset = 0; offset < file_size; offset += MMAP_WINDOW_SIZE) {
+		size_t window = file_size - offset;
+
+		if (window > MMAP_WINDOW_SIZE)
+			window = MMAP_WINDOW_SIZE;
+
+		memset(&shm, 0, sizeof(shm));
+		shm.buffer = map + offset;
+		shm.size = window;
+		shm.flags = TEEC_MEM_INPUT;
+		res = TEEC_RegisterSharedMemory(&ctx->ctx, &shm);
+		if (res != TEEC_SUCCESS) {
+			if (!offset) {
+				printf("  mmap input: cannot register mapping: 0x%x\n",
+				       res);
+				res = TEEC_ERROR_NOT_SUPPORTED;
+			} else
+				printf("Error: Cannot register input window: 0x%x\n",
+				       res);
+			break;
+		}
+
+		for (pos = 0; pos < window; pos += CHUNK_SIZE) {
+			size_t len = window - pos;
+
+			if (len > CHUNK_SIZE)
+				len = CHUNK_SIZE;
+
+			memset(&op, 0, sizeof(op));
+			op.params[1].memref.parent = &shm;
+			op.params[1].memref.offset = pos;
+			op.params[1].memref.size = len;
+
+			res = send_chunk(ctx, id, id_len, &op,
+					 *total_written == 0, *total_written);
+			if (res != TEEC_SUCCESS)
+				break;
+
+			*total_written += len;
+			print_write_progress(*total_written, file_size);
+		}
+
+		TEEC_ReleaseSharedMemory(&shm);
+		/* Drop sent pages so the mapping never pins the whole file */
+		madvise(map + offset, window, MADV_DONTNEED);
+		if (res != TEEC_SUCCESS)
+			break;
+	}
+
+	munmap(map, file_size);
+	return res;
+}
+
+/* Reads each chunk straight into a pool block and sends it from there */
+static TEEC_Result stream_file_read(struct test_ctx *ctx,
+				    const struct shm_buf *id, size_t id_len,
+				    int fd, size_t file_size,
+				    size_t *total_written)
+{
+	TEEC_Operation op;
+	TEEC_Result res;
+	struct shm_buf chunk;
+	ssize_t bytes_read;
+
+	res = shm_pool_get(ctx->pool, CHUNK_SIZE, &chunk);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: No shared memory for a chunk: 0x%x\n", res);
+		return res;
+	}
+
+	/* Stream file in chunks - NO FULL FILE IN MEMORY! */
+	while ((bytes_read = read(fd, chunk.buffer, CHUNK_SIZE)) > 0) {
+		/* Send chunk to TEE */
+		memset(&op, 0, sizeof(op));
+		shm_pool_param(&op.params[1], &chunk, 0, bytes_read);
+
+		res = send_chunk(ctx, id, id_len, &op,
+				 *total_written == 0, *total_written);
+		if (res != TEEC_SUCCESS)
+			break;
+
+		*total_written += bytes_read;
+		print_write_progress(*total_written, file_size);
+	}
+
+	shm_pool_put(ctx->pool, &chunk);
+	if (res != TEEC_SUCCESS)
+		return res;
+	if (bytes_read < 0) {
+		printf("Error: Read failed from file\n");
+		return TEEC_ERROR_GENERIC;
+	}
+	return TEEC_SUCCESS;
+}
+
 /**
  * Stream file directly to secure storage WITHOUT loading entire file to memory
  * This is the KEY function that solves the memory problem
@@ -86,13 +338,11 @@ TEEC_Result write_file_to_secure_storage_streaming(struct test_ctx *ctx,
 {
 	TEEC_Operation op;
 	uint32_t origin;
-	TEEC_Result res;
-	size_t id_len = strlen(obj_id);
+	TEEC_Result res = TEEC_ERROR_NOT_SUPPORTED;
 	int fd;
-	char chunk_buffer[CHUNK_SIZE];
-	ssize_t bytes_read;
 	size_t total_written = 0;
-	int is_first = 1;
+	size_t id_len = strlen(obj_id);
+	struct shm_buf id;
 	struct stat st;
 
 	/* Get file size */
@@ -104,65 +354,41 @@ TEEC_Result write_file_to_secure_storage_streaming(struct test_ctx *ctx,
 	printf("  Streaming file: %s (%zu bytes = %.2f MB)\n", 
 	       filename, st.st_size, st.st_size / (1024.0 * 1024.0));
 
+	/* Every chunk names the object, from this one block */
+	res = shm_pool_get(ctx->pool, id_len, &id);
+	if (res != TEEC_SUCCESS) {
+		printf("Error: No shared memory for the object ID: 0x%x\n", res);
+		return res;
+	}
+	memcpy(id.buffer, obj_id, id_len);
+	res = TEEC_ERROR_NOT_SUPPORTED;
+
 	/* Open source file */
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		printf("Error: Cannot open file %s\n", filename);
+		shm_pool_put(ctx->pool, &id);
 		return TEEC_ERROR_ITEM_NOT_FOUND;
 	}
 
-	/* Stream file in chunks - NO FULL FILE IN MEMORY! */
-	while ((bytes_read = read(fd, chunk_buffer, CHUNK_SIZE)) > 0) {
-		/* Send chunk to TEE */
-		memset(&op, 0, sizeof(op));
-		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
-						 TEEC_MEMREF_TEMP_INPUT,
-						 TEEC_VALUE_INPUT,
-						 TEEC_NONE);
-
-		op.params[0].tmpref.buffer = obj_id;
-		op.params[0].tmpref.size = id_len;
-
-		op.params[1].tmpref.buffer = chunk_buffer;
-		op.params[1].tmpref.size = bytes_read;
-
-		op.params[2].value.a = is_first;
-
-		res = TEEC_InvokeCommand(&ctx->sess,
-					 TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK,
-					 &op, &origin);
-		if (res != TEEC_SUCCESS) {
-			printf("Error: Write failed at offset %zu: 0x%x / %u\n",
-			       total_written, res, origin);
-			if (res == TEEC_ERROR_OUT_OF_MEMORY) {
-				printf("\n*** STORAGE FULL ***\n");
-				printf("Your /data/tee/ partition is too small.\n");
-				printf("Current written: %zu bytes (%.2f MB)\n", 
-				       total_written, total_written / (1024.0 * 1024.0));
-				printf("Check: df -h /data/tee/\n\n");
-			}
-			close(fd);
-			return res;
-		}
-
-		total_written += bytes_read;
-		is_first = 0;
-
-		/* Progress indicator every 1MB */
-		if (total_written % (1024 * 1024) == 0) {
-			printf("  Progress: %zu/%zu bytes (%.1f%%) - %.2f MB\n",
-			       total_written, st.st_size,
-			       (total_written * 100.0) / st.st_size,
-			       total_written / (1024.0 * 1024.0));
-		}
+	if (use_mmap_input()) {
+		res = stream_file_mmap(ctx, &id, id_len, fd, st.st_size,
+				       &total_written);
+		if (res != TEEC_ERROR_NOT_SUPPORTED)
+			printf("  Input path: mmap\n");
+	}
+	if (res == TEEC_ERROR_NOT_SUPPORTED) {
+		printf("  Input path: read%s\n",
+		       use_mmap_input() ? " (mmap unavailable)" : "");
+		res = stream_file_read(ctx, &id, id_len, fd, st.st_size,
+				       &total_written);
 	}
 
 	close(fd);
+	shm_pool_put(ctx->pool, &id);
 
-	if (bytes_read < 0) {
-		printf("Error: Read failed from file\n");
-		return TEEC_ERROR_GENERIC;
-	}
+	if (res != TEEC_SUCCESS)
+		return res;
 
 	printf("  ✓ Total written: %zu bytes (%.2f MB)\n", 
 	       total_written, total_written / (1024.0 * 1024.0));
@@ -236,51 +462,32 @@ TEEC_Result read_and_verify_size(struct test_ctx *ctx, char *obj_id,
 	}
 }
 
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
 /**
  * Generate test file with random data
  */
 int generate_test_file(const char *filename, size_t size_mb)
 {
-	int fd;
-	size_t total_written = 0;
-	size_t chunk_size = 1024 * 1024; // 1MB chunks
-	char *buffer;
-	size_t target_size = size_mb * 1024 * 1024;
+	struct testgen_params params;
 
 	printf("Generating test file: %s (%zu MB)...\n", filename, size_mb);
 
-	buffer = malloc(chunk_size);
-	if (!buffer) {
-		printf("Error: Cannot allocate buffer for test file\n");
-		return -1;
-	}
-
-	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd < 0) {
+	/* TESTGEN_PROFILE / TESTGEN_SEED select the data, see testgen.h */
+	testgen_params_from_env(&params);
+	params.size = (uint64_t)size_mb * 1024 * 1024;
+	if (testgen_write_file(filename, &params) != 0) {
 		printf("Error: Cannot create test file %s\n", filename);
-		free(buffer);
 		return -1;
 	}
 
-	/* Fill with pattern */
-	memset(buffer, 0xAB, chunk_size);
-
-	while (total_written < target_size) {
-		size_t to_write = (target_size - total_written > chunk_size) ?
-				   chunk_size : (target_size - total_written);
-		
-		if (write(fd, buffer, to_write) != to_write) {
-			printf("Error: Write failed\n");
-			close(fd);
-			free(buffer);
-			return -1;
-		}
-		total_written += to_write;
-	}
-
-	close(fd);
-	free(buffer);
-	printf("✓ Test file created: %zu bytes\n", total_written);
+	printf("✓ Test file created: %zu bytes\n", (size_t)params.size);
 	return 0;
 }
 
@@ -298,6 +505,9 @@ int main(int argc, char *argv[])
 	// *** CHANGE 3: Add iterations variable ***
 	int iterations = DEFAULT_ITERATIONS;
 	int i;
+	struct benchdb_run *run;
+	const char *profile = getenv("TESTGEN_PROFILE");
+	double start;
 
 	printf("=======================================================\n");
 	printf("  OP-TEE Secure Storage - Multiple Copy Test (Loop)\n");
@@ -351,6 +561,13 @@ int main(int argc, char *argv[])
 	       (st.st_size * iterations) / (1024.0 * 1024.0));
 	printf("========================================\n\n");
 
+	/* Each iteration is one sample, so a run is its own distribution */
+	run = benchdb_begin("multi_file");
+	benchdb_config(run, "file_size", "%lld", (long long)st.st_size);
+	benchdb_config(run, "iterations", "%d", iterations);
+	benchdb_config(run, "data", "%s", !use_generated_file ? "file" :
+			profile ? profile : "random");
+
 	printf("Preparing TEE session...\n");
 	prepare_tee_session(&ctx);
 	printf("✓ Session established\n\n");
@@ -375,10 +592,11 @@ int main(int argc, char *argv[])
 		printf("--- Iteration %d/%d ---\n", i, iterations);
 		printf("Object ID: %s\n", obj_id);
 		
+		start = now_ms();
 		res = write_file_to_secure_storage_streaming(&ctx, obj_id, test_file);
 		if (res != TEEC_SUCCESS) {
 			printf("\n✗ FAILED to write iteration %d\n", i);
-			if (res == TEEC_ERROR_OUT_OF_MEMORY) {
+			if (res == TEEC_ERROR_STORAGE_NO_SPACE) {
 				printf("\nDiagnosis:\n");
 				printf("  - Your /data/tee/ partition is FULL\n");
 				printf("  - Successfully stored %d/%d copies\n", i-1, iterations);
@@ -389,6 +607,8 @@ int main(int argc, char *argv[])
 			}
 			goto cleanup;
 		}
+		benchdb_sample(run, "write_ms", "ms", BENCHDB_LOWER,
+			       now_ms() - start);
 		printf("✓ Iteration %d/%d PASSED\n\n", i, iterations);
 	}
 
@@ -407,11 +627,14 @@ int main(int argc, char *argv[])
 		snprintf(obj_id, sizeof(obj_id), "%s_%d", obj_id_base, i);
 		
 		printf("--- Verifying %d/%d: %s ---\n", i, iterations, obj_id);
+		start = now_ms();
 		res = read_and_verify_size(&ctx, obj_id, st.st_size);
 		if (res != TEEC_SUCCESS) {
 			printf("✗ Verification FAILED for iteration %d\n", i);
 			goto cleanup;
 		}
+		benchdb_sample(run, "verify_ms", "ms", BENCHDB_LOWER,
+			       now_ms() - start);
 		printf("✓ Verification %d/%d PASSED\n\n", i, iterations);
 	}
 
@@ -428,11 +651,14 @@ int main(int argc, char *argv[])
 		snprintf(obj_id, sizeof(obj_id), "%s_%d", obj_id_base, i);
 		
 		printf("--- Deleting %d/%d: %s ---\n", i, iterations, obj_id);
+		start = now_ms();
 		res = delete_secure_object(&ctx, obj_id);
 		if (res != TEEC_SUCCESS) {
 			printf("✗ Deletion FAILED for iteration %d\n", i);
 			// Continue deleting other objects even if one fails
 		} else {
+			benchdb_sample(run, "delete_ms", "ms", BENCHDB_LOWER,
+				       now_ms() - start);
 			printf("✓ Deletion %d/%d PASSED\n\n", i, iterations);
 		}
 	}
@@ -459,6 +685,12 @@ cleanup:
 	}
 	
 	printf("✓ Session closed\n");
+
+	/* Only complete runs go into the results file */
+	if (res == TEEC_SUCCESS)
+		benchdb_commit(run);
+	else
+		benchdb_discard(run);
 	
 	return (res == TEEC_SUCCESS) ? 0 : 1;
 }
\ No newline at end of file
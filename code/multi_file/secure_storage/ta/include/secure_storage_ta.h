@@ -35,8 +35,11 @@
  * TA_SECURE_STORAGE_CMD_READ_RAW - Create and fill a secure storage file
  * param[0] (memref) ID used the identify the persistent object
  * param[1] (memref) Raw data dumped from the persistent object
- * param[2] unused
+ * param[2] unused, or (value output) bytes read (a), object size (b)
  * param[3] unused
+ *
+ * Cancellable: a cancelled read returns TEE_ERROR_CANCEL with the bytes
+ * read so far in param[1] and, if given, param[2].
  */
 #define TA_SECURE_STORAGE_CMD_READ_RAW		0
 
@@ -65,4 +68,21 @@
 #define TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK  3
 #define TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL  4
 
+/*
+ * TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT - Delete the object of an
+ * unfinished chunked write; no-op without one. A new first chunk on the
+ * session drops an unfinished write the same way.
+ * param[0..3] unused
+ */
+#define TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT	8
+
+/*
+ * TA_SECURE_STORAGE_ERROR_HEAP - The TA ran out of its own heap; the
+ * store is not full, that is TEE_ERROR_STORAGE_NO_SPACE. Short of heap,
+ * the TA first moves data through smaller buffers, so this means even
+ * the smallest did not fit. A TA-defined result, outside the TEE_ERROR_*
+ * range.
+ */
+#define TA_SECURE_STORAGE_ERROR_HEAP	0x0000A001
+
 #endif /* __SECURE_STORAGE_H__ */
\ No newline at end of file
@@ -5,12 +5,115 @@
 
 #define CHUNK_SIZE (16 * 1024)  // 16KB chunks for shared memory safety
 
+/*
+ * Command buffers come from an arena allocated once per instance and
+ * reset when each command returns, so streaming a file costs no heap
+ * operations per chunk. What does not fit spills to the heap until the
+ * reset. The single instance runs one command at a time, so all its
+ * sessions share the arena.
+ */
+#define ARENA_ALIGN 8
+#define ARENA_SIZE (CHUNK_SIZE + TEE_OBJECT_ID_MAX_LEN + 2 * ARENA_ALIGN)
+
+/*
+ * Short of heap, the arena and staging buffers halve down to these and
+ * data moves through them in pieces; below them a command fails with
+ * TA_SECURE_STORAGE_ERROR_HEAP.
+ */
+#define ARENA_MIN (TEE_OBJECT_ID_MAX_LEN + 2 * ARENA_ALIGN + STAGE_MIN)
+#define STAGE_MIN 512
+
+struct arena_spill {
+	struct arena_spill *next;
+};
+
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+	struct arena_spill *spills;
+};
+
 /* Session context to maintain state across calls */
 struct write_session {
 	TEE_ObjectHandle object;
 	bool in_progress;
 };
 
+static struct arena g_arena;
+
+static void *arena_alloc(struct arena *a, size_t size)
+{
+	size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	struct arena_spill *spill;
+	void *ptr;
+
+	if (need >= size && need <= a->size - a->used) {
+		ptr = a->base + a->used;
+		a->used += need;
+		return ptr;
+	}
+
+	spill = TEE_Malloc(sizeof(*spill) + size, 0);
+	if (!spill)
+		return NULL;
+	spill->next = a->spills;
+	a->spills = spill;
+	return spill + 1;
+}
+
+static void arena_reset(struct arena *a)
+{
+	struct arena_spill *spill;
+
+	a->used = 0;
+	while (a->spills) {
+		spill = a->spills;
+		a->spills = spill->next;
+		TEE_Free(spill);
+	}
+}
+
+/*
+ * A staging buffer of want bytes or, when the heap is short, of half as
+ * many and so on down to STAGE_MIN; *got is the size given.
+ */
+static void *stage_alloc(size_t want, size_t *got)
+{
+	size_t size = want;
+	void *buf;
+
+	while (!(buf = arena_alloc(&g_arena, size))) {
+		if (size <= STAGE_MIN)
+			return NULL;
+		size = size / 2 > STAGE_MIN ? size / 2 : STAGE_MIN;
+	}
+	*got = size;
+	return buf;
+}
+
+/*
+ * Writes len bytes of shared memory to the object through the staging
+ * buffer, in pieces of its size; a failed write leaves the data position
+ * where it was.
+ */
+static TEE_Result write_staged(TEE_ObjectHandle object, const char *src,
+			       size_t len, char *stage, size_t stage_sz)
+{
+	size_t n, done = 0;
+	TEE_Result res;
+
+	while (done < len) {
+		n = len - done < stage_sz ? len - done : stage_sz;
+		TEE_MemMove(stage, src + done, n);
+		res = TEE_WriteObjectData(object, stage, n);
+		if (res != TEE_SUCCESS)
+			return res;
+		done += n;
+	}
+	return TEE_SUCCESS;
+}
+
 static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
@@ -27,9 +130,9 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = TEE_Malloc(obj_id_sz, 0);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
@@ -40,12 +143,10 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 					&object);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to open persistent object, res=0x%08x", res);
-		TEE_Free(obj_id);
 		return res;
 	}
 
 	TEE_CloseAndDeletePersistentObject1(object);
-	TEE_Free(obj_id);
 
 	return res;
 }
@@ -64,15 +165,16 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4])
 	size_t obj_id_sz;
 	char *data;
 	size_t data_sz;
+	size_t stage_sz;
 	uint32_t obj_data_flag;
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = TEE_Malloc(obj_id_sz, 0);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
@@ -81,16 +183,12 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4])
 	/* Check if data size is too large for single allocation */
 	if (data_sz > CHUNK_SIZE) {
 		EMSG("Data size %zu exceeds chunk size. Use chunked write commands.", data_sz);
-		TEE_Free(obj_id);
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	data = TEE_Malloc(data_sz, 0);
-	if (!data) {
-		TEE_Free(obj_id);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
+	data = stage_alloc(data_sz, &stage_sz);
+	if (!data)
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	obj_data_flag = TEE_DATA_FLAG_ACCESS_READ |
 			TEE_DATA_FLAG_ACCESS_WRITE |
@@ -105,20 +203,17 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4])
 					&object);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
-		TEE_Free(obj_id);
-		TEE_Free(data);
 		return res;
 	}
 
-	res = TEE_WriteObjectData(object, data, data_sz);
+	res = write_staged(object, params[1].memref.buffer, data_sz, data,
+			   stage_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_WriteObjectData failed 0x%08x", res);
 		TEE_CloseAndDeletePersistentObject1(object);
 	} else {
 		TEE_CloseObject(object);
 	}
-	TEE_Free(obj_id);
-	TEE_Free(data);
 	return res;
 }
 
@@ -136,6 +231,7 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 	size_t obj_id_sz;
 	char *data;
 	size_t data_sz;
+	size_t stage_sz;
 	uint32_t is_first;
 
 	if (param_types != exp_param_types)
@@ -150,17 +246,10 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	obj_id = TEE_Malloc(obj_id_sz, 0);
-	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
-
-	data = TEE_Malloc(data_sz, 0);
-	if (!data) {
-		TEE_Free(obj_id);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
+	/* Short of heap the chunk goes in pieces, and the write goes on */
+	data = stage_alloc(data_sz, &stage_sz);
+	if (!data)
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	/* If first chunk, create/truncate object */
 	if (is_first) {
@@ -168,6 +257,18 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 					 TEE_DATA_FLAG_ACCESS_WRITE_META |
 					 TEE_DATA_FLAG_OVERWRITE;
 
+		/* Only creating the object needs the ID */
+		obj_id = arena_alloc(&g_arena, obj_id_sz);
+		if (!obj_id)
+			return TA_SECURE_STORAGE_ERROR_HEAP;
+		TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
+
+		/* The client gave up on the previous write */
+		if (sess->in_progress) {
+			TEE_CloseAndDeletePersistentObject1(sess->object);
+			sess->in_progress = false;
+		}
+
 		res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
 						obj_id, obj_id_sz,
 						obj_data_flag,
@@ -176,28 +277,23 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 						&sess->object);
 		if (res != TEE_SUCCESS) {
 			EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
-			TEE_Free(obj_id);
-			TEE_Free(data);
 			return res;
 		}
 		sess->in_progress = true;
 	} else if (!sess->in_progress) {
 		EMSG("No write session in progress");
-		TEE_Free(obj_id);
-		TEE_Free(data);
 		return TEE_ERROR_BAD_STATE;
 	}
 
 	/* Write the chunk */
-	res = TEE_WriteObjectData(sess->object, data, data_sz);
+	res = write_staged(sess->object, params[1].memref.buffer, data_sz,
+			   data, stage_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_WriteObjectData failed 0x%08x", res);
 		TEE_CloseAndDeletePersistentObject1(sess->object);
 		sess->in_progress = false;
 	}
 
-	TEE_Free(obj_id);
-	TEE_Free(data);
 	return res;
 }
 
@@ -215,6 +311,17 @@ static TEE_Result write_raw_final(struct write_session *sess)
 	return TEE_SUCCESS;
 }
 
+/* Deletes the object of a chunked write the client has given up on */
+static TEE_Result write_raw_abort(struct write_session *sess)
+{
+	if (sess->in_progress) {
+		TEE_CloseAndDeletePersistentObject1(sess->object);
+		sess->in_progress = false;
+		IMSG("Write session aborted");
+	}
+	return TEE_SUCCESS;
+}
+
 static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 {
 	const uint32_t exp_param_types =
@@ -222,8 +329,14 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 				TEE_PARAM_TYPE_MEMREF_OUTPUT,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
+	/* The same, with a progress report in param[2] */
+	const uint32_t progress_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
 	TEE_ObjectHandle object;
-	TEE_ObjectInfo object_info;
+	TEE_ObjectInfo object_info = { 0 };
 	TEE_Result res;
 	uint32_t read_bytes;
 	char *obj_id;
@@ -232,26 +345,27 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 	size_t data_sz;
 	size_t total_read = 0;
 	size_t chunk_size;
+	size_t stage_sz;
 	TEE_Time start_time, end_time;
 	uint32_t elapsed_ms;
+	bool progress = param_types == progress_param_types;
+	bool was_masked = true;
 
-	if (param_types != exp_param_types)
+	if (param_types != exp_param_types && !progress)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = TEE_Malloc(obj_id_sz, 0);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
 	data_sz = params[1].memref.size;
 
-	chunk_buffer = TEE_Malloc(CHUNK_SIZE, 0);
-	if (!chunk_buffer) {
-		TEE_Free(obj_id);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
+	chunk_buffer = stage_alloc(CHUNK_SIZE, &stage_sz);
+	if (!chunk_buffer)
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
 					obj_id, obj_id_sz,
@@ -260,8 +374,6 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 					&object);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to open persistent object, res=0x%08x", res);
-		TEE_Free(obj_id);
-		TEE_Free(chunk_buffer);
 		return res;
 	}
 
@@ -279,10 +391,17 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 
 	TEE_GetSystemTime(&start_time);
 
-	/* Read data in chunks */
+	/* Read data in chunks, cancellable between them */
+	was_masked = TEE_UnmaskCancellation();
 	while (total_read < object_info.dataSize) {
-		chunk_size = (object_info.dataSize - total_read > CHUNK_SIZE) ? 
-		              CHUNK_SIZE : (object_info.dataSize - total_read);
+		if (TEE_GetCancellationFlag()) {
+			params[1].memref.size = total_read;
+			res = TEE_ERROR_CANCEL;
+			goto exit;
+		}
+
+		chunk_size = (object_info.dataSize - total_read > stage_sz) ? 
+		              stage_sz : (object_info.dataSize - total_read);
 
 		res = TEE_ReadObjectData(object, chunk_buffer, chunk_size, &read_bytes);
 		if (res != TEE_SUCCESS) {
@@ -312,19 +431,34 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 	params[1].memref.size = total_read;
 
 exit:
+	if (was_masked)
+		TEE_MaskCancellation();
+	if (progress) {
+		params[2].value.a = total_read;
+		params[2].value.b = object_info.dataSize;
+	}
 	TEE_CloseObject(object);
-	TEE_Free(obj_id);
-	TEE_Free(chunk_buffer);
 	return res;
 }
 
 TEE_Result TA_CreateEntryPoint(void)
 {
+	g_arena.size = ARENA_SIZE;
+	while (!(g_arena.base = TEE_Malloc(g_arena.size, 0))) {
+		if (g_arena.size <= ARENA_MIN)
+			return TA_SECURE_STORAGE_ERROR_HEAP;
+		g_arena.size = g_arena.size / 2 > ARENA_MIN ?
+			       g_arena.size / 2 : ARENA_MIN;
+	}
+	g_arena.used = 0;
+	g_arena.spills = NULL;
 	return TEE_SUCCESS;
 }
 
 void TA_DestroyEntryPoint(void)
 {
+	TEE_Free(g_arena.base);
+	g_arena.base = NULL;
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
@@ -335,7 +469,7 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
 
 	sess = TEE_Malloc(sizeof(*sess), 0);
 	if (!sess)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TA_SECURE_STORAGE_ERROR_HEAP;
 
 	sess->in_progress = false;
 	*session = sess;
@@ -347,8 +481,9 @@ void TA_CloseSessionEntryPoint(void *session)
 	struct write_session *sess = session;
 
 	if (sess) {
+		/* A write cut short must not look like a whole object */
 		if (sess->in_progress)
-			TEE_CloseObject(sess->object);
+			TEE_CloseAndDeletePersistentObject1(sess->object);
 		TEE_Free(sess);
 	}
 }
@@ -359,20 +494,34 @@ TEE_Result TA_InvokeCommandEntryPoint(void *session,
 				      TEE_Param params[4])
 {
 	struct write_session *sess = session;
+	TEE_Result res;
 
 	switch (command) {
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW:
-		return create_raw_object(param_types, params);
+		res = create_raw_object(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK:
-		return write_raw_chunk(param_types, params, sess);
+		res = write_raw_chunk(param_types, params, sess);
+		break;
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL:
-		return write_raw_final(sess);
+		res = write_raw_final(sess);
+		break;
 	case TA_SECURE_STORAGE_CMD_READ_RAW:
-		return read_raw_object(param_types, params);
+		res = read_raw_object(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_DELETE:
-		return delete_object(param_types, params);
+		res = delete_object(param_types, params);
+		break;
+	case TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT:
+		res = write_raw_abort(sess);
+		break;
 	default:
 		EMSG("Command ID 0x%x is not supported", command);
-		return TEE_ERROR_NOT_SUPPORTED;
+		res = TEE_ERROR_NOT_SUPPORTED;
+		break;
 	}
+
+	/* Command buffers live until here */
+	arena_reset(&g_arena);
+	return res;
 }
\ No newline at end of file
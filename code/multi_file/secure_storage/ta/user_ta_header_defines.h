@@ -36,7 +36,12 @@
 
 #define TA_UUID				TA_SECURE_STORAGE_UUID
 
-#define TA_FLAGS			(TA_FLAG_EXEC_DDR | TA_FLAG_SINGLE_INSTANCE)
+/*
+ * Write state lives in the session, so several clients (the soak test's
+ * threads) may each hold a session on the one instance.
+ */
+#define TA_FLAGS			(TA_FLAG_EXEC_DDR | TA_FLAG_SINGLE_INSTANCE | \
+					 TA_FLAG_MULTI_SESSION)
 #define TA_STACK_SIZE			(2 * 1024)
 #define TA_DATA_SIZE			(32 * 1024)
 
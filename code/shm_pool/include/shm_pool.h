@@ -0,0 +1,69 @@
+/*
+ * Pool of shared memory for TEEC clients.
+ *
+ * A TEEC_MEMREF_TEMP_* parameter makes libteec allocate, map and free
+ * shared memory around every invocation, and copy the data through it.
+ * The pool allocates shared memory from the context once, in
+ * power-of-two size classes from SHM_POOL_MIN_SIZE up, and hands out
+ * blocks of it. A block goes to the TA as a TEEC_MEMREF_PARTIAL_*
+ * parameter, see shm_pool_param, with no shared memory set up or torn
+ * down on the invoke path.
+ *
+ * A class grows a slab at a time: one TEEC_AllocateSharedMemory of
+ * SHM_POOL_SLAB_SIZE, or one block if that is larger, cut into blocks.
+ * Every thread keeps a cache of free blocks per class and moves them to
+ * and from the pool's free lists a batch at a time, so most gets and
+ * puts take no lock. Memory is released only by shm_pool_destroy.
+ */
+#ifndef SHM_POOL_H
+#define SHM_POOL_H
+
+#include <stddef.h>
+
+#include <tee_client_api.h>
+
+#define SHM_POOL_MIN_SIZE	256
+#define SHM_POOL_MAX_CLASSES	24
+#define SHM_POOL_SLAB_SIZE	(256 * 1024)
+/* What a thread's cache holds per class, at most */
+#define SHM_POOL_CACHE_BLOCKS	16
+#define SHM_POOL_CACHE_BYTES	(1024 * 1024)
+
+struct shm_pool;
+
+/* A block: size bytes at buffer, offset bytes into shm */
+struct shm_buf {
+	void *buffer;
+	size_t size;
+	TEEC_SharedMemory *shm;
+	size_t offset;
+};
+
+/*
+ * A pool on ctx for blocks of up to max_size bytes. ctx must outlive
+ * it. Returns NULL on failure.
+ */
+struct shm_pool *shm_pool_create(TEEC_Context *ctx, size_t max_size);
+
+/* Releases all of its shared memory; no thread may be using the pool */
+void shm_pool_destroy(struct shm_pool *p);
+
+/*
+ * A block of at least size bytes. Fails with TEEC_ERROR_EXCESS_DATA
+ * above the pool's max_size, when the caller should fall back to a
+ * temporary memref, or with the error of growing the pool.
+ */
+TEEC_Result shm_pool_get(struct shm_pool *p, size_t size,
+			 struct shm_buf *buf);
+
+/* Returns the block; any thread may put a block any thread got */
+void shm_pool_put(struct shm_pool *p, struct shm_buf *buf);
+
+/*
+ * Points a TEEC_MEMREF_PARTIAL_* parameter at size bytes of the block,
+ * offset bytes in. The caller sets the parameter type.
+ */
+void shm_pool_param(TEEC_Parameter *param, const struct shm_buf *buf,
+		    size_t offset, size_t size);
+
+#endif /* SHM_POOL_H */
@@ -0,0 +1,274 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <shm_pool.h>
+
+struct block {
+	TEEC_SharedMemory *shm;
+	size_t offset;
+};
+
+struct slab {
+	TEEC_SharedMemory shm;
+	struct slab *next;
+};
+
+/* Room is reserved as slabs are added, so puts never allocate */
+struct free_list {
+	struct block *blocks;
+	size_t n;
+	size_t cap;
+};
+
+/* A thread's free blocks, found through the pool's key */
+struct cache {
+	struct shm_pool *pool;
+	struct cache *next;
+	unsigned int n[SHM_POOL_MAX_CLASSES];
+	struct block blocks[SHM_POOL_MAX_CLASSES][SHM_POOL_CACHE_BLOCKS];
+};
+
+struct shm_pool {
+	TEEC_Context *ctx;
+	unsigned int nclasses;
+	unsigned int batch[SHM_POOL_MAX_CLASSES];	/* half a full cache */
+	pthread_key_t key;
+
+	/* Free lists, slabs and caches, under lock */
+	pthread_mutex_t lock;
+	struct free_list free[SHM_POOL_MAX_CLASSES];
+	struct slab *slabs;
+	struct cache *caches;
+};
+
+static size_t class_size(unsigned int c)
+{
+	return (size_t)SHM_POOL_MIN_SIZE << c;
+}
+
+static unsigned int class_of(size_t size)
+{
+	unsigned int c = 0;
+
+	while (class_size(c) < size)
+		c++;
+	return c;
+}
+
+/* Adds a slab of class c to its free list. Called under lock */
+static TEEC_Result grow(struct shm_pool *p, unsigned int c)
+{
+	struct free_list *fl = &p->free[c];
+	size_t size = class_size(c);
+	size_t n = size < SHM_POOL_SLAB_SIZE ? SHM_POOL_SLAB_SIZE / size : 1;
+	struct block *blocks;
+	struct slab *slab;
+	TEEC_Result res;
+	size_t i;
+
+	blocks = realloc(fl->blocks, (fl->cap + n) * sizeof(*blocks));
+	if (!blocks)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	fl->blocks = blocks;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	slab->shm.size = n * size;
+	slab->shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	res = TEEC_AllocateSharedMemory(p->ctx, &slab->shm);
+	if (res != TEEC_SUCCESS) {
+		free(slab);
+		return res;
+	}
+	slab->next = p->slabs;
+	p->slabs = slab;
+
+	fl->cap += n;
+	for (i = 0; i < n; i++) {
+		fl->blocks[fl->n].shm = &slab->shm;
+		fl->blocks[fl->n].offset = i * size;
+		fl->n++;
+	}
+	return TEEC_SUCCESS;
+}
+
+static TEEC_Result refill(struct shm_pool *p, struct cache *cache,
+			  unsigned int c)
+{
+	struct free_list *fl = &p->free[c];
+	TEEC_Result res = TEEC_SUCCESS;
+
+	pthread_mutex_lock(&p->lock);
+	if (!fl->n)
+		res = grow(p, c);
+	while (res == TEEC_SUCCESS && fl->n && cache->n[c] < p->batch[c])
+		cache->blocks[c][cache->n[c]++] = fl->blocks[--fl->n];
+	pthread_mutex_unlock(&p->lock);
+	return res;
+}
+
+/* Returns n of the cache's blocks of class c. Called under lock */
+static void flush(struct shm_pool *p, struct cache *cache, unsigned int c,
+		  unsigned int n)
+{
+	struct free_list *fl = &p->free[c];
+
+	while (n-- && cache->n[c])
+		fl->blocks[fl->n++] = cache->blocks[c][--cache->n[c]];
+}
+
+/* Thread exit: the thread's blocks go back to the pool */
+static void cache_release(void *arg)
+{
+	struct cache *cache = arg, **pp;
+	struct shm_pool *p = cache->pool;
+	unsigned int c;
+
+	pthread_mutex_lock(&p->lock);
+	for (c = 0; c < p->nclasses; c++)
+		flush(p, cache, c, SHM_POOL_CACHE_BLOCKS);
+	for (pp = &p->caches; *pp; pp = &(*pp)->next) {
+		if (*pp == cache) {
+			*pp = cache->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	free(cache);
+}
+
+static struct cache *thread_cache(struct shm_pool *p)
+{
+	struct cache *cache = pthread_getspecific(p->key);
+
+	if (cache)
+		return cache;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->pool = p;
+	if (pthread_setspecific(p->key, cache)) {
+		free(cache);
+		return NULL;
+	}
+	pthread_mutex_lock(&p->lock);
+	cache->next = p->caches;
+	p->caches = cache;
+	pthread_mutex_unlock(&p->lock);
+	return cache;
+}
+
+struct shm_pool *shm_pool_create(TEEC_Context *ctx, size_t max_size)
+{
+	struct shm_pool *p;
+	unsigned int c, batch;
+
+	if (!ctx || class_of(max_size) >= SHM_POOL_MAX_CLASSES)
+		return NULL;
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	if (pthread_key_create(&p->key, cache_release)) {
+		free(p);
+		return NULL;
+	}
+	pthread_mutex_init(&p->lock, NULL);
+	p->ctx = ctx;
+	p->nclasses = class_of(max_size) + 1;
+
+	/* Large classes cache fewer blocks, down to one */
+	for (c = 0; c < p->nclasses; c++) {
+		batch = SHM_POOL_CACHE_BYTES / 2 / class_size(c);
+		if (batch > SHM_POOL_CACHE_BLOCKS / 2)
+			batch = SHM_POOL_CACHE_BLOCKS / 2;
+		p->batch[c] = batch ? batch : 1;
+	}
+	return p;
+}
+
+void shm_pool_destroy(struct shm_pool *p)
+{
+	struct cache *cache;
+	struct slab *slab;
+	unsigned int c;
+
+	if (!p)
+		return;
+	/* Exiting threads no longer release their caches; free them here */
+	pthread_key_delete(p->key);
+	while (p->caches) {
+		cache = p->caches;
+		p->caches = cache->next;
+		free(cache);
+	}
+	while (p->slabs) {
+		slab = p->slabs;
+		p->slabs = slab->next;
+		TEEC_ReleaseSharedMemory(&slab->shm);
+		free(slab);
+	}
+	for (c = 0; c < p->nclasses; c++)
+		free(p->free[c].blocks);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+TEEC_Result shm_pool_get(struct shm_pool *p, size_t size,
+			 struct shm_buf *buf)
+{
+	struct cache *cache;
+	struct block b;
+	unsigned int c;
+	TEEC_Result res;
+
+	if (size > class_size(p->nclasses - 1))
+		return TEEC_ERROR_EXCESS_DATA;
+	c = class_of(size);
+	cache = thread_cache(p);
+	if (!cache)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	if (!cache->n[c]) {
+		res = refill(p, cache, c);
+		if (res != TEEC_SUCCESS)
+			return res;
+	}
+
+	b = cache->blocks[c][--cache->n[c]];
+	buf->buffer = (uint8_t *)b.shm->buffer + b.offset;
+	buf->size = class_size(c);
+	buf->shm = b.shm;
+	buf->offset = b.offset;
+	return TEEC_SUCCESS;
+}
+
+void shm_pool_put(struct shm_pool *p, struct shm_buf *buf)
+{
+	struct block b = { .shm = buf->shm, .offset = buf->offset };
+	unsigned int c = class_of(buf->size);
+	struct cache *cache = thread_cache(p);
+
+	if (!cache) {
+		pthread_mutex_lock(&p->lock);
+		p->free[c].blocks[p->free[c].n++] = b;
+		pthread_mutex_unlock(&p->lock);
+	} else {
+		if (cache->n[c] == 2 * p->batch[c]) {
+			pthread_mutex_lock(&p->lock);
+			flush(p, cache, c, p->batch[c]);
+			pthread_mutex_unlock(&p->lock);
+		}
+		cache->blocks[c][cache->n[c]++] = b;
+	}
+	buf->shm = NULL;
+	buf->buffer = NULL;
+}
+
+void shm_pool_param(TEEC_Parameter *param, const struct shm_buf *buf,
+		    size_t offset, size_t size)
+{
+	param->memref.parent = buf->shm;
+	param->memref.offset = buf->offset + offset;
+	param->memref.size = size;
+}
@@ -0,0 +1,780 @@
+/*
+ * Secure storage soak test.
+ *
+ * Writer, reader and deleter threads, each with its own TEE context and
+ * session, run against the storage TA for a fixed time. The run cycles
+ * through two phases:
+ *
+ *   fill   writers create objects until the TA reports the storage full;
+ *          deleters only churn a few percent of what is written, which
+ *          fragments the store the way a long-lived device would
+ *   drain  writers pause and deleters remove objects until the live
+ *          bytes are down to the drain target, then filling resumes
+ *
+ * Readers run throughout and verify every byte they read. Each interval
+ * prints per-operation throughput, latency percentiles and error counts;
+ * -o also writes them as CSV. The capacity reached on every fill shows
+ * whether the store degrades as it fragments and recovers after deletes.
+ * -L drains the TA's binary trace to a file every interval, over a
+ * session of its own.
+ *
+ * IDs and data go to the TA in shared memory from each worker's
+ * shm_pool, as partial memrefs: writers generate objects straight into
+ * it and readers verify them there.
+ */
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* OP-TEE TEE client API (built by optee_client) */
+#include <tee_client_api.h>
+
+/* TA API: UUID and command IDs */
+#include <secure_storage_ta.h>
+
+/* Synthetic test data */
+#include <testgen.h>
+
+/* TA trace decoder */
+#include <ta_trace.h>
+
+/* Shared memory for the calls */
+#include <shm_pool.h>
+
+#define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
+#define MAX_OBJECTS 4096
+#define MAX_SIZE_CLASSES 8
+
+enum soak_op { OP_WRITE, OP_READ, OP_DELETE, OP_COUNT };
+
+static const char *const op_names[OP_COUNT] = { "write", "read", "delete" };
+
+enum soak_phase { PHASE_FILL, PHASE_DRAIN };
+
+enum slot_state { SLOT_FREE, SLOT_WRITING, SLOT_LIVE, SLOT_DELETING };
+
+struct slot {
+	enum slot_state state;
+	unsigned int readers;
+	size_t size;
+	uint32_t generation;	/* seeds the contents, new on every write */
+};
+
+struct size_class {
+	size_t size;
+	unsigned int weight;
+};
+
+/* Counters for one operation over one reporting interval */
+struct op_stats {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t full;		/* rejected for lack of space */
+	uint64_t *lat_ns;
+	size_t nlat;
+	size_t lat_cap;
+};
+
+struct soak {
+	/* Configuration */
+	unsigned int writers, readers, deleters;
+	unsigned int duration_s, interval_s;
+	unsigned int drain_pct;	/* live bytes to free when full */
+	unsigned int churn_pct;	/* deletes per write while filling */
+	struct size_class classes[MAX_SIZE_CLASSES];
+	unsigned int nclasses, total_weight;
+	unsigned int max_objects;
+	FILE *csv;
+	FILE *trace;
+
+	/* Shared state, under lock */
+	pthread_mutex_t lock;
+	pthread_cond_t phase_cv;
+	struct slot slots[MAX_OBJECTS];
+	enum soak_phase phase;
+	uint64_t live_bytes;
+	unsigned int live_objects;
+	uint64_t drain_target;
+	uint64_t fill_writes;
+	uint64_t fill_deletes;
+	unsigned int fills;
+	uint64_t verify_failures;
+	struct op_stats stats[OP_COUNT];
+	volatile int stop;
+};
+
+struct worker {
+	struct soak *soak;
+	enum soak_op role;
+	unsigned int id;
+	uint64_t rng;
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	struct shm_pool *pool;
+	uint8_t *expect;
+	pthread_t thread;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t next_rand(struct worker *w)
+{
+	/* xorshift64*, per worker so threads need no locking */
+	w->rng ^= w->rng >> 12;
+	w->rng ^= w->rng << 25;
+	w->rng ^= w->rng >> 27;
+	return (uint32_t)((w->rng * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+static void object_id(char *id, size_t len, unsigned int slot)
+{
+	snprintf(id, len, "soak_%04u", slot);
+}
+
+static void object_data(uint32_t generation, unsigned int slot, void *buf,
+			size_t size)
+{
+	struct testgen_params p;
+
+	testgen_defaults(&p);
+	p.seed = ((uint64_t)generation << 32) | slot;
+	testgen_fill(&p, 0, buf, size);
+}
+
+static void record(struct soak *s, enum soak_op op, uint64_t start,
+		   size_t bytes, TEEC_Result res)
+{
+	struct op_stats *st = &s->stats[op];
+	uint64_t lat = now_ns() - start;
+
+	pthread_mutex_lock(&s->lock);
+	if (res == TEEC_SUCCESS) {
+		st->count++;
+		st->bytes += bytes;
+		if (st->nlat == st->lat_cap) {
+			size_t cap = st->lat_cap ? st->lat_cap * 2 : 1024;
+			uint64_t *l = realloc(st->lat_ns, cap * sizeof(*l));
+
+			if (l) {
+				st->lat_ns = l;
+				st->lat_cap = cap;
+			}
+		}
+		if (st->nlat < st->lat_cap)
+			st->lat_ns[st->nlat++] = lat;
+	} else if (res == TEEC_ERROR_STORAGE_NO_SPACE) {
+		/* Heap exhaustion is TA_SECURE_STORAGE_ERROR_HEAP, an error */
+		st->full++;
+	} else {
+		st->errors++;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static TEEC_Result invoke(struct worker *w, uint32_t cmd, TEEC_Operation *op)
+{
+	uint32_t origin;
+
+	return TEEC_InvokeCommand(&w->sess, cmd, op, &origin);
+}
+
+/* The object's ID, in a block of its own; *len is its length */
+static TEEC_Result get_id(struct worker *w, unsigned int slot,
+			  struct shm_buf *b, size_t *len)
+{
+	char id[32];
+	TEEC_Result res;
+
+	object_id(id, sizeof(id), slot);
+	*len = strlen(id);
+	res = shm_pool_get(w->pool, *len, b);
+	if (res == TEEC_SUCCESS)
+		memcpy(b->buffer, id, *len);
+	return res;
+}
+
+/*
+ * Writes the object in data in CHUNK_SIZE pieces, as the multi_file host
+ * does, each a slice of the block.
+ */
+static TEEC_Result write_object(struct worker *w, const struct shm_buf *id,
+				size_t idlen, const struct shm_buf *data,
+				size_t size)
+{
+	TEEC_Operation op;
+	TEEC_Result res;
+	size_t off = 0;
+
+	do {
+		size_t len = size - off < CHUNK_SIZE ? size - off : CHUNK_SIZE;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+						 TEEC_MEMREF_PARTIAL_INPUT,
+						 TEEC_VALUE_INPUT,
+						 TEEC_NONE);
+		shm_pool_param(&op.params[0], id, 0, idlen);
+		shm_pool_param(&op.params[1], data, off, len);
+		op.params[2].value.a = off == 0;
+		res = invoke(w, TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK, &op);
+		if (res != TEEC_SUCCESS)
+			return res;	/* the TA drops the partial object */
+		off += len;
+	} while (off < size);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE,
+					 TEEC_NONE, TEEC_NONE);
+	return invoke(w, TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL, &op);
+}
+
+static size_t pick_size(struct worker *w)
+{
+	struct soak *s = w->soak;
+	unsigned int r = next_rand(w) % s->total_weight;
+	unsigned int i;
+
+	for (i = 0; i < s->nclasses - 1; i++) {
+		if (r < s->classes[i].weight)
+			break;
+		r -= s->classes[i].weight;
+	}
+	return s->classes[i].size;
+}
+
+/*
+ * Claims a slot in the given state, starting from a random one so the
+ * threads spread out. Returns -1 if there is none. Called under lock.
+ */
+static int claim_slot(struct worker *w, enum slot_state want)
+{
+	struct soak *s = w->soak;
+	unsigned int start = next_rand(w) % s->max_objects;
+	unsigned int i, n;
+
+	for (i = 0; i < s->max_objects; i++) {
+		n = (start + i) % s->max_objects;
+		if (s->slots[n].state == want &&
+		    (want != SLOT_LIVE || w->role != OP_DELETE ||
+		     !s->slots[n].readers))
+			return n;
+	}
+	return -1;
+}
+
+static void enter_drain(struct soak *s)
+{
+	if (s->phase != PHASE_FILL)
+		return;
+	s->phase = PHASE_DRAIN;
+	s->fills++;
+	s->drain_target = s->live_bytes * (100 - s->drain_pct) / 100;
+	printf("# fill %u: storage full at %u objects, %.2f MB; draining to %.2f MB\n",
+	       s->fills, s->live_objects, s->live_bytes / (1024.0 * 1024.0),
+	       s->drain_target / (1024.0 * 1024.0));
+	pthread_cond_broadcast(&s->phase_cv);
+}
+
+static void writer_step(struct worker *w)
+{
+	struct soak *s = w->soak;
+	struct shm_buf id, data;
+	size_t idlen;
+	size_t size = pick_size(w);
+	uint32_t generation = next_rand(w);
+	uint64_t start;
+	TEEC_Result res;
+	int n;
+
+	pthread_mutex_lock(&s->lock);
+	while (s->phase != PHASE_FILL && !s->stop)
+		pthread_cond_wait(&s->phase_cv, &s->lock);
+	n = s->stop ? -1 : claim_slot(w, SLOT_FREE);
+	if (n >= 0)
+		s->slots[n].state = SLOT_WRITING;
+	else if (!s->stop)
+		enter_drain(s);		/* out of slots counts as full */
+	pthread_mutex_unlock(&s->lock);
+	if (n < 0)
+		return;
+
+	res = get_id(w, n, &id, &idlen);
+	if (res == TEEC_SUCCESS) {
+		res = shm_pool_get(w->pool, size, &data);
+		if (res != TEEC_SUCCESS)
+			shm_pool_put(w->pool, &id);
+	}
+	if (res == TEEC_SUCCESS)
+		object_data(generation, n, data.buffer, size);
+	start = now_ns();
+	if (res == TEEC_SUCCESS) {
+		res = write_object(w, &id, idlen, &data, size);
+		shm_pool_put(w->pool, &data);
+		shm_pool_put(w->pool, &id);
+	}
+	record(s, OP_WRITE, start, size, res);
+
+	pthread_mutex_lock(&s->lock);
+	if (res == TEEC_SUCCESS) {
+		s->slots[n].state = SLOT_LIVE;
+		s->slots[n].size = size;
+		s->slots[n].generation = generation;
+		s->live_bytes += size;
+		s->live_objects++;
+		s->fill_writes++;
+	} else {
+		s->slots[n].state = SLOT_FREE;
+		if (res == TEEC_ERROR_STORAGE_NO_SPACE)
+			enter_drain(s);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void reader_step(struct worker *w)
+{
+	struct soak *s = w->soak;
+	TEEC_Operation op;
+	struct shm_buf id, data;
+	size_t idlen;
+	size_t size;
+	uint32_t generation;
+	uint64_t start;
+	TEEC_Result res;
+	int n;
+
+	pthread_mutex_lock(&s->lock);
+	n = claim_slot(w, SLOT_LIVE);
+	if (n >= 0) {
+		s->slots[n].readers++;
+		size = s->slots[n].size;
+		generation = s->slots[n].generation;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if (n < 0) {
+		usleep(1000);
+		return;
+	}
+
+	res = get_id(w, n, &id, &idlen);
+	if (res == TEEC_SUCCESS) {
+		res = shm_pool_get(w->pool, size, &data);
+		if (res != TEEC_SUCCESS)
+			shm_pool_put(w->pool, &id);
+	}
+	if (res != TEEC_SUCCESS) {
+		record(s, OP_READ, now_ns(), size, res);
+		goto out;
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_MEMREF_PARTIAL_OUTPUT,
+					 TEEC_NONE, TEEC_NONE);
+	shm_pool_param(&op.params[0], &id, 0, idlen);
+	shm_pool_param(&op.params[1], &data, 0, size);
+	start = now_ns();
+	res = invoke(w, TA_SECURE_STORAGE_CMD_READ_RAW, &op);
+	record(s, OP_READ, start, size, res);
+
+	if (res == TEEC_SUCCESS) {
+		object_data(generation, n, w->expect, size);
+		if (op.params[1].memref.size != size ||
+		    memcmp(data.buffer, w->expect, size)) {
+			pthread_mutex_lock(&s->lock);
+			s->verify_failures++;
+			pthread_mutex_unlock(&s->lock);
+			fprintf(stderr, "Verify failed: %.*s (%zu bytes)\n",
+				(int)idlen, (char *)id.buffer, size);
+		}
+	}
+	shm_pool_put(w->pool, &data);
+	shm_pool_put(w->pool, &id);
+
+out:
+	pthread_mutex_lock(&s->lock);
+	s->slots[n].readers--;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static TEEC_Result delete_object(struct worker *w, unsigned int slot)
+{
+	TEEC_Operation op;
+	struct shm_buf id;
+	size_t idlen;
+	TEEC_Result res;
+
+	res = get_id(w, slot, &id, &idlen);
+	if (res != TEEC_SUCCESS)
+		return res;
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+					 TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	shm_pool_param(&op.params[0], &id, 0, idlen);
+	res = invoke(w, TA_SECURE_STORAGE_CMD_DELETE, &op);
+	shm_pool_put(w->pool, &id);
+	return res;
+}
+
+static void deleter_step(struct worker *w)
+{
+	struct soak *s = w->soak;
+	uint64_t start;
+	TEEC_Result res;
+	int n = -1;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->phase == PHASE_DRAIN ||
+	    s->fill_deletes * 100 < s->fill_writes * s->churn_pct)
+		n = claim_slot(w, SLOT_LIVE);
+	if (n >= 0) {
+		s->slots[n].state = SLOT_DELETING;
+		if (s->phase == PHASE_FILL)
+			s->fill_deletes++;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if (n < 0) {
+		usleep(1000);
+		return;
+	}
+
+	start = now_ns();
+	res = delete_object(w, n);
+	record(s, OP_DELETE, start, 0, res);
+
+	pthread_mutex_lock(&s->lock);
+	if (res == TEEC_SUCCESS) {
+		s->live_bytes -= s->slots[n].size;
+		s->live_objects--;
+		s->slots[n].state = SLOT_FREE;
+		if (s->phase == PHASE_DRAIN &&
+		    s->live_bytes <= s->drain_target) {
+			printf("# drained to %u objects, %.2f MB; filling\n",
+			       s->live_objects,
+			       s->live_bytes / (1024.0 * 1024.0));
+			s->phase = PHASE_FILL;
+			s->fill_writes = 0;
+			s->fill_deletes = 0;
+			pthread_cond_broadcast(&s->phase_cv);
+		}
+	} else {
+		s->slots[n].state = SLOT_LIVE;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+
+	while (!w->soak->stop) {
+		switch (w->role) {
+		case OP_WRITE:
+			writer_step(w);
+			break;
+		case OP_READ:
+			reader_step(w);
+			break;
+		default:
+			deleter_step(w);
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t *sorted, size_t n, double pct)
+{
+	size_t i;
+
+	if (!n)
+		return 0;
+	i = (size_t)(pct / 100.0 * (n - 1) + 0.5);
+	return sorted[i] / 1000.0;
+}
+
+/* Prints and resets the interval's counters. Called under lock. */
+static void report(struct soak *s, double t, double secs)
+{
+	static const char *const phase_names[] = { "fill", "drain" };
+	int op;
+
+	for (op = 0; op < OP_COUNT; op++) {
+		struct op_stats *st = &s->stats[op];
+		double p50, p95, p99, max;
+
+		qsort(st->lat_ns, st->nlat, sizeof(*st->lat_ns), cmp_u64);
+		p50 = pct_us(st->lat_ns, st->nlat, 50);
+		p95 = pct_us(st->lat_ns, st->nlat, 95);
+		p99 = pct_us(st->lat_ns, st->nlat, 99);
+		max = pct_us(st->lat_ns, st->nlat, 100);
+
+		printf("%8.1f %-5s %-6s %8llu %8.2f %10.0f %10.0f %10.0f %10.0f %6llu %6llu %7u %10.2f\n",
+		       t, phase_names[s->phase], op_names[op],
+		       (unsigned long long)st->count,
+		       st->bytes / (1024.0 * 1024.0) / secs,
+		       p50, p95, p99, max,
+		       (unsigned long long)st->errors,
+		       (unsigned long long)st->full,
+		       s->live_objects, s->live_bytes / (1024.0 * 1024.0));
+		if (s->csv)
+			fprintf(s->csv, "%.1f,%s,%s,%llu,%.3f,%.1f,%.1f,%.1f,%.1f,%llu,%llu,%u,%llu\n",
+				t, phase_names[s->phase], op_names[op],
+				(unsigned long long)st->count,
+				st->bytes / (1024.0 * 1024.0) / secs,
+				p50, p95, p99, max,
+				(unsigned long long)st->errors,
+				(unsigned long long)st->full,
+				s->live_objects,
+				(unsigned long long)s->live_bytes);
+
+		st->count = 0;
+		st->bytes = 0;
+		st->errors = 0;
+		st->full = 0;
+		st->nlat = 0;
+	}
+	if (s->csv)
+		fflush(s->csv);
+	fflush(stdout);
+}
+
+/* "4K:50,64K:30,1M:20": object sizes and their relative weights */
+static void parse_mix(struct soak *s, const char *arg)
+{
+	char *copy = strdup(arg), *tok, *save = NULL;
+
+	if (!copy)
+		err(1, "strdup");
+	s->nclasses = 0;
+	s->total_weight = 0;
+	for (tok = strtok_r(copy, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		char *end;
+		unsigned long long size = strtoull(tok, &end, 10);
+		unsigned long weight = 1;
+
+		if (*end == 'K' || *end == 'k')
+			size <<= 10, end++;
+		else if (*end == 'M' || *end == 'm')
+			size <<= 20, end++;
+		if (*end == ':')
+			weight = strtoul(end + 1, &end, 10);
+		if (*end || !size || !weight || s->nclasses == MAX_SIZE_CLASSES)
+			errx(1, "Invalid size mix: %s", arg);
+		s->classes[s->nclasses].size = size;
+		s->classes[s->nclasses].weight = weight;
+		s->nclasses++;
+		s->total_weight += weight;
+	}
+	free(copy);
+	if (!s->nclasses)
+		errx(1, "Invalid size mix: %s", arg);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: storage_soak [options]\n"
+		"  -w N      writer threads (default 2)\n"
+		"  -r N      reader threads (default 2)\n"
+		"  -d N      deleter threads (default 1)\n"
+		"  -t secs   duration (default 60)\n"
+		"  -i secs   report interval (default 5)\n"
+		"  -m mix    object sizes and weights (default 4K:50,64K:35,1M:15)\n"
+		"  -n N      object slots, at most %d (default 1024)\n"
+		"  -D pct    live bytes to delete once full (default 50)\n"
+		"  -c pct    deletes per write while filling (default 5)\n"
+		"  -o file   also write the intervals as CSV\n"
+		"  -L file   drain the TA trace to file every interval\n",
+		MAX_OBJECTS);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct soak s;
+	TEEC_UUID uuid = TA_SECURE_STORAGE_UUID;
+	struct worker *workers;
+	TEEC_Context trace_ctx;
+	TEEC_Session trace_sess;
+	unsigned int nworkers, i;
+	size_t max_size = 0;
+	uint64_t start, last, now;
+	uint32_t origin;
+	TEEC_Result res;
+	int opt;
+
+	s.writers = 2;
+	s.readers = 2;
+	s.deleters = 1;
+	s.duration_s = 60;
+	s.interval_s = 5;
+	s.drain_pct = 50;
+	s.churn_pct = 5;
+	s.max_objects = 1024;
+	parse_mix(&s, "4K:50,64K:35,1M:15");
+
+	while ((opt = getopt(argc, argv, "w:r:d:t:i:m:n:D:c:o:L:")) != -1) {
+		switch (opt) {
+		case 'w': s.writers = atoi(optarg); break;
+		case 'r': s.readers = atoi(optarg); break;
+		case 'd': s.deleters = atoi(optarg); break;
+		case 't': s.duration_s = atoi(optarg); break;
+		case 'i': s.interval_s = atoi(optarg); break;
+		case 'm': parse_mix(&s, optarg); break;
+		case 'n': s.max_objects = atoi(optarg); break;
+		case 'D': s.drain_pct = atoi(optarg); break;
+		case 'c': s.churn_pct = atoi(optarg); break;
+		case 'o':
+			s.csv = fopen(optarg, "w");
+			if (!s.csv)
+				err(1, "%s", optarg);
+			break;
+		case 'L':
+			s.trace = fopen(optarg, "w");
+			if (!s.trace)
+				err(1, "%s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!s.writers || !s.deleters || !s.interval_s ||
+	    !s.max_objects || s.max_objects > MAX_OBJECTS ||
+	    !s.drain_pct || s.drain_pct > 100)
+		usage();
+
+	for (i = 0; i < s.nclasses; i++)
+		if (s.classes[i].size > max_size)
+			max_size = s.classes[i].size;
+
+	pthread_mutex_init(&s.lock, NULL);
+	pthread_cond_init(&s.phase_cv, NULL);
+
+	nworkers = s.writers + s.readers + s.deleters;
+	workers = calloc(nworkers, sizeof(*workers));
+	if (!workers)
+		err(1, "calloc");
+
+	for (i = 0; i < nworkers; i++) {
+		struct worker *w = &workers[i];
+
+		w->soak = &s;
+		w->id = i;
+		w->role = i < s.writers ? OP_WRITE :
+			  i < s.writers + s.readers ? OP_READ : OP_DELETE;
+		w->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+		w->expect = malloc(max_size);
+		if (!w->expect)
+			err(1, "malloc");
+
+		res = TEEC_InitializeContext(NULL, &w->ctx);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+		res = TEEC_OpenSession(&w->ctx, &w->sess, &uuid,
+				       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+			     res, origin);
+		w->pool = shm_pool_create(&w->ctx, max_size);
+		if (!w->pool)
+			errx(1, "Cannot create the shared memory pool");
+	}
+
+	if (s.trace) {
+		res = TEEC_InitializeContext(NULL, &trace_ctx);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+		res = TEEC_OpenSession(&trace_ctx, &trace_sess, &uuid,
+				       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+		if (res != TEEC_SUCCESS)
+			errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+			     res, origin);
+	}
+
+	printf("# %u writers, %u readers, %u deleters, %u s, mix:",
+	       s.writers, s.readers, s.deleters, s.duration_s);
+	for (i = 0; i < s.nclasses; i++)
+		printf(" %zu:%u", s.classes[i].size, s.classes[i].weight);
+	printf("\n#   time phase op        count     MB/s    p50(us)    p95(us)    p99(us)    max(us) errors   full objects  live(MB)\n");
+	if (s.csv)
+		fprintf(s.csv, "time_s,phase,op,count,mb_per_s,p50_us,p95_us,p99_us,max_us,errors,full,live_objects,live_bytes\n");
+
+	for (i = 0; i < nworkers; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_run,
+				   &workers[i]))
+			errx(1, "Cannot create worker thread");
+
+	start = last = now_ns();
+	do {
+		sleep(1);
+		now = now_ns();
+		if (now - last >= (uint64_t)s.interval_s * 1000000000ULL) {
+			pthread_mutex_lock(&s.lock);
+			report(&s, (now - start) / 1e9, (now - last) / 1e9);
+			pthread_mutex_unlock(&s.lock);
+			last = now;
+			if (s.trace) {
+				fprintf(s.trace, "# %.1f s\n",
+					(now - start) / 1e9);
+				res = ta_trace_drain(&trace_sess, s.trace,
+						     NULL);
+				if (res != TEEC_SUCCESS)
+					errx(1, "Draining the trace failed with code 0x%x",
+					     res);
+			}
+		}
+	} while (now - start < (uint64_t)s.duration_s * 1000000000ULL);
+
+	pthread_mutex_lock(&s.lock);
+	s.stop = 1;
+	pthread_cond_broadcast(&s.phase_cv);
+	pthread_mutex_unlock(&s.lock);
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	/* Leave the store as we found it */
+	for (i = 0; i < s.max_objects; i++)
+		if (s.slots[i].state == SLOT_LIVE)
+			delete_object(&workers[0], i);
+
+	printf("# %u fills, %llu verify failures\n", s.fills,
+	       (unsigned long long)s.verify_failures);
+
+	for (i = 0; i < nworkers; i++) {
+		TEEC_CloseSession(&workers[i].sess);
+		shm_pool_destroy(workers[i].pool);
+		TEEC_FinalizeContext(&workers[i].ctx);
+		free(workers[i].expect);
+	}
+	for (i = 0; i < OP_COUNT; i++)
+		free(s.stats[i].lat_ns);
+	free(workers);
+	if (s.csv)
+		fclose(s.csv);
+	if (s.trace) {
+		TEEC_CloseSession(&trace_sess);
+		TEEC_FinalizeContext(&trace_ctx);
+		fclose(s.trace);
+	}
+	return s.verify_failures ? 1 : 0;
+}
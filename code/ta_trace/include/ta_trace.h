@@ -0,0 +1,24 @@
+/*
+ * Host side of the storage TA's binary trace.
+ *
+ * The TA records events as an ID and three raw arguments in a ring in
+ * its own memory, see TA_SECURE_STORAGE_CMD_GET_TRACE; nothing is
+ * formatted in the secure world. These drain the ring over any session
+ * to the TA, which is a single instance, and render the records as text
+ * from the event table the TA was built with.
+ */
+#ifndef TA_TRACE_H
+#define TA_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <tee_client_api.h>
+
+/*
+ * Drains the ring and writes a line per record to out. *lost, if not
+ * NULL, is set to the records the ring overwrote since the last drain.
+ */
+TEEC_Result ta_trace_drain(TEEC_Session *sess, FILE *out, uint32_t *lost);
+
+#endif /* TA_TRACE_H */
@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include <ta_trace.h>
+
+/* TA API: command IDs and the trace event table */
+#include <secure_storage_ta.h>
+
+#define DRAIN_RECORDS 64
+
+static const struct {
+	const char *name;
+	const char *fmt;
+} events[TA_TRACE_NEVENTS] = {
+#define TA_TRACE_ENTRY(name, level, fmt) [TA_TRACE_##name] = { #name, fmt },
+	TA_TRACE_EVENTS(TA_TRACE_ENTRY)
+#undef TA_TRACE_ENTRY
+};
+
+static void print_record(FILE *out, const struct ta_trace_record *r)
+{
+	fprintf(out, "%10u.%03u ", r->time_ms / 1000, r->time_ms % 1000);
+	if (r->event >= TA_TRACE_NEVENTS) {
+		/* A TA built with a newer table */
+		fprintf(out, "event %u: %u %u %u\n", r->event, r->args[0],
+			r->args[1], r->args[2]);
+		return;
+	}
+	fprintf(out, "%-14s ", events[r->event].name);
+	fprintf(out, events[r->event].fmt, r->args[0], r->args[1],
+		r->args[2]);
+	fputc('\n', out);
+}
+
+TEEC_Result ta_trace_drain(TEEC_Session *sess, FILE *out, uint32_t *lost)
+{
+	struct ta_trace_record rec[DRAIN_RECORDS];
+	TEEC_Operation op;
+	TEEC_Result res;
+	uint32_t origin, n, i;
+
+	if (lost)
+		*lost = 0;
+	do {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT,
+						 TEEC_VALUE_OUTPUT, TEEC_NONE,
+						 TEEC_NONE);
+		op.params[0].tmpref.buffer = rec;
+		op.params[0].tmpref.size = sizeof(rec);
+		res = TEEC_InvokeCommand(sess, TA_SECURE_STORAGE_CMD_GET_TRACE,
+					 &op, &origin);
+		if (res != TEEC_SUCCESS)
+			return res;
+
+		n = op.params[1].value.a;
+		if (n > DRAIN_RECORDS)
+			return TEEC_ERROR_BAD_FORMAT;
+		if (op.params[1].value.b) {
+			fprintf(out, "%14s %-14s %u records overwritten\n",
+				"", "LOST", op.params[1].value.b);
+			if (lost)
+				*lost += op.params[1].value.b;
+		}
+		for (i = 0; i < n; i++)
+			print_record(out, &rec[i]);
+	} while (n == DRAIN_RECORDS);
+
+	return TEEC_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/*
+ * Prints the storage TA's trace ring. With -f, keeps polling it, so a
+ * benchmark running in another process can be watched without the TA
+ * writing to the secure console.
+ */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <tee_client_api.h>
+
+/* TA API: UUID */
+#include <secure_storage_ta.h>
+
+#include <ta_trace.h>
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: ta_trace [-f ms]\n"
+		"  -f ms     keep draining, every ms milliseconds\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	TEEC_UUID uuid = TA_SECURE_STORAGE_UUID;
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	unsigned int follow_ms = 0;
+	uint32_t origin;
+	TEEC_Result res;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:")) != -1) {
+		switch (opt) {
+		case 'f':
+			follow_ms = atoi(optarg);
+			if (!follow_ms)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	res = TEEC_InitializeContext(NULL, &ctx);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+	res = TEEC_OpenSession(&ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC, NULL,
+			       NULL, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+		     res, origin);
+
+	do {
+		res = ta_trace_drain(&sess, stdout, NULL);
+		if (res != TEEC_SUCCESS)
+			errx(1, "Draining the trace failed with code 0x%x", res);
+		fflush(stdout);
+		if (follow_ms)
+			usleep(follow_ms * 1000);
+	} while (follow_ms);
+
+	TEEC_CloseSession(&sess);
+	TEEC_FinalizeContext(&ctx);
+	return 0;
+}
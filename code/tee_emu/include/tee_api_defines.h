@@ -0,0 +1,131 @@
+/*
+ * GlobalPlatform TEE constants used by the TAs in this repository, with the
+ * values from the GP TEE Internal Core API specification (as in OP-TEE's
+ * lib/libutee/include/tee_api_defines.h).
+ */
+#ifndef TEE_API_DEFINES_H
+#define TEE_API_DEFINES_H
+
+#define TEE_INT_CORE_API_SPEC_VERSION	0x0001000B
+
+/* Return codes */
+#define TEE_SUCCESS			0x00000000
+#define TEE_ERROR_CORRUPT_OBJECT	0xF0100001
+#define TEE_ERROR_CORRUPT_OBJECT_2	0xF0100002
+#define TEE_ERROR_STORAGE_NOT_AVAILABLE	0xF0100003
+#define TEE_ERROR_STORAGE_NOT_AVAILABLE_2 0xF0100004
+#define TEE_ERROR_GENERIC		0xFFFF0000
+#define TEE_ERROR_ACCESS_DENIED		0xFFFF0001
+#define TEE_ERROR_CANCEL		0xFFFF0002
+#define TEE_ERROR_ACCESS_CONFLICT	0xFFFF0003
+#define TEE_ERROR_EXCESS_DATA		0xFFFF0004
+#define TEE_ERROR_BAD_FORMAT		0xFFFF0005
+#define TEE_ERROR_BAD_PARAMETERS	0xFFFF0006
+#define TEE_ERROR_BAD_STATE		0xFFFF0007
+#define TEE_ERROR_ITEM_NOT_FOUND	0xFFFF0008
+#define TEE_ERROR_NOT_IMPLEMENTED	0xFFFF0009
+#define TEE_ERROR_NOT_SUPPORTED		0xFFFF000A
+#define TEE_ERROR_NO_DATA		0xFFFF000B
+#define TEE_ERROR_OUT_OF_MEMORY		0xFFFF000C
+#define TEE_ERROR_BUSY			0xFFFF000D
+#define TEE_ERROR_COMMUNICATION		0xFFFF000E
+#define TEE_ERROR_SECURITY		0xFFFF000F
+#define TEE_ERROR_SHORT_BUFFER		0xFFFF0010
+#define TEE_ERROR_EXTERNAL_CANCEL	0xFFFF0011
+#define TEE_ERROR_OVERFLOW		0xFFFF300F
+#define TEE_ERROR_TARGET_DEAD		0xFFFF3024
+#define TEE_ERROR_STORAGE_NO_SPACE	0xFFFF3041
+#define TEE_ERROR_MAC_INVALID		0xFFFF3071
+#define TEE_ERROR_SIGNATURE_INVALID	0xFFFF3072
+#define TEE_ERROR_TIME_NOT_SET		0xFFFF5000
+#define TEE_ERROR_TIME_NEEDS_RESET	0xFFFF5001
+
+/* Parameter types */
+#define TEE_PARAM_TYPE_NONE		0
+#define TEE_PARAM_TYPE_VALUE_INPUT	1
+#define TEE_PARAM_TYPE_VALUE_OUTPUT	2
+#define TEE_PARAM_TYPE_VALUE_INOUT	3
+#define TEE_PARAM_TYPE_MEMREF_INPUT	5
+#define TEE_PARAM_TYPE_MEMREF_OUTPUT	6
+#define TEE_PARAM_TYPE_MEMREF_INOUT	7
+
+/* Login types */
+#define TEE_LOGIN_PUBLIC		0x00000000
+#define TEE_LOGIN_USER			0x00000001
+#define TEE_LOGIN_GROUP			0x00000002
+#define TEE_LOGIN_APPLICATION		0x00000004
+
+/* Origin codes */
+#define TEE_ORIGIN_API			0x00000001
+#define TEE_ORIGIN_COMMS		0x00000002
+#define TEE_ORIGIN_TEE			0x00000003
+#define TEE_ORIGIN_TRUSTED_APP		0x00000004
+
+/* TEE_Malloc hints */
+#define TEE_MALLOC_FILL_ZERO		0x00000000
+#define TEE_MALLOC_NO_FILL		0x00000001
+#define TEE_MALLOC_NO_SHARE		0x00000002
+#define TEE_USER_MEM_HINT_NO_FILL_ZERO	0x80000000
+
+/* Storage */
+#define TEE_STORAGE_PRIVATE		0x00000001
+#define TEE_STORAGE_PRIVATE_REE		0x80000000
+#define TEE_STORAGE_PRIVATE_RPMB	0x80000100
+
+#define TEE_OBJECT_ID_MAX_LEN		64
+#define TEE_DATA_MAX_POSITION		0xFFFFFFFF
+
+#define TEE_DATA_FLAG_ACCESS_READ	0x00000001
+#define TEE_DATA_FLAG_ACCESS_WRITE	0x00000002
+#define TEE_DATA_FLAG_ACCESS_WRITE_META	0x00000004
+#define TEE_DATA_FLAG_SHARE_READ	0x00000010
+#define TEE_DATA_FLAG_SHARE_WRITE	0x00000020
+#define TEE_DATA_FLAG_OVERWRITE		0x00000400
+
+#define TEE_HANDLE_FLAG_PERSISTENT	0x00010000
+#define TEE_HANDLE_FLAG_INITIALIZED	0x00020000
+#define TEE_HANDLE_FLAG_KEY_SET		0x00040000
+#define TEE_HANDLE_FLAG_EXPECT_TWO_KEYS	0x00080000
+
+#define TEE_USAGE_EXTRACTABLE		0x00000001
+#define TEE_USAGE_ENCRYPT		0x00000002
+#define TEE_USAGE_DECRYPT		0x00000004
+#define TEE_USAGE_MAC			0x00000008
+#define TEE_USAGE_SIGN			0x00000010
+#define TEE_USAGE_VERIFY		0x00000020
+#define TEE_USAGE_DERIVE		0x00000040
+#define TEE_USAGE_DEFAULT		0xFFFFFFFF
+
+/* Operation classes */
+#define TEE_OPERATION_CIPHER		1
+#define TEE_OPERATION_MAC		3
+#define TEE_OPERATION_AE		4
+#define TEE_OPERATION_DIGEST		5
+#define TEE_OPERATION_ASYMMETRIC_CIPHER	6
+#define TEE_OPERATION_ASYMMETRIC_SIGNATURE 7
+#define TEE_OPERATION_KEY_DERIVATION	8
+
+/* Algorithms */
+#define TEE_ALG_AES_ECB_NOPAD		0x10000010
+#define TEE_ALG_AES_CBC_NOPAD		0x10000110
+#define TEE_ALG_AES_CTR			0x10000210
+#define TEE_ALG_AES_CTS			0x10000310
+#define TEE_ALG_AES_XTS			0x10000410
+#define TEE_ALG_AES_GCM			0x40000810
+#define TEE_ALG_MD5			0x50000001
+#define TEE_ALG_SHA1			0x50000002
+#define TEE_ALG_SHA224			0x50000003
+#define TEE_ALG_SHA256			0x50000004
+#define TEE_ALG_SHA384			0x50000005
+#define TEE_ALG_SHA512			0x50000006
+
+/* Object types */
+#define TEE_TYPE_AES			0xA0000010
+#define TEE_TYPE_GENERIC_SECRET		0xA0000000
+#define TEE_TYPE_DATA			0xA00000BF
+
+/* Attributes */
+#define TEE_ATTR_SECRET_VALUE		0xC0000000
+#define TEE_ATTR_FLAG_VALUE		(1 << 29)
+
+#endif /* TEE_API_DEFINES_H */
@@ -0,0 +1,130 @@
+/*
+ * Subset of the GlobalPlatform TEE Internal Core API implemented by the
+ * emulator: what the storage and crypto TAs in this repository use, plus
+ * the neighbouring calls a TA change is likely to reach for next.
+ */
+#ifndef TEE_INTERNAL_API_H
+#define TEE_INTERNAL_API_H
+
+#include <tee_api_defines.h>
+#include <tee_api_types.h>
+#include <trace.h>
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+/* TA entry points, implemented by the TA */
+TEE_Result TA_CreateEntryPoint(void);
+void TA_DestroyEntryPoint(void);
+TEE_Result TA_OpenSessionEntryPoint(uint32_t paramTypes, TEE_Param params[4],
+				    void **sessionContext);
+void TA_CloseSessionEntryPoint(void *sessionContext);
+TEE_Result TA_InvokeCommandEntryPoint(void *sessionContext,
+				      uint32_t commandID, uint32_t paramTypes,
+				      TEE_Param params[4]);
+
+/* Panics */
+void TEE_Panic(TEE_Result panicCode) __attribute__((noreturn));
+
+/* Memory */
+void *TEE_Malloc(size_t size, uint32_t hint);
+void *TEE_Realloc(void *buffer, size_t newSize);
+void TEE_Free(void *buffer);
+void *TEE_MemMove(void *dest, const void *src, size_t size);
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size);
+void TEE_MemFill(void *buff, uint32_t x, size_t size);
+
+/* Time */
+void TEE_GetSystemTime(TEE_Time *time);
+void TEE_GetREETime(TEE_Time *time);
+TEE_Result TEE_Wait(uint32_t timeout);
+
+/* Cancellation */
+bool TEE_GetCancellationFlag(void);
+bool TEE_UnmaskCancellation(void);
+bool TEE_MaskCancellation(void);
+
+/* Transient and generic objects */
+void TEE_GetObjectInfo(TEE_ObjectHandle object, TEE_ObjectInfo *objectInfo);
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle object,
+			      TEE_ObjectInfo *objectInfo);
+void TEE_CloseObject(TEE_ObjectHandle object);
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object);
+void TEE_FreeTransientObject(TEE_ObjectHandle object);
+void TEE_ResetTransientObject(TEE_ObjectHandle object);
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount);
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length);
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			    uint32_t a, uint32_t b);
+TEE_Result TEE_CopyObjectAttributes1(TEE_ObjectHandle destObject,
+				     TEE_ObjectHandle srcObject);
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+			   const TEE_Attribute *params, uint32_t paramCount);
+
+/* Persistent objects, backed by files in the emulator's storage directory */
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+				    size_t objectIDLen, uint32_t flags,
+				    TEE_ObjectHandle *object);
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+				      size_t objectIDLen, uint32_t flags,
+				      TEE_ObjectHandle attributes,
+				      const void *initialData,
+				      size_t initialDataLen,
+				      TEE_ObjectHandle *object);
+void TEE_CloseAndDeletePersistentObject(TEE_ObjectHandle object);
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object);
+TEE_Result TEE_RenamePersistentObject(TEE_ObjectHandle object,
+				      const void *newObjectID,
+				      size_t newObjectIDLen);
+TEE_Result TEE_AllocatePersistentObjectEnumerator(TEE_ObjectEnumHandle *
+						  objectEnumerator);
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator);
+void TEE_ResetPersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator);
+TEE_Result TEE_StartPersistentObjectEnumerator(TEE_ObjectEnumHandle
+					       objectEnumerator,
+					       uint32_t storageID);
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+				       TEE_ObjectInfo *objectInfo,
+				       void *objectID, size_t *objectIDLen);
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			      uint32_t size, uint32_t *count);
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			       uint32_t size);
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size);
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+			      TEE_Whence whence);
+
+/* Cryptographic operations: AES (ECB, CBC, CTR) and the SHA family */
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize);
+void TEE_FreeOperation(TEE_OperationHandle operation);
+void TEE_GetOperationInfo(TEE_OperationHandle operation,
+			  TEE_OperationInfo *operationInfo);
+void TEE_ResetOperation(TEE_OperationHandle operation);
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key);
+void TEE_CopyOperation(TEE_OperationHandle dstOperation,
+		       TEE_OperationHandle srcOperation);
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+		      size_t chunkSize);
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+			     size_t chunkLen, void *hash, uint32_t *hashLen);
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+		    size_t IVLen);
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+			    size_t srcLen, void *destData, uint32_t *destLen);
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			     const void *srcData, size_t srcLen,
+			     void *destData, uint32_t *destLen);
+
+/* Random */
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen);
+
+#endif /* TEE_INTERNAL_API_H */
@@ -0,0 +1,10 @@
+/*
+ * OP-TEE extensions to the Internal Core API. None of them are used by the
+ * TAs in this repository; the header exists so their includes resolve.
+ */
+#ifndef TEE_INTERNAL_API_EXTENSIONS_H
+#define TEE_INTERNAL_API_EXTENSIONS_H
+
+#include <tee_api_types.h>
+
+#endif /* TEE_INTERNAL_API_EXTENSIONS_H */
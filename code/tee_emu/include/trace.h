@@ -0,0 +1,23 @@
+/*
+ * TA logging for the emulator. Levels follow CFG_TEE_TA_LOG_LEVEL
+ * (1 error, 2 info, 3 debug, 4 flow) and are chosen at run time with the
+ * TEE_EMU_LOG environment variable; messages go to stderr in the same
+ * "I/TA: func:line message" shape as OP-TEE's secure console.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_ERROR	1
+#define TRACE_INFO	2
+#define TRACE_DEBUG	3
+#define TRACE_FLOW	4
+
+void tee_emu_trace(int level, const char *func, int line, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+#define EMSG(...) tee_emu_trace(TRACE_ERROR, __func__, __LINE__, __VA_ARGS__)
+#define IMSG(...) tee_emu_trace(TRACE_INFO, __func__, __LINE__, __VA_ARGS__)
+#define DMSG(...) tee_emu_trace(TRACE_DEBUG, __func__, __LINE__, __VA_ARGS__)
+#define FMSG(...) tee_emu_trace(TRACE_FLOW, __func__, __LINE__, __VA_ARGS__)
+
+#endif /* TRACE_H */
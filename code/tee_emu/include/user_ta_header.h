@@ -0,0 +1,18 @@
+/*
+ * TA property flags referenced from user_ta_header_defines.h. Values as in
+ * OP-TEE's user_ta_header.h; the emulator honours SINGLE_INSTANCE,
+ * MULTI_SESSION and INSTANCE_KEEP_ALIVE.
+ */
+#ifndef USER_TA_HEADER_H
+#define USER_TA_HEADER_H
+
+#define TA_FLAG_USER_MODE		0
+#define TA_FLAG_EXEC_DDR		0
+#define TA_FLAG_SINGLE_INSTANCE		(1 << 2)
+#define TA_FLAG_MULTI_SESSION		(1 << 3)
+#define TA_FLAG_INSTANCE_KEEP_ALIVE	(1 << 4)
+#define TA_FLAG_SECURE_DATA_PATH	(1 << 5)
+#define TA_FLAG_CACHE_MAINTENANCE	(1 << 7)
+#define TA_FLAG_CONCURRENT		(1 << 8)
+
+#endif /* USER_TA_HEADER_H */
@@ -0,0 +1,16 @@
+/*
+ * Properties of the TA being emulated. Built once per TA with that TA's
+ * include directory on the path, so user_ta_header_defines.h resolves to
+ * the file the real TA is signed with.
+ */
+#include <user_ta_header.h>
+#include <user_ta_header_defines.h>
+
+#include "tee_emu.h"
+
+const struct tee_emu_ta_props tee_emu_ta = {
+	.uuid = TA_UUID,
+	.flags = TA_FLAGS,
+	.stack_size = TA_STACK_SIZE,
+	.data_size = TA_DATA_SIZE,
+};
@@ -0,0 +1,56 @@
+/*
+ * Internal interfaces shared by the emulator's client and TA sides.
+ */
+#ifndef TEE_EMU_H
+#define TEE_EMU_H
+
+#include <tee_internal_api.h>
+
+/* Properties of the linked TA, from its user_ta_header_defines.h */
+struct tee_emu_ta_props {
+	TEE_UUID uuid;
+	uint32_t flags;
+	size_t stack_size;
+	size_t data_size;
+};
+
+extern const struct tee_emu_ta_props tee_emu_ta;
+
+/*
+ * State of the command being executed on the calling thread. The client
+ * dispatcher installs it around every TA entry point call.
+ */
+struct tee_emu_invocation {
+	volatile bool cancelled;
+	bool cancel_masked;
+};
+
+void tee_emu_enter(struct tee_emu_invocation *inv);
+void tee_emu_leave(void);
+
+/* TA heap, capped at TA_DATA_SIZE unless TEE_EMU_HEAP_SIZE overrides it */
+size_t tee_emu_heap_used(void);
+size_t tee_emu_heap_peak(void);
+
+/*
+ * Object handle. Transient objects hold secret key material; persistent
+ * ones are an open file in the TA's storage directory.
+ */
+struct __TEE_ObjectHandle {
+	TEE_ObjectInfo info;
+	uint8_t *key;			/* TEE_ATTR_SECRET_VALUE */
+	size_t key_len;
+	int fd;				/* -1 for transient objects */
+	uint32_t flags;			/* TEE_DATA_FLAG_* of the open */
+	uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+	size_t id_len;
+	struct __TEE_ObjectHandle *next;	/* open persistent objects */
+};
+
+/* Closes persistent objects the TA left open when its instance goes away */
+void tee_emu_storage_close_all(void);
+
+/* Unsigned environment setting, def when unset or malformed */
+unsigned long tee_emu_env(const char *name, unsigned long def);
+
+#endif /* TEE_EMU_H */
@@ -0,0 +1,249 @@
+/*
+ * Core Internal API services for the emulator: logging, panics, the TA
+ * heap, time, randomness and cancellation.
+ */
+#include <openssl/rand.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tee_emu.h"
+
+/*
+ * Every TEE_Malloc block carries its size in front so TEE_Free can keep
+ * the heap accounting without the caller passing sizes around.
+ */
+struct heap_block {
+	size_t size;
+	size_t pad;		/* keeps the payload 16 byte aligned */
+};
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t heap_used;
+static size_t heap_peak;
+static size_t heap_limit;
+
+static __thread struct tee_emu_invocation *current_invocation;
+
+unsigned long tee_emu_env(const char *name, unsigned long def)
+{
+	const char *value = getenv(name);
+	char *end;
+	unsigned long v;
+
+	if (!value || !*value)
+		return def;
+	v = strtoul(value, &end, 0);
+	return *end ? def : v;
+}
+
+void tee_emu_trace(int level, const char *func, int line, const char *fmt, ...)
+{
+	static const char prefix[] = "?EIDF";
+	static int max_level = -1;
+	va_list ap;
+
+	if (max_level < 0)
+		max_level = tee_emu_env("TEE_EMU_LOG", TRACE_INFO);
+	if (level > max_level)
+		return;
+
+	fprintf(stderr, "%c/TA: %s:%d ", prefix[level < 5 ? level : 0],
+		func, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+void TEE_Panic(TEE_Result panicCode)
+{
+	fprintf(stderr, "E/TA: TA panicked with code 0x%x\n", panicCode);
+	abort();
+}
+
+static size_t heap_cap(void)
+{
+	if (!heap_limit)
+		heap_limit = tee_emu_env("TEE_EMU_HEAP_SIZE", tee_emu_ta.data_size);
+	return heap_limit;
+}
+
+size_t tee_emu_heap_used(void)
+{
+	return heap_used;
+}
+
+size_t tee_emu_heap_peak(void)
+{
+	return heap_peak;
+}
+
+static bool heap_charge(size_t old_size, size_t new_size)
+{
+	bool ok = true;
+
+	pthread_mutex_lock(&heap_lock);
+	if (heap_used - old_size + new_size > heap_cap()) {
+		ok = false;
+	} else {
+		heap_used = heap_used - old_size + new_size;
+		if (heap_used > heap_peak)
+			heap_peak = heap_used;
+	}
+	pthread_mutex_unlock(&heap_lock);
+	return ok;
+}
+
+void *TEE_Malloc(size_t size, uint32_t hint)
+{
+	struct heap_block *block;
+
+	if (!heap_charge(0, size))
+		return NULL;
+
+	block = malloc(sizeof(*block) + size);
+	if (!block) {
+		heap_charge(size, 0);
+		return NULL;
+	}
+	block->size = size;
+	if (!(hint & (TEE_MALLOC_NO_FILL | TEE_USER_MEM_HINT_NO_FILL_ZERO)))
+		memset(block + 1, 0, size);
+	return block + 1;
+}
+
+void *TEE_Realloc(void *buffer, size_t newSize)
+{
+	struct heap_block *block;
+	size_t old_size;
+
+	if (!buffer)
+		return TEE_Malloc(newSize, 0);
+
+	block = (struct heap_block *)buffer - 1;
+	old_size = block->size;
+	if (!heap_charge(old_size, newSize))
+		return NULL;
+
+	block = realloc(block, sizeof(*block) + newSize);
+	if (!block) {
+		heap_charge(newSize, old_size);
+		return NULL;
+	}
+	block->size = newSize;
+	return block + 1;
+}
+
+void TEE_Free(void *buffer)
+{
+	struct heap_block *block;
+
+	if (!buffer)
+		return;
+	block = (struct heap_block *)buffer - 1;
+	heap_charge(block->size, 0);
+	free(block);
+}
+
+void *TEE_MemMove(void *dest, const void *src, size_t size)
+{
+	return memmove(dest, src, size);
+}
+
+int32_t TEE_MemCompare(const void *buffer1, const void *buffer2, size_t size)
+{
+	int r = memcmp(buffer1, buffer2, size);
+
+	return r < 0 ? -1 : r > 0;
+}
+
+void TEE_MemFill(void *buff, uint32_t x, size_t size)
+{
+	memset(buff, (int)x, size);
+}
+
+static void fill_time(clockid_t clock, TEE_Time *time)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	time->seconds = (uint32_t)ts.tv_sec;
+	time->millis = (uint32_t)(ts.tv_nsec / 1000000);
+}
+
+void TEE_GetSystemTime(TEE_Time *time)
+{
+	fill_time(CLOCK_MONOTONIC, time);
+}
+
+void TEE_GetREETime(TEE_Time *time)
+{
+	fill_time(CLOCK_REALTIME, time);
+}
+
+/* Sleeps in short steps so a cancelled invocation returns early */
+TEE_Result TEE_Wait(uint32_t timeout)
+{
+	struct timespec step = { 0, 10 * 1000000 };
+
+	while (timeout) {
+		if (TEE_GetCancellationFlag())
+			return TEE_ERROR_CANCEL;
+		if (timeout < 10)
+			step.tv_nsec = timeout * 1000000L;
+		nanosleep(&step, NULL);
+		timeout -= step.tv_nsec / 1000000;
+	}
+	return TEE_SUCCESS;
+}
+
+void TEE_GenerateRandom(void *randomBuffer, size_t randomBufferLen)
+{
+	if (RAND_bytes(randomBuffer, (int)randomBufferLen) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+void tee_emu_enter(struct tee_emu_invocation *inv)
+{
+	current_invocation = inv;
+}
+
+void tee_emu_leave(void)
+{
+	current_invocation = NULL;
+}
+
+bool TEE_GetCancellationFlag(void)
+{
+	struct tee_emu_invocation *inv = current_invocation;
+
+	return inv && !inv->cancel_masked && inv->cancelled;
+}
+
+bool TEE_UnmaskCancellation(void)
+{
+	struct tee_emu_invocation *inv = current_invocation;
+	bool was_masked;
+
+	if (!inv)
+		return true;
+	was_masked = inv->cancel_masked;
+	inv->cancel_masked = false;
+	return was_masked;
+}
+
+bool TEE_MaskCancellation(void)
+{
+	struct tee_emu_invocation *inv = current_invocation;
+	bool was_masked;
+
+	if (!inv)
+		return true;
+	was_masked = inv->cancel_masked;
+	inv->cancel_masked = true;
+	return was_masked;
+}
@@ -0,0 +1,315 @@
+/*
+ * Cryptographic operations on top of OpenSSL's EVP interface: AES in ECB,
+ * CBC and CTR modes and the MD5/SHA digests. The TEE keeps the key with the
+ * operation, so EVP contexts are re-initialised from op->key on every
+ * TEE_CipherInit.
+ */
+#include <openssl/evp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tee_emu.h"
+
+struct __TEE_OperationHandle {
+	TEE_OperationInfo info;
+	EVP_CIPHER_CTX *cipher;
+	EVP_MD_CTX *digest;
+	uint8_t key[32];
+	size_t key_len;
+	size_t buffered;		/* partial block held back by EVP */
+	bool initialized;		/* CipherInit done, or digest started */
+};
+
+static const EVP_CIPHER *aes_cipher(uint32_t algorithm, size_t key_len)
+{
+	switch (algorithm) {
+	case TEE_ALG_AES_ECB_NOPAD:
+		return key_len == 16 ? EVP_aes_128_ecb() :
+		       key_len == 24 ? EVP_aes_192_ecb() : EVP_aes_256_ecb();
+	case TEE_ALG_AES_CBC_NOPAD:
+		return key_len == 16 ? EVP_aes_128_cbc() :
+		       key_len == 24 ? EVP_aes_192_cbc() : EVP_aes_256_cbc();
+	case TEE_ALG_AES_CTR:
+		return key_len == 16 ? EVP_aes_128_ctr() :
+		       key_len == 24 ? EVP_aes_192_ctr() : EVP_aes_256_ctr();
+	default:
+		return NULL;
+	}
+}
+
+static const EVP_MD *digest_md(uint32_t algorithm)
+{
+	switch (algorithm) {
+	case TEE_ALG_MD5:
+		return EVP_md5();
+	case TEE_ALG_SHA1:
+		return EVP_sha1();
+	case TEE_ALG_SHA224:
+		return EVP_sha224();
+	case TEE_ALG_SHA256:
+		return EVP_sha256();
+	case TEE_ALG_SHA384:
+		return EVP_sha384();
+	case TEE_ALG_SHA512:
+		return EVP_sha512();
+	default:
+		return NULL;
+	}
+}
+
+static void start_digest(TEE_OperationHandle op)
+{
+	if (EVP_DigestInit_ex(op->digest, digest_md(op->info.algorithm),
+			      NULL) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+	op->initialized = true;
+}
+
+TEE_Result TEE_AllocateOperation(TEE_OperationHandle *operation,
+				 uint32_t algorithm, uint32_t mode,
+				 uint32_t maxKeySize)
+{
+	struct __TEE_OperationHandle *op;
+	const EVP_MD *md = digest_md(algorithm);
+
+	*operation = TEE_HANDLE_NULL;
+	if (md) {
+		if (mode != TEE_MODE_DIGEST)
+			return TEE_ERROR_NOT_SUPPORTED;
+	} else if (aes_cipher(algorithm, 32)) {
+		if (mode != TEE_MODE_ENCRYPT && mode != TEE_MODE_DECRYPT)
+			return TEE_ERROR_NOT_SUPPORTED;
+		if (maxKeySize != 128 && maxKeySize != 192 && maxKeySize != 256)
+			return TEE_ERROR_NOT_SUPPORTED;
+	} else {
+		EMSG("Algorithm 0x%x is not emulated", algorithm);
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+
+	op = calloc(1, sizeof(*op));
+	if (!op)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	op->info.algorithm = algorithm;
+	op->info.mode = mode;
+	op->info.requiredKeyUsage = 0;
+
+	if (md) {
+		op->info.operationClass = TEE_OPERATION_DIGEST;
+		op->info.digestLength = EVP_MD_size(md);
+		op->digest = EVP_MD_CTX_new();
+		if (!op->digest) {
+			free(op);
+			return TEE_ERROR_OUT_OF_MEMORY;
+		}
+		start_digest(op);
+		op->info.handleState = TEE_HANDLE_FLAG_KEY_SET;
+	} else {
+		op->info.operationClass = TEE_OPERATION_CIPHER;
+		op->info.maxKeySize = maxKeySize;
+		op->cipher = EVP_CIPHER_CTX_new();
+		if (!op->cipher) {
+			free(op);
+			return TEE_ERROR_OUT_OF_MEMORY;
+		}
+	}
+
+	*operation = op;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeOperation(TEE_OperationHandle operation)
+{
+	if (!operation)
+		return;
+	EVP_CIPHER_CTX_free(operation->cipher);
+	EVP_MD_CTX_free(operation->digest);
+	memset(operation->key, 0, sizeof(operation->key));
+	free(operation);
+}
+
+void TEE_GetOperationInfo(TEE_OperationHandle operation,
+			  TEE_OperationInfo *operationInfo)
+{
+	if (!operation)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	*operationInfo = operation->info;
+}
+
+void TEE_ResetOperation(TEE_OperationHandle operation)
+{
+	if (!operation)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (operation->digest) {
+		start_digest(operation);
+		return;
+	}
+	EVP_CIPHER_CTX_reset(operation->cipher);
+	operation->initialized = false;
+	operation->info.handleState &= ~TEE_HANDLE_FLAG_INITIALIZED;
+}
+
+TEE_Result TEE_SetOperationKey(TEE_OperationHandle operation,
+			       TEE_ObjectHandle key)
+{
+	if (!operation || operation->digest)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	TEE_ResetOperation(operation);
+	if (!key) {
+		memset(operation->key, 0, sizeof(operation->key));
+		operation->key_len = 0;
+		operation->info.keySize = 0;
+		operation->info.handleState &= ~TEE_HANDLE_FLAG_KEY_SET;
+		return TEE_SUCCESS;
+	}
+
+	if (!key->key || key->info.objectType != TEE_TYPE_AES ||
+	    key->key_len * 8 > operation->info.maxKeySize)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	memcpy(operation->key, key->key, key->key_len);
+	operation->key_len = key->key_len;
+	operation->info.keySize = key->key_len * 8;
+	operation->info.handleState |= TEE_HANDLE_FLAG_KEY_SET;
+	return TEE_SUCCESS;
+}
+
+void TEE_CopyOperation(TEE_OperationHandle dstOperation,
+		       TEE_OperationHandle srcOperation)
+{
+	if (!dstOperation || !srcOperation ||
+	    dstOperation->info.algorithm != srcOperation->info.algorithm ||
+	    dstOperation->info.mode != srcOperation->info.mode)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (srcOperation->digest) {
+		if (EVP_MD_CTX_copy_ex(dstOperation->digest,
+				       srcOperation->digest) != 1)
+			TEE_Panic(TEE_ERROR_GENERIC);
+	} else if (EVP_CIPHER_CTX_copy(dstOperation->cipher,
+				       srcOperation->cipher) != 1) {
+		TEE_Panic(TEE_ERROR_GENERIC);
+	}
+	memcpy(dstOperation->key, srcOperation->key, sizeof(dstOperation->key));
+	dstOperation->key_len = srcOperation->key_len;
+	dstOperation->buffered = srcOperation->buffered;
+	dstOperation->initialized = srcOperation->initialized;
+	dstOperation->info.keySize = srcOperation->info.keySize;
+	dstOperation->info.handleState = srcOperation->info.handleState;
+}
+
+void TEE_DigestUpdate(TEE_OperationHandle operation, const void *chunk,
+		      size_t chunkSize)
+{
+	if (!operation || !operation->digest)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (EVP_DigestUpdate(operation->digest, chunk, chunkSize) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+}
+
+TEE_Result TEE_DigestDoFinal(TEE_OperationHandle operation, const void *chunk,
+			     size_t chunkLen, void *hash, uint32_t *hashLen)
+{
+	unsigned int len;
+
+	if (!operation || !operation->digest)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	if (*hashLen < operation->info.digestLength) {
+		*hashLen = operation->info.digestLength;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (chunkLen)
+		TEE_DigestUpdate(operation, chunk, chunkLen);
+	if (EVP_DigestFinal_ex(operation->digest, hash, &len) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+	*hashLen = len;
+	start_digest(operation);
+	return TEE_SUCCESS;
+}
+
+void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
+		    size_t IVLen)
+{
+	const EVP_CIPHER *cipher;
+
+	if (!operation || !operation->cipher ||
+	    !(operation->info.handleState & TEE_HANDLE_FLAG_KEY_SET))
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	cipher = aes_cipher(operation->info.algorithm, operation->key_len);
+	if (EVP_CIPHER_iv_length(cipher) &&
+	    (!IV || IVLen != (size_t)EVP_CIPHER_iv_length(cipher)))
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+
+	if (EVP_CipherInit_ex(operation->cipher, cipher, NULL, operation->key,
+			      IV, operation->info.mode == TEE_MODE_ENCRYPT) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+	EVP_CIPHER_CTX_set_padding(operation->cipher, 0);
+	operation->buffered = 0;
+	operation->initialized = true;
+	operation->info.handleState |= TEE_HANDLE_FLAG_INITIALIZED;
+}
+
+static TEE_Result cipher_update(TEE_OperationHandle operation,
+				const void *srcData, size_t srcLen,
+				void *destData, uint32_t *destLen, bool final)
+{
+	size_t block = EVP_CIPHER_CTX_block_size(operation->cipher);
+	size_t pending = 0;
+	size_t out_len;
+	int n = 0, tail = 0;
+
+	if (!operation->cipher || !operation->initialized)
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	/*
+	 * Without padding EVP holds back partial blocks; report the size that
+	 * will actually be produced so SHORT_BUFFER matches a real TEE.
+	 */
+	if (block > 1) {
+		pending = operation->buffered;
+		if (final && (pending + srcLen) % block)
+			return TEE_ERROR_BAD_PARAMETERS;
+		out_len = (pending + srcLen) / block * block;
+	} else {
+		out_len = srcLen;
+	}
+	if (*destLen < out_len) {
+		*destLen = (uint32_t)out_len;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	if (srcLen && EVP_CipherUpdate(operation->cipher, destData, &n,
+				       srcData, (int)srcLen) != 1)
+		TEE_Panic(TEE_ERROR_GENERIC);
+	operation->buffered = (pending + srcLen) % block;
+	if (final) {
+		if (EVP_CipherFinal_ex(operation->cipher,
+				       (uint8_t *)destData + n, &tail) != 1)
+			return TEE_ERROR_BAD_PARAMETERS;
+		operation->initialized = false;
+		operation->info.handleState &= ~TEE_HANDLE_FLAG_INITIALIZED;
+	}
+	*destLen = (uint32_t)(n + tail);
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CipherUpdate(TEE_OperationHandle operation, const void *srcData,
+			    size_t srcLen, void *destData, uint32_t *destLen)
+{
+	if (!operation)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	return cipher_update(operation, srcData, srcLen, destData, destLen,
+			     false);
+}
+
+TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
+			     const void *srcData, size_t srcLen,
+			     void *destData, uint32_t *destLen)
+{
+	if (!operation)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	return cipher_update(operation, srcData, srcLen, destData, destLen,
+			     true);
+}
@@ -0,0 +1,957 @@
+/*
+ * Transient and persistent objects. Each persistent object is a file named
+ * by the hex encoding of its object ID, in a per-TA directory under
+ * TEE_EMU_STORAGE (default /tmp/tee_emu_storage). TEE_EMU_STORAGE_LIMIT
+ * caps the bytes a TA may store, so "storage full" paths can be exercised
+ * without filling a partition. A persistent key object keeps its type and
+ * secret in a ".attr" file next to its data, outside the enumeration and
+ * the storage limit.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tee_emu.h"
+
+#define DATA_ACCESS_FLAGS (TEE_DATA_FLAG_ACCESS_READ | \
+			   TEE_DATA_FLAG_ACCESS_WRITE | \
+			   TEE_DATA_FLAG_ACCESS_WRITE_META | \
+			   TEE_DATA_FLAG_SHARE_READ | \
+			   TEE_DATA_FLAG_SHARE_WRITE)
+
+struct __TEE_ObjectEnumHandle {
+	DIR *dir;
+};
+
+/* Head of a ".attr" file; the secret follows */
+struct object_attrs {
+	uint32_t type;
+	uint32_t max_size;
+	uint32_t key_len;
+};
+
+static pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct __TEE_ObjectHandle *open_objects;
+static char storage_dir[4096];
+static long long storage_used = -1;	/* bytes, -1 until first scanned */
+
+static const char *ta_storage_dir(void)
+{
+	const char *root;
+	const TEE_UUID *u = &tee_emu_ta.uuid;
+
+	if (storage_dir[0])
+		return storage_dir;
+
+	root = getenv("TEE_EMU_STORAGE");
+	if (!root || !*root)
+		root = "/tmp/tee_emu_storage";
+	mkdir(root, 0700);
+	snprintf(storage_dir, sizeof(storage_dir),
+		 "%s/%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		 root, u->timeLow, u->timeMid, u->timeHiAndVersion,
+		 u->clockSeqAndNode[0], u->clockSeqAndNode[1],
+		 u->clockSeqAndNode[2], u->clockSeqAndNode[3],
+		 u->clockSeqAndNode[4], u->clockSeqAndNode[5],
+		 u->clockSeqAndNode[6], u->clockSeqAndNode[7]);
+	mkdir(storage_dir, 0700);
+	return storage_dir;
+}
+
+static void object_path(const void *id, size_t id_len, char *path, size_t size)
+{
+	const uint8_t *p = id;
+	size_t len = snprintf(path, size, "%s/", ta_storage_dir());
+
+	for (size_t i = 0; i < id_len && len + 3 < size; i++)
+		len += snprintf(path + len, size - len, "%02x", p[i]);
+}
+
+static void attr_path(const void *id, size_t id_len, char *path, size_t size)
+{
+	size_t len;
+
+	object_path(id, id_len, path, size);
+	len = strlen(path);
+	snprintf(path + len, size - len, ".attr");
+}
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Decodes a storage file name back into an object ID */
+static bool decode_object_name(const char *name, void *id, size_t *id_len)
+{
+	size_t len = strlen(name);
+	uint8_t *out = id;
+
+	if (!len || len % 2 || len / 2 > TEE_OBJECT_ID_MAX_LEN)
+		return false;
+	for (size_t i = 0; i < len; i += 2) {
+		int hi = hex_value(name[i]);
+		int lo = hex_value(name[i + 1]);
+
+		if (hi < 0 || lo < 0)
+			return false;
+		out[i / 2] = (uint8_t)(hi << 4 | lo);
+	}
+	*id_len = len / 2;
+	return true;
+}
+
+/* Caller holds storage_lock */
+static void scan_storage_used(void)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+
+	if (storage_used >= 0)
+		return;
+	storage_used = 0;
+	dir = opendir(ta_storage_dir());
+	if (!dir)
+		return;
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] != '.' && !strchr(de->d_name, '.') &&
+		    !fstatat(dirfd(dir), de->d_name, &st, 0))
+			storage_used += st.st_size;
+	}
+	closedir(dir);
+}
+
+/* Accounts for a change in stored bytes; false when over the limit */
+static bool storage_charge(long long delta)
+{
+	unsigned long limit = tee_emu_env("TEE_EMU_STORAGE_LIMIT", 0);
+	bool ok = true;
+
+	pthread_mutex_lock(&storage_lock);
+	scan_storage_used();
+	if (delta > 0 && limit && storage_used + delta > (long long)limit)
+		ok = false;
+	else
+		storage_used += delta;
+	pthread_mutex_unlock(&storage_lock);
+	return ok;
+}
+
+static TEE_Result errno_to_tee(int err)
+{
+	switch (err) {
+	case ENOENT:
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	case ENOSPC:
+	case EDQUOT:
+		return TEE_ERROR_STORAGE_NO_SPACE;
+	case ENOMEM:
+		return TEE_ERROR_OUT_OF_MEMORY;
+	case EACCES:
+	case EPERM:
+		return TEE_ERROR_ACCESS_DENIED;
+	default:
+		return TEE_ERROR_STORAGE_NOT_AVAILABLE;
+	}
+}
+
+/*
+ * GP sharing rules: a second handle on an object needs both opens to allow
+ * the other's access through SHARE_READ/SHARE_WRITE, and WRITE_META is
+ * exclusive. Caller holds storage_lock.
+ */
+static bool access_conflict(const void *id, size_t id_len, uint32_t flags)
+{
+	for (struct __TEE_ObjectHandle *o = open_objects; o; o = o->next) {
+		if (o->id_len != id_len || memcmp(o->id, id, id_len))
+			continue;
+		if ((flags | o->flags) & TEE_DATA_FLAG_ACCESS_WRITE_META)
+			return true;
+		if ((flags & TEE_DATA_FLAG_ACCESS_READ) &&
+		    !(o->flags & TEE_DATA_FLAG_SHARE_READ))
+			return true;
+		if ((o->flags & TEE_DATA_FLAG_ACCESS_READ) &&
+		    !(flags & TEE_DATA_FLAG_SHARE_READ))
+			return true;
+		if ((flags & TEE_DATA_FLAG_ACCESS_WRITE) &&
+		    !(o->flags & TEE_DATA_FLAG_SHARE_WRITE))
+			return true;
+		if ((o->flags & TEE_DATA_FLAG_ACCESS_WRITE) &&
+		    !(flags & TEE_DATA_FLAG_SHARE_WRITE))
+			return true;
+	}
+	return false;
+}
+
+static struct __TEE_ObjectHandle *new_handle(void)
+{
+	struct __TEE_ObjectHandle *o = calloc(1, sizeof(*o));
+
+	if (o)
+		o->fd = -1;
+	return o;
+}
+
+/* Caller holds storage_lock */
+static void unlink_open_object(struct __TEE_ObjectHandle *object)
+{
+	struct __TEE_ObjectHandle **link;
+
+	for (link = &open_objects; *link; link = &(*link)->next) {
+		if (*link == object) {
+			*link = object->next;
+			return;
+		}
+	}
+}
+
+static void free_handle(struct __TEE_ObjectHandle *object)
+{
+	if (object->fd >= 0) {
+		pthread_mutex_lock(&storage_lock);
+		unlink_open_object(object);
+		pthread_mutex_unlock(&storage_lock);
+		close(object->fd);
+	}
+	if (object->key) {
+		memset(object->key, 0, object->key_len);
+		free(object->key);
+	}
+	free(object);
+}
+
+static void check_persistent(TEE_ObjectHandle object)
+{
+	if (!object || object->fd < 0)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+}
+
+/*
+ * The results GP lets each storage call return, TEE_SUCCESS ending the
+ * list. libutee panics the TA on any other, as gp_result does, so a TA
+ * cannot come to handle here an error it never gets on a board.
+ */
+static const TEE_Result open_results[] = {
+	TEE_ERROR_ITEM_NOT_FOUND, TEE_ERROR_ACCESS_CONFLICT,
+	TEE_ERROR_OUT_OF_MEMORY, TEE_ERROR_CORRUPT_OBJECT,
+	TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result create_results[] = {
+	TEE_ERROR_ITEM_NOT_FOUND, TEE_ERROR_ACCESS_CONFLICT,
+	TEE_ERROR_OUT_OF_MEMORY, TEE_ERROR_STORAGE_NO_SPACE,
+	TEE_ERROR_CORRUPT_OBJECT, TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result rename_results[] = {
+	TEE_ERROR_ACCESS_CONFLICT, TEE_ERROR_CORRUPT_OBJECT,
+	TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result read_results[] = {
+	TEE_ERROR_CORRUPT_OBJECT, TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result write_results[] = {
+	TEE_ERROR_STORAGE_NO_SPACE, TEE_ERROR_OVERFLOW,
+	TEE_ERROR_CORRUPT_OBJECT, TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result truncate_results[] = {
+	TEE_ERROR_STORAGE_NO_SPACE, TEE_ERROR_CORRUPT_OBJECT,
+	TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+static const TEE_Result seek_results[] = {
+	TEE_ERROR_OVERFLOW, TEE_ERROR_CORRUPT_OBJECT,
+	TEE_ERROR_STORAGE_NOT_AVAILABLE, TEE_SUCCESS
+};
+
+static TEE_Result gp_result(TEE_Result res, const TEE_Result *allowed)
+{
+	const TEE_Result *r;
+
+	if (res == TEE_SUCCESS)
+		return res;
+	for (r = allowed; *r != TEE_SUCCESS; r++)
+		if (*r == res)
+			return res;
+	EMSG("Result 0x%x is not one GP allows for this call", res);
+	TEE_Panic(res);
+	return res;
+}
+
+void tee_emu_storage_close_all(void)
+{
+	while (open_objects)
+		free_handle(open_objects);
+}
+
+TEE_Result TEE_AllocateTransientObject(TEE_ObjectType objectType,
+				       uint32_t maxObjectSize,
+				       TEE_ObjectHandle *object)
+{
+	struct __TEE_ObjectHandle *o;
+
+	switch (objectType) {
+	case TEE_TYPE_AES:
+		if (maxObjectSize != 128 && maxObjectSize != 192 &&
+		    maxObjectSize != 256)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	case TEE_TYPE_GENERIC_SECRET:
+		if (!maxObjectSize || maxObjectSize > 4096 || maxObjectSize % 8)
+			return TEE_ERROR_NOT_SUPPORTED;
+		break;
+	default:
+		EMSG("Object type 0x%x is not emulated", objectType);
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+
+	o = new_handle();
+	if (!o)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	o->info.objectType = objectType;
+	o->info.maxObjectSize = maxObjectSize;
+	o->info.objectUsage = TEE_USAGE_DEFAULT;
+	*object = o;
+	return TEE_SUCCESS;
+}
+
+void TEE_FreeTransientObject(TEE_ObjectHandle object)
+{
+	if (!object)
+		return;
+	if (object->fd >= 0)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+	free_handle(object);
+}
+
+void TEE_ResetTransientObject(TEE_ObjectHandle object)
+{
+	if (!object)
+		return;
+	if (object->key) {
+		memset(object->key, 0, object->key_len);
+		free(object->key);
+	}
+	object->key = NULL;
+	object->key_len = 0;
+	object->info.objectSize = 0;
+	object->info.handleFlags &= ~TEE_HANDLE_FLAG_INITIALIZED;
+}
+
+static TEE_Result set_secret(TEE_ObjectHandle object, const void *secret,
+			     size_t len)
+{
+	if (len * 8 > object->info.maxObjectSize)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (object->info.objectType == TEE_TYPE_AES &&
+	    len != 16 && len != 24 && len != 32)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	object->key = malloc(len);
+	if (!object->key)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memcpy(object->key, secret, len);
+	object->key_len = len;
+	object->info.objectSize = len * 8;
+	object->info.handleFlags |= TEE_HANDLE_FLAG_INITIALIZED;
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_PopulateTransientObject(TEE_ObjectHandle object,
+				       const TEE_Attribute *attrs,
+				       uint32_t attrCount)
+{
+	if (!object || object->fd >= 0 ||
+	    (object->info.handleFlags & TEE_HANDLE_FLAG_INITIALIZED))
+		TEE_Panic(TEE_ERROR_BAD_STATE);
+
+	for (uint32_t i = 0; i < attrCount; i++) {
+		if (attrs[i].attributeID == TEE_ATTR_SECRET_VALUE)
+			return set_secret(object, attrs[i].content.ref.buffer,
+					  attrs[i].content.ref.length);
+	}
+	return TEE_ERROR_BAD_PARAMETERS;
+}
+
+void TEE_InitRefAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			  const void *buffer, size_t length)
+{
+	attr->attributeID = attributeID;
+	attr->content.ref.buffer = (void *)buffer;
+	attr->content.ref.length = length;
+}
+
+void TEE_InitValueAttribute(TEE_Attribute *attr, uint32_t attributeID,
+			    uint32_t a, uint32_t b)
+{
+	attr->attributeID = attributeID;
+	attr->content.value.a = a;
+	attr->content.value.b = b;
+}
+
+TEE_Result TEE_CopyObjectAttributes1(TEE_ObjectHandle destObject,
+				     TEE_ObjectHandle srcObject)
+{
+	if (!srcObject || !srcObject->key)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return set_secret(destObject, srcObject->key, srcObject->key_len);
+}
+
+TEE_Result TEE_GenerateKey(TEE_ObjectHandle object, uint32_t keySize,
+			   const TEE_Attribute *params __unused,
+			   uint32_t paramCount __unused)
+{
+	uint8_t secret[512];
+	TEE_Result res;
+
+	if (!object || object->fd >= 0 || keySize % 8 ||
+	    keySize / 8 > sizeof(secret))
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (RAND_bytes(secret, keySize / 8) != 1)
+		return TEE_ERROR_GENERIC;
+	res = set_secret(object, secret, keySize / 8);
+	memset(secret, 0, sizeof(secret));
+	return res;
+}
+
+TEE_Result TEE_GetObjectInfo1(TEE_ObjectHandle object,
+			      TEE_ObjectInfo *objectInfo)
+{
+	struct stat st;
+	off_t pos;
+
+	if (!object)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (object->fd >= 0) {
+		if (fstat(object->fd, &st))
+			return errno_to_tee(errno);
+		pos = lseek(object->fd, 0, SEEK_CUR);
+		object->info.dataSize = (uint32_t)st.st_size;
+		object->info.dataPosition = (uint32_t)(pos < 0 ? 0 : pos);
+	}
+	*objectInfo = object->info;
+	return TEE_SUCCESS;
+}
+
+void TEE_GetObjectInfo(TEE_ObjectHandle object, TEE_ObjectInfo *objectInfo)
+{
+	if (TEE_GetObjectInfo1(object, objectInfo) != TEE_SUCCESS)
+		TEE_Panic(TEE_ERROR_BAD_PARAMETERS);
+}
+
+void TEE_CloseObject(TEE_ObjectHandle object)
+{
+	if (object)
+		free_handle(object);
+}
+
+static TEE_Result check_object_id(uint32_t storageID, const void *objectID,
+				  size_t objectIDLen)
+{
+	if (storageID != TEE_STORAGE_PRIVATE &&
+	    storageID != TEE_STORAGE_PRIVATE_REE &&
+	    storageID != TEE_STORAGE_PRIVATE_RPMB)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (!objectID || !objectIDLen || objectIDLen > TEE_OBJECT_ID_MAX_LEN)
+		return TEE_ERROR_BAD_PARAMETERS;
+	return TEE_SUCCESS;
+}
+
+/* Gives a just opened handle the key its ".attr" file holds, if any */
+static TEE_Result load_attrs(struct __TEE_ObjectHandle *o)
+{
+	struct object_attrs a;
+	uint8_t secret[512];
+	char path[4096];
+	TEE_Result res;
+	int fd;
+
+	attr_path(o->id, o->id_len, path, sizeof(path));
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return errno == ENOENT ? TEE_SUCCESS : errno_to_tee(errno);
+	if (read(fd, &a, sizeof(a)) != sizeof(a) ||
+	    a.key_len > sizeof(secret) ||
+	    read(fd, secret, a.key_len) != (ssize_t)a.key_len) {
+		close(fd);
+		return TEE_ERROR_CORRUPT_OBJECT;
+	}
+	close(fd);
+
+	o->info.objectType = a.type;
+	o->info.maxObjectSize = a.max_size;
+	res = set_secret(o, secret, a.key_len);
+	memset(secret, 0, sizeof(secret));
+	return res;
+}
+
+static TEE_Result store_attrs(const void *id, size_t id_len,
+			      TEE_ObjectHandle attributes)
+{
+	struct object_attrs a = {
+		.type = attributes->info.objectType,
+		.max_size = attributes->info.maxObjectSize,
+		.key_len = attributes->key_len,
+	};
+	char path[4096];
+	bool ok;
+	int fd;
+
+	attr_path(id, id_len, path, sizeof(path));
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return errno_to_tee(errno);
+	ok = write(fd, &a, sizeof(a)) == sizeof(a) &&
+	     write(fd, attributes->key, a.key_len) == (ssize_t)a.key_len;
+	close(fd);
+	if (!ok) {
+		unlink(path);
+		return TEE_ERROR_STORAGE_NO_SPACE;
+	}
+	return TEE_SUCCESS;
+}
+
+static TEE_Result open_handle(const void *objectID, size_t objectIDLen,
+			      uint32_t flags, int open_flags,
+			      TEE_ObjectHandle *object)
+{
+	struct __TEE_ObjectHandle *o;
+	char path[4096];
+	struct stat st;
+
+	object_path(objectID, objectIDLen, path, sizeof(path));
+
+	o = new_handle();
+	if (!o)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	pthread_mutex_lock(&storage_lock);
+	if (access_conflict(objectID, objectIDLen, flags)) {
+		pthread_mutex_unlock(&storage_lock);
+		free(o);
+		return TEE_ERROR_ACCESS_CONFLICT;
+	}
+	if ((open_flags & O_TRUNC) && !stat(path, &st)) {
+		scan_storage_used();
+		storage_used -= st.st_size;
+	}
+	o->fd = open(path, open_flags | O_CLOEXEC, 0600);
+	if (o->fd < 0) {
+		TEE_Result res = errno == EEXIST ? TEE_ERROR_ACCESS_CONFLICT :
+						   errno_to_tee(errno);
+
+		pthread_mutex_unlock(&storage_lock);
+		free(o);
+		return res;
+	}
+	o->flags = flags & DATA_ACCESS_FLAGS;
+	memcpy(o->id, objectID, objectIDLen);
+	o->id_len = objectIDLen;
+	o->info.objectType = TEE_TYPE_DATA;
+	o->info.objectUsage = TEE_USAGE_DEFAULT;
+	o->info.handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+			      TEE_HANDLE_FLAG_INITIALIZED | o->flags;
+	o->next = open_objects;
+	open_objects = o;
+	pthread_mutex_unlock(&storage_lock);
+
+	*object = o;
+	return TEE_SUCCESS;
+}
+
+/* Opens an existing object, with its key if it is a key object */
+static TEE_Result open_existing(const void *objectID, size_t objectIDLen,
+				uint32_t flags, int open_flags,
+				TEE_ObjectHandle *object)
+{
+	TEE_Result res = open_handle(objectID, objectIDLen, flags, open_flags,
+				     object);
+
+	if (res != TEE_SUCCESS)
+		return res;
+	res = load_attrs(*object);
+	if (res != TEE_SUCCESS) {
+		free_handle(*object);
+		*object = TEE_HANDLE_NULL;
+	}
+	return res;
+}
+
+static TEE_Result open_object(uint32_t storageID, const void *objectID,
+			      size_t objectIDLen, uint32_t flags,
+			      TEE_ObjectHandle *object)
+{
+	TEE_Result res = check_object_id(storageID, objectID, objectIDLen);
+	int mode = (flags & TEE_DATA_FLAG_ACCESS_WRITE) ? O_RDWR : O_RDONLY;
+
+	*object = TEE_HANDLE_NULL;
+	if (res != TEE_SUCCESS)
+		return res;
+	return open_existing(objectID, objectIDLen, flags, mode, object);
+}
+
+static TEE_Result create_object(uint32_t storageID, const void *objectID,
+				size_t objectIDLen, uint32_t flags,
+				TEE_ObjectHandle attributes,
+				const void *initialData, size_t initialDataLen,
+				TEE_ObjectHandle *object)
+{
+	TEE_Result res = check_object_id(storageID, objectID, objectIDLen);
+	int mode = O_RDWR | O_CREAT | O_TRUNC;
+	char path[4096];
+	TEE_ObjectHandle o;
+
+	if (object)
+		*object = TEE_HANDLE_NULL;
+	if (res != TEE_SUCCESS)
+		return res;
+	if (attributes && (!attributes->key || attributes->fd >= 0)) {
+		EMSG("Only transient secret-key attributes are emulated");
+		return TEE_ERROR_NOT_SUPPORTED;
+	}
+	if (!(flags & TEE_DATA_FLAG_OVERWRITE))
+		mode |= O_EXCL;
+
+	res = open_handle(objectID, objectIDLen, flags, mode, &o);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* The key goes with the object; an overwritten one loses its key */
+	if (attributes) {
+		res = store_attrs(objectID, objectIDLen, attributes);
+		if (res == TEE_SUCCESS) {
+			o->info.objectType = attributes->info.objectType;
+			o->info.maxObjectSize = attributes->info.maxObjectSize;
+			res = set_secret(o, attributes->key,
+					 attributes->key_len);
+		}
+		if (res != TEE_SUCCESS) {
+			o->flags |= TEE_DATA_FLAG_ACCESS_WRITE_META;
+			TEE_CloseAndDeletePersistentObject1(o);
+			return res;
+		}
+	} else {
+		attr_path(objectID, objectIDLen, path, sizeof(path));
+		unlink(path);
+	}
+
+	if (initialDataLen) {
+		/* Written through the handle, whatever its access rights */
+		uint32_t access = o->flags;
+
+		o->flags |= TEE_DATA_FLAG_ACCESS_WRITE;
+		res = TEE_WriteObjectData(o, initialData, initialDataLen);
+		o->flags = access;
+		lseek(o->fd, 0, SEEK_SET);
+		if (res != TEE_SUCCESS) {
+			TEE_CloseAndDeletePersistentObject1(o);
+			return res;
+		}
+	}
+
+	if (object)
+		*object = o;
+	else
+		TEE_CloseObject(o);
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_CloseAndDeletePersistentObject1(TEE_ObjectHandle object)
+{
+	char path[4096];
+	struct stat st;
+
+	if (!object)
+		return TEE_SUCCESS;
+	check_persistent(object);
+	if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+		TEE_Panic(TEE_ERROR_ACCESS_DENIED);
+
+	object_path(object->id, object->id_len, path, sizeof(path));
+	if (!fstat(object->fd, &st))
+		storage_charge(-(long long)st.st_size);
+	unlink(path);
+	attr_path(object->id, object->id_len, path, sizeof(path));
+	unlink(path);
+	free_handle(object);
+	return TEE_SUCCESS;
+}
+
+void TEE_CloseAndDeletePersistentObject(TEE_ObjectHandle object)
+{
+	TEE_CloseAndDeletePersistentObject1(object);
+}
+
+static TEE_Result rename_object(TEE_ObjectHandle object,
+				const void *newObjectID, size_t newObjectIDLen)
+{
+	char from[4096], to[4096];
+	TEE_Result res;
+
+	check_persistent(object);
+	if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE_META))
+		TEE_Panic(TEE_ERROR_ACCESS_DENIED);
+	res = check_object_id(TEE_STORAGE_PRIVATE, newObjectID, newObjectIDLen);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	object_path(object->id, object->id_len, from, sizeof(from));
+	object_path(newObjectID, newObjectIDLen, to, sizeof(to));
+	if (!access(to, F_OK))
+		return TEE_ERROR_ACCESS_CONFLICT;
+	if (rename(from, to))
+		return errno_to_tee(errno);
+	attr_path(object->id, object->id_len, from, sizeof(from));
+	attr_path(newObjectID, newObjectIDLen, to, sizeof(to));
+	rename(from, to);
+
+	memcpy(object->id, newObjectID, newObjectIDLen);
+	object->id_len = newObjectIDLen;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result read_data(TEE_ObjectHandle object, void *buffer,
+			    uint32_t size, uint32_t *count)
+{
+	ssize_t n;
+	size_t done = 0;
+
+	check_persistent(object);
+	if (!(object->flags & TEE_DATA_FLAG_ACCESS_READ))
+		TEE_Panic(TEE_ERROR_ACCESS_DENIED);
+
+	while (done < size) {
+		n = read(object->fd, (uint8_t *)buffer + done, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return errno_to_tee(errno);
+		if (n == 0)
+			break;
+		done += n;
+	}
+	*count = (uint32_t)done;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result write_data(TEE_ObjectHandle object, const void *buffer,
+			     uint32_t size)
+{
+	struct stat st;
+	off_t pos;
+	long long growth;
+	ssize_t n;
+	size_t done = 0;
+
+	check_persistent(object);
+	if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE))
+		TEE_Panic(TEE_ERROR_ACCESS_DENIED);
+
+	pos = lseek(object->fd, 0, SEEK_CUR);
+	if (pos < 0 || fstat(object->fd, &st))
+		return errno_to_tee(errno);
+	if ((uint64_t)pos + size > TEE_DATA_MAX_POSITION)
+		return TEE_ERROR_OVERFLOW;
+
+	growth = (long long)pos + size - st.st_size;
+	if (growth > 0 && !storage_charge(growth))
+		return TEE_ERROR_STORAGE_NO_SPACE;
+
+	while (done < size) {
+		n = write(object->fd, (const uint8_t *)buffer + done,
+			  size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			TEE_Result res = errno_to_tee(errno);
+
+			if (growth > 0)
+				storage_charge(-growth);
+			return res;
+		}
+		done += n;
+	}
+	return TEE_SUCCESS;
+}
+
+static TEE_Result truncate_data(TEE_ObjectHandle object, uint32_t size)
+{
+	struct stat st;
+
+	check_persistent(object);
+	if (!(object->flags & TEE_DATA_FLAG_ACCESS_WRITE))
+		TEE_Panic(TEE_ERROR_ACCESS_DENIED);
+	if (fstat(object->fd, &st))
+		return errno_to_tee(errno);
+	if (size > st.st_size && !storage_charge(size - st.st_size))
+		return TEE_ERROR_STORAGE_NO_SPACE;
+	if (ftruncate(object->fd, size))
+		return errno_to_tee(errno);
+	if (size < st.st_size)
+		storage_charge(-(long long)(st.st_size - size));
+	return TEE_SUCCESS;
+}
+
+static TEE_Result seek_data(TEE_ObjectHandle object, int32_t offset,
+			    TEE_Whence whence)
+{
+	struct stat st;
+	long long base;
+
+	check_persistent(object);
+	switch (whence) {
+	case TEE_DATA_SEEK_SET:
+		base = 0;
+		break;
+	case TEE_DATA_SEEK_CUR:
+		base = lseek(object->fd, 0, SEEK_CUR);
+		break;
+	case TEE_DATA_SEEK_END:
+		if (fstat(object->fd, &st))
+			return errno_to_tee(errno);
+		base = st.st_size;
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (base + offset < 0)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (base + offset > TEE_DATA_MAX_POSITION)
+		return TEE_ERROR_OVERFLOW;
+	if (lseek(object->fd, base + offset, SEEK_SET) < 0)
+		return errno_to_tee(errno);
+	return TEE_SUCCESS;
+}
+
+TEE_Result TEE_OpenPersistentObject(uint32_t storageID, const void *objectID,
+				    size_t objectIDLen, uint32_t flags,
+				    TEE_ObjectHandle *object)
+{
+	return gp_result(open_object(storageID, objectID, objectIDLen, flags,
+				     object), open_results);
+}
+
+TEE_Result TEE_CreatePersistentObject(uint32_t storageID, const void *objectID,
+				      size_t objectIDLen, uint32_t flags,
+				      TEE_ObjectHandle attributes,
+				      const void *initialData,
+				      size_t initialDataLen,
+				      TEE_ObjectHandle *object)
+{
+	return gp_result(create_object(storageID, objectID, objectIDLen,
+				       flags, attributes, initialData,
+				       initialDataLen, object),
+			 create_results);
+}
+
+TEE_Result TEE_RenamePersistentObject(TEE_ObjectHandle object,
+				      const void *newObjectID,
+				      size_t newObjectIDLen)
+{
+	return gp_result(rename_object(object, newObjectID, newObjectIDLen),
+			 rename_results);
+}
+
+TEE_Result TEE_ReadObjectData(TEE_ObjectHandle object, void *buffer,
+			      uint32_t size, uint32_t *count)
+{
+	return gp_result(read_data(object, buffer, size, count), read_results);
+}
+
+TEE_Result TEE_WriteObjectData(TEE_ObjectHandle object, const void *buffer,
+			       uint32_t size)
+{
+	return gp_result(write_data(object, buffer, size), write_results);
+}
+
+TEE_Result TEE_TruncateObjectData(TEE_ObjectHandle object, uint32_t size)
+{
+	return gp_result(truncate_data(object, size), truncate_results);
+}
+
+TEE_Result TEE_SeekObjectData(TEE_ObjectHandle object, int32_t offset,
+			      TEE_Whence whence)
+{
+	return gp_result(seek_data(object, offset, whence), seek_results);
+}
+
+TEE_Result TEE_AllocatePersistentObjectEnumerator(TEE_ObjectEnumHandle *
+						  objectEnumerator)
+{
+	*objectEnumerator = calloc(1, sizeof(**objectEnumerator));
+	return *objectEnumerator ? TEE_SUCCESS : TEE_ERROR_OUT_OF_MEMORY;
+}
+
+void TEE_ResetPersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator)
+{
+	if (objectEnumerator && objectEnumerator->dir) {
+		closedir(objectEnumerator->dir);
+		objectEnumerator->dir = NULL;
+	}
+}
+
+void TEE_FreePersistentObjectEnumerator(TEE_ObjectEnumHandle objectEnumerator)
+{
+	TEE_ResetPersistentObjectEnumerator(objectEnumerator);
+	free(objectEnumerator);
+}
+
+TEE_Result TEE_StartPersistentObjectEnumerator(TEE_ObjectEnumHandle
+					       objectEnumerator,
+					       uint32_t storageID)
+{
+	if (storageID != TEE_STORAGE_PRIVATE &&
+	    storageID != TEE_STORAGE_PRIVATE_REE &&
+	    storageID != TEE_STORAGE_PRIVATE_RPMB)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	TEE_ResetPersistentObjectEnumerator(objectEnumerator);
+	objectEnumerator->dir = opendir(ta_storage_dir());
+	return objectEnumerator->dir ? TEE_SUCCESS : errno_to_tee(errno);
+}
+
+TEE_Result TEE_GetNextPersistentObject(TEE_ObjectEnumHandle objectEnumerator,
+				       TEE_ObjectInfo *objectInfo,
+				       void *objectID, size_t *objectIDLen)
+{
+	uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+	size_t id_len;
+	struct dirent *de;
+	struct stat st;
+
+	if (!objectEnumerator->dir)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	while ((de = readdir(objectEnumerator->dir))) {
+		if (!decode_object_name(de->d_name, id, &id_len))
+			continue;
+		if (fstatat(dirfd(objectEnumerator->dir), de->d_name, &st, 0) ||
+		    !S_ISREG(st.st_mode))
+			continue;
+		if (*objectIDLen < id_len)
+			return TEE_ERROR_SHORT_BUFFER;
+
+		memcpy(objectID, id, id_len);
+		*objectIDLen = id_len;
+		if (objectInfo) {
+			memset(objectInfo, 0, sizeof(*objectInfo));
+			objectInfo->objectType = TEE_TYPE_DATA;
+			objectInfo->objectUsage = TEE_USAGE_DEFAULT;
+			objectInfo->dataSize = (uint32_t)st.st_size;
+			objectInfo->handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+						  TEE_HANDLE_FLAG_INITIALIZED;
+		}
+		return TEE_SUCCESS;
+	}
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
@@ -0,0 +1,453 @@
+/*
+ * In-process TEE Client API. Sessions and commands call straight into the
+ * TA entry points linked into the same executable, with parameters
+ * converted the way tee-supplicant and the OP-TEE core would: temporary
+ * memory references are bounced through a copy, registered shared memory
+ * is passed by reference.
+ *
+ * The TA's globals exist once per process, so every TA behaves as a single
+ * instance whose entry points are serialised by ta_lock.
+ *
+ * TEE_EMU_KILL_AFTER=n kills the client at its n-th command, before the
+ * command reaches the TA: its open sessions are closed the way the TEE
+ * driver closes those of a process that died, and the process exits
+ * with status 137. This checks what a TA leaves behind a dead client.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tee_client_api.h>
+#include <user_ta_header.h>
+
+#include "tee_emu.h"
+
+#define SHM_FLAG_ALLOCATED	0x1
+
+/* Command in flight, for TEEC_RequestCancellation */
+struct pending_op {
+	TEEC_Operation *op;
+	struct tee_emu_invocation inv;
+	struct pending_op *next;
+};
+
+struct ta_params {
+	uint32_t types;
+	TEE_Param params[TEEC_CONFIG_PAYLOAD_REF_COUNT];
+	void *bounce[TEEC_CONFIG_PAYLOAD_REF_COUNT];
+};
+
+/* Open session, for closing it when the client is killed */
+struct open_session {
+	TEEC_Session *session;
+	struct open_session *next;
+};
+
+static pthread_mutex_t ta_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int ta_sessions;
+static bool ta_alive;
+static uint32_t next_session_id = 1;
+static struct open_session *open_sessions;
+static unsigned long commands;
+
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pending_op *pending_ops;
+
+static void set_origin(uint32_t *returnOrigin, uint32_t origin)
+{
+	if (returnOrigin)
+		*returnOrigin = origin;
+}
+
+static uint32_t memref_direction(uint32_t shm_flags)
+{
+	switch (shm_flags & (TEEC_MEM_INPUT | TEEC_MEM_OUTPUT)) {
+	case TEEC_MEM_INPUT:
+		return TEE_PARAM_TYPE_MEMREF_INPUT;
+	case TEEC_MEM_OUTPUT:
+		return TEE_PARAM_TYPE_MEMREF_OUTPUT;
+	default:
+		return TEE_PARAM_TYPE_MEMREF_INOUT;
+	}
+}
+
+static void free_params(struct ta_params *p)
+{
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		free(p->bounce[i]);
+		p->bounce[i] = NULL;
+	}
+}
+
+static TEEC_Result to_ta_params(TEEC_Operation *operation,
+				struct ta_params *p)
+{
+	memset(p, 0, sizeof(*p));
+	if (!operation)
+		return TEEC_SUCCESS;
+
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		uint32_t type = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+		TEEC_Parameter *cp = &operation->params[i];
+		TEE_Param *tp = &p->params[i];
+		TEEC_SharedMemory *shm;
+
+		switch (type) {
+		case TEEC_NONE:
+			break;
+		case TEEC_VALUE_INPUT:
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			tp->value.a = cp->value.a;
+			tp->value.b = cp->value.b;
+			break;
+		case TEEC_MEMREF_TEMP_INPUT:
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			tp->memref.size = cp->tmpref.size;
+			if (!cp->tmpref.buffer)
+				break;
+			p->bounce[i] = malloc(cp->tmpref.size ?
+					      cp->tmpref.size : 1);
+			if (!p->bounce[i]) {
+				free_params(p);
+				return TEEC_ERROR_OUT_OF_MEMORY;
+			}
+			if (type != TEEC_MEMREF_TEMP_OUTPUT)
+				memcpy(p->bounce[i], cp->tmpref.buffer,
+				       cp->tmpref.size);
+			tp->memref.buffer = p->bounce[i];
+			break;
+		case TEEC_MEMREF_WHOLE:
+			shm = cp->memref.parent;
+			if (!shm) {
+				free_params(p);
+				return TEEC_ERROR_BAD_PARAMETERS;
+			}
+			type = memref_direction(shm->flags);
+			tp->memref.buffer = shm->buffer;
+			tp->memref.size = shm->size;
+			break;
+		case TEEC_MEMREF_PARTIAL_INPUT:
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			shm = cp->memref.parent;
+			if (!shm || cp->memref.offset > shm->size ||
+			    cp->memref.size > shm->size - cp->memref.offset) {
+				free_params(p);
+				return TEEC_ERROR_BAD_PARAMETERS;
+			}
+			type -= TEEC_MEMREF_PARTIAL_INPUT -
+				TEE_PARAM_TYPE_MEMREF_INPUT;
+			tp->memref.buffer = (uint8_t *)shm->buffer +
+					    cp->memref.offset;
+			tp->memref.size = cp->memref.size;
+			break;
+		default:
+			free_params(p);
+			return TEEC_ERROR_BAD_PARAMETERS;
+		}
+		p->types |= type << (i * 4);
+	}
+	return TEEC_SUCCESS;
+}
+
+/*
+ * Copies outputs back to the client. Updated memref sizes are always
+ * reported, so a SHORT_BUFFER answer carries the size the TA wants, but
+ * data is only copied when it fits the client's buffer.
+ */
+static void from_ta_params(TEEC_Operation *operation, struct ta_params *p)
+{
+	if (!operation)
+		return;
+
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		uint32_t type = TEEC_PARAM_TYPE_GET(operation->paramTypes, i);
+		TEEC_Parameter *cp = &operation->params[i];
+		TEE_Param *tp = &p->params[i];
+
+		switch (type) {
+		case TEEC_VALUE_OUTPUT:
+		case TEEC_VALUE_INOUT:
+			cp->value.a = tp->value.a;
+			cp->value.b = tp->value.b;
+			break;
+		case TEEC_MEMREF_TEMP_OUTPUT:
+		case TEEC_MEMREF_TEMP_INOUT:
+			if (p->bounce[i] && tp->memref.size <= cp->tmpref.size)
+				memcpy(cp->tmpref.buffer, p->bounce[i],
+				       tp->memref.size);
+			cp->tmpref.size = tp->memref.size;
+			break;
+		case TEEC_MEMREF_WHOLE:
+			if (cp->memref.parent->flags & TEEC_MEM_OUTPUT)
+				cp->memref.size = tp->memref.size;
+			break;
+		case TEEC_MEMREF_PARTIAL_OUTPUT:
+		case TEEC_MEMREF_PARTIAL_INOUT:
+			cp->memref.size = tp->memref.size;
+			break;
+		default:
+			break;
+		}
+	}
+	free_params(p);
+}
+
+static void begin_op(struct pending_op *pending, TEEC_Operation *operation)
+{
+	memset(pending, 0, sizeof(*pending));
+	pending->op = operation;
+	pending->inv.cancel_masked = true;
+	if (operation)
+		operation->started = 1;
+
+	pthread_mutex_lock(&pending_lock);
+	pending->next = pending_ops;
+	pending_ops = pending;
+	pthread_mutex_unlock(&pending_lock);
+	tee_emu_enter(&pending->inv);
+}
+
+static void end_op(struct pending_op *pending)
+{
+	struct pending_op **link;
+
+	tee_emu_leave();
+	pthread_mutex_lock(&pending_lock);
+	for (link = &pending_ops; *link; link = &(*link)->next) {
+		if (*link == pending) {
+			*link = pending->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pending_lock);
+}
+
+/* Caller holds ta_lock */
+static void release_instance(void)
+{
+	if (ta_sessions || !ta_alive ||
+	    (tee_emu_ta.flags & TA_FLAG_INSTANCE_KEEP_ALIVE))
+		return;
+	TA_DestroyEntryPoint();
+	tee_emu_storage_close_all();
+	ta_alive = false;
+}
+
+/* Caller holds ta_lock */
+static void forget_session(TEEC_Session *session)
+{
+	struct open_session **link, *os;
+
+	for (link = &open_sessions; *link; link = &(*link)->next) {
+		if ((*link)->session == session) {
+			os = *link;
+			*link = os->next;
+			free(os);
+			break;
+		}
+	}
+}
+
+/* Caller holds ta_lock. Does not return */
+static void kill_client(void)
+{
+	fprintf(stderr, "tee_emu: client killed at command %lu\n", commands);
+	while (open_sessions) {
+		TA_CloseSessionEntryPoint(open_sessions->session->ta_session);
+		ta_sessions--;
+		forget_session(open_sessions->session);
+	}
+	release_instance();
+	_exit(137);
+}
+
+TEEC_Result TEEC_InitializeContext(const char *name __unused,
+				   TEEC_Context *context)
+{
+	if (!context)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	memset(context, 0, sizeof(*context));
+	context->fd = -1;
+	context->reg_mem = true;
+	context->memref_null = true;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_FinalizeContext(TEEC_Context *context __unused)
+{
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *context, TEEC_Session *session,
+			     const TEEC_UUID *destination,
+			     uint32_t connectionMethod __unused,
+			     const void *connectionData __unused,
+			     TEEC_Operation *operation,
+			     uint32_t *returnOrigin)
+{
+	struct pending_op pending;
+	struct ta_params p;
+	void *sess_ctx = NULL;
+	TEEC_Result res;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_API);
+	if (!context || !session || !destination)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TEE);
+	if (memcmp(destination, &tee_emu_ta.uuid, sizeof(*destination)))
+		return TEEC_ERROR_ITEM_NOT_FOUND;
+
+	res = to_ta_params(operation, &p);
+	if (res != TEEC_SUCCESS) {
+		set_origin(returnOrigin, TEEC_ORIGIN_API);
+		return res;
+	}
+
+	pthread_mutex_lock(&ta_lock);
+	if (ta_sessions && !(tee_emu_ta.flags & TA_FLAG_MULTI_SESSION)) {
+		pthread_mutex_unlock(&ta_lock);
+		free_params(&p);
+		return TEEC_ERROR_BUSY;
+	}
+
+	begin_op(&pending, operation);
+	if (!ta_alive) {
+		res = TA_CreateEntryPoint();
+		if (res != TEE_SUCCESS)
+			goto out;
+		ta_alive = true;
+	}
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TRUSTED_APP);
+	res = TA_OpenSessionEntryPoint(p.types, p.params, &sess_ctx);
+	if (res == TEE_SUCCESS) {
+		struct open_session *os = malloc(sizeof(*os));
+
+		ta_sessions++;
+		session->ctx = context;
+		session->session_id = next_session_id++;
+		session->ta_session = sess_ctx;
+		/* Only a killed client misses the record */
+		if (os) {
+			os->session = session;
+			os->next = open_sessions;
+			open_sessions = os;
+		}
+	} else {
+		release_instance();
+	}
+out:
+	end_op(&pending);
+	pthread_mutex_unlock(&ta_lock);
+	from_ta_params(operation, &p);
+	return res;
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+	if (!session || !session->ctx)
+		return;
+
+	pthread_mutex_lock(&ta_lock);
+	TA_CloseSessionEntryPoint(session->ta_session);
+	ta_sessions--;
+	forget_session(session);
+	release_instance();
+	pthread_mutex_unlock(&ta_lock);
+
+	session->ctx = NULL;
+	session->ta_session = NULL;
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+			       TEEC_Operation *operation,
+			       uint32_t *returnOrigin)
+{
+	struct pending_op pending;
+	struct ta_params p;
+	TEEC_Result res;
+
+	set_origin(returnOrigin, TEEC_ORIGIN_API);
+	if (!session || !session->ctx)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	res = to_ta_params(operation, &p);
+	if (res != TEEC_SUCCESS)
+		return res;
+
+	pthread_mutex_lock(&ta_lock);
+	if (++commands == tee_emu_env("TEE_EMU_KILL_AFTER", 0))
+		kill_client();
+	begin_op(&pending, operation);
+	res = TA_InvokeCommandEntryPoint(session->ta_session, commandID,
+					 p.types, p.params);
+	end_op(&pending);
+	pthread_mutex_unlock(&ta_lock);
+
+	set_origin(returnOrigin, TEEC_ORIGIN_TRUSTED_APP);
+	from_ta_params(operation, &p);
+	return res;
+}
+
+void TEEC_RequestCancellation(TEEC_Operation *operation)
+{
+	pthread_mutex_lock(&pending_lock);
+	for (struct pending_op *po = pending_ops; po; po = po->next) {
+		if (po->op == operation)
+			po->inv.cancelled = true;
+	}
+	pthread_mutex_unlock(&pending_lock);
+}
+
+TEEC_Result TEEC_RegisterSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	if (!context || !sharedMem)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	if (!sharedMem->buffer && sharedMem->size)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	sharedMem->id = -1;
+	sharedMem->alloced_size = sharedMem->size;
+	sharedMem->shadow_buffer = NULL;
+	sharedMem->registered_fd = -1;
+	sharedMem->internal.flags = 0;
+	return TEEC_SUCCESS;
+}
+
+TEEC_Result TEEC_AllocateSharedMemory(TEEC_Context *context,
+				      TEEC_SharedMemory *sharedMem)
+{
+	size_t size;
+
+	if (!context || !sharedMem)
+		return TEEC_ERROR_BAD_PARAMETERS;
+
+	/* Zero-sized allocations still need a valid, distinct pointer */
+	size = sharedMem->size ? sharedMem->size : 8;
+	sharedMem->buffer = malloc(size);
+	if (!sharedMem->buffer)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+	sharedMem->id = -1;
+	sharedMem->alloced_size = size;
+	sharedMem->shadow_buffer = NULL;
+	sharedMem->registered_fd = -1;
+	sharedMem->internal.flags = SHM_FLAG_ALLOCATED;
+	return TEEC_SUCCESS;
+}
+
+void TEEC_ReleaseSharedMemory(TEEC_SharedMemory *sharedMemory)
+{
+	if (!sharedMemory)
+		return;
+	if (sharedMemory->internal.flags & SHM_FLAG_ALLOCATED)
+		free(sharedMemory->buffer);
+	sharedMemory->buffer = NULL;
+	sharedMemory->size = 0;
+	sharedMemory->alloced_size = 0;
+	sharedMemory->internal.flags = 0;
+}
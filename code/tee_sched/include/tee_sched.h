@@ -0,0 +1,79 @@
+/*
+ * Chunk-granular request scheduler for the storage TA.
+ *
+ * Callers on any number of threads submit blocking write, read and
+ * delete requests. Rather than each request owning a session for its
+ * whole length, a pool of worker threads, one per session, runs them a
+ * TA call at a time: a write is one call per CHUNK_SIZE piece plus the
+ * final call, a read or delete is a single call. After every call the
+ * worker picks the next step by priority class, so a small interactive
+ * read waits for at most one chunk of a bulk write, not the whole file.
+ *
+ * Classes are strict, except that a class passed over
+ * TEE_SCHED_STARVE_STEPS times in a row while it had work gets the next
+ * step, so background work still trickles through under load. Requests
+ * in one class take turns, a step each.
+ *
+ * The TA keeps an open write in its session, so a write is bound to the
+ * session that ran its first chunk and a session runs one write at a
+ * time; reads and deletes go to any session. A read is one TA call
+ * however large, but the TA checks for cancellation between chunks.
+ *
+ * With a timeout set for its class, a request that is still queued or
+ * running at its deadline fails with TEEC_ERROR_CANCEL: the running TA
+ * call is cancelled, see teec_deadline.h, and a write's partial object
+ * is deleted. A cancelled read still sets *size to the bytes it got.
+ *
+ * Workers pass IDs and data in shared memory from a shm_pool rather than
+ * as temporary memrefs, so a call sets up no shared memory; reads above
+ * 1 MiB still go through temporary memrefs.
+ */
+#ifndef TEE_SCHED_H
+#define TEE_SCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tee_client_api.h>
+
+enum tee_sched_prio {
+	TEE_SCHED_INTERACTIVE,
+	TEE_SCHED_BULK,
+	TEE_SCHED_BACKGROUND,
+	TEE_SCHED_NPRIO
+};
+
+/* Run each request to completion, in arrival order, ignoring priority */
+#define TEE_SCHED_WHOLE		(1 << 0)
+
+#define TEE_SCHED_STARVE_STEPS	8
+
+struct tee_sched;
+
+/*
+ * Opens sessions sessions to the storage TA and starts their workers.
+ * Returns NULL, with *res set if res is not NULL, on failure.
+ */
+struct tee_sched *tee_sched_open(unsigned int sessions, uint32_t flags,
+				 TEEC_Result *res);
+
+/* Stops the workers; no request may be pending */
+void tee_sched_close(struct tee_sched *s);
+
+/* Deadline of the class's later requests, from submission; 0 for none */
+void tee_sched_set_timeout(struct tee_sched *s, enum tee_sched_prio prio,
+			   unsigned int timeout_ms);
+
+TEEC_Result tee_sched_write(struct tee_sched *s, enum tee_sched_prio prio,
+			    const char *id, const void *data, size_t size);
+
+/* *size is the buffer size in, the object size out */
+TEEC_Result tee_sched_read(struct tee_sched *s, enum tee_sched_prio prio,
+			   const char *id, void *buf, size_t *size);
+
+TEEC_Result tee_sched_delete(struct tee_sched *s, enum tee_sched_prio prio,
+			     const char *id);
+
+const char *tee_sched_prio_name(enum tee_sched_prio prio);
+
+#endif /* TEE_SCHED_H */
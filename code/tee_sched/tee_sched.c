@@ -0,0 +1,525 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* TA API: UUID and command IDs */
+#include <secure_storage_ta.h>
+
+#include <shm_pool.h>
+#include <tee_sched.h>
+#include <teec_deadline.h>
+
+#define CHUNK_SIZE (16 * 1024)  // 16KB - must match TA
+/* Larger reads go through temporary memrefs */
+#define POOL_MAX_SIZE (1024 * 1024)
+
+enum req_op { REQ_WRITE, REQ_READ, REQ_DELETE };
+
+struct req {
+	enum req_op op;
+	enum tee_sched_prio prio;
+	const char *id;
+	const uint8_t *data;
+	uint8_t *buf;
+	size_t size;
+	size_t off;		/* bytes written so far */
+	int session;		/* bound worker, -1 before the first step */
+	uint64_t deadline;	/* 0 for none */
+	int done;
+	TEEC_Result res;
+	struct req *next;
+};
+
+struct worker {
+	struct tee_sched *s;
+	int id;
+	TEEC_Session sess;
+	int writing;		/* a write is bound to this session */
+	pthread_t thread;
+};
+
+struct tee_sched {
+	TEEC_Context ctx;
+	struct shm_pool *pool;	/* the workers' shared memory */
+	uint32_t flags;
+	struct worker *workers;
+	unsigned int nworkers;
+
+	/* Queues and request state, under lock */
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	struct req *head[TEE_SCHED_NPRIO];
+	struct req *tail[TEE_SCHED_NPRIO];
+	unsigned int passed[TEE_SCHED_NPRIO];	/* steps given to others */
+	unsigned int timeout_ms[TEE_SCHED_NPRIO];
+	int stop;
+};
+
+static const char *const prio_names[TEE_SCHED_NPRIO] = {
+	"interactive", "bulk", "background"
+};
+
+const char *tee_sched_prio_name(enum tee_sched_prio prio)
+{
+	return prio < TEE_SCHED_NPRIO ? prio_names[prio] : "unknown";
+}
+
+/* Called under lock */
+static void enqueue(struct tee_sched *s, struct req *r)
+{
+	unsigned int p = s->flags & TEE_SCHED_WHOLE ? 0 : r->prio;
+
+	r->next = NULL;
+	if (s->tail[p])
+		s->tail[p]->next = r;
+	else
+		s->head[p] = r;
+	s->tail[p] = r;
+}
+
+/* Removes r from its queue if it is waiting there. Called under lock */
+static int withdraw(struct tee_sched *s, struct req *r)
+{
+	unsigned int p = s->flags & TEE_SCHED_WHOLE ? 0 : r->prio;
+	struct req **pp, *prev = NULL;
+
+	for (pp = &s->head[p]; *pp; prev = *pp, pp = &(*pp)->next) {
+		if (*pp != r)
+			continue;
+		*pp = r->next;
+		if (s->tail[p] == r)
+			s->tail[p] = prev;
+		return 1;
+	}
+	return 0;
+}
+
+static int runnable(const struct worker *w, const struct req *r)
+{
+	if (r->session >= 0)
+		return r->session == w->id;
+	return r->op != REQ_WRITE || !w->writing;
+}
+
+/* Takes the first request of class p that w can run. Called under lock */
+static struct req *take(struct tee_sched *s, unsigned int p,
+			const struct worker *w)
+{
+	struct req **pp, *prev = NULL, *r;
+
+	for (pp = &s->head[p]; *pp; prev = *pp, pp = &(*pp)->next) {
+		r = *pp;
+		if (!runnable(w, r))
+			continue;
+		*pp = r->next;
+		if (s->tail[p] == r)
+			s->tail[p] = prev;
+		r->next = NULL;
+		return r;
+	}
+	return NULL;
+}
+
+/* Next step for w: the best class, unless one is starving. Under lock */
+static struct req *pick(struct tee_sched *s, const struct worker *w)
+{
+	struct req *r = NULL;
+	unsigned int p, q;
+
+	for (p = 0; p < TEE_SCHED_NPRIO && !r; p++)
+		if (s->passed[p] >= TEE_SCHED_STARVE_STEPS)
+			r = take(s, p, w);
+	for (p = 0; p < TEE_SCHED_NPRIO && !r; p++)
+		r = take(s, p, w);
+	if (!r)
+		return NULL;
+
+	p = s->flags & TEE_SCHED_WHOLE ? 0 : r->prio;
+	s->passed[p] = 0;
+	for (q = p + 1; q < TEE_SCHED_NPRIO; q++)
+		if (s->head[q])
+			s->passed[q]++;
+	return r;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Ends a failed write: the TA deletes what it had stored so far */
+static int abort_write(struct worker *w)
+{
+	TEEC_Operation op;
+	uint32_t origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE, TEEC_NONE,
+					 TEEC_NONE);
+	TEEC_InvokeCommand(&w->sess, TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT,
+			   &op, &origin);
+	w->writing = 0;
+	return 1;
+}
+
+/*
+ * Sets params 0 and 1 of op to the ID and size bytes of data, in or out
+ * as data_type says, and param 2 to param2_type. They go in blocks from
+ * the pool, b[0] and b[1], as partial memrefs; if the pool cannot serve
+ * the size, b[0].shm is NULL and they are temporary memrefs.
+ */
+static void set_refs(struct tee_sched *s, TEEC_Operation *op,
+		     struct shm_buf b[2], const char *id, const uint8_t *data,
+		     size_t size, uint32_t data_type, uint32_t param2_type)
+{
+	size_t idlen = strlen(id);
+	uint32_t id_type = TEEC_MEMREF_TEMP_INPUT;
+
+	b[1].shm = NULL;
+	if (shm_pool_get(s->pool, idlen, &b[0]) != TEEC_SUCCESS) {
+		b[0].shm = NULL;
+	} else if (data_type != TEEC_NONE &&
+		   shm_pool_get(s->pool, size, &b[1]) != TEEC_SUCCESS) {
+		shm_pool_put(s->pool, &b[0]);
+	}
+
+	if (b[0].shm) {
+		memcpy(b[0].buffer, id, idlen);
+		shm_pool_param(&op->params[0], &b[0], 0, idlen);
+		id_type = TEEC_MEMREF_PARTIAL_INPUT;
+		if (data_type == TEEC_MEMREF_TEMP_INPUT) {
+			memcpy(b[1].buffer, data, size);
+			data_type = TEEC_MEMREF_PARTIAL_INPUT;
+		} else if (data_type == TEEC_MEMREF_TEMP_OUTPUT) {
+			data_type = TEEC_MEMREF_PARTIAL_OUTPUT;
+		}
+		if (b[1].shm)
+			shm_pool_param(&op->params[1], &b[1], 0, size);
+	} else {
+		op->params[0].tmpref.buffer = (void *)id;
+		op->params[0].tmpref.size = idlen;
+		op->params[1].tmpref.buffer = (void *)data;
+		op->params[1].tmpref.size = size;
+	}
+	op->paramTypes = TEEC_PARAM_TYPES(id_type, data_type, param2_type,
+					  TEEC_NONE);
+}
+
+/*
+ * After the call: copies pooled output of up to size bytes to data and
+ * returns the blocks. Returns the size the TA reported in param 1.
+ */
+static size_t put_refs(struct tee_sched *s, TEEC_Operation *op,
+		       struct shm_buf b[2], uint8_t *data, size_t size)
+{
+	size_t out;
+
+	if (!b[0].shm)
+		return op->params[1].tmpref.size;
+	shm_pool_put(s->pool, &b[0]);
+	if (!b[1].shm)
+		return 0;
+	out = op->params[1].memref.size;
+	if (data && out <= size)
+		memcpy(data, b[1].buffer, out);
+	shm_pool_put(s->pool, &b[1]);
+	return out;
+}
+
+/*
+ * Makes one TA call for r, cancelled at its deadline. Returns 1 once
+ * the request is complete.
+ */
+static int step(struct worker *w, struct req *r)
+{
+	TEEC_Operation op;
+	struct shm_buf b[2];
+	uint32_t origin;
+	size_t len;
+
+	/* Expired while queued */
+	if (r->deadline && now_ns() >= r->deadline) {
+		r->res = TEEC_ERROR_CANCEL;
+		return r->session >= 0 ? abort_write(w) : 1;
+	}
+
+	memset(&op, 0, sizeof(op));
+	switch (r->op) {
+	case REQ_WRITE:
+		/* Every write sends one chunk, even if empty, then the final */
+		if (r->session >= 0 && r->off == r->size) {
+			op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE,
+							 TEEC_NONE, TEEC_NONE);
+			r->res = teec_invoke_deadline(&w->sess,
+					TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL,
+					&op, &origin, r->deadline);
+			if (r->res != TEEC_SUCCESS)
+				return abort_write(w);
+			w->writing = 0;
+			return 1;
+		}
+		len = r->size - r->off < CHUNK_SIZE ? r->size - r->off :
+						      CHUNK_SIZE;
+		set_refs(w->s, &op, b, r->id, r->data + r->off, len,
+			 TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT);
+		op.params[2].value.a = r->session < 0;
+		r->session = w->id;
+		w->writing = 1;
+		r->res = teec_invoke_deadline(&w->sess,
+					TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK,
+					&op, &origin, r->deadline);
+		put_refs(w->s, &op, b, NULL, 0);
+		if (r->res != TEEC_SUCCESS)
+			return abort_write(w);
+		r->off += len;
+		return 0;
+	case REQ_READ:
+		set_refs(w->s, &op, b, r->id, r->buf, r->size,
+			 TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
+		/* A cancelled read reports the bytes it got in size */
+		r->res = teec_invoke_deadline(&w->sess,
+					      TA_SECURE_STORAGE_CMD_READ_RAW,
+					      &op, &origin, r->deadline);
+		r->size = put_refs(w->s, &op, b, r->buf, r->size);
+		return 1;
+	default:
+		set_refs(w->s, &op, b, r->id, NULL, 0, TEEC_NONE, TEEC_NONE);
+		r->res = teec_invoke_deadline(&w->sess,
+					      TA_SECURE_STORAGE_CMD_DELETE,
+					      &op, &origin, r->deadline);
+		put_refs(w->s, &op, b, NULL, 0);
+		return 1;
+	}
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct tee_sched *s = w->s;
+	struct req *r = NULL;
+	int done;
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		while (!s->stop && !(r = pick(s, w)))
+			pthread_cond_wait(&s->work_cv, &s->lock);
+		if (s->stop)
+			break;
+		pthread_mutex_unlock(&s->lock);
+
+		do
+			done = step(w, r);
+		while (!done && (s->flags & TEE_SCHED_WHOLE));
+
+		pthread_mutex_lock(&s->lock);
+		if (done) {
+			r->done = 1;
+			pthread_cond_broadcast(&s->done_cv);
+		} else {
+			/* Back of its class, so its peers get a turn */
+			enqueue(s, r);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+static TEEC_Result submit(struct tee_sched *s, struct req *r)
+{
+	struct timespec ts;
+	int expired = 0;
+
+	r->session = -1;
+	r->done = 0;
+	pthread_mutex_lock(&s->lock);
+	r->deadline = s->timeout_ms[r->prio] ?
+		      teec_deadline_after(s->timeout_ms[r->prio]) : 0;
+	ts.tv_sec = r->deadline / 1000000000ULL;
+	ts.tv_nsec = r->deadline % 1000000000ULL;
+	enqueue(s, r);
+	/* Any worker may be the one able to run it */
+	pthread_cond_broadcast(&s->work_cv);
+	while (!r->done) {
+		if (!r->deadline || expired) {
+			pthread_cond_wait(&s->done_cv, &s->lock);
+			continue;
+		}
+		if (pthread_cond_timedwait(&s->done_cv, &s->lock, &ts) !=
+		    ETIMEDOUT)
+			continue;
+		/*
+		 * Give up on a request no worker has started. One that is
+		 * running, or a write between chunks, is the worker's to
+		 * cancel, within a step.
+		 */
+		expired = 1;
+		if (r->session < 0 && withdraw(s, r)) {
+			r->res = TEEC_ERROR_CANCEL;
+			r->done = 1;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	return r->res;
+}
+
+void tee_sched_set_timeout(struct tee_sched *s, enum tee_sched_prio prio,
+			   unsigned int timeout_ms)
+{
+	if (prio >= TEE_SCHED_NPRIO)
+		return;
+	pthread_mutex_lock(&s->lock);
+	s->timeout_ms[prio] = timeout_ms;
+	pthread_mutex_unlock(&s->lock);
+}
+
+TEEC_Result tee_sched_write(struct tee_sched *s, enum tee_sched_prio prio,
+			    const char *id, const void *data, size_t size)
+{
+	struct req r = {
+		.op = REQ_WRITE,
+		.prio = prio,
+		.id = id,
+		.data = data,
+		.size = size,
+	};
+
+	return submit(s, &r);
+}
+
+TEEC_Result tee_sched_read(struct tee_sched *s, enum tee_sched_prio prio,
+			   const char *id, void *buf, size_t *size)
+{
+	struct req r = {
+		.op = REQ_READ,
+		.prio = prio,
+		.id = id,
+		.buf = buf,
+		.size = *size,
+	};
+	TEEC_Result res = submit(s, &r);
+
+	*size = r.size;
+	return res;
+}
+
+TEEC_Result tee_sched_delete(struct tee_sched *s, enum tee_sched_prio prio,
+			     const char *id)
+{
+	struct req r = {
+		.op = REQ_DELETE,
+		.prio = prio,
+		.id = id,
+	};
+
+	return submit(s, &r);
+}
+
+static void stop_workers(struct tee_sched *s, unsigned int started)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->work_cv);
+	pthread_mutex_unlock(&s->lock);
+	for (i = 0; i < started; i++)
+		pthread_join(s->workers[i].thread, NULL);
+}
+
+static void close_sessions(struct tee_sched *s, unsigned int opened)
+{
+	unsigned int i;
+
+	for (i = 0; i < opened; i++)
+		TEEC_CloseSession(&s->workers[i].sess);
+	shm_pool_destroy(s->pool);
+	TEEC_FinalizeContext(&s->ctx);
+}
+
+struct tee_sched *tee_sched_open(unsigned int sessions, uint32_t flags,
+				 TEEC_Result *res)
+{
+	TEEC_UUID uuid = TA_SECURE_STORAGE_UUID;
+	pthread_condattr_t attr;
+	struct tee_sched *s;
+	uint32_t origin;
+	TEEC_Result r = TEEC_ERROR_OUT_OF_MEMORY;
+	unsigned int i;
+
+	if (!sessions)
+		sessions = 1;
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		goto err;
+	s->workers = calloc(sessions, sizeof(*s->workers));
+	if (!s->workers)
+		goto err_free;
+	s->flags = flags;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->work_cv, NULL);
+	/* Deadlines are CLOCK_MONOTONIC */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s->done_cv, &attr);
+	pthread_condattr_destroy(&attr);
+
+	r = TEEC_InitializeContext(NULL, &s->ctx);
+	if (r != TEEC_SUCCESS)
+		goto err_free;
+	s->pool = shm_pool_create(&s->ctx, POOL_MAX_SIZE);
+	if (!s->pool) {
+		r = TEEC_ERROR_OUT_OF_MEMORY;
+		close_sessions(s, 0);
+		goto err_free;
+	}
+	for (i = 0; i < sessions; i++) {
+		r = TEEC_OpenSession(&s->ctx, &s->workers[i].sess, &uuid,
+				     TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+		if (r != TEEC_SUCCESS) {
+			close_sessions(s, i);
+			goto err_free;
+		}
+	}
+
+	for (i = 0; i < sessions; i++) {
+		s->workers[i].s = s;
+		s->workers[i].id = i;
+		if (pthread_create(&s->workers[i].thread, NULL, worker_run,
+				   &s->workers[i])) {
+			stop_workers(s, i);
+			close_sessions(s, sessions);
+			r = TEEC_ERROR_OUT_OF_MEMORY;
+			goto err_free;
+		}
+	}
+	s->nworkers = sessions;
+	return s;
+
+err_free:
+	if (s)
+		free(s->workers);
+	free(s);
+err:
+	if (res)
+		*res = r;
+	return NULL;
+}
+
+void tee_sched_close(struct tee_sched *s)
+{
+	if (!s)
+		return;
+	stop_workers(s, s->nworkers);
+	close_sessions(s, s->nworkers);
+	pthread_cond_destroy(&s->done_cv);
+	pthread_cond_destroy(&s->work_cv);
+	pthread_mutex_destroy(&s->lock);
+	free(s->workers);
+	free(s);
+}
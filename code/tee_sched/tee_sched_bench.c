@@ -0,0 +1,343 @@
+/*
+ * Small-request latency under bulk load, through tee_sched.
+ *
+ * Interactive readers fetch a small object in a loop, with a short
+ * pause between reads, while bulk and background writers keep
+ * rewriting large objects. At the end it prints the count, throughput
+ * and latency percentiles of each class. Run it with -m whole to get
+ * the monolithic baseline, where every request holds its session from
+ * first chunk to last, and compare the interactive p99. -T and -B set
+ * deadlines; requests that miss them are counted as cancelled.
+ */
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tee_sched.h>
+
+/* Synthetic test data */
+#include <testgen.h>
+
+#define SMALL_ID "sched_small"
+
+struct bench {
+	struct tee_sched *sched;
+	size_t bulk_size;
+	size_t small_size;
+	unsigned int think_us;
+	volatile int stop;
+};
+
+struct client {
+	struct bench *b;
+	enum tee_sched_prio prio;
+	unsigned int id;
+	uint8_t *buf;
+	uint8_t *expect;
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t cancelled;
+	uint64_t *lat_ns;
+	size_t nlat;
+	size_t lat_cap;
+	pthread_t thread;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill(uint64_t seed, void *buf, size_t size)
+{
+	struct testgen_params p;
+
+	testgen_defaults(&p);
+	p.seed = seed;
+	testgen_fill(&p, 0, buf, size);
+}
+
+static void record(struct client *c, uint64_t start, size_t bytes,
+		   TEEC_Result res)
+{
+	uint64_t lat = now_ns() - start;
+
+	if (res == TEEC_ERROR_CANCEL) {
+		c->cancelled++;
+		return;
+	}
+	if (res != TEEC_SUCCESS) {
+		c->errors++;
+		return;
+	}
+	c->count++;
+	c->bytes += bytes;
+	if (c->nlat == c->lat_cap) {
+		size_t cap = c->lat_cap ? c->lat_cap * 2 : 1024;
+		uint64_t *l = realloc(c->lat_ns, cap * sizeof(*l));
+
+		if (!l)
+			return;
+		c->lat_ns = l;
+		c->lat_cap = cap;
+	}
+	c->lat_ns[c->nlat++] = lat;
+}
+
+static void *reader_run(void *arg)
+{
+	struct client *c = arg;
+	struct bench *b = c->b;
+	size_t size;
+	uint64_t start;
+	TEEC_Result res;
+
+	while (!b->stop) {
+		size = b->small_size;
+		start = now_ns();
+		res = tee_sched_read(b->sched, c->prio, SMALL_ID, c->buf,
+				     &size);
+		record(c, start, size, res);
+		if (res == TEEC_SUCCESS &&
+		    (size != b->small_size ||
+		     memcmp(c->buf, c->expect, size))) {
+			fprintf(stderr, "Verify failed: %s\n", SMALL_ID);
+			c->errors++;
+		}
+		usleep(b->think_us);
+	}
+	return NULL;
+}
+
+static void *writer_run(void *arg)
+{
+	struct client *c = arg;
+	struct bench *b = c->b;
+	char id[32];
+	uint64_t start;
+	TEEC_Result res;
+
+	snprintf(id, sizeof(id), "sched_%s_%u", tee_sched_prio_name(c->prio),
+		 c->id);
+	while (!b->stop) {
+		start = now_ns();
+		res = tee_sched_write(b->sched, c->prio, id, c->buf,
+				      b->bulk_size);
+		record(c, start, b->bulk_size, res);
+	}
+	tee_sched_delete(b->sched, c->prio, id);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t *sorted, size_t n, double pct)
+{
+	size_t i;
+
+	if (!n)
+		return 0;
+	i = (size_t)(pct / 100.0 * (n - 1) + 0.5);
+	return sorted[i] / 1000.0;
+}
+
+/* Merges the class's clients and prints one line */
+static void report(struct client *clients, unsigned int n,
+		   enum tee_sched_prio prio, double secs)
+{
+	uint64_t count = 0, bytes = 0, errors = 0, cancelled = 0, *lat;
+	size_t nlat = 0, i;
+	unsigned int k, threads = 0;
+
+	for (k = 0; k < n; k++) {
+		if (clients[k].prio != prio)
+			continue;
+		threads++;
+		nlat += clients[k].nlat;
+	}
+	if (!threads)
+		return;
+	lat = malloc((nlat ? nlat : 1) * sizeof(*lat));
+	if (!lat)
+		err(1, "malloc");
+	for (k = 0, i = 0; k < n; k++) {
+		if (clients[k].prio != prio)
+			continue;
+		count += clients[k].count;
+		bytes += clients[k].bytes;
+		errors += clients[k].errors;
+		cancelled += clients[k].cancelled;
+		memcpy(lat + i, clients[k].lat_ns,
+		       clients[k].nlat * sizeof(*lat));
+		i += clients[k].nlat;
+	}
+	qsort(lat, nlat, sizeof(*lat), cmp_u64);
+	printf("%-11s %7u %8llu %8.2f %10.0f %10.0f %10.0f %10.0f %6llu %6llu\n",
+	       tee_sched_prio_name(prio), threads,
+	       (unsigned long long)count,
+	       bytes / (1024.0 * 1024.0) / secs,
+	       pct_us(lat, nlat, 50), pct_us(lat, nlat, 95),
+	       pct_us(lat, nlat, 99), pct_us(lat, nlat, 100),
+	       (unsigned long long)errors, (unsigned long long)cancelled);
+	free(lat);
+}
+
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	unsigned long long size = strtoull(arg, &end, 10);
+
+	if (*end == 'K' || *end == 'k')
+		size <<= 10, end++;
+	else if (*end == 'M' || *end == 'm')
+		size <<= 20, end++;
+	if (*end || !size)
+		errx(1, "Invalid size: %s", arg);
+	return size;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: tee_sched_bench [options]\n"
+		"  -m mode   sched, or whole for monolithic requests (default sched)\n"
+		"  -s N      sessions (default 2)\n"
+		"  -r N      interactive readers (default 2)\n"
+		"  -w N      bulk writers (default 2)\n"
+		"  -g N      background writers (default 1)\n"
+		"  -k size   interactive object size (default 4K)\n"
+		"  -b size   bulk and background object size (default 16M)\n"
+		"  -p usecs  pause between interactive reads (default 1000)\n"
+		"  -T ms     interactive deadline (default none)\n"
+		"  -B ms     bulk and background deadline (default none)\n"
+		"  -t secs   duration (default 10)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct bench b;
+	struct client *clients;
+	unsigned int sessions = 2, readers = 2, writers = 2, background = 1;
+	unsigned int duration_s = 10, nclients, i, p;
+	unsigned int interactive_ms = 0, bulk_ms = 0;
+	uint32_t flags = 0;
+	uint8_t *small;
+	uint64_t start;
+	double secs;
+	TEEC_Result res;
+	int opt;
+
+	b.small_size = 4 * 1024;
+	b.bulk_size = 16 * 1024 * 1024;
+	b.think_us = 1000;
+
+	while ((opt = getopt(argc, argv, "m:s:r:w:g:k:b:p:t:T:B:")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (!strcmp(optarg, "whole"))
+				flags |= TEE_SCHED_WHOLE;
+			else if (strcmp(optarg, "sched"))
+				usage();
+			break;
+		case 's': sessions = atoi(optarg); break;
+		case 'r': readers = atoi(optarg); break;
+		case 'w': writers = atoi(optarg); break;
+		case 'g': background = atoi(optarg); break;
+		case 'k': b.small_size = parse_size(optarg); break;
+		case 'b': b.bulk_size = parse_size(optarg); break;
+		case 'p': b.think_us = atoi(optarg); break;
+		case 't': duration_s = atoi(optarg); break;
+		case 'T': interactive_ms = atoi(optarg); break;
+		case 'B': bulk_ms = atoi(optarg); break;
+		default:
+			usage();
+		}
+	}
+	if (!sessions || !readers || !duration_s)
+		usage();
+
+	b.sched = tee_sched_open(sessions, flags, &res);
+	if (!b.sched)
+		errx(1, "tee_sched_open failed with code 0x%x", res);
+
+	small = malloc(b.small_size);
+	if (!small)
+		err(1, "malloc");
+	fill(0, small, b.small_size);
+	res = tee_sched_write(b.sched, TEE_SCHED_INTERACTIVE, SMALL_ID, small,
+			      b.small_size);
+	if (res != TEEC_SUCCESS)
+		errx(1, "Cannot write %s: 0x%x", SMALL_ID, res);
+	tee_sched_set_timeout(b.sched, TEE_SCHED_INTERACTIVE, interactive_ms);
+	tee_sched_set_timeout(b.sched, TEE_SCHED_BULK, bulk_ms);
+	tee_sched_set_timeout(b.sched, TEE_SCHED_BACKGROUND, bulk_ms);
+
+	nclients = readers + writers + background;
+	clients = calloc(nclients, sizeof(*clients));
+	if (!clients)
+		err(1, "calloc");
+	for (i = 0; i < nclients; i++) {
+		struct client *c = &clients[i];
+
+		c->b = &b;
+		c->id = i;
+		if (i < readers) {
+			c->prio = TEE_SCHED_INTERACTIVE;
+			c->buf = malloc(b.small_size);
+			c->expect = small;
+		} else {
+			c->prio = i < readers + writers ? TEE_SCHED_BULK :
+							  TEE_SCHED_BACKGROUND;
+			c->buf = malloc(b.bulk_size);
+			if (c->buf)
+				fill(i, c->buf, b.bulk_size);
+		}
+		if (!c->buf)
+			err(1, "malloc");
+	}
+
+	printf("# %s, %u sessions, %u readers of %zu B, %u bulk and %u background writers of %zu B, %u s\n",
+	       flags & TEE_SCHED_WHOLE ? "whole requests" : "chunk scheduling",
+	       sessions, readers, b.small_size, writers, background,
+	       b.bulk_size, duration_s);
+
+	start = now_ns();
+	for (i = 0; i < nclients; i++)
+		if (pthread_create(&clients[i].thread, NULL,
+				   i < readers ? reader_run : writer_run,
+				   &clients[i]))
+			errx(1, "Cannot create client thread");
+	sleep(duration_s);
+	b.stop = 1;
+	for (i = 0; i < nclients; i++)
+		pthread_join(clients[i].thread, NULL);
+	secs = (now_ns() - start) / 1e9;
+
+	printf("# class     threads    count     MB/s    p50(us)    p95(us)    p99(us)    max(us) errors cancel\n");
+	for (p = 0; p < TEE_SCHED_NPRIO; p++)
+		report(clients, nclients, p, secs);
+
+	tee_sched_delete(b.sched, TEE_SCHED_INTERACTIVE, SMALL_ID);
+	tee_sched_close(b.sched);
+	for (i = 0; i < nclients; i++) {
+		free(clients[i].buf);
+		free(clients[i].lat_ns);
+	}
+	free(clients);
+	free(small);
+	return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * TEEC_InvokeCommand with a deadline.
+ *
+ * A watchdog thread, started on first use, calls
+ * TEEC_RequestCancellation on every operation whose deadline has
+ * passed, and keeps calling it every TEEC_DEADLINE_RETRY_MS until the
+ * invocation returns: a request made before the operation reached the
+ * TEE is otherwise lost. What cancellation does is up to the TA; the
+ * storage TA unmasks it in its long loops and returns
+ * TEEC_ERROR_CANCEL with the progress it made.
+ */
+#ifndef TEEC_DEADLINE_H
+#define TEEC_DEADLINE_H
+
+#include <stdint.h>
+
+#include <tee_client_api.h>
+
+#define TEEC_DEADLINE_RETRY_MS 10
+
+/* Absolute deadline timeout_ms from now, CLOCK_MONOTONIC nanoseconds */
+uint64_t teec_deadline_after(unsigned int timeout_ms);
+
+/*
+ * As TEEC_InvokeCommand, cancelled at deadline. A deadline of 0 means
+ * none; one already past fails with TEEC_ERROR_CANCEL without invoking.
+ * operation must not be NULL.
+ */
+TEEC_Result teec_invoke_deadline(TEEC_Session *session, uint32_t cmd,
+				 TEEC_Operation *operation, uint32_t *origin,
+				 uint64_t deadline);
+
+#endif /* TEEC_DEADLINE_H */
@@ -0,0 +1,115 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <teec_deadline.h>
+
+/* An invocation in flight with a deadline, on its caller's stack */
+struct armed {
+	TEEC_Operation *op;
+	uint64_t next;		/* time of the next cancellation request */
+	struct armed *link;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_t thread;
+static int running;
+static struct armed *armed;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t teec_deadline_after(unsigned int timeout_ms)
+{
+	return now_ns() + timeout_ms * 1000000ULL;
+}
+
+static void *watchdog(void *arg)
+{
+	struct armed *a;
+	struct timespec ts;
+	uint64_t now, wake;
+
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		now = now_ns();
+		wake = UINT64_MAX;
+		for (a = armed; a; a = a->link) {
+			if (a->next <= now) {
+				TEEC_RequestCancellation(a->op);
+				a->next = now + TEEC_DEADLINE_RETRY_MS *
+						1000000ULL;
+			}
+			if (a->next < wake)
+				wake = a->next;
+		}
+		if (wake == UINT64_MAX) {
+			pthread_cond_wait(&cv, &lock);
+			continue;
+		}
+		ts.tv_sec = wake / 1000000000ULL;
+		ts.tv_nsec = wake % 1000000000ULL;
+		pthread_cond_timedwait(&cv, &lock, &ts);
+	}
+	return NULL;
+}
+
+static void start_watchdog(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cv, &attr);
+	pthread_condattr_destroy(&attr);
+	running = !pthread_create(&thread, NULL, watchdog, NULL);
+	if (running)
+		pthread_detach(thread);
+}
+
+TEEC_Result teec_invoke_deadline(TEEC_Session *session, uint32_t cmd,
+				 TEEC_Operation *operation, uint32_t *origin,
+				 uint64_t deadline)
+{
+	struct armed a = { .op = operation, .next = deadline }, **link;
+	TEEC_Result res;
+
+	if (!deadline)
+		return TEEC_InvokeCommand(session, cmd, operation, origin);
+	if (origin)
+		*origin = TEEC_ORIGIN_API;
+	if (!operation)
+		return TEEC_ERROR_BAD_PARAMETERS;
+	if (deadline <= now_ns())
+		return TEEC_ERROR_CANCEL;
+
+	pthread_once(&once, start_watchdog);
+	if (!running)
+		return TEEC_ERROR_OUT_OF_MEMORY;
+
+	pthread_mutex_lock(&lock);
+	a.link = armed;
+	armed = &a;
+	pthread_cond_signal(&cv);
+	pthread_mutex_unlock(&lock);
+
+	res = TEEC_InvokeCommand(session, cmd, operation, origin);
+
+	pthread_mutex_lock(&lock);
+	for (link = &armed; *link; link = &(*link)->link) {
+		if (*link == &a) {
+			*link = a.link;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return res;
+}
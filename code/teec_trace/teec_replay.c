@@ -0,0 +1,474 @@
+/*
+ * Re-issues a trace recorded by teec_trace.so against the TA and reports
+ * per-command latency distributions next to the recorded ones.
+ *
+ *   teec_replay [--speed max|recorded|<factor>] [--repeat N] trace
+ *
+ * "max" (the default) issues each command as soon as the previous one
+ * returns; "recorded" keeps the original gaps between calls and a factor
+ * such as 2 replays twice as fast. Commands run one at a time on a single
+ * thread, so traces of multi-threaded clients are serialised in the order
+ * their calls started. Session opens are replayed without parameters.
+ */
+#include <err.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <tee_client_api.h>
+
+#include "teec_trace.h"
+
+#define MAX_CMDS	64
+
+struct latencies {
+	uint64_t *ns;
+	size_t n;
+	size_t cap;
+};
+
+struct cmd_stats {
+	uint32_t cmd;
+	struct latencies replayed;
+	struct latencies recorded;
+	size_t mismatches;		/* result differs from the recording */
+};
+
+struct replay {
+	TEEC_Context ctx;
+	TEEC_Session **sessions;	/* by trace session number */
+	size_t nsessions;
+	struct cmd_stats cmds[MAX_CMDS];
+	size_t ncmds;
+	double speed;			/* 0 for max speed */
+	uint64_t wall_start;
+	uint64_t trace_first;
+	bool started;
+	size_t line;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add_latency(struct latencies *l, uint64_t ns)
+{
+	if (l->n == l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 256;
+		l->ns = realloc(l->ns, l->cap * sizeof(*l->ns));
+		if (!l->ns)
+			err(1, "realloc");
+	}
+	l->ns[l->n++] = ns;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Percentile of a sorted sample, in microseconds */
+static double percentile_us(const struct latencies *l, double p)
+{
+	size_t i;
+
+	if (!l->n)
+		return 0;
+	i = (size_t)(p / 100.0 * (l->n - 1) + 0.5);
+	return l->ns[i] / 1000.0;
+}
+
+static struct cmd_stats *cmd_stats(struct replay *r, uint32_t cmd)
+{
+	for (size_t i = 0; i < r->ncmds; i++)
+		if (r->cmds[i].cmd == cmd)
+			return &r->cmds[i];
+	if (r->ncmds == MAX_CMDS)
+		errx(1, "more than %d distinct command IDs", MAX_CMDS);
+	r->cmds[r->ncmds].cmd = cmd;
+	return &r->cmds[r->ncmds++];
+}
+
+static TEEC_Session **session_slot(struct replay *r, unsigned long id)
+{
+	if (id >= r->nsessions) {
+		size_t n = id + 16;
+
+		r->sessions = realloc(r->sessions, n * sizeof(*r->sessions));
+		if (!r->sessions)
+			err(1, "realloc");
+		memset(r->sessions + r->nsessions, 0,
+		       (n - r->nsessions) * sizeof(*r->sessions));
+		r->nsessions = n;
+	}
+	return &r->sessions[id];
+}
+
+/* Sleeps until the recorded time t, scaled by the replay speed */
+static void pace(struct replay *r, uint64_t t)
+{
+	uint64_t due, now;
+	struct timespec ts;
+
+	if (!r->started) {
+		r->started = true;
+		r->trace_first = t;
+		r->wall_start = now_ns();
+	}
+	if (r->speed <= 0 || t < r->trace_first)
+		return;
+
+	due = r->wall_start + (uint64_t)((t - r->trace_first) / r->speed);
+	now = now_ns();
+	if (due <= now)
+		return;
+	ts.tv_sec = (due - now) / 1000000000ULL;
+	ts.tv_nsec = (due - now) % 1000000000ULL;
+	nanosleep(&ts, NULL);
+}
+
+static bool parse_uuid(const char *s, TEEC_UUID *uuid)
+{
+	unsigned int b[8];
+
+	if (sscanf(s, "%8x-%4hx-%4hx-%2x%2x-%2x%2x%2x%2x%2x%2x",
+		   &uuid->timeLow, &uuid->timeMid, &uuid->timeHiAndVersion,
+		   &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7]) != 11)
+		return false;
+	for (int i = 0; i < 8; i++)
+		uuid->clockSeqAndNode[i] = (uint8_t)b[i];
+	return true;
+}
+
+/* Deterministic stand-in for a payload recorded only as a hash */
+static void synthesize(uint8_t *buf, size_t size, char class, uint64_t seed)
+{
+	uint64_t x = seed ? seed : 1;
+
+	for (size_t i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		switch (class) {
+		case 'd':
+			buf[i] = '0' + x % 10;
+			break;
+		case 'a':
+			buf[i] = 'a' + x % 26;
+			break;
+		default:
+			buf[i] = (uint8_t)x;
+			break;
+		}
+	}
+}
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Fills buf from a payload description; false if it is malformed */
+static bool fill_payload(uint8_t *buf, size_t size, const char *data)
+{
+	switch (data[0]) {
+	case '-':
+	case 'n':
+		return true;
+	case 'h':
+		if (!data[1])
+			return false;
+		synthesize(buf, size, data[1], strtoull(data + 2, NULL, 16));
+		return true;
+	case 'x':
+		data++;
+		for (size_t i = 0; i < size; i++) {
+			int hi = hex_value(data[2 * i]);
+			int lo = hi < 0 ? -1 : hex_value(data[2 * i + 1]);
+
+			if (lo < 0)
+				return false;
+			buf[i] = (uint8_t)(hi << 4 | lo);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Builds one operation parameter from its trace token */
+static bool parse_param(const char *tok, TEEC_Operation *op, int i,
+			void **buf)
+{
+	static const uint32_t value_types[] = {
+		['i'] = TEEC_VALUE_INPUT, ['o'] = TEEC_VALUE_OUTPUT,
+		['b'] = TEEC_VALUE_INOUT,
+	};
+	static const uint32_t memref_types[] = {
+		['i'] = TEEC_MEMREF_TEMP_INPUT, ['o'] = TEEC_MEMREF_TEMP_OUTPUT,
+		['b'] = TEEC_MEMREF_TEMP_INOUT,
+	};
+	uint32_t type;
+	char dir = tok[1];
+	size_t size, out;
+	int pos;
+
+	if (!strcmp(tok, "-"))
+		return true;
+	if (dir != 'i' && dir != 'o' && dir != 'b')
+		return false;
+
+	if (tok[0] == 'v') {
+		type = value_types[(int)dir];
+		if (dir != 'o' && sscanf(tok + 2, ":%" SCNu32 ":%" SCNu32,
+					 &op->params[i].value.a,
+					 &op->params[i].value.b) != 2)
+			return false;
+	} else if (tok[0] == 'm') {
+		type = memref_types[(int)dir];
+		if (sscanf(tok + 2, ":%zu:%zu:%n", &size, &out, &pos) != 2)
+			return false;
+		op->params[i].tmpref.size = size;
+		if (tok[2 + pos] != 'n') {
+			*buf = malloc(size ? size : 1);
+			if (!*buf)
+				err(1, "malloc");
+			if (!fill_payload(*buf, size, tok + 2 + pos))
+				return false;
+			op->params[i].tmpref.buffer = *buf;
+		}
+	} else {
+		return false;
+	}
+	op->paramTypes |= type << (i * 4);
+	return true;
+}
+
+static void replay_open(struct replay *r, char *args)
+{
+	unsigned long t, id;
+	char uuid_str[40];
+	TEEC_Session **slot;
+	TEEC_UUID uuid;
+	uint32_t origin;
+	TEEC_Result res;
+
+	if (sscanf(args, "%lu %lu %39s", &t, &id, uuid_str) != 3 ||
+	    !parse_uuid(uuid_str, &uuid))
+		errx(1, "line %zu: malformed session open", r->line);
+	if (!id)
+		return;		/* the recorded open failed */
+
+	pace(r, t);
+	slot = session_slot(r, id);
+	*slot = calloc(1, sizeof(**slot));
+	if (!*slot)
+		err(1, "calloc");
+	res = TEEC_OpenSession(&r->ctx, *slot, &uuid, TEEC_LOGIN_PUBLIC,
+			       NULL, NULL, &origin);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x",
+		     res, origin);
+}
+
+static void replay_close(struct replay *r, char *args)
+{
+	unsigned long t, id;
+	TEEC_Session **slot;
+
+	if (sscanf(args, "%lu %lu", &t, &id) != 2)
+		errx(1, "line %zu: malformed session close", r->line);
+	slot = session_slot(r, id);
+	if (!*slot)
+		return;
+	pace(r, t);
+	TEEC_CloseSession(*slot);
+	free(*slot);
+	*slot = NULL;
+}
+
+static void replay_invoke(struct replay *r, char *args)
+{
+	unsigned long t, id;
+	uint32_t cmd, recorded_res, recorded_origin, origin;
+	uint64_t recorded_ns, start;
+	void *bufs[TEEC_CONFIG_PAYLOAD_REF_COUNT] = { NULL };
+	TEEC_Operation op;
+	TEEC_Session **slot;
+	TEEC_Result res;
+	struct cmd_stats *stats;
+	char *save, *tok;
+	int pos;
+
+	if (sscanf(args, "%lu %lu %" SCNx32 " %" SCNx32 " %" SCNu32 " %" SCNu64
+		   "%n", &t, &id, &cmd, &recorded_res, &recorded_origin,
+		   &recorded_ns, &pos) != 6)
+		errx(1, "line %zu: malformed invoke", r->line);
+
+	memset(&op, 0, sizeof(op));
+	tok = strtok_r(args + pos, " \n", &save);
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		if (!tok || !parse_param(tok, &op, i, &bufs[i]))
+			errx(1, "line %zu: malformed parameter %d", r->line, i);
+		tok = strtok_r(NULL, " \n", &save);
+	}
+
+	slot = session_slot(r, id);
+	if (!*slot)
+		errx(1, "line %zu: session %lu is not open", r->line, id);
+
+	pace(r, t);
+	start = now_ns();
+	res = TEEC_InvokeCommand(*slot, cmd, &op, &origin);
+
+	stats = cmd_stats(r, cmd);
+	add_latency(&stats->replayed, now_ns() - start);
+	add_latency(&stats->recorded, recorded_ns);
+	if (res != recorded_res)
+		stats->mismatches++;
+
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++)
+		free(bufs[i]);
+}
+
+static void replay_trace(struct replay *r, FILE *f)
+{
+	char *line = NULL;
+	size_t cap = 0;
+
+	r->line = 0;
+	r->started = false;
+	while (getline(&line, &cap, f) > 0) {
+		r->line++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (line[1] != ' ')
+			errx(1, "line %zu: unknown event", r->line);
+		switch (line[0]) {
+		case 'O':
+			replay_open(r, line + 2);
+			break;
+		case 'I':
+			replay_invoke(r, line + 2);
+			break;
+		case 'C':
+			replay_close(r, line + 2);
+			break;
+		default:
+			errx(1, "line %zu: unknown event '%c'", r->line,
+			     line[0]);
+		}
+	}
+	free(line);
+
+	/* Sessions the client never closed */
+	for (size_t i = 0; i < r->nsessions; i++) {
+		if (r->sessions[i]) {
+			TEEC_CloseSession(r->sessions[i]);
+			free(r->sessions[i]);
+			r->sessions[i] = NULL;
+		}
+	}
+}
+
+static void print_report(struct replay *r)
+{
+	printf("%-10s %8s %10s %10s %10s %10s %10s %10s %8s\n", "command",
+	       "count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us",
+	       "rec_p50", "errors");
+	for (size_t i = 0; i < r->ncmds; i++) {
+		struct cmd_stats *s = &r->cmds[i];
+		double sum = 0;
+
+		qsort(s->replayed.ns, s->replayed.n, sizeof(uint64_t),
+		      compare_u64);
+		qsort(s->recorded.ns, s->recorded.n, sizeof(uint64_t),
+		      compare_u64);
+		for (size_t k = 0; k < s->replayed.n; k++)
+			sum += s->replayed.ns[k];
+
+		printf("0x%-8x %8zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f "
+		       "%8zu\n", s->cmd, s->replayed.n,
+		       sum / s->replayed.n / 1000.0,
+		       percentile_us(&s->replayed, 50),
+		       percentile_us(&s->replayed, 90),
+		       percentile_us(&s->replayed, 99),
+		       percentile_us(&s->replayed, 100),
+		       percentile_us(&s->recorded, 50), s->mismatches);
+	}
+}
+
+static void usage(const char *prog)
+{
+	errx(1, "usage: %s [--speed max|recorded|<factor>] [--repeat N] trace",
+	     prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct replay r;
+	const char *path = NULL;
+	unsigned long repeat = 1;
+	char magic[64];
+	TEEC_Result res;
+	FILE *f;
+
+	memset(&r, 0, sizeof(r));
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+			const char *s = argv[++i];
+
+			if (!strcmp(s, "max"))
+				r.speed = 0;
+			else if (!strcmp(s, "recorded"))
+				r.speed = 1;
+			else if ((r.speed = strtod(s, NULL)) <= 0)
+				usage(argv[0]);
+		} else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+			repeat = strtoul(argv[++i], NULL, 0);
+			if (!repeat)
+				usage(argv[0]);
+		} else if (argv[i][0] == '-' || path) {
+			usage(argv[0]);
+		} else {
+			path = argv[i];
+		}
+	}
+	if (!path)
+		usage(argv[0]);
+
+	f = fopen(path, "r");
+	if (!f)
+		err(1, "%s", path);
+	if (!fgets(magic, sizeof(magic), f) ||
+	    strncmp(magic, TEEC_TRACE_MAGIC, strlen(TEEC_TRACE_MAGIC)))
+		errx(1, "%s: not a TEEC trace", path);
+
+	res = TEEC_InitializeContext(NULL, &r.ctx);
+	if (res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	for (unsigned long i = 0; i < repeat; i++) {
+		rewind(f);
+		replay_trace(&r, f);
+	}
+
+	TEEC_FinalizeContext(&r.ctx);
+	fclose(f);
+	print_report(&r);
+	return 0;
+}
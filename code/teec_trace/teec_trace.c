@@ -0,0 +1,414 @@
+/*
+ * LD_PRELOAD shim that records every TEEC session open, invoke and close
+ * of an unmodified client into a trace for teec_replay:
+ *
+ *   TEEC_TRACE_FILE=app.%p.trace LD_PRELOAD=./teec_trace.so ./app
+ *
+ * %p in the file name expands to the process ID. By default input
+ * payloads are stored as hashes only; TEEC_TRACE_PAYLOAD=full records the
+ * bytes so the replay sends exactly what the client sent. Without
+ * TEEC_TRACE_FILE the shim passes calls straight through.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <err.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <tee_client_api.h>
+
+#include "teec_trace.h"
+
+#define MAX_SESSIONS	256
+
+typedef TEEC_Result (*open_session_fn)(TEEC_Context *, TEEC_Session *,
+				       const TEEC_UUID *, uint32_t,
+				       const void *, TEEC_Operation *,
+				       uint32_t *);
+typedef void (*close_session_fn)(TEEC_Session *);
+typedef TEEC_Result (*invoke_command_fn)(TEEC_Session *, uint32_t,
+					 TEEC_Operation *, uint32_t *);
+
+static open_session_fn real_open_session;
+static close_session_fn real_close_session;
+static invoke_command_fn real_invoke_command;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace;
+static bool full_payload;
+static uint64_t trace_start;
+
+/* Trace numbers of the sessions currently open, by TEEC_Session address */
+static TEEC_Session *sessions[MAX_SESSIONS];
+static unsigned int session_ids[MAX_SESSIONS];
+static unsigned int next_session = 1;
+
+/* Memref as the TA sees it, whatever kind the client passed */
+struct memref_view {
+	const uint8_t *buffer;
+	size_t size;
+	char dir;		/* 'i', 'o' or 'b' */
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *real_symbol(const char *name)
+{
+	void *sym = dlsym(RTLD_NEXT, name);
+
+	if (!sym)
+		errx(1, "teec_trace: %s not found, is libteec linked?", name);
+	return sym;
+}
+
+static void close_trace(void)
+{
+	pthread_mutex_lock(&trace_lock);
+	if (trace)
+		fclose(trace);
+	trace = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static void open_trace(void)
+{
+	const char *pattern = getenv("TEEC_TRACE_FILE");
+	const char *payload = getenv("TEEC_TRACE_PAYLOAD");
+	char path[4096];
+	size_t len = 0;
+
+	real_open_session = (open_session_fn)real_symbol("TEEC_OpenSession");
+	real_close_session = (close_session_fn)real_symbol("TEEC_CloseSession");
+	real_invoke_command =
+		(invoke_command_fn)real_symbol("TEEC_InvokeCommand");
+
+	if (!pattern || !*pattern)
+		return;
+
+	for (const char *p = pattern; *p && len + 24 < sizeof(path); p++) {
+		if (p[0] == '%' && p[1] == 'p') {
+			len += snprintf(path + len, sizeof(path) - len, "%d",
+					(int)getpid());
+			p++;
+		} else {
+			path[len++] = *p;
+		}
+	}
+	path[len] = '\0';
+
+	trace = fopen(path, "w");
+	if (!trace) {
+		warn("teec_trace: cannot open %s", path);
+		return;
+	}
+	full_payload = payload && !strcmp(payload, "full");
+	fprintf(trace, "%s\n# payload %s\n", TEEC_TRACE_MAGIC,
+		full_payload ? "full" : "hash");
+	trace_start = now_ns();
+	atexit(close_trace);
+}
+
+static void init_trace(void)
+{
+	pthread_once(&trace_once, open_trace);
+}
+
+/* Caller holds trace_lock */
+static unsigned int session_id(TEEC_Session *session)
+{
+	for (int i = 0; i < MAX_SESSIONS; i++)
+		if (sessions[i] == session)
+			return session_ids[i];
+	return 0;
+}
+
+/* Caller holds trace_lock */
+static unsigned int add_session(TEEC_Session *session)
+{
+	for (int i = 0; i < MAX_SESSIONS; i++) {
+		if (!sessions[i]) {
+			sessions[i] = session;
+			session_ids[i] = next_session;
+			return next_session++;
+		}
+	}
+	return 0;
+}
+
+/* Caller holds trace_lock */
+static void remove_session(TEEC_Session *session)
+{
+	for (int i = 0; i < MAX_SESSIONS; i++)
+		if (sessions[i] == session)
+			sessions[i] = NULL;
+}
+
+static char memref_dir(uint32_t type, uint32_t shm_flags)
+{
+	switch (type) {
+	case TEEC_MEMREF_TEMP_INPUT:
+	case TEEC_MEMREF_PARTIAL_INPUT:
+		return 'i';
+	case TEEC_MEMREF_TEMP_OUTPUT:
+	case TEEC_MEMREF_PARTIAL_OUTPUT:
+		return 'o';
+	case TEEC_MEMREF_WHOLE:
+		if ((shm_flags & (TEEC_MEM_INPUT | TEEC_MEM_OUTPUT)) ==
+		    TEEC_MEM_INPUT)
+			return 'i';
+		if ((shm_flags & (TEEC_MEM_INPUT | TEEC_MEM_OUTPUT)) ==
+		    TEEC_MEM_OUTPUT)
+			return 'o';
+		return 'b';
+	default:
+		return 'b';
+	}
+}
+
+static bool get_memref(TEEC_Operation *op, int i, struct memref_view *view)
+{
+	uint32_t type = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+	TEEC_Parameter *p = &op->params[i];
+	TEEC_SharedMemory *shm;
+
+	switch (type) {
+	case TEEC_MEMREF_TEMP_INPUT:
+	case TEEC_MEMREF_TEMP_OUTPUT:
+	case TEEC_MEMREF_TEMP_INOUT:
+		view->buffer = p->tmpref.buffer;
+		view->size = p->tmpref.size;
+		view->dir = memref_dir(type, 0);
+		return true;
+	case TEEC_MEMREF_WHOLE:
+	case TEEC_MEMREF_PARTIAL_INPUT:
+	case TEEC_MEMREF_PARTIAL_OUTPUT:
+	case TEEC_MEMREF_PARTIAL_INOUT:
+		shm = p->memref.parent;
+		if (!shm)
+			return false;
+		view->dir = memref_dir(type, shm->flags);
+		if (type == TEEC_MEMREF_WHOLE) {
+			view->buffer = shm->buffer;
+			view->size = shm->size;
+		} else {
+			view->buffer = shm->buffer ?
+				       (uint8_t *)shm->buffer +
+				       p->memref.offset : NULL;
+			view->size = p->memref.size;
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static size_t memref_out_size(TEEC_Operation *op, int i)
+{
+	uint32_t type = TEEC_PARAM_TYPE_GET(op->paramTypes, i);
+
+	if (type >= TEEC_MEMREF_TEMP_INPUT && type <= TEEC_MEMREF_TEMP_INOUT)
+		return op->params[i].tmpref.size;
+	if (type == TEEC_MEMREF_WHOLE && op->params[i].memref.parent &&
+	    !(op->params[i].memref.parent->flags & TEEC_MEM_OUTPUT))
+		return op->params[i].memref.parent->size;
+	return op->params[i].memref.size;
+}
+
+/*
+ * Input side of one parameter. Inputs must be captured before the call,
+ * since the TA may overwrite inout buffers and values; a memref's output
+ * size is appended once the call returns.
+ */
+struct param_record {
+	char head[48];
+	char *data;		/* memref payload description, malloc'd */
+	bool memref;
+};
+
+static char *describe_payload(const struct memref_view *v)
+{
+	char *s = NULL;
+	size_t len;
+	FILE *f;
+
+	if (v->dir == 'o')
+		return strdup("-");
+	if (!v->buffer)
+		return strdup("n");
+	if (!full_payload) {
+		if (asprintf(&s, "h%c%016" PRIx64,
+			     teec_trace_class(v->buffer, v->size),
+			     teec_trace_fnv64(v->buffer, v->size)) < 0)
+			return NULL;
+		return s;
+	}
+
+	f = open_memstream(&s, &len);
+	if (!f)
+		return NULL;
+	fputc('x', f);
+	for (size_t k = 0; k < v->size; k++)
+		fprintf(f, "%02x", v->buffer[k]);
+	fclose(f);
+	return s;
+}
+
+static void record_inputs(TEEC_Operation *op, struct param_record *rec)
+{
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		uint32_t type = op ? TEEC_PARAM_TYPE_GET(op->paramTypes, i) :
+				     TEEC_NONE;
+		struct memref_view v;
+
+		rec[i].memref = false;
+		rec[i].data = NULL;
+		if (type == TEEC_VALUE_OUTPUT) {
+			strcpy(rec[i].head, "vo");
+		} else if (type == TEEC_VALUE_INPUT ||
+			   type == TEEC_VALUE_INOUT) {
+			snprintf(rec[i].head, sizeof(rec[i].head),
+				 "v%c:%" PRIu32 ":%" PRIu32,
+				 type == TEEC_VALUE_INPUT ? 'i' : 'b',
+				 op->params[i].value.a, op->params[i].value.b);
+		} else if (type != TEEC_NONE && get_memref(op, i, &v)) {
+			snprintf(rec[i].head, sizeof(rec[i].head), "m%c:%zu",
+				 v.dir, v.size);
+			rec[i].data = describe_payload(&v);
+			rec[i].memref = true;
+		} else {
+			strcpy(rec[i].head, "-");
+		}
+	}
+}
+
+/* Caller holds trace_lock */
+static void write_params(TEEC_Operation *op, struct param_record *rec)
+{
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++) {
+		if (rec[i].memref)
+			fprintf(trace, " %s:%zu:%s", rec[i].head,
+				memref_out_size(op, i),
+				rec[i].data ? rec[i].data : "-");
+		else
+			fprintf(trace, " %s", rec[i].head);
+	}
+	fputc('\n', trace);
+}
+
+static void free_params(struct param_record *rec)
+{
+	for (int i = 0; i < TEEC_CONFIG_PAYLOAD_REF_COUNT; i++)
+		free(rec[i].data);
+}
+
+TEEC_Result TEEC_OpenSession(TEEC_Context *context, TEEC_Session *session,
+			     const TEEC_UUID *destination,
+			     uint32_t connectionMethod,
+			     const void *connectionData,
+			     TEEC_Operation *operation,
+			     uint32_t *returnOrigin)
+{
+	uint32_t origin = 0;
+	uint64_t start, end;
+	TEEC_Result res;
+
+	init_trace();
+	start = now_ns();
+	res = real_open_session(context, session, destination,
+				connectionMethod, connectionData, operation,
+				&origin);
+	end = now_ns();
+	if (returnOrigin)
+		*returnOrigin = origin;
+	if (!trace || !destination)
+		return res;
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace) {
+		const TEEC_UUID *u = destination;
+		unsigned int id = res == TEEC_SUCCESS ? add_session(session) : 0;
+
+		fprintf(trace, "O %" PRIu64 " %u %08x-%04x-%04x-%02x%02x-"
+			"%02x%02x%02x%02x%02x%02x %#x %u %" PRIu64 "\n",
+			start - trace_start, id, u->timeLow, u->timeMid,
+			u->timeHiAndVersion, u->clockSeqAndNode[0],
+			u->clockSeqAndNode[1], u->clockSeqAndNode[2],
+			u->clockSeqAndNode[3], u->clockSeqAndNode[4],
+			u->clockSeqAndNode[5], u->clockSeqAndNode[6],
+			u->clockSeqAndNode[7], res, origin, end - start);
+	}
+	pthread_mutex_unlock(&trace_lock);
+	return res;
+}
+
+void TEEC_CloseSession(TEEC_Session *session)
+{
+	uint64_t start, end;
+	unsigned int id = 0;
+
+	init_trace();
+	if (trace) {
+		pthread_mutex_lock(&trace_lock);
+		id = session_id(session);
+		remove_session(session);
+		pthread_mutex_unlock(&trace_lock);
+	}
+
+	start = now_ns();
+	real_close_session(session);
+	end = now_ns();
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace && id)
+		fprintf(trace, "C %" PRIu64 " %u %" PRIu64 "\n",
+			start - trace_start, id, end - start);
+	pthread_mutex_unlock(&trace_lock);
+}
+
+TEEC_Result TEEC_InvokeCommand(TEEC_Session *session, uint32_t commandID,
+			       TEEC_Operation *operation,
+			       uint32_t *returnOrigin)
+{
+	struct param_record rec[TEEC_CONFIG_PAYLOAD_REF_COUNT];
+	uint32_t origin = 0;
+	uint64_t start, end;
+	TEEC_Result res;
+	bool traced;
+
+	init_trace();
+	traced = trace != NULL;
+	if (traced)
+		record_inputs(operation, rec);
+
+	start = now_ns();
+	res = real_invoke_command(session, commandID, operation, &origin);
+	end = now_ns();
+	if (returnOrigin)
+		*returnOrigin = origin;
+	if (!traced)
+		return res;
+
+	pthread_mutex_lock(&trace_lock);
+	if (trace) {
+		fprintf(trace, "I %" PRIu64 " %u %#x %#x %u %" PRIu64,
+			start - trace_start, session_id(session), commandID,
+			res, origin, end - start);
+		write_params(operation, rec);
+	}
+	pthread_mutex_unlock(&trace_lock);
+	free_params(rec);
+	return res;
+}
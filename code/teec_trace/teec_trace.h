@@ -0,0 +1,65 @@
+/*
+ * TEEC invoke trace format, shared by the recording shim (teec_trace.so)
+ * and teec_replay.
+ *
+ * A trace is a text file, one event per line, times in nanoseconds
+ * relative to the first event:
+ *
+ *   # teec trace v1
+ *   # payload hash|full
+ *   O <t> <sess> <uuid> <result> <origin> <dur>
+ *   I <t> <sess> <cmd> <result> <origin> <dur> <p0> <p1> <p2> <p3>
+ *   C <t> <sess> <dur>
+ *
+ * Sessions are numbered from 1 in the order they were opened. Each
+ * parameter is one token:
+ *
+ *   -                          TEEC_NONE
+ *   vi:<a>:<b> vo vb:<a>:<b>   value input, output, inout
+ *   m<d>:<size>:<out>:<data>   memref; d is i, o or b (inout) as seen by
+ *                              the TA, size the buffer handed in, out the
+ *                              size reported back
+ *
+ * <data> describes the input payload: "-" for outputs, "n" for a NULL
+ * buffer, "x<hex>" for the bytes themselves, or "h<class><fnv64>" when only
+ * a hash was recorded. The class (d digits, a printable, b binary) lets the
+ * replay synthesise data the TA will accept, and equal payloads hash
+ * equally, so an object written and later read under the same ID is
+ * replayed under the same synthetic ID.
+ */
+#ifndef TEEC_TRACE_H
+#define TEEC_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TEEC_TRACE_MAGIC	"# teec trace v1"
+
+static inline uint64_t teec_trace_fnv64(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static inline char teec_trace_class(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	char class = 'd';
+
+	for (size_t i = 0; i < len; i++) {
+		if (p[i] >= '0' && p[i] <= '9')
+			continue;
+		if (p[i] < 0x20 || p[i] > 0x7e)
+			return 'b';
+		class = 'a';
+	}
+	return class;
+}
+
+#endif /* TEEC_TRACE_H */
@@ -0,0 +1,67 @@
+/*
+ * Synthetic test data shared by the host programs and the testgen tool.
+ *
+ * The output is a sequence of blocks. Each block is, independently:
+ *
+ *   zero      all zero bytes                       (zero_pct %)
+ *   duplicate a copy of an earlier block           (dup_pct %)
+ *   data      random bytes, of which compress_pct % are replaced by a
+ *             repeating text filler so the block compresses by about
+ *             that much
+ *
+ * A block's kind and contents depend only on the seed and the block
+ * number, so a file is reproducible from its parameters and identical
+ * whatever the number of threads that wrote it.
+ */
+#ifndef TESTGEN_H
+#define TESTGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TESTGEN_DEFAULT_SEED		0x5eed5eedULL
+#define TESTGEN_DEFAULT_BLOCK_SIZE	4096
+
+struct testgen_params {
+	uint64_t size;
+	uint64_t seed;
+	size_t block_size;		/* power of two, at most 1 MB */
+	unsigned int compress_pct;
+	unsigned int zero_pct;
+	unsigned int dup_pct;		/* zero_pct + dup_pct <= 100 */
+	unsigned int threads;		/* 0: one per online CPU */
+};
+
+/* Incompressible random data, default seed and block size */
+void testgen_defaults(struct testgen_params *p);
+
+/*
+ * Applies a named profile on top of p: random, text (50% compressible),
+ * sparse (50% zero blocks), dedup (50% duplicate blocks) or mixed.
+ * Returns -1 for an unknown name.
+ */
+int testgen_set_profile(struct testgen_params *p, const char *name);
+
+/*
+ * Defaults, then TESTGEN_PROFILE and TESTGEN_SEED from the environment,
+ * so every host can be pointed at other data without new options.
+ */
+void testgen_params_from_env(struct testgen_params *p);
+
+/* Returns -1 if the parameters are inconsistent */
+int testgen_check(const struct testgen_params *p);
+
+/*
+ * Produces len bytes of the stream starting at offset, which must be a
+ * multiple of the block size. Single-threaded.
+ */
+void testgen_fill(const struct testgen_params *p, uint64_t offset,
+		  void *buf, size_t len);
+
+/*
+ * Creates path with p->size bytes of the stream, written by p->threads
+ * threads with pwrite(). Returns 0, or -1 with errno set.
+ */
+int testgen_write_file(const char *path, const struct testgen_params *p);
+
+#endif /* TESTGEN_H */
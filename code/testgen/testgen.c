@@ -0,0 +1,323 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <testgen.h>
+
+/* Bytes each worker generates and writes per pwrite() */
+#define TESTGEN_STRIPE (1024 * 1024)
+
+/*
+ * xoshiro256++ run as TG_LANES independent generators in structure-of-
+ * arrays form. Every step is the same operation on each lane, which the
+ * compiler turns into NEON/SSE/AVX2 code without intrinsics, so the
+ * fill runs at memory speed on both the board and the build host.
+ */
+#define TG_LANES 4
+
+struct tg_rng {
+	uint64_t s[4][TG_LANES];
+};
+
+static const char tg_filler[] =
+	"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do "
+	"eiusmod tempor incididunt ut labore et dolore magna aliqua. ";
+
+static const struct {
+	const char *name;
+	unsigned int compress_pct;
+	unsigned int zero_pct;
+	unsigned int dup_pct;
+} tg_profiles[] = {
+	{ "random", 0, 0, 0 },
+	{ "text", 50, 0, 0 },
+	{ "sparse", 0, 50, 0 },
+	{ "dedup", 0, 0, 50 },
+	{ "mixed", 30, 10, 20 },
+};
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t block_hash(uint64_t seed, uint64_t block, uint64_t salt)
+{
+	uint64_t x = seed ^ (block * 0xd1342543de82ef95ULL) ^ salt;
+
+	return splitmix64(&x);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static void rng_seed(struct tg_rng *rng, uint64_t seed, uint64_t block)
+{
+	uint64_t x = block_hash(seed, block, 0);
+
+	for (int i = 0; i < 4; i++)
+		for (int l = 0; l < TG_LANES; l++)
+			rng->s[i][l] = splitmix64(&x);
+}
+
+static void rng_step(struct tg_rng *rng, uint64_t out[TG_LANES])
+{
+	uint64_t t[TG_LANES];
+	int l;
+
+	for (l = 0; l < TG_LANES; l++) {
+		out[l] = rotl(rng->s[0][l] + rng->s[3][l], 23) + rng->s[0][l];
+		t[l] = rng->s[1][l] << 17;
+		rng->s[2][l] ^= rng->s[0][l];
+		rng->s[3][l] ^= rng->s[1][l];
+		rng->s[1][l] ^= rng->s[2][l];
+		rng->s[0][l] ^= rng->s[3][l];
+		rng->s[2][l] ^= t[l];
+		rng->s[3][l] = rotl(rng->s[3][l], 45);
+	}
+}
+
+static void fill_random(struct tg_rng *rng, uint8_t *buf, size_t len)
+{
+	uint64_t out[TG_LANES];
+
+	while (len >= sizeof(out)) {
+		rng_step(rng, out);
+		memcpy(buf, out, sizeof(out));
+		buf += sizeof(out);
+		len -= sizeof(out);
+	}
+	if (len) {
+		rng_step(rng, out);
+		memcpy(buf, out, len);
+	}
+}
+
+static void fill_filler(uint8_t *buf, size_t len, size_t pos)
+{
+	size_t n;
+
+	pos %= sizeof(tg_filler) - 1;
+	while (len) {
+		n = sizeof(tg_filler) - 1 - pos;
+		if (n > len)
+			n = len;
+		memcpy(buf, tg_filler + pos, n);
+		buf += n;
+		len -= n;
+		pos = 0;
+	}
+}
+
+/*
+ * Writes the first len bytes of the given block. Duplicates are resolved
+ * to the block they copy; the source is always lower-numbered, so the
+ * chain ends at a zero or data block.
+ */
+static void gen_block(const struct testgen_params *p, uint64_t block,
+		      uint8_t *buf, size_t len)
+{
+	struct tg_rng rng;
+	uint64_t h;
+	unsigned int roll;
+	size_t random_len;
+
+	for (;;) {
+		h = block_hash(p->seed, block, 0x6b696e64);	/* "kind" */
+		roll = h % 100;
+		if (roll < p->zero_pct) {
+			memset(buf, 0, len);
+			return;
+		}
+		if (roll >= p->zero_pct + p->dup_pct || !block)
+			break;
+		block = (h >> 8) % block;
+	}
+
+	random_len = p->block_size - p->block_size * p->compress_pct / 100;
+	rng_seed(&rng, p->seed, block);
+	if (random_len > len)
+		random_len = len;
+	fill_random(&rng, buf, random_len);
+	fill_filler(buf + random_len, len - random_len, block * 7);
+}
+
+void testgen_defaults(struct testgen_params *p)
+{
+	memset(p, 0, sizeof(*p));
+	p->seed = TESTGEN_DEFAULT_SEED;
+	p->block_size = TESTGEN_DEFAULT_BLOCK_SIZE;
+}
+
+int testgen_set_profile(struct testgen_params *p, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(tg_profiles) / sizeof(tg_profiles[0]); i++) {
+		if (strcmp(name, tg_profiles[i].name))
+			continue;
+		p->compress_pct = tg_profiles[i].compress_pct;
+		p->zero_pct = tg_profiles[i].zero_pct;
+		p->dup_pct = tg_profiles[i].dup_pct;
+		return 0;
+	}
+	return -1;
+}
+
+void testgen_params_from_env(struct testgen_params *p)
+{
+	const char *profile = getenv("TESTGEN_PROFILE");
+	const char *seed = getenv("TESTGEN_SEED");
+
+	testgen_defaults(p);
+	if (profile)
+		testgen_set_profile(p, profile);
+	if (seed)
+		p->seed = strtoull(seed, NULL, 0);
+}
+
+int testgen_check(const struct testgen_params *p)
+{
+	if (!p->block_size || p->block_size > TESTGEN_STRIPE ||
+	    (p->block_size & (p->block_size - 1)))
+		return -1;
+	if (p->compress_pct > 100 || p->zero_pct + p->dup_pct > 100)
+		return -1;
+	return 0;
+}
+
+void testgen_fill(const struct testgen_params *p, uint64_t offset,
+		  void *buf, size_t len)
+{
+	uint8_t *out = buf;
+	uint64_t block = offset / p->block_size;
+	size_t n;
+
+	while (len) {
+		n = len < p->block_size ? len : p->block_size;
+		gen_block(p, block++, out, n);
+		out += n;
+		len -= n;
+	}
+}
+
+struct tg_worker {
+	const struct testgen_params *p;
+	int fd;
+	unsigned int id;
+	unsigned int count;
+	int err;
+	pthread_t thread;
+};
+
+/* Stripes are dealt round-robin so all workers stay near the file end */
+static void *tg_worker_run(void *arg)
+{
+	struct tg_worker *w = arg;
+	const struct testgen_params *p = w->p;
+	uint8_t *buf = malloc(TESTGEN_STRIPE);
+	uint64_t off;
+	size_t len, done;
+	ssize_t n;
+
+	if (!buf) {
+		w->err = ENOMEM;
+		return NULL;
+	}
+
+	for (off = (uint64_t)w->id * TESTGEN_STRIPE; off < p->size;
+	     off += (uint64_t)w->count * TESTGEN_STRIPE) {
+		len = p->size - off < TESTGEN_STRIPE ?
+		      p->size - off : TESTGEN_STRIPE;
+		testgen_fill(p, off, buf, len);
+		for (done = 0; done < len; done += n) {
+			n = pwrite(w->fd, buf + done, len - done, off + done);
+			if (n <= 0) {
+				w->err = n < 0 ? errno : EIO;
+				goto out;
+			}
+		}
+	}
+out:
+	free(buf);
+	return NULL;
+}
+
+int testgen_write_file(const char *path, const struct testgen_params *p)
+{
+	struct tg_worker *workers;
+	uint64_t stripes = (p->size + TESTGEN_STRIPE - 1) / TESTGEN_STRIPE;
+	unsigned int count = p->threads;
+	unsigned int started, i;
+	int fd, err = 0;
+
+	if (testgen_check(p)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!count) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		count = cpus > 0 ? cpus : 1;
+	}
+	if (count > stripes)
+		count = stripes ? stripes : 1;
+
+	workers = calloc(count, sizeof(*workers));
+	if (!workers)
+		return -1;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		free(workers);
+		return -1;
+	}
+	/* Size the file once so no pwrite() has to extend it */
+	if (ftruncate(fd, p->size)) {
+		err = errno;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		workers[i].p = p;
+		workers[i].fd = fd;
+		workers[i].id = i;
+		workers[i].count = count;
+	}
+
+	/*
+	 * Worker 0 runs on the calling thread, as does any worker whose
+	 * thread could not be created.
+	 */
+	for (started = 1; started < count; started++)
+		if (pthread_create(&workers[started].thread, NULL,
+				   tg_worker_run, &workers[started]))
+			break;
+	tg_worker_run(&workers[0]);
+	for (i = started; i < count; i++)
+		tg_worker_run(&workers[i]);
+	for (i = 1; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	for (i = 0; i < count && !err; i++)
+		err = workers[i].err;
+out:
+	if (close(fd) && !err)
+		err = errno;
+	free(workers);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
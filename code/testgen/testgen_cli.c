@@ -0,0 +1,121 @@
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <testgen.h>
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: testgen [options] <size> <output>\n"
+		"  size takes a K, M or G suffix (powers of 1024)\n"
+		"  -p profile   random, text, sparse, dedup or mixed\n"
+		"  -s seed      (default 0x%llx)\n"
+		"  -c percent   compressible part of each data block\n"
+		"  -z percent   zero blocks\n"
+		"  -d percent   blocks duplicating an earlier block\n"
+		"  -b bytes     block size (default %d)\n"
+		"  -j threads   (default: online CPUs)\n",
+		(unsigned long long)TESTGEN_DEFAULT_SEED,
+		TESTGEN_DEFAULT_BLOCK_SIZE);
+	exit(1);
+}
+
+static uint64_t parse_size(const char *s)
+{
+	char *end;
+	uint64_t v;
+
+	errno = 0;
+	v = strtoull(s, &end, 0);
+	if (errno || end == s)
+		errx(1, "Invalid size: %s", s);
+	switch (*end) {
+	case 'G': case 'g':
+		v <<= 10;
+		/* fall through */
+	case 'M': case 'm':
+		v <<= 10;
+		/* fall through */
+	case 'K': case 'k':
+		v <<= 10;
+		end++;
+		break;
+	}
+	if (*end)
+		errx(1, "Invalid size: %s", s);
+	return v;
+}
+
+static unsigned int parse_pct(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 10);
+
+	if (end == s || *end || v > 100)
+		errx(1, "Invalid percentage: %s", s);
+	return v;
+}
+
+int main(int argc, char *argv[])
+{
+	struct testgen_params p;
+	struct timespec start, end;
+	double secs;
+	int opt;
+
+	testgen_defaults(&p);
+	while ((opt = getopt(argc, argv, "p:s:c:z:d:b:j:")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (testgen_set_profile(&p, optarg))
+				errx(1, "Unknown profile: %s", optarg);
+			break;
+		case 's':
+			p.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			p.compress_pct = parse_pct(optarg);
+			break;
+		case 'z':
+			p.zero_pct = parse_pct(optarg);
+			break;
+		case 'd':
+			p.dup_pct = parse_pct(optarg);
+			break;
+		case 'b':
+			p.block_size = parse_size(optarg);
+			break;
+		case 'j':
+			p.threads = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2)
+		usage();
+
+	p.size = parse_size(argv[optind]);
+	if (testgen_check(&p))
+		errx(1, "Block size must be a power of two up to 1M, and zero and duplicate blocks at most 100%% together");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (testgen_write_file(argv[optind + 1], &p))
+		err(1, "%s", argv[optind + 1]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%s: %llu bytes, seed 0x%llx, compress %u%%, zero %u%%, dup %u%%, "
+	       "%.3f s (%.1f MB/s)\n",
+	       argv[optind + 1], (unsigned long long)p.size,
+	       (unsigned long long)p.seed, p.compress_pct, p.zero_pct,
+	       p.dup_pct, secs,
+	       secs > 0 ? p.size / (1024.0 * 1024.0) / secs : 0.0);
+	return 0;
+}
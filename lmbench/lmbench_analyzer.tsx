@@ -1,154 +1,254 @@
 import React, { useState } from 'react';
 import { LineChart, Line, BarChart, Bar, XAxis, YAxis, CartesianGrid, Tooltip, Legend, ResponsiveContainer } from 'recharts';
-import { Download, Info } from 'lucide-react';
+import { Download, Info, Upload, X } from 'lucide-react';
+import baseline from './results/dell-Precision-3660.json';
+
+// Results come from lmbench_parse (schema "lmbench-results", version 1);
+// more runs can be loaded next to the bundled baseline
+const SCHEMA = 'lmbench-results';
+const SCHEMA_VERSION = 1;
+const RUN_COLORS = ['#3b82f6', '#10b981', '#f59e0b', '#ef4444', '#8b5cf6', '#06b6d4'];
+
+const KB = 1024;
+const MB = 1024 * KB;
+const GB = 1024 * MB;
+
+const formatSize = (bytes) => {
+  if (bytes >= GB) return `${+(bytes / GB).toFixed(1)}GB`;
+  if (bytes >= MB) return `${+(bytes / MB).toFixed(1)}MB`;
+  if (bytes >= KB) return `${+(bytes / KB).toFixed(1)}KB`;
+  return `${bytes}B`;
+};
+
+const metricValue = (run, name) => {
+  const m = run.metrics.find(m => m.name === name);
+  return m ? m.value : null;
+};
+
+const findSeries = (run, name) => run.series.find(s => s.name === name);
+
+// Point of a series at the given size, or null if it was not measured
+const seriesValue = (run, name, bytes) => {
+  const s = findSeries(run, name);
+  const p = s && s.points.find(p => p[0] === bytes);
+  return p ? p[1] : null;
+};
+
+// One row per metric, one key per run, for grouped bar charts
+const metricRows = (runs, metrics) =>
+  metrics.map(([label, name]) => {
+    const row = { name: label };
+    runs.forEach(run => { row[run.label] = metricValue(run, name); });
+    return row;
+  });
+
+// One row per size, one key per run and series, for line charts
+const seriesRows = (runs, series, sizes) =>
+  sizes.map(bytes => {
+    const row = { size: formatSize(bytes) };
+    runs.forEach(run => series.forEach(([key, name]) => {
+      row[runs.length > 1 ? `${run.label} ${key}` : key] = seriesValue(run, name, bytes);
+    }));
+    return row;
+  });
+
+// Colors tell series apart, dash patterns tell runs apart
+const RUN_DASHES = [undefined, '6 3', '2 2', '8 3 2 3'];
+
+const lineKeys = (runs, keys) =>
+  runs.flatMap((run, r) => keys.map(([key, color]) => ({
+    key: runs.length > 1 ? `${run.label} ${key}` : key,
+    color,
+    dash: RUN_DASHES[r % RUN_DASHES.length]
+  })));
+
+const parseResults = (json, source) => {
+  if (json.schema !== SCHEMA || json.version !== SCHEMA_VERSION)
+    throw new Error(`${source}: not ${SCHEMA} version ${SCHEMA_VERSION}`);
+  return json.runs;
+};
 
 const LMBenchAnalyzer = () => {
   const [activeTab, setActiveTab] = useState('overview');
+  const [runs, setRuns] = useState(() => parseResults(baseline, 'baseline'));
+  const [loadError, setLoadError] = useState(null);
 
-  // System Information
-  const sysInfo = {
-    hostname: "dell-Precision-3660",
-    os: "Ubuntu 24.04.1",
-    kernel: "6.14.0-33-generic",
-    cpu: "5780 MHz (0.1730 ns clock)",
-    processors: 32,
-    memory: "8192 MB"
+  const loadFiles = async (event) => {
+    const loaded = [];
+    try {
+      for (const file of event.target.files)
+        loaded.push(...parseResults(JSON.parse(await file.text()), file.name));
+      setLoadError(null);
+    } catch (e) {
+      setLoadError(e.message);
+    }
+    // Same label again replaces the earlier run
+    setRuns(prev => [...prev.filter(r => !loaded.some(l => l.label === r.label)), ...loaded]);
+    event.target.value = '';
   };
 
+  const removeRun = (label) => setRuns(prev => prev.filter(r => r.label !== label));
+
+  // System Information
+  const sysInfo = runs.map(run => ({
+    label: run.label,
+    hostname: run.machine.HOSTNAME,
+    os: `${run.machine.SYSNAME} (${run.machine.OS})`,
+    kernel: run.machine.RELEASE,
+    cpu: run.machine.MHZ,
+    processors: run.machine.PROCESSORS,
+    memory: `${run.machine.MB} MB`
+  }));
+
   // Syscall and Context Switch Latencies (microseconds)
-  const syscallData = [
-    { name: 'Simple syscall', value: 0.0556 },
-    { name: 'Simple read', value: 0.0881 },
-    { name: 'Simple write', value: 0.0749 },
-    { name: 'Simple stat', value: 0.2713 },
-    { name: 'Simple fstat', value: 0.1064 },
-    { name: 'Open/close', value: 0.5643 },
-    { name: 'Signal handler', value: 0.5884 },
-    { name: 'Protection fault', value: 0.2872 }
-  ];
+  const syscallData = metricRows(runs, [
+    ['Simple syscall', 'Simple syscall'],
+    ['Simple read', 'Simple read'],
+    ['Simple write', 'Simple write'],
+    ['Simple stat', 'Simple stat'],
+    ['Simple fstat', 'Simple fstat'],
+    ['Open/close', 'Simple open/close'],
+    ['Signal handler', 'Signal handler overhead'],
+    ['Protection fault', 'Protection fault']
+  ]);
 
   // Process operations (microseconds)
-  const processData = [
-    { name: 'Fork+exit', value: 291.40 },
-    { name: 'Fork+execve', value: 1307.00 },
-    { name: 'Fork+/bin/sh', value: 2651.50 }
-  ];
+  const processData = metricRows(runs, [
+    ['Fork+exit', 'Process fork+exit'],
+    ['Fork+execve', 'Process fork+execve'],
+    ['Fork+/bin/sh', 'Process fork+/bin/sh -c']
+  ]);
 
   // IPC Latencies (microseconds)
-  const ipcData = [
-    { name: 'Pipe', value: 2.87 },
-    { name: 'AF_UNIX stream', value: 2.81 },
-    { name: 'UDP localhost', value: 4.31 },
-    { name: 'TCP localhost', value: 5.56 },
-    { name: 'RPC/UDP', value: 5.55 },
-    { name: 'RPC/TCP', value: 6.88 },
-    { name: 'TCP connect', value: 7.70 }
-  ];
+  const ipcData = metricRows(runs, [
+    ['Pipe', 'Pipe latency'],
+    ['AF_UNIX stream', 'AF_UNIX sock stream latency'],
+    ['UDP localhost', 'UDP latency using localhost'],
+    ['TCP localhost', 'TCP latency using localhost'],
+    ['RPC/UDP', 'RPC/udp latency using localhost'],
+    ['RPC/TCP', 'RPC/tcp latency using localhost'],
+    ['TCP connect', 'TCP/IP connection cost to localhost']
+  ]);
 
   // Integer Operations (nanoseconds)
-  const intOpsData = [
-    { name: 'Bit', value: 0.13 },
-    { name: 'Add', value: 0.00 },
-    { name: 'Mul', value: 0.54 },
-    { name: 'Div', value: 1.92 },
-    { name: 'Mod', value: 2.96 }
-  ];
+  const intOpsData = metricRows(runs, [
+    ['Bit', 'integer bit'],
+    ['Add', 'integer add'],
+    ['Mul', 'integer mul'],
+    ['Div', 'integer div'],
+    ['Mod', 'integer mod']
+  ]);
 
   // Float Operations (nanoseconds)
-  const floatOpsData = [
-    { name: 'Add', value: 0.35 },
-    { name: 'Mul', value: 0.69 },
-    { name: 'Div', value: 1.91 }
-  ];
+  const floatOpsData = metricRows(runs, [
+    ['Add', 'float add'],
+    ['Mul', 'float mul'],
+    ['Div', 'float div']
+  ]);
 
   // Memory Bandwidth (MB/sec) - selected sizes
-  const memBandwidthData = [
-    { size: '512B', read: 1751.79, write: 44741.90, mmap: 103710.61 },
-    { size: '1KB', read: 3304.72, write: 45847.59, mmap: 82080.72 },
-    { size: '4KB', read: 11269.36, write: 43778.40, mmap: 83253.77 },
-    { size: '64KB', read: 29412.61, write: 40557.40, mmap: 67030.27 },
-    { size: '1MB', read: 29947.63, write: 38881.81, mmap: 66126.41 },
-    { size: '16MB', read: 22052.07, write: 32151.46, mmap: 48647.24 },
-    { size: '128MB', read: 7763.64, write: 10359.50, mmap: 12067.77 },
-    { size: '1GB', read: 7785.36, write: 9909.02, mmap: 14563.95 }
+  const bandwidthSeries = [
+    ['read', 'read bandwidth'],
+    ['write', 'Memory write bandwidth'],
+    ['mmap', 'Mmap read bandwidth']
   ];
+  const memBandwidthData = seriesRows(runs, bandwidthSeries,
+    [512, KB, 4 * KB, 64 * KB, MB, 16 * MB, 128 * MB, GB]);
 
   // Memory Copy Bandwidth (MB/sec) - selected sizes
-  const memCopyData = [
-    { size: '512B', bcopy: 188094.24, aligned: 205774.51, bzero: 294851.06 },
-    { size: '4KB', bcopy: 264482.44, aligned: 266082.84, bzero: 322042.74 },
-    { size: '64KB', bcopy: 79480.47, aligned: 76285.61, bzero: 88474.79 },
-    { size: '1MB', bcopy: 59874.90, aligned: 57574.87, bzero: 89822.67 },
-    { size: '16MB', bcopy: 22725.14, aligned: 22742.16, bzero: 53773.13 },
-    { size: '128MB', bcopy: 13470.27, aligned: 13697.08, bzero: 12121.17 }
+  const copySeries = [
+    ['bcopy', 'libc bcopy unaligned'],
+    ['aligned', 'libc bcopy aligned'],
+    ['bzero', 'Memory bzero bandwidth']
   ];
+  const memCopyData = seriesRows(runs, copySeries,
+    [512, 4 * KB, 64 * KB, MB, 16 * MB, 128 * MB]);
 
   // Memory Latency - L1/L2/L3/RAM (nanoseconds, stride 128)
-  const memLatencyData = [
-    { size: '4KB', latency: 0.867 },
-    { size: '8KB', latency: 0.867 },
-    { size: '32KB', latency: 0.868 },
-    { size: '64KB', latency: 2.777 },
-    { size: '128KB', latency: 2.781 },
-    { size: '256KB', latency: 2.776 },
-    { size: '512KB', latency: 2.821 },
-    { size: '1MB', latency: 1.056 },
-    { size: '2MB', latency: 1.260 },
-    { size: '4MB', latency: 1.619 },
-    { size: '8MB', latency: 3.401 },
-    { size: '16MB', latency: 1.715 },
-    { size: '32MB', latency: 8.817 },
-    { size: '64MB', latency: 7.996 },
-    { size: '128MB', latency: 17.298 },
-    { size: '512MB', latency: 10.130 },
-    { size: '8GB', latency: 9.944 }
-  ];
+  const latencySeries = [['latency', 'Memory load latency stride=128']];
+  const memLatencyData = seriesRows(runs, latencySeries,
+    [4 * KB, 8 * KB, 32 * KB, 64 * KB, 128 * KB, 256 * KB, 512 * KB, MB,
+     2 * MB, 4 * MB, 8 * MB, 16 * MB, 32 * MB, 64 * MB, 128 * MB,
+     512 * MB, 8 * GB]);
 
   // Network Bandwidth
-  const networkBandwidth = [
-    { size: '1KB', bandwidth: 6.06 },
-    { size: '64KB', bandwidth: 341.33 },
-    { size: '128KB', bandwidth: 654.80 },
-    { size: '1MB', bandwidth: 4543.59 },
-    { size: '10MB', bandwidth: 10737.61 }
-  ];
+  const networkSeries = [['bandwidth', 'Socket bandwidth using localhost']];
+  const networkSizes = [...new Set(runs.flatMap(run => {
+    const s = findSeries(run, networkSeries[0][1]);
+    return s ? s.points.map(p => p[0]) : [];
+  }))].sort((a, b) => a - b);
+  const networkBandwidth = seriesRows(runs, networkSeries, networkSizes);
+
+  const runBars = (color) => runs.map((run, r) => (
+    <Bar key={run.label} dataKey={run.label}
+         fill={runs.length > 1 ? RUN_COLORS[r % RUN_COLORS.length] : color} />
+  ));
+
+  const runLines = (keys) => lineKeys(runs, keys).map(l => (
+    <Line key={l.key} type="monotone" dataKey={l.key} stroke={l.color}
+          strokeDasharray={l.dash} strokeWidth={2} connectNulls />
+  ));
+
+  const fastestSyscall = (run) => {
+    const m = run.metrics.filter(m => m.category === 'syscall' && m.value !== null)
+      .reduce((best, m) => (!best || m.value < best.value ? m : best), null);
+    return m ? { value: `${m.value.toFixed(3)} µs`, name: m.name } : { value: 'n/a', name: '' };
+  };
+
+  const peakRead = (run) => {
+    const s = findSeries(run, 'read bandwidth');
+    const p = s && s.points.reduce((best, p) => (!best || p[1] > best[1] ? p : best), null);
+    return p ? { value: `${(p[1] / 1024).toFixed(1)} GB/s`, at: `Peak read @ ${formatSize(p[0])}` }
+             : { value: 'n/a', at: '' };
+  };
+
+  const gbPerSec = (mbPerSec) => (mbPerSec === null ? 'n/a' : `${(mbPerSec / 1024).toFixed(1)} GB/s`);
+
+  const l1Latency = (run) => {
+    const s = findSeries(run, 'Memory load latency stride=128');
+    return s && s.points.length ? `${s.points[0][1].toFixed(2)} ns` : 'n/a';
+  };
 
   const renderOverview = () => (
     <div className="space-y-6">
-      <div className="bg-blue-50 border border-blue-200 rounded-lg p-4">
-        <div className="flex items-start gap-2">
-          <Info className="w-5 h-5 text-blue-600 mt-0.5" />
-          <div>
-            <h3 className="font-semibold text-blue-900">System Information</h3>
-            <div className="grid grid-cols-2 gap-x-6 gap-y-2 mt-2 text-sm">
-              <div><span className="font-medium">Hostname:</span> {sysInfo.hostname}</div>
-              <div><span className="font-medium">OS:</span> {sysInfo.os}</div>
-              <div><span className="font-medium">Kernel:</span> {sysInfo.kernel}</div>
-              <div><span className="font-medium">CPU:</span> {sysInfo.cpu}</div>
-              <div><span className="font-medium">Processors:</span> {sysInfo.processors}</div>
-              <div><span className="font-medium">Memory:</span> {sysInfo.memory}</div>
+      {sysInfo.map((info, r) => (
+        <div key={info.label} className="space-y-4">
+          <div className="bg-blue-50 border border-blue-200 rounded-lg p-4">
+            <div className="flex items-start gap-2">
+              <Info className="w-5 h-5 text-blue-600 mt-0.5" />
+              <div>
+                <h3 className="font-semibold text-blue-900">System Information: {info.label}</h3>
+                <div className="grid grid-cols-2 gap-x-6 gap-y-2 mt-2 text-sm">
+                  <div><span className="font-medium">Hostname:</span> {info.hostname}</div>
+                  <div><span className="font-medium">OS:</span> {info.os}</div>
+                  <div><span className="font-medium">Kernel:</span> {info.kernel}</div>
+                  <div><span className="font-medium">CPU:</span> {info.cpu}</div>
+                  <div><span className="font-medium">Processors:</span> {info.processors}</div>
+                  <div><span className="font-medium">Memory:</span> {info.memory}</div>
+                </div>
+              </div>
             </div>
           </div>
-        </div>
-      </div>
 
-      <div className="grid grid-cols-1 md:grid-cols-3 gap-4">
-        <div className="bg-white border rounded-lg p-4">
-          <h4 className="font-semibold mb-2">Fastest Syscall</h4>
-          <p className="text-2xl font-bold text-green-600">0.056 µs</p>
-          <p className="text-sm text-gray-600">Simple syscall</p>
-        </div>
-        <div className="bg-white border rounded-lg p-4">
-          <h4 className="font-semibold mb-2">Memory Bandwidth</h4>
-          <p className="text-2xl font-bold text-blue-600">29.9 GB/s</p>
-          <p className="text-sm text-gray-600">Peak read @ 1MB</p>
-        </div>
-        <div className="bg-white border rounded-lg p-4">
-          <h4 className="font-semibold mb-2">L1 Cache Latency</h4>
-          <p className="text-2xl font-bold text-purple-600">0.87 ns</p>
-          <p className="text-sm text-gray-600">Stride 128</p>
+          <div className="grid grid-cols-1 md:grid-cols-3 gap-4">
+            <div className="bg-white border rounded-lg p-4">
+              <h4 className="font-semibold mb-2">Fastest Syscall</h4>
+              <p className="text-2xl font-bold text-green-600">{fastestSyscall(runs[r]).value}</p>
+              <p className="text-sm text-gray-600">{fastestSyscall(runs[r]).name}</p>
+            </div>
+            <div className="bg-white border rounded-lg p-4">
+              <h4 className="font-semibold mb-2">Memory Bandwidth</h4>
+              <p className="text-2xl font-bold text-blue-600">{peakRead(runs[r]).value}</p>
+              <p className="text-sm text-gray-600">{peakRead(runs[r]).at}</p>
+            </div>
+            <div className="bg-white border rounded-lg p-4">
+              <h4 className="font-semibold mb-2">L1 Cache Latency</h4>
+              <p className="text-2xl font-bold text-purple-600">{l1Latency(runs[r])}</p>
+              <p className="text-sm text-gray-600">Stride 128</p>
+            </div>
+          </div>
         </div>
-      </div>
+      ))}
     </div>
   );
 
@@ -162,7 +262,8 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="name" angle={-45} textAnchor="end" height={100} />
             <YAxis label={{ value: 'Microseconds (µs)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Bar dataKey="value" fill="#3b82f6" />
+            {runs.length > 1 && <Legend />}
+            {runBars('#3b82f6')}
           </BarChart>
         </ResponsiveContainer>
       </div>
@@ -175,7 +276,8 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="name" />
             <YAxis label={{ value: 'Microseconds (µs)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Bar dataKey="value" fill="#8b5cf6" />
+            {runs.length > 1 && <Legend />}
+            {runBars('#8b5cf6')}
           </BarChart>
         </ResponsiveContainer>
       </div>
@@ -188,7 +290,8 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="name" angle={-45} textAnchor="end" height={80} />
             <YAxis label={{ value: 'Microseconds (µs)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Bar dataKey="value" fill="#10b981" />
+            {runs.length > 1 && <Legend />}
+            {runBars('#10b981')}
           </BarChart>
         </ResponsiveContainer>
       </div>
@@ -205,7 +308,8 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="name" />
             <YAxis label={{ value: 'Nanoseconds (ns)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Bar dataKey="value" fill="#f59e0b" />
+            {runs.length > 1 && <Legend />}
+            {runBars('#f59e0b')}
           </BarChart>
         </ResponsiveContainer>
       </div>
@@ -218,7 +322,8 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="name" />
             <YAxis label={{ value: 'Nanoseconds (ns)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Bar dataKey="value" fill="#ef4444" />
+            {runs.length > 1 && <Legend />}
+            {runBars('#ef4444')}
           </BarChart>
         </ResponsiveContainer>
       </div>
@@ -236,9 +341,7 @@ const LMBenchAnalyzer = () => {
             <YAxis label={{ value: 'MB/sec', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
             <Legend />
-            <Line type="monotone" dataKey="read" stroke="#3b82f6" strokeWidth={2} />
-            <Line type="monotone" dataKey="write" stroke="#10b981" strokeWidth={2} />
-            <Line type="monotone" dataKey="mmap" stroke="#8b5cf6" strokeWidth={2} />
+            {runLines([['read', '#3b82f6'], ['write', '#10b981'], ['mmap', '#8b5cf6']])}
           </LineChart>
         </ResponsiveContainer>
       </div>
@@ -252,9 +355,7 @@ const LMBenchAnalyzer = () => {
             <YAxis label={{ value: 'MB/sec', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
             <Legend />
-            <Line type="monotone" dataKey="bcopy" stroke="#f59e0b" strokeWidth={2} />
-            <Line type="monotone" dataKey="aligned" stroke="#ef4444" strokeWidth={2} />
-            <Line type="monotone" dataKey="bzero" stroke="#06b6d4" strokeWidth={2} />
+            {runLines([['bcopy', '#f59e0b'], ['aligned', '#ef4444'], ['bzero', '#06b6d4']])}
           </LineChart>
         </ResponsiveContainer>
       </div>
@@ -267,13 +368,14 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="size" />
             <YAxis label={{ value: 'Nanoseconds (ns)', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Line type="monotone" dataKey="latency" stroke="#8b5cf6" strokeWidth={2} />
+            {runs.length > 1 && <Legend />}
+            {runLines([['latency', '#8b5cf6']])}
           </LineChart>
         </ResponsiveContainer>
         <div className="mt-4 p-4 bg-gray-50 rounded">
           <p className="text-sm text-gray-700">
-            <strong>Cache observations:</strong> L1 cache (~0.87ns), L2/L3 transition (~2.8ns), 
-            Main memory access varies (1-17ns depending on size), showing NUMA effects on this 32-core system.
+            <strong>Reading the curve:</strong> each plateau is one level of the hierarchy; the
+            steps between them fall at the L1, L2 and last-level cache sizes of the machine.
           </p>
         </div>
       </div>
@@ -290,23 +392,26 @@ const LMBenchAnalyzer = () => {
             <XAxis dataKey="size" />
             <YAxis label={{ value: 'MB/sec', angle: -90, position: 'insideLeft' }} />
             <Tooltip />
-            <Line type="monotone" dataKey="bandwidth" stroke="#10b981" strokeWidth={2} />
+            {runs.length > 1 && <Legend />}
+            {runLines([['bandwidth', '#10b981']])}
           </LineChart>
         </ResponsiveContainer>
       </div>
 
-      <div className="grid grid-cols-1 md:grid-cols-2 gap-4">
-        <div className="bg-white border rounded-lg p-4">
-          <h4 className="font-semibold mb-2">AF_UNIX Stream</h4>
-          <p className="text-2xl font-bold text-blue-600">18.3 GB/s</p>
-          <p className="text-sm text-gray-600">Bandwidth</p>
-        </div>
-        <div className="bg-white border rounded-lg p-4">
-          <h4 className="font-semibold mb-2">Pipe</h4>
-          <p className="text-2xl font-bold text-green-600">4.8 GB/s</p>
-          <p className="text-sm text-gray-600">Bandwidth</p>
+      {runs.map(run => (
+        <div key={run.label} className="grid grid-cols-1 md:grid-cols-2 gap-4">
+          <div className="bg-white border rounded-lg p-4">
+            <h4 className="font-semibold mb-2">AF_UNIX Stream</h4>
+            <p className="text-2xl font-bold text-blue-600">{gbPerSec(metricValue(run, 'AF_UNIX sock stream bandwidth'))}</p>
+            <p className="text-sm text-gray-600">Bandwidth{runs.length > 1 ? `, ${run.label}` : ''}</p>
+          </div>
+          <div className="bg-white border rounded-lg p-4">
+            <h4 className="font-semibold mb-2">Pipe</h4>
+            <p className="text-2xl font-bold text-green-600">{gbPerSec(metricValue(run, 'Pipe bandwidth'))}</p>
+            <p className="text-sm text-gray-600">Bandwidth{runs.length > 1 ? `, ${run.label}` : ''}</p>
+          </div>
         </div>
-      </div>
+      ))}
     </div>
   );
 
@@ -325,13 +430,32 @@ const LMBenchAnalyzer = () => {
           <div className="flex items-center justify-between">
             <div>
               <h1 className="text-2xl font-bold text-gray-900">LMBench Results Analyzer</h1>
-              <p className="text-sm text-gray-600 mt-1">{sysInfo.hostname} - {sysInfo.os}</p>
+              <div className="flex flex-wrap gap-2 mt-1">
+                {runs.map(run => (
+                  <span key={run.label} className="flex items-center gap-1 text-sm text-gray-600 bg-gray-100 rounded px-2">
+                    {run.label} - {run.machine.SYSNAME} {run.machine.RELEASE}
+                    {runs.length > 1 && (
+                      <button onClick={() => removeRun(run.label)} title="Remove run">
+                        <X className="w-3 h-3" />
+                      </button>
+                    )}
+                  </span>
+                ))}
+              </div>
+            </div>
+            <div className="flex gap-2">
+              <label className="flex items-center gap-2 px-4 py-2 bg-white border text-gray-700 rounded hover:bg-gray-50 cursor-pointer">
+                <Upload className="w-4 h-4" />
+                Load Results
+                <input type="file" accept=".json,application/json" multiple className="hidden" onChange={loadFiles} />
+              </label>
+              <button className="flex items-center gap-2 px-4 py-2 bg-blue-600 text-white rounded hover:bg-blue-700">
+                <Download className="w-4 h-4" />
+                Export Report
+              </button>
             </div>
-            <button className="flex items-center gap-2 px-4 py-2 bg-blue-600 text-white rounded hover:bg-blue-700">
-              <Download className="w-4 h-4" />
-              Export Report
-            </button>
           </div>
+          {loadError && <p className="text-sm text-red-600 mt-2">{loadError}</p>}
         </div>
       </div>
 
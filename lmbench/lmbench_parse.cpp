@@ -0,0 +1,481 @@
+// lmbench_parse: turn raw lmbench result files into analyzer JSON
+//
+//   lmbench_parse [--label NAME] [-o out.json] results/<os>/<host>.<n> ...
+//
+// Every input file becomes one entry of "runs", so several machines or
+// several runs of one machine load side by side. Within a run:
+//
+//   machine  the [KEY: value] header lmbench writes before the results
+//   metrics  "name: value unit" lines, e.g. Simple syscall, integer mul
+//   series   size sweeps, e.g. "read bandwidth or Memory load latency
+//            stride=128, as [x, y, ...] points with their units; sizes
+//            are in bytes
+//
+// Categories and units come from the rule tables below, so a result line
+// this version does not know still lands in "other" rather than being
+// dropped. Bump kSchemaVersion on any incompatible change to the layout.
+//
+// Build: c++ -std=c++17 -O2 -o lmbench_parse lmbench_parse.cpp
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kSchemaVersion = 1;
+
+struct Metric {
+    std::string Category;
+    std::string Name;
+    double Value = 0;           // NaN for inf and other failed results
+    std::string Unit;
+};
+
+struct Series {
+    std::string Category;
+    std::string Name;
+    std::string XUnit;
+    double XScale = 0;
+    std::string YUnit;
+    std::vector<std::string> Columns;   // names of y columns past the first
+    std::vector<std::vector<double>> Points;
+};
+
+struct Run {
+    std::string Source;
+    std::string Label;
+    std::string Started;
+    std::string Finished;
+    std::vector<std::pair<std::string, std::string>> Machine;
+    std::vector<Metric> Metrics;
+    std::vector<Series> AllSeries;
+    unsigned Skipped = 0;       // result lines no rule or series claimed
+};
+
+struct MetricRule {
+    const char *Prefix;
+    const char *Contains;       // nullptr: prefix alone decides
+    const char *Category;
+};
+
+// First match wins
+const MetricRule kMetricRules[] = {
+    {"Simple ", nullptr, "syscall"},
+    {"Select on", nullptr, "syscall"},
+    {"Signal handler", nullptr, "syscall"},
+    {"Protection fault", nullptr, "syscall"},
+    {"Process ", nullptr, "process"},
+    {"Pipe latency", nullptr, "ipc"},
+    {"AF_UNIX sock stream latency", nullptr, "ipc"},
+    {"UDP latency", nullptr, "ipc"},
+    {"TCP latency", nullptr, "ipc"},
+    {"RPC/", nullptr, "ipc"},
+    {"TCP/IP connection", nullptr, "ipc"},
+    {"Pipe bandwidth", nullptr, "ipc_bandwidth"},
+    {"AF_UNIX sock stream bandwidth", nullptr, "ipc_bandwidth"},
+    {"", "parallelism", "cpu_parallelism"},
+    {"integer ", nullptr, "cpu_ops"},
+    {"int64 ", nullptr, "cpu_ops"},
+    {"float ", nullptr, "cpu_ops"},
+    {"double ", nullptr, "cpu_ops"},
+    {"File ", nullptr, "filesystem"},
+    {"Pagefaults", nullptr, "filesystem"},
+    {"STREAM", nullptr, "stream"},
+};
+
+struct SeriesRule {
+    const char *Contains;
+    const char *Category;
+    const char *XUnit;
+    double XScale;              // to bytes; 0 leaves x as printed
+    const char *YUnit;
+    const char *Columns;        // space-separated, for multi-column rows
+};
+
+// lmbench prints sizes in MB, but the bandwidth tools divide by 10^6 and
+// lat_mem_rd by 2^20; converting both to bytes lets runs line up
+const SeriesRule kSeriesRules[] = {
+    {"size=", "context_switch", "processes", 0, "us", nullptr},
+    {"mappings", "mmap", "bytes", 1e6, "us", nullptr},
+    {"File system latency", "filesystem", "bytes", 1024, "",
+     "files creates_per_s removes_per_s"},
+    {"Socket bandwidth", "network", "bytes", 1e6, "MB/s", nullptr},
+    {"load latency", "memory_latency", "bytes", 1048576, "ns", nullptr},
+    {"bandwidth", "memory_bandwidth", "bytes", 1e6, "MB/s", nullptr},
+    {"bcopy", "memory_bandwidth", "bytes", 1e6, "MB/s", nullptr},
+};
+
+bool startsWith(const std::string &S, const char *Prefix) {
+    return S.compare(0, std::strlen(Prefix), Prefix) == 0;
+}
+
+std::string trim(const std::string &S) {
+    size_t B = S.find_first_not_of(" \t\r");
+    size_t E = S.find_last_not_of(" \t\r");
+    return B == std::string::npos ? "" : S.substr(B, E - B + 1);
+}
+
+// A whole token as a number; a k suffix (file system sizes) is dropped
+bool parseNumber(const std::string &Tok, double &V) {
+    if (Tok == "inf" || Tok == "-inf" || Tok == "nan") {
+        V = NAN;
+        return true;
+    }
+    char *End;
+    V = std::strtod(Tok.c_str(), &End);
+    if (End == Tok.c_str())
+        return false;
+    if (*End == 'k' || *End == 'K')
+        ++End;
+    return *End == '\0';
+}
+
+std::vector<std::string> split(const std::string &S) {
+    std::vector<std::string> Toks;
+    size_t I = 0;
+    while ((I = S.find_first_not_of(" \t", I)) != std::string::npos) {
+        size_t E = S.find_first_of(" \t", I);
+        Toks.push_back(S.substr(I, E - I));
+        I = E;
+    }
+    return Toks;
+}
+
+std::string shortUnit(const std::string &U) {
+    if (U == "microseconds")
+        return "us";
+    if (U == "nanoseconds")
+        return "ns";
+    if (U == "MB/sec")
+        return "MB/s";
+    if (U == "KB/sec")
+        return "KB/s";
+    return U;
+}
+
+const char *metricCategory(const std::string &Name) {
+    for (const MetricRule &R : kMetricRules)
+        if (startsWith(Name, R.Prefix) &&
+            (!R.Contains || Name.find(R.Contains) != std::string::npos))
+            return R.Category;
+    return "other";
+}
+
+void classifySeries(Series &S) {
+    S.Category = "other";
+    for (const SeriesRule &R : kSeriesRules) {
+        if (S.Name.find(R.Contains) == std::string::npos)
+            continue;
+        S.Category = R.Category;
+        S.XUnit = R.XUnit;
+        S.XScale = R.XScale;
+        S.YUnit = R.YUnit;
+        if (R.Columns)
+            S.Columns = split(R.Columns);
+        return;
+    }
+}
+
+// "name: value unit"; anything else with a colon is not a metric
+bool parseMetric(const std::string &Line, Metric &M) {
+    size_t Colon = Line.rfind(": ");
+    if (Colon == std::string::npos || Colon == 0)
+        return false;
+    std::vector<std::string> Toks = split(Line.substr(Colon + 2));
+    if (Toks.empty() || Toks.size() > 2 || !parseNumber(Toks[0], M.Value))
+        return false;
+    M.Name = trim(Line.substr(0, Colon));
+    M.Unit = Toks.size() == 2 ? shortUnit(Toks[1]) : "";
+    M.Category = metricCategory(M.Name);
+    return true;
+}
+
+// Sizes are printed with a few digits only, so 1.05 MB is 1 MiB and
+// 0.00586 MiB is 6 KiB: snap to the nearest multiple of a power of two
+// around an eighth of the size when within 0.5%, else to whole bytes
+double toBytes(double X, double Scale) {
+    double B = X * Scale;
+    if (B >= 8) {
+        double Step = std::exp2(std::floor(std::log2(B / 8)));
+        double Snapped = std::round(B / Step) * Step;
+        if (std::fabs(B - Snapped) <= Snapped / 200)
+            return Snapped;
+    }
+    return std::round(B);
+}
+
+bool isHeaderKey(const std::string &Key) {
+    for (char C : Key)
+        if (!(std::isupper(static_cast<unsigned char>(C)) ||
+              std::isdigit(static_cast<unsigned char>(C)) || C == '_' ||
+              C == ' '))
+            return false;
+    return !Key.empty();
+}
+
+// [KEY: value] settings; [net: ...] and friends are skipped, and of the
+// free-form lines the dates mark the start and end of the run
+void parseHeader(const std::string &Line, Run &R) {
+    std::string Body = Line.substr(1, Line.size() - 2);
+    size_t Colon = Body.find(": ");
+    std::string Key = Colon == std::string::npos ? "" : Body.substr(0, Colon);
+
+    if (Key == "net" || Key == "if" || Key == "mount")
+        return;
+    if (isHeaderKey(Key)) {
+        R.Machine.emplace_back(Key, trim(Body.substr(Colon + 2)));
+        return;
+    }
+    // The uname banner and the uptime line
+    if (startsWith(Body, "lmbench") || Body.empty() || Body[0] == ' ')
+        return;
+    (R.Started.empty() ? R.Started : R.Finished) = Body;
+}
+
+std::string machineValue(const Run &R, const char *Key) {
+    for (const auto &KV : R.Machine)
+        if (KV.first == Key)
+            return KV.second;
+    return "";
+}
+
+bool loadRun(const char *Path, Run &R) {
+    std::ifstream In(Path);
+    if (!In) {
+        std::fprintf(stderr, "lmbench_parse: cannot open %s\n", Path);
+        return false;
+    }
+    R.Source = Path;
+
+    std::string Line, Group;
+    Series *Cur = nullptr;
+    // An unquoted title with no points of its own heads quoted sub-series
+    // (Memory load latency, then "stride=16, "stride=32, ...)
+    bool GroupOpen = false;
+
+    while (std::getline(In, Line)) {
+        Line = trim(Line);
+        if (Line.empty()) {
+            Cur = nullptr;
+            continue;
+        }
+        if (Line.front() == '[' && Line.back() == ']') {
+            parseHeader(Line, R);
+            continue;
+        }
+        if (startsWith(Line, "Usage:") || Line.find("error") !=
+            std::string::npos)
+            continue;
+
+        std::vector<std::string> Toks = split(Line);
+        double V;
+        if (parseNumber(Toks[0], V)) {
+            if (!Cur) {
+                ++R.Skipped;
+                continue;
+            }
+            std::vector<double> Row;
+            for (const std::string &T : Toks) {
+                if (!parseNumber(T, V))
+                    break;          // trailing unit, e.g. MB/sec
+                Row.push_back(V);
+            }
+            if (Row.size() < 2)
+                continue;
+            if (Cur->XScale)
+                Row[0] = toBytes(Row[0], Cur->XScale);
+            Cur->Points.push_back(Row);
+            if (&R.AllSeries.back() == Cur && Cur->Name == Group)
+                GroupOpen = false;
+            continue;
+        }
+
+        Metric M;
+        if (parseMetric(Line, M)) {
+            R.Metrics.push_back(M);
+            Cur = nullptr;
+            Group.clear();
+            GroupOpen = false;
+            continue;
+        }
+        if (Line.find(':') != std::string::npos) {
+            ++R.Skipped;
+            continue;
+        }
+
+        Series S;
+        if (Line.front() == '"') {
+            S.Name = trim(Line.substr(1));
+            if (GroupOpen)
+                S.Name = Group + " " + S.Name;
+        } else {
+            S.Name = Line;
+            Group = Line;
+            GroupOpen = true;
+        }
+        classifySeries(S);
+        R.AllSeries.push_back(S);
+        Cur = &R.AllSeries.back();
+    }
+
+    // Group titles and benchmarks that only printed usage have no points
+    std::vector<Series> Kept;
+    for (Series &S : R.AllSeries)
+        if (!S.Points.empty())
+            Kept.push_back(std::move(S));
+    R.AllSeries.swap(Kept);
+
+    if (R.Label.empty()) {
+        R.Label = machineValue(R, "HOSTNAME");
+        if (R.Label.empty())
+            R.Label = Path;
+    }
+    return true;
+}
+
+void writeJsonString(std::FILE *Out, const std::string &Str) {
+    std::fputc('"', Out);
+    for (char C : Str) {
+        if (C == '"' || C == '\\')
+            std::fprintf(Out, "\\%c", C);
+        else if (static_cast<unsigned char>(C) < 0x20)
+            std::fprintf(Out, "\\u%04x", C);
+        else
+            std::fputc(C, Out);
+    }
+    std::fputc('"', Out);
+}
+
+void writeJsonNumber(std::FILE *Out, double V) {
+    if (std::isfinite(V))
+        std::fprintf(Out, "%.12g", V);
+    else
+        std::fputs("null", Out);
+}
+
+void writeRun(std::FILE *Out, const Run &R) {
+    std::fprintf(Out, "    {\n      \"label\": ");
+    writeJsonString(Out, R.Label);
+    std::fprintf(Out, ",\n      \"source\": ");
+    writeJsonString(Out, R.Source);
+    std::fprintf(Out, ",\n      \"started\": ");
+    writeJsonString(Out, R.Started);
+    std::fprintf(Out, ",\n      \"finished\": ");
+    writeJsonString(Out, R.Finished);
+
+    std::fprintf(Out, ",\n      \"machine\": {");
+    for (size_t I = 0; I < R.Machine.size(); ++I) {
+        std::fprintf(Out, "%s\n        ", I ? "," : "");
+        writeJsonString(Out, R.Machine[I].first);
+        std::fprintf(Out, ": ");
+        writeJsonString(Out, R.Machine[I].second);
+    }
+    std::fprintf(Out, "\n      },\n      \"metrics\": [");
+    for (size_t I = 0; I < R.Metrics.size(); ++I) {
+        const Metric &M = R.Metrics[I];
+        std::fprintf(Out, "%s\n        {\"category\": \"%s\", \"name\": ",
+                     I ? "," : "", M.Category.c_str());
+        writeJsonString(Out, M.Name);
+        std::fprintf(Out, ", \"value\": ");
+        writeJsonNumber(Out, M.Value);
+        std::fprintf(Out, ", \"unit\": ");
+        writeJsonString(Out, M.Unit);
+        std::fprintf(Out, "}");
+    }
+    std::fprintf(Out, "\n      ],\n      \"series\": [");
+    for (size_t I = 0; I < R.AllSeries.size(); ++I) {
+        const Series &S = R.AllSeries[I];
+        std::fprintf(Out, "%s\n        {\"category\": \"%s\", \"name\": ",
+                     I ? "," : "", S.Category.c_str());
+        writeJsonString(Out, S.Name);
+        std::fprintf(Out, ", \"x_unit\": ");
+        writeJsonString(Out, S.XUnit);
+        std::fprintf(Out, ", \"y_unit\": ");
+        writeJsonString(Out, S.YUnit);
+        if (!S.Columns.empty()) {
+            std::fprintf(Out, ", \"columns\": [");
+            for (size_t C = 0; C < S.Columns.size(); ++C) {
+                std::fprintf(Out, "%s", C ? ", " : "");
+                writeJsonString(Out, S.Columns[C]);
+            }
+            std::fprintf(Out, "]");
+        }
+        std::fprintf(Out, ",\n         \"points\": [");
+        for (size_t P = 0; P < S.Points.size(); ++P) {
+            std::fprintf(Out, "%s[", P ? ", " : "");
+            for (size_t C = 0; C < S.Points[P].size(); ++C) {
+                std::fprintf(Out, "%s", C ? ", " : "");
+                writeJsonNumber(Out, S.Points[P][C]);
+            }
+            std::fprintf(Out, "]");
+        }
+        std::fprintf(Out, "]}");
+    }
+    std::fprintf(Out, "\n      ]\n    }");
+}
+
+bool writeJson(const char *Path, const std::vector<Run> &Runs) {
+    std::FILE *Out = Path ? std::fopen(Path, "w") : stdout;
+    if (!Out) {
+        std::perror(Path);
+        return false;
+    }
+
+    std::fprintf(Out, "{\n  \"schema\": \"lmbench-results\",\n"
+                 "  \"version\": %d,\n  \"runs\": [\n", kSchemaVersion);
+    for (size_t I = 0; I < Runs.size(); ++I) {
+        writeRun(Out, Runs[I]);
+        std::fprintf(Out, "%s\n", I + 1 < Runs.size() ? "," : "");
+    }
+    std::fprintf(Out, "  ]\n}\n");
+    if (Out != stdout)
+        std::fclose(Out);
+    return true;
+}
+
+void usage(const char *Prog) {
+    std::fprintf(stderr, "usage: %s [--label NAME] [-o out.json] "
+                 "result-file...\n"
+                 "  --label applies to the next result file only\n", Prog);
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+    const char *OutPath = nullptr;
+    std::string NextLabel;
+    std::vector<Run> Runs;
+
+    for (int I = 1; I < argc; ++I) {
+        if (!std::strcmp(argv[I], "--label") && I + 1 < argc) {
+            NextLabel = argv[++I];
+        } else if (!std::strcmp(argv[I], "-o") && I + 1 < argc) {
+            OutPath = argv[++I];
+        } else if (argv[I][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            Runs.emplace_back();
+            Runs.back().Label = NextLabel;
+            NextLabel.clear();
+            if (!loadRun(argv[I], Runs.back()))
+                return 1;
+        }
+    }
+    if (Runs.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (const Run &R : Runs)
+        std::fprintf(stderr, "%s: %zu metrics, %zu series%s\n",
+                     R.Source.c_str(), R.Metrics.size(), R.AllSeries.size(),
+                     R.Skipped ? " (some lines not recognized)" : "");
+    return writeJson(OutPath, Runs) ? 0 : 1;
+}
@@ -6,6 +6,39 @@
 #define CHUNK_SIZE (16 * 1024)
 #define MAX_OBJECT_ID_LEN 256
 
+/*
+ * Scratch for command buffers: commands bump-allocate from it and it is
+ * reset when the command returns, so streaming chunks in or out does no
+ * heap operations. What does not fit spills to the heap and is freed at
+ * the reset. The single instance runs one command at a time, so one
+ * arena serves every session; one per session would not fit the heap.
+ */
+#define ARENA_ALIGN 8
+#define ARENA_SIZE (CHUNK_SIZE + MAX_OBJECT_ID_LEN + 2 * ARENA_ALIGN)
+
+/*
+ * Heap pressure: the arena and staging buffers halve until they fit, no
+ * smaller than these, and data moves through them in as many pieces as
+ * it takes. Only when the smallest does not fit does a command fail,
+ * with TA_SECURE_STORAGE_ERROR_HEAP rather than a generic out of memory.
+ */
+#define ARENA_MIN (MAX_OBJECT_ID_LEN + 2 * ARENA_ALIGN + STAGE_MIN)
+#define STAGE_MIN 512
+
+struct arena_spill {
+	struct arena_spill *next;
+	size_t size;
+};
+
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+	struct arena_spill *spills;
+	uint32_t spill_count;
+	size_t stage_cut;	/* last staging size cut to, 0 if none */
+};
+
 struct write_session {
 	TEE_ObjectHandle object;
 	bool in_progress;
@@ -13,13 +46,68 @@ struct write_session {
 	uint32_t chunk_count;
 };
 
+/*
+ * What GET_STORAGE_INFO reports, from one walk of the storage and then
+ * kept current by the commands that change it. Only this TA reaches its
+ * private storage and it runs as one instance, kept alive, so the index
+ * outlives its clients. A change it cannot account for exactly, an
+ * overwrite or a failed write, drops it and the next call walks again.
+ */
+struct object_index {
+	bool valid;
+	uint32_t count;
+	uint64_t bytes;
+};
+
 struct tee_memory_stats {
 	uint32_t allocated_bytes;
 	uint32_t peak_allocated;
 	uint32_t allocation_count;
+	uint32_t heap_failures;
+	uint32_t failure_allocated;	/* heap in use at the last failure */
+	uint32_t failure_size;		/* and the bytes it asked for */
 };
 
+/*
+ * Binary trace: commands record an event ID and its raw arguments in a
+ * fixed ring rather than formatting text for the secure console, which
+ * is synchronous and shows up in the timings being measured. GET_TRACE
+ * drains the ring and the host renders it from TA_TRACE_EVENTS. Events
+ * above TA_TRACE_LEVEL compile to nothing, their arguments unevaluated;
+ * 0 records nothing. Records are stamped with the time of the command's
+ * first one: the system time is a call into the TEE core, paid at most
+ * once per command rather than per event.
+ */
+#ifndef TA_TRACE_LEVEL
+#define TA_TRACE_LEVEL TA_TRACE_INFO
+#endif
+#define TRACE_RING_SIZE 128
+
+enum trace_level {
+#define TRACE_LEVEL_ENUM(name, level, fmt) TRACE_LEVEL_##name = level,
+	TA_TRACE_EVENTS(TRACE_LEVEL_ENUM)
+#undef TRACE_LEVEL_ENUM
+};
+
+struct trace_ring {
+	struct ta_trace_record rec[TRACE_RING_SIZE];
+	uint32_t head;		/* records ever recorded */
+	uint32_t tail;		/* records ever drained or overwritten */
+	uint32_t lost;		/* overwritten since the last drain */
+	uint32_t now_ms;	/* the running command's time, */
+	bool timed;		/* once read */
+};
+
+#define TRACE(name, a, b, c) \
+	do { \
+		if (TRACE_LEVEL_##name <= TA_TRACE_LEVEL) \
+			trace_put(TA_TRACE_##name, (a), (b), (c)); \
+	} while (0)
+
 static struct tee_memory_stats g_mem_stats = {0};
+static struct arena g_arena;
+static struct trace_ring g_trace;
+static struct object_index g_index;
 
 static void track_allocation(size_t size)
 {
@@ -55,9 +143,193 @@ static void tracked_free(void *ptr, size_t size)
 	}
 }
 
+static void *arena_alloc(struct arena *a, size_t size)
+{
+	size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	struct arena_spill *spill;
+	void *ptr;
+
+	if (need >= size && need <= a->size - a->used) {
+		ptr = a->base + a->used;
+		a->used += need;
+		return ptr;
+	}
+
+	spill = tracked_malloc(sizeof(*spill) + size);
+	if (!spill)
+		return NULL;
+	spill->size = sizeof(*spill) + size;
+	spill->next = a->spills;
+	a->spills = spill;
+	a->spill_count++;
+	return spill + 1;
+}
+
+static void arena_reset(struct arena *a)
+{
+	struct arena_spill *spill;
+
+	a->used = 0;
+	while (a->spills) {
+		spill = a->spills;
+		a->spills = spill->next;
+		tracked_free(spill, spill->size);
+	}
+}
+
+static void trace_put(uint32_t event, uint32_t a, uint32_t b, uint32_t c)
+{
+	struct ta_trace_record *r;
+	TEE_Time t;
+
+	/* Full: overwrite the oldest, the newest say more */
+	if (g_trace.head - g_trace.tail == TRACE_RING_SIZE) {
+		g_trace.tail++;
+		g_trace.lost++;
+	}
+	if (!g_trace.timed) {
+		TEE_GetSystemTime(&t);
+		g_trace.now_ms = t.seconds * 1000 + t.millis;
+		g_trace.timed = true;
+	}
+	r = &g_trace.rec[g_trace.head++ % TRACE_RING_SIZE];
+	r->time_ms = g_trace.now_ms;
+	r->event = event;
+	r->args[0] = a;
+	r->args[1] = b;
+	r->args[2] = c;
+}
+
+/* Entry points call this first: their records take a new time */
+static void trace_begin(void)
+{
+	g_trace.timed = false;
+}
+
+/*
+ * A staging buffer of want bytes or, when the heap is short, of half as
+ * many and so on down to STAGE_MIN; *got is the size given. The caller
+ * moves its data through in pieces of that size.
+ */
+static void *stage_alloc(size_t want, size_t *got)
+{
+	size_t size = want;
+	void *buf;
+
+	while (!(buf = arena_alloc(&g_arena, size))) {
+		if (size <= STAGE_MIN)
+			return NULL;
+		size = size / 2 > STAGE_MIN ? size / 2 : STAGE_MIN;
+	}
+	/* Steady pressure traces once, not on every command */
+	if (size < want && size != g_arena.stage_cut)
+		TRACE(HEAP_SHRINK, want, size, g_mem_stats.allocated_bytes);
+	g_arena.stage_cut = size < want ? size : 0;
+	*got = size;
+	return buf;
+}
+
+/* Records the failure for GET_MEM_STATS; returns the TA's code for it */
+static TEE_Result heap_exhausted(size_t want)
+{
+	g_mem_stats.heap_failures++;
+	g_mem_stats.failure_allocated = g_mem_stats.allocated_bytes;
+	g_mem_stats.failure_size = want;
+	TRACE(HEAP_FAILED, want, g_mem_stats.allocated_bytes, 0);
+	return TA_SECURE_STORAGE_ERROR_HEAP;
+}
+
+static void index_add(int32_t count, int64_t bytes)
+{
+	if (g_index.valid) {
+		g_index.count += count;
+		g_index.bytes += bytes;
+	}
+}
+
+/*
+ * Creates the object, replacing one of the same ID. The index counts a
+ * new object; one that replaces another, of a size it does not know,
+ * drops the index.
+ */
+static TEE_Result create_indexed(const char *obj_id, size_t obj_id_sz,
+				 uint32_t flags, TEE_ObjectHandle *object)
+{
+	TEE_Result res;
+
+	if (g_index.valid) {
+		res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
+						 obj_id, obj_id_sz,
+						 flags & ~TEE_DATA_FLAG_OVERWRITE,
+						 TEE_HANDLE_NULL, NULL, 0,
+						 object);
+		if (res == TEE_SUCCESS)
+			index_add(1, 0);
+		if (res != TEE_ERROR_ACCESS_CONFLICT)
+			return res;
+		g_index.valid = false;
+	}
+	return TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
+					  obj_id, obj_id_sz, flags,
+					  TEE_HANDLE_NULL, NULL, 0, object);
+}
+
+/*
+ * Writes len bytes of shared memory to the object through the staging
+ * buffer, in pieces of its size; a failed write leaves the data position
+ * where it was.
+ */
+static TEE_Result write_staged(TEE_ObjectHandle object, const char *src,
+			       size_t len, char *stage, size_t stage_sz)
+{
+	size_t n, done = 0;
+	TEE_Result res;
+
+	while (done < len) {
+		n = len - done < stage_sz ? len - done : stage_sz;
+		TEE_MemMove(stage, src + done, n);
+		res = TEE_WriteObjectData(object, stage, n);
+		if (res != TEE_SUCCESS)
+			return res;
+		done += n;
+	}
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_trace(uint32_t param_types, TEE_Param params[4])
+{
+	const uint32_t exp_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE,
+				TEE_PARAM_TYPE_NONE);
+	char *out;
+	size_t max;
+	uint32_t n = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	out = params[0].memref.buffer;
+	max = params[0].memref.size / sizeof(struct ta_trace_record);
+	while (n < max && g_trace.tail != g_trace.head) {
+		TEE_MemMove(out + n * sizeof(struct ta_trace_record),
+			    &g_trace.rec[g_trace.tail++ % TRACE_RING_SIZE],
+			    sizeof(struct ta_trace_record));
+		n++;
+	}
+
+	params[0].memref.size = n * sizeof(struct ta_trace_record);
+	params[1].value.a = n;
+	params[1].value.b = g_trace.lost;
+	g_trace.lost = 0;
+	return TEE_SUCCESS;
+}
+
 /**
  * ⭐ Get TRUE secure storage information by enumerating objects
  * This uses TEE_StartPersistentObjectEnumerator to scan actual secure storage
+ * once; the object index answers after that.
  */
 static TEE_Result get_storage_info(uint32_t param_types, TEE_Param params[4],
                                     const char *test_obj_id, size_t test_obj_id_len)
@@ -76,12 +348,17 @@ static TEE_Result get_storage_info(uint32_t param_types, TEE_Param params[4],
 	uint32_t object_count = 0;
 	uint64_t total_size = 0;
 	uint64_t test_object_size = 0;
-	bool found_test_object = false;
+	bool was_masked;
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	IMSG("⭐ Enumerating secure storage objects...");
+	if (g_index.valid && !test_obj_id) {
+		object_count = g_index.count;
+		total_size = g_index.bytes;
+		res = TEE_SUCCESS;
+		goto report;
+	}
 
 	/* ⭐ THIS IS THE KEY: Enumerate ACTUAL secure storage */
 	res = TEE_AllocatePersistentObjectEnumerator(&enumerator);
@@ -97,8 +374,17 @@ static TEE_Result get_storage_info(uint32_t param_types, TEE_Param params[4],
 		return res;
 	}
 
+	/* The walk can be long; a cancelled one reports what it counted */
+	was_masked = TEE_UnmaskCancellation();
+
 	/* ⭐ Scan through ALL objects in secure storage */
 	while (true) {
+		if (TEE_GetCancellationFlag()) {
+			TRACE(STORAGE_CANCEL, object_count, 0, 0);
+			res = TEE_ERROR_CANCEL;
+			break;
+		}
+
 		obj_id_len = sizeof(obj_id);
 		res = TEE_GetNextPersistentObject(enumerator, &obj_info, 
 		                                   obj_id, &obj_id_len);
@@ -117,20 +403,28 @@ static TEE_Result get_storage_info(uint32_t param_types, TEE_Param params[4],
 		object_count++;
 		total_size += obj_info.dataSize;
 
-		IMSG("  Found object #%u: size=%u bytes", object_count, obj_info.dataSize);
+		TRACE(STORAGE_OBJECT, object_count, obj_info.dataSize, 0);
 
 		/* Check if this is our test object */
 		if (test_obj_id && obj_id_len == test_obj_id_len &&
 		    TEE_MemCompare(obj_id, test_obj_id, obj_id_len) == 0) {
 			test_object_size = obj_info.dataSize;
-			found_test_object = true;
-			IMSG("  ⭐ This is our test object!");
 		}
 	}
 
+	if (was_masked)
+		TEE_MaskCancellation();
 	TEE_ResetPersistentObjectEnumerator(enumerator);
 	TEE_FreePersistentObjectEnumerator(enumerator);
 
+	/* A whole walk is exact, and the index starts from it */
+	if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+		g_index.count = object_count;
+		g_index.bytes = total_size;
+		g_index.valid = true;
+	}
+
+report:
 	/* Return results */
 	params[0].value.a = object_count;
 	params[0].value.b = TEE_STORAGE_PRIVATE;  // Storage ID
@@ -142,16 +436,9 @@ static TEE_Result get_storage_info(uint32_t param_types, TEE_Param params[4],
 	params[2].value.a = (uint32_t)(test_object_size & 0xFFFFFFFF);
 	params[2].value.b = (uint32_t)(test_object_size >> 32);
 
-	IMSG("⭐ Storage enumeration complete:");
-	IMSG("  Total objects: %u", object_count);
-	IMSG("  Total size: %lu bytes (%.2f MB)", 
-	     total_size, total_size / (1024.0 * 1024.0));
-	if (found_test_object) {
-		IMSG("  Test object size: %lu bytes (%.2f MB)",
-		     test_object_size, test_object_size / (1024.0 * 1024.0));
-	}
+	TRACE(STORAGE_INFO, object_count, (uint32_t)(total_size >> 10), 0);
 
-	return TEE_SUCCESS;
+	return res == TEE_ERROR_CANCEL ? res : TEE_SUCCESS;
 }
 
 /**
@@ -170,27 +457,41 @@ static TEE_Result get_memory_stats(uint32_t param_types, TEE_Param params[4])
 				TEE_PARAM_TYPE_VALUE_OUTPUT,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
+	/* The same, with the last heap failure in param[2] */
+	const uint32_t failure_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
 
-	if (param_types != exp_param_types)
+	if (param_types != exp_param_types &&
+	    param_types != failure_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	params[0].value.a = g_mem_stats.allocated_bytes;
 	params[0].value.b = g_mem_stats.peak_allocated;
 	params[1].value.a = g_mem_stats.allocation_count;
-
-	IMSG("TEE Memory Stats - Current: %u bytes, Peak: %u bytes, Allocations: %u",
-	     g_mem_stats.allocated_bytes, g_mem_stats.peak_allocated,
-	     g_mem_stats.allocation_count);
+	params[1].value.b = g_mem_stats.heap_failures;
+	if (param_types == failure_param_types) {
+		params[2].value.a = g_mem_stats.failure_allocated;
+		params[2].value.b = g_mem_stats.failure_size;
+	}
 
 	return TEE_SUCCESS;
 }
 
+/*
+ * Starts a new measurement. What is allocated stays allocated, so the
+ * bytes in use are kept and the peak restarts from them.
+ */
 static TEE_Result reset_memory_stats(void)
 {
-	g_mem_stats.allocated_bytes = 0;
-	g_mem_stats.peak_allocated = 0;
+	g_mem_stats.peak_allocated = g_mem_stats.allocated_bytes;
 	g_mem_stats.allocation_count = 0;
-	IMSG("TEE Memory statistics reset");
+	g_mem_stats.heap_failures = 0;
+	g_mem_stats.failure_allocated = 0;
+	g_mem_stats.failure_size = 0;
+	TRACE(STATS_RESET, g_mem_stats.allocated_bytes, 0, 0);
 	return TEE_SUCCESS;
 }
 
@@ -202,6 +503,7 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
 	TEE_ObjectHandle object;
+	TEE_ObjectInfo info;
 	TEE_Result res;
 	char *obj_id;
 	size_t obj_id_sz;
@@ -210,9 +512,9 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = tracked_malloc(obj_id_sz);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return heap_exhausted(obj_id_sz);
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
@@ -223,14 +525,16 @@ static TEE_Result delete_object(uint32_t param_types, TEE_Param params[4])
 					&object);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to open persistent object, res=0x%08x", res);
-		tracked_free(obj_id, obj_id_sz);
 		return res;
 	}
 
+	if (TEE_GetObjectInfo1(object, &info) == TEE_SUCCESS)
+		index_add(-1, -(int64_t)info.dataSize);
+	else
+		g_index.valid = false;
 	TEE_CloseAndDeletePersistentObject1(object);
-	tracked_free(obj_id, obj_id_sz);
 
-	IMSG("Object deleted successfully");
+	TRACE(DELETE, 0, 0, 0);
 	return res;
 }
 
@@ -247,15 +551,16 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4])
 	size_t obj_id_sz;
 	char *data;
 	size_t data_sz;
+	size_t stage_sz;
 	uint32_t obj_data_flag;
 
 	if (param_types != exp_param_types)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = tracked_malloc(obj_id_sz);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return heap_exhausted(obj_id_sz);
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
@@ -263,45 +568,35 @@ static TEE_Result create_raw_object(uint32_t param_types, TEE_Param params[4])
 	
 	if (data_sz > CHUNK_SIZE) {
 		EMSG("Data size %zu exceeds chunk size. Use chunked write commands.", data_sz);
-		tracked_free(obj_id, obj_id_sz);
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return TEE_ERROR_BAD_PARAMETERS;
 	}
 	
-	data = tracked_malloc(data_sz);
-	if (!data) {
-		tracked_free(obj_id, obj_id_sz);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
+	data = stage_alloc(data_sz, &stage_sz);
+	if (!data)
+		return heap_exhausted(data_sz);
 
 	obj_data_flag = TEE_DATA_FLAG_ACCESS_READ |
 			TEE_DATA_FLAG_ACCESS_WRITE |
 			TEE_DATA_FLAG_ACCESS_WRITE_META |
 			TEE_DATA_FLAG_OVERWRITE;
 
-	res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-					obj_id, obj_id_sz,
-					obj_data_flag,
-					TEE_HANDLE_NULL,
-					NULL, 0,
-					&object);
+	res = create_indexed(obj_id, obj_id_sz, obj_data_flag, &object);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
-		tracked_free(obj_id, obj_id_sz);
-		tracked_free(data, data_sz);
 		return res;
 	}
 
-	res = TEE_WriteObjectData(object, data, data_sz);
+	res = write_staged(object, params[1].memref.buffer, data_sz, data,
+			   stage_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_WriteObjectData failed 0x%08x", res);
 		TEE_CloseAndDeletePersistentObject1(object);
+		g_index.valid = false;
 	} else {
 		TEE_CloseObject(object);
-		IMSG("Object created: %zu bytes", data_sz);
+		index_add(0, data_sz);
+		TRACE(CREATE, data_sz, 0, 0);
 	}
-	tracked_free(obj_id, obj_id_sz);
-	tracked_free(data, data_sz);
 	return res;
 }
 
@@ -318,6 +613,7 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 	size_t obj_id_sz;
 	char *data;
 	size_t data_sz;
+	size_t stage_sz;
 	uint32_t is_first;
 
 	if (param_types != exp_param_types)
@@ -332,37 +628,32 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
-	obj_id = tracked_malloc(obj_id_sz);
-	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
-	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
-
-	data = tracked_malloc(data_sz);
-	if (!data) {
-		tracked_free(obj_id, obj_id_sz);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-	TEE_MemMove(data, params[1].memref.buffer, data_sz);
-
 	if (is_first) {
 		uint32_t obj_data_flag = TEE_DATA_FLAG_ACCESS_WRITE |
 					 TEE_DATA_FLAG_ACCESS_WRITE_META |
 					 TEE_DATA_FLAG_OVERWRITE;
 
-		IMSG("Starting chunked write session");
-		IMSG("TEE Memory before object creation - Current: %u bytes, Peak: %u bytes",
-		     g_mem_stats.allocated_bytes, g_mem_stats.peak_allocated);
+		/* Only creating the object needs the ID */
+		obj_id = arena_alloc(&g_arena, obj_id_sz);
+		if (!obj_id)
+			return heap_exhausted(obj_id_sz);
+		TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
-		res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-						obj_id, obj_id_sz,
-						obj_data_flag,
-						TEE_HANDLE_NULL,
-						NULL, 0,
-						&sess->object);
+		if (sess->in_progress) {
+			/* The client gave up on the previous write */
+			TRACE(WRITE_DROP, sess->total_bytes_written,
+			      sess->chunk_count, 0);
+			TEE_CloseAndDeletePersistentObject1(sess->object);
+			index_add(-1, -(int64_t)sess->total_bytes_written);
+			sess->in_progress = false;
+		}
+		TRACE(WRITE_START, g_mem_stats.allocated_bytes,
+		      g_mem_stats.peak_allocated, 0);
+
+		res = create_indexed(obj_id, obj_id_sz, obj_data_flag,
+				     &sess->object);
 		if (res != TEE_SUCCESS) {
 			EMSG("TEE_CreatePersistentObject failed 0x%08x", res);
-			tracked_free(obj_id, obj_id_sz);
-			tracked_free(data, data_sz);
 			return res;
 		}
 		sess->in_progress = true;
@@ -370,29 +661,32 @@ static TEE_Result write_raw_chunk(uint32_t param_types, TEE_Param params[4],
 		sess->chunk_count = 0;
 	} else if (!sess->in_progress) {
 		EMSG("No write session in progress");
-		tracked_free(obj_id, obj_id_sz);
-		tracked_free(data, data_sz);
 		return TEE_ERROR_BAD_STATE;
 	}
 
-	res = TEE_WriteObjectData(sess->object, data, data_sz);
+	/* Short of heap the chunk goes in pieces, and the write goes on */
+	data = stage_alloc(data_sz, &stage_sz);
+	if (!data)
+		return heap_exhausted(data_sz);
+
+	res = write_staged(sess->object, params[1].memref.buffer, data_sz,
+			   data, stage_sz);
 	if (res != TEE_SUCCESS) {
 		EMSG("TEE_WriteObjectData failed 0x%08x", res);
 		TEE_CloseAndDeletePersistentObject1(sess->object);
+		g_index.valid = false;
 		sess->in_progress = false;
 	} else {
+		index_add(0, data_sz);
 		sess->total_bytes_written += data_sz;
 		sess->chunk_count++;
 
-		if (sess->chunk_count % 10 == 0) {
-			IMSG("Progress: %u chunks written, %zu total bytes, TEE mem: %u bytes",
-			     sess->chunk_count, sess->total_bytes_written,
-			     g_mem_stats.allocated_bytes);
-		}
+		if (sess->chunk_count % 10 == 0)
+			TRACE(WRITE_PROGRESS, sess->chunk_count,
+			      sess->total_bytes_written,
+			      g_mem_stats.allocated_bytes);
 	}
 
-	tracked_free(obj_id, obj_id_sz);
-	tracked_free(data, data_sz);
 	return res;
 }
 
@@ -406,12 +700,22 @@ static TEE_Result write_raw_final(struct write_session *sess)
 	TEE_CloseObject(sess->object);
 	sess->in_progress = false;
 	
-	IMSG("Write session completed successfully");
-	IMSG("  Total chunks: %u", sess->chunk_count);
-	IMSG("  Total bytes written: %zu", sess->total_bytes_written);
-	IMSG("  TEE Memory - Current: %u bytes, Peak: %u bytes",
-	     g_mem_stats.allocated_bytes, g_mem_stats.peak_allocated);
-	
+	TRACE(WRITE_DONE, sess->chunk_count, sess->total_bytes_written,
+	      g_mem_stats.peak_allocated);
+	return TEE_SUCCESS;
+}
+
+/* Deletes the object of a chunked write the client has given up on */
+static TEE_Result write_raw_abort(struct write_session *sess)
+{
+	if (!sess->in_progress)
+		return TEE_SUCCESS;
+
+	TEE_CloseAndDeletePersistentObject1(sess->object);
+	index_add(-1, -(int64_t)sess->total_bytes_written);
+	sess->in_progress = false;
+
+	TRACE(WRITE_ABORT, sess->chunk_count, sess->total_bytes_written, 0);
 	return TEE_SUCCESS;
 }
 
@@ -422,8 +726,14 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 				TEE_PARAM_TYPE_MEMREF_OUTPUT,
 				TEE_PARAM_TYPE_NONE,
 				TEE_PARAM_TYPE_NONE);
+	/* The same, with a progress report in param[2] */
+	const uint32_t progress_param_types =
+		TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+				TEE_PARAM_TYPE_MEMREF_OUTPUT,
+				TEE_PARAM_TYPE_VALUE_OUTPUT,
+				TEE_PARAM_TYPE_NONE);
 	TEE_ObjectHandle object;
-	TEE_ObjectInfo object_info;
+	TEE_ObjectInfo object_info = { 0 };
 	TEE_Result res;
 	uint32_t read_bytes;
 	char *obj_id;
@@ -432,29 +742,27 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 	size_t data_sz;
 	size_t total_read = 0;
 	size_t chunk_size;
+	size_t stage_sz;
 	TEE_Time start_time, end_time;
 	uint32_t elapsed_ms;
+	bool progress = param_types == progress_param_types;
+	bool was_masked = true;
 
-	if (param_types != exp_param_types)
+	if (param_types != exp_param_types && !progress)
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	obj_id_sz = params[0].memref.size;
-	obj_id = tracked_malloc(obj_id_sz);
+	obj_id = arena_alloc(&g_arena, obj_id_sz);
 	if (!obj_id)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return heap_exhausted(obj_id_sz);
 
 	TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_sz);
 
 	data_sz = params[1].memref.size;
 
-	chunk_buffer = tracked_malloc(CHUNK_SIZE);
-	if (!chunk_buffer) {
-		tracked_free(obj_id, obj_id_sz);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-
-	IMSG("TEE Memory before read - Current: %u bytes, Peak: %u bytes",
-	     g_mem_stats.allocated_bytes, g_mem_stats.peak_allocated);
+	chunk_buffer = stage_alloc(CHUNK_SIZE, &stage_sz);
+	if (!chunk_buffer)
+		return heap_exhausted(CHUNK_SIZE);
 
 	res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
 					obj_id, obj_id_sz,
@@ -463,8 +771,6 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 					&object);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to open persistent object, res=0x%08x", res);
-		tracked_free(obj_id, obj_id_sz);
-		tracked_free(chunk_buffer, CHUNK_SIZE);
 		return res;
 	}
 
@@ -474,7 +780,8 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 		goto exit;
 	}
 
-	IMSG("Reading object: %u bytes", object_info.dataSize);
+	TRACE(READ_START, object_info.dataSize, g_mem_stats.allocated_bytes,
+	      g_mem_stats.peak_allocated);
 
 	if (object_info.dataSize > data_sz) {
 		params[1].memref.size = object_info.dataSize;
@@ -484,9 +791,22 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 
 	TEE_GetSystemTime(&start_time);
 
+	/*
+	 * Cancellable between chunks, so an abandoned read frees this
+	 * thread and the object soon after the client gives up.
+	 */
+	was_masked = TEE_UnmaskCancellation();
+
 	while (total_read < object_info.dataSize) {
-		chunk_size = (object_info.dataSize - total_read > CHUNK_SIZE) ? 
-		              CHUNK_SIZE : (object_info.dataSize - total_read);
+		if (TEE_GetCancellationFlag()) {
+			TRACE(READ_CANCEL, total_read, object_info.dataSize, 0);
+			params[1].memref.size = total_read;
+			res = TEE_ERROR_CANCEL;
+			goto exit;
+		}
+
+		chunk_size = (object_info.dataSize - total_read > stage_sz) ? 
+		              stage_sz : (object_info.dataSize - total_read);
 
 		res = TEE_ReadObjectData(object, chunk_buffer, chunk_size, &read_bytes);
 		if (res != TEE_SUCCESS) {
@@ -512,16 +832,18 @@ static TEE_Result read_raw_object(uint32_t param_types, TEE_Param params[4])
 	elapsed_ms = (end_time.seconds - start_time.seconds) * 1000 +
 	             (end_time.millis - start_time.millis);
 
-	IMSG("Read completed: %u bytes in %u ms", object_info.dataSize, elapsed_ms);
-	IMSG("TEE Memory after read - Current: %u bytes, Peak: %u bytes",
-	     g_mem_stats.allocated_bytes, g_mem_stats.peak_allocated);
-	
+	TRACE(READ_DONE, object_info.dataSize, elapsed_ms,
+	      g_mem_stats.peak_allocated);
 	params[1].memref.size = total_read;
 
 exit:
+	if (was_masked)
+		TEE_MaskCancellation();
+	if (progress) {
+		params[2].value.a = total_read;
+		params[2].value.b = object_info.dataSize;
+	}
 	TEE_CloseObject(object);
-	tracked_free(obj_id, obj_id_sz);
-	tracked_free(chunk_buffer, CHUNK_SIZE);
 	return res;
 }
 
@@ -529,12 +851,34 @@ TEE_Result TA_CreateEntryPoint(void)
 {
 	IMSG("TA Create Entry Point - Initializing TEE memory tracking");
 	reset_memory_stats();
+
+	/* Paid once here, instead of on every command */
+	g_arena.size = ARENA_SIZE;
+	while (!(g_arena.base = tracked_malloc(g_arena.size))) {
+		if (g_arena.size <= ARENA_MIN)
+			return heap_exhausted(ARENA_MIN);
+		g_arena.size = g_arena.size / 2 > ARENA_MIN ?
+			       g_arena.size / 2 : ARENA_MIN;
+	}
+	if (g_arena.size < ARENA_SIZE)
+		TRACE(HEAP_SHRINK, ARENA_SIZE, g_arena.size,
+		      g_mem_stats.allocated_bytes);
+	g_arena.used = 0;
+	g_arena.spills = NULL;
+	g_arena.spill_count = 0;
+	g_arena.stage_cut = 0;
 	return TEE_SUCCESS;
 }
 
 void TA_DestroyEntryPoint(void)
 {
+	tracked_free(g_arena.base, g_arena.size);
+	g_arena.base = NULL;
+
 	IMSG("TA Destroy Entry Point - Final memory stats:");
+	IMSG("  Arena of %zu bytes, spills to the heap: %u", g_arena.size,
+	     g_arena.spill_count);
+	IMSG("  Heap failures: %u", g_mem_stats.heap_failures);
 	IMSG("  Allocated: %u bytes", g_mem_stats.allocated_bytes);
 	IMSG("  Peak: %u bytes", g_mem_stats.peak_allocated);
 	IMSG("  Total allocations: %u", g_mem_stats.allocation_count);
@@ -546,39 +890,37 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t __unused param_types,
 {
 	struct write_session *sess;
 
-	IMSG("Opening new session");
-
+	trace_begin();
 	sess = tracked_malloc(sizeof(*sess));
 	if (!sess)
-		return TEE_ERROR_OUT_OF_MEMORY;
+		return heap_exhausted(sizeof(*sess));
 
 	sess->in_progress = false;
 	sess->total_bytes_written = 0;
 	sess->chunk_count = 0;
 	*session = sess;
 	
-	IMSG("Session opened - TEE Memory: %u bytes allocated",
-	     g_mem_stats.allocated_bytes);
-	
+	TRACE(SESSION_OPEN, g_mem_stats.allocated_bytes, 0, 0);
 	return TEE_SUCCESS;
 }
 
 void TA_CloseSessionEntryPoint(void *session)
 {
 	struct write_session *sess = session;
+	bool dropped = false;
 
-	IMSG("Closing session");
-
+	trace_begin();
 	if (sess) {
-		if (sess->in_progress) {
-			IMSG("Warning: Closing session with write in progress");
-			TEE_CloseObject(sess->object);
+		/* A write cut short must not look like a whole object */
+		dropped = sess->in_progress;
+		if (dropped) {
+			TEE_CloseAndDeletePersistentObject1(sess->object);
+			index_add(-1, -(int64_t)sess->total_bytes_written);
 		}
 		tracked_free(sess, sizeof(*sess));
 	}
-	
-	IMSG("Session closed - TEE Memory: %u bytes allocated",
-	     g_mem_stats.allocated_bytes);
+
+	TRACE(SESSION_CLOSE, g_mem_stats.allocated_bytes, dropped, 0);
 }
 
 TEE_Result TA_InvokeCommandEntryPoint(void *session,
@@ -587,26 +929,50 @@ TEE_Result TA_InvokeCommandEntryPoint(void *session,
 				      TEE_Param params[4])
 {
 	struct write_session *sess = session;
+	TEE_Result res;
 
+	trace_begin();
 	switch (command) {
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW:
-		return create_raw_object(param_types, params);
+		res = create_raw_object(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW_CHUNK:
-		return write_raw_chunk(param_types, params, sess);
+		res = write_raw_chunk(param_types, params, sess);
+		break;
 	case TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL:
-		return write_raw_final(sess);
+		res = write_raw_final(sess);
+		break;
 	case TA_SECURE_STORAGE_CMD_READ_RAW:
-		return read_raw_object(param_types, params);
+		res = read_raw_object(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_DELETE:
-		return delete_object(param_types, params);
+		res = delete_object(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_GET_MEM_STATS:
-		return get_memory_stats(param_types, params);
+		res = get_memory_stats(param_types, params);
+		break;
 	case TA_SECURE_STORAGE_CMD_RESET_MEM_STATS:
-		return reset_memory_stats();
+		res = reset_memory_stats();
+		break;
 	case TA_SECURE_STORAGE_CMD_GET_STORAGE_INFO:
-		return get_storage_info_wrapper(param_types, params);
+		res = get_storage_info_wrapper(param_types, params);
+		break;
+	case TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT:
+		res = write_raw_abort(sess);
+		break;
+	case TA_SECURE_STORAGE_CMD_GET_TRACE:
+		res = get_trace(param_types, params);
+		break;
 	default:
 		EMSG("Command ID 0x%x is not supported", command);
-		return TEE_ERROR_NOT_SUPPORTED;
+		res = TEE_ERROR_NOT_SUPPORTED;
+		break;
 	}
+
+	if (res != TEE_SUCCESS)
+		TRACE(CMD_FAILED, command, res, 0);
+
+	/* Command buffers live until here */
+	arena_reset(&g_arena);
+	return res;
 }
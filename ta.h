@@ -27,6 +27,8 @@
 #ifndef __SECURE_STORAGE_H__
 #define __SECURE_STORAGE_H__
 
+#include <stdint.h>
+
 /* UUID of the trusted application */
 #define TA_SECURE_STORAGE_UUID \
 		{ 0xf4e750bb, 0x1437, 0x4fbf, \
@@ -35,8 +37,11 @@
  * TA_SECURE_STORAGE_CMD_READ_RAW - Create and fill a secure storage file
  * param[0] (memref) ID used the identify the persistent object
  * param[1] (memref) Raw data dumped from the persistent object
- * param[2] unused
+ * param[2] unused, or (value output) bytes read (a), object size (b)
  * param[3] unused
+ *
+ * Cancellable: a cancelled read returns TEE_ERROR_CANCEL with the bytes
+ * read so far in param[1] and, if given, param[2].
  */
 #define TA_SECURE_STORAGE_CMD_READ_RAW		0
 
@@ -66,10 +71,21 @@
 #define TA_SECURE_STORAGE_CMD_WRITE_RAW_FINAL  4
 
 
+/*
+ * TA_SECURE_STORAGE_CMD_GET_MEM_STATS - TA heap statistics
+ * param[0] (value output) bytes allocated (a), peak (b)
+ * param[1] (value output) allocations (a), TA_SECURE_STORAGE_ERROR_HEAP
+ *          failures (b)
+ * param[2] unused, or (value output) heap in use (a) and bytes asked for
+ *          (b) at the last heap failure
+ * param[3] unused
+ */
 #define TA_SECURE_STORAGE_CMD_GET_MEM_STATS	5
 
 /*
- * TA_SECURE_STORAGE_CMD_RESET_MEM_STATS - Reset memory statistics
+ * TA_SECURE_STORAGE_CMD_RESET_MEM_STATS - Reset memory statistics: the
+ * peak restarts from the bytes allocated, which are kept, and the
+ * allocation and heap failure counts go to zero
  * param[0] unused
  * param[1] unused
  * param[2] unused
@@ -84,7 +100,87 @@
  * param[1] (value output) - total_size_low (a), total_size_high (b)
  * param[2] (value output) - test_obj_size_low (a), test_obj_size_high (b)
  * param[3] unused
+ *
+ * Cancellable: a cancelled walk returns TEE_ERROR_CANCEL with the counts
+ * of the objects seen so far. After a whole walk the instance keeps the
+ * counts current itself and answers without walking, until an overwrite
+ * or a failed write leaves them in doubt.
  */
 #define TA_SECURE_STORAGE_CMD_GET_STORAGE_INFO	7
 
+/*
+ * TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT - Delete the object of an
+ * unfinished chunked write; no-op without one. A new first chunk on the
+ * session drops an unfinished write the same way.
+ * param[0..3] unused
+ */
+#define TA_SECURE_STORAGE_CMD_WRITE_RAW_ABORT	8
+
+/*
+ * TA_SECURE_STORAGE_CMD_GET_TRACE - Drain the TA's trace ring, oldest
+ * record first
+ * param[0] (memref output) struct ta_trace_record[], as many as fit
+ * param[1] (value output) records returned (a), records lost to ring
+ *          overflow since the last drain (b)
+ * param[2] unused
+ * param[3] unused
+ *
+ * A full buffer may have left records behind; call again until it
+ * comes back short.
+ */
+#define TA_SECURE_STORAGE_CMD_GET_TRACE		9
+
+/*
+ * TA_SECURE_STORAGE_ERROR_HEAP - The TA ran out of its own heap; the
+ * store is not full, that is TEE_ERROR_STORAGE_NO_SPACE. Short of heap,
+ * the TA first moves data through smaller buffers, so this means even
+ * the smallest did not fit. A TA-defined result, outside the TEE_ERROR_*
+ * range; GET_MEM_STATS has the snapshot.
+ */
+#define TA_SECURE_STORAGE_ERROR_HEAP	0x0000A001
+
+/*
+ * Trace events: name, level and the host's format for the three
+ * arguments. The TA records the ID and the raw arguments only; hosts
+ * render the text. Events above the TA's compile-time TA_TRACE_LEVEL
+ * are not built in.
+ */
+#define TA_TRACE_ERROR	1
+#define TA_TRACE_INFO	2
+#define TA_TRACE_DEBUG	3
+
+#define TA_TRACE_EVENTS(X) \
+	X(CMD_FAILED,     TA_TRACE_ERROR, "command %u failed: 0x%08x") \
+	X(SESSION_OPEN,   TA_TRACE_INFO,  "session opened, heap %u bytes") \
+	X(SESSION_CLOSE,  TA_TRACE_INFO,  "session closed, heap %u bytes, write dropped %u") \
+	X(CREATE,         TA_TRACE_INFO,  "object created: %u bytes") \
+	X(DELETE,         TA_TRACE_INFO,  "object deleted") \
+	X(WRITE_START,    TA_TRACE_INFO,  "chunked write started, heap %u bytes, peak %u bytes") \
+	X(WRITE_DROP,     TA_TRACE_ERROR, "dropped unfinished write of %u bytes, %u chunks") \
+	X(WRITE_PROGRESS, TA_TRACE_DEBUG, "%u chunks written, %u bytes, heap %u bytes") \
+	X(WRITE_DONE,     TA_TRACE_INFO,  "write done: %u chunks, %u bytes, peak heap %u bytes") \
+	X(WRITE_ABORT,    TA_TRACE_ERROR, "write aborted after %u chunks, %u bytes") \
+	X(READ_START,     TA_TRACE_INFO,  "reading %u bytes, heap %u bytes, peak %u bytes") \
+	X(READ_DONE,      TA_TRACE_INFO,  "read %u bytes in %u ms, peak heap %u bytes") \
+	X(READ_CANCEL,    TA_TRACE_ERROR, "read cancelled at %u of %u bytes") \
+	X(STORAGE_OBJECT, TA_TRACE_DEBUG, "object #%u: %u bytes") \
+	X(STORAGE_INFO,   TA_TRACE_INFO,  "storage holds %u objects, %u KiB") \
+	X(STORAGE_CANCEL, TA_TRACE_ERROR, "enumeration cancelled after %u objects") \
+	X(STATS_RESET,    TA_TRACE_INFO,  "memory statistics reset, heap %u bytes") \
+	X(HEAP_SHRINK,    TA_TRACE_INFO,  "heap short: %u byte buffer cut to %u, heap %u bytes") \
+	X(HEAP_FAILED,    TA_TRACE_ERROR, "heap exhausted: %u bytes wanted, heap %u bytes")
+
+enum ta_trace_event {
+#define TA_TRACE_ENUM(name, level, fmt) TA_TRACE_##name,
+	TA_TRACE_EVENTS(TA_TRACE_ENUM)
+#undef TA_TRACE_ENUM
+	TA_TRACE_NEVENTS
+};
+
+struct ta_trace_record {
+	uint32_t time_ms;	/* TEE system time at the command, wraps */
+	uint32_t event;		/* enum ta_trace_event */
+	uint32_t args[3];
+};
+
 #endif /* __SECURE_STORAGE_H__ */
\ No newline at end of file